@@ -351,6 +351,7 @@ int main_impl(int argc, char* argv[])
 					}
 
 					node.m_Cfg.m_VerificationThreads = vm[cli::VERIFICATION_THREADS].as<int>();
+					node.m_Cfg.m_VerificationWindow = static_cast<size_t>(vm[cli::VERIFICATION_WINDOW].as<uint32_t>()) << 20;
 
 					node.m_Cfg.m_LogEvents = vm[cli::LOG_UTXOS].as<bool>();
 
@@ -439,6 +440,29 @@ int main_impl(int argc, char* argv[])
 					if (vm.count(cli::VACUUM))
 						node.m_Cfg.m_ProcessorParams.m_Vacuum = vm[cli::VACUUM].as<bool>();
 
+					{
+						auto& ma = node.m_Cfg.m_ProcessorParams.m_MappingAccess;
+
+						const string& sPrefault = vm[cli::MAPPING_PREFAULT].as<string>();
+						if (sPrefault == "sync")
+							ma.m_Prefault = MappedFileRaw::Access::Prefault::Sync;
+						else if (sPrefault == "async")
+							ma.m_Prefault = MappedFileRaw::Access::Prefault::Async;
+						else if (sPrefault != "none")
+							LOG_WARNING() << "Unknown " << cli::MAPPING_PREFAULT << ": " << sPrefault;
+
+						ma.m_Random = vm[cli::MAPPING_RANDOM].as<bool>();
+						ma.m_HugePages = vm[cli::MAPPING_HUGEPAGES].as<bool>();
+					}
+
+					{
+						auto& tun = node.m_Cfg.m_ProcessorParams.m_DbTuning;
+						tun.m_PageSize = vm[cli::DB_PAGE_SIZE].as<uint32_t>();
+						tun.m_CacheSize_MB = vm[cli::DB_CACHE_SIZE].as<uint32_t>();
+						tun.m_MmapSize_MB = vm[cli::DB_MMAP_SIZE].as<uint32_t>();
+						tun.m_Wal = vm[cli::DB_WAL].as<bool>();
+					}
+
 					if (vm.count(cli::RESET_ID))
 						node.m_Cfg.m_ProcessorParams.m_ResetSelfID = vm[cli::RESET_ID].as<bool>();
 
@@ -457,6 +481,19 @@ int main_impl(int argc, char* argv[])
 							node.m_Cfg.m_Horizon.SetInfinite();
 					}
 
+					if (vm.count(cli::SNAPSHOT_IMPORT))
+					{
+						if (boost::filesystem::exists(node.m_Cfg.m_sPathLocal))
+						{
+							LOG_INFO() << "DB already exists, snapshot import skipped";
+						}
+						else
+						{
+							string sPath = vm[cli::SNAPSHOT_IMPORT].as<string>();
+							NodeProcessor::ImportSnapshot(sPath.c_str(), node.m_Cfg.m_sPathLocal.c_str());
+						}
+					}
+
 					node.Initialize(stratumServer.get());
 
 					if (vm[cli::PRINT_TXO].as<bool>())
@@ -473,6 +510,13 @@ int main_impl(int argc, char* argv[])
 						LOG_INFO() << "Recovery info written";
 					}
 
+					if (vm.count(cli::SNAPSHOT_EXPORT))
+					{
+						string sPath = vm[cli::SNAPSHOT_EXPORT].as<string>();
+						LOG_INFO() << "Writing snapshot...";
+						node.get_Processor().ExportSnapshot(sPath.c_str());
+					}
+
 					if (vm.count(cli::RECOVERY_AUTO_PATH))
 					{
 						node.m_Cfg.m_Recovery.m_sPathOutput = vm[cli::RECOVERY_AUTO_PATH].as<string>();
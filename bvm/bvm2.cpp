@@ -158,6 +158,7 @@ namespace bvm2 {
 	void Processor::InitBase(uint32_t nStackBytes)
 	{
 		ZeroObject(m_Code);
+		m_pDecoded = nullptr;
 		ZeroObject(m_Data);
 		ZeroObject(m_LinearMem);
 		ZeroObject(m_Instruction);
@@ -249,7 +250,16 @@ namespace bvm2 {
 		LoadVar(vk, x.m_Body);
 
 		m_Code = x.m_Body;
+		m_pDecoded = &x.m_Decoded;
 		const Header& hdr = ParseMod();
+
+		if (m_pCodeCache)
+		{
+			// only valid contracts are cached
+			x.m_pCached = m_pCodeCache->Get(cid, x.m_Body);
+			m_pDecoded = &x.get_Decoded();
+		}
+
 		Wasm::Test(iMethod < ByteOrder::from_le(hdr.m_NumMethods));
 
 		m_Stack.Push(pArgs);
@@ -273,11 +283,13 @@ namespace bvm2 {
 			m_Stack.m_PosMin = x.m_StackPosMin;
 			m_Stack.m_BytesMax = x.m_StackBytesMax;
 
+			m_pDecoded = nullptr;
 			m_FarCalls.m_Stack.Delete(x);
 			if (m_FarCalls.m_Stack.empty())
 				return; // finished
 
 			m_Code = m_FarCalls.m_Stack.back().m_Body;
+			m_pDecoded = &m_FarCalls.m_Stack.back().get_Decoded();
 			ParseMod(); // restore code/data sections
 		}
 
@@ -370,6 +382,142 @@ namespace bvm2 {
 
 		m_Charge -= n;
 	}
+
+	uint32_t ProcessorContract::RunCharged()
+	{
+		// Same as charging each instruction before it's executed.
+		// The 1st one is charged in advance. Host calls are only invoked as the 1st instruction, so that the charge is settled before them.
+		DischargeUnits(Limits::Cost::Cycle);
+
+		uint32_t nMax = m_Charge / Limits::Cost::Cycle + 1;
+		uint32_t nCycles = nMax;
+
+		try
+		{
+			RunMany(nCycles);
+		}
+		catch (...)
+		{
+			m_Charge -= (nMax - nCycles - 1) * Limits::Cost::Cycle;
+			throw;
+		}
+
+		uint32_t nDone = nMax - nCycles;
+		m_Charge -= (nDone - 1) * Limits::Cost::Cycle;
+		return nDone;
+	}
+
+	void ProcessorContract::CodeCache::Clear()
+	{
+		while (!m_ImageMru.empty())
+			Delete(m_ImageMru.front().get_ParentObj());
+
+		assert(m_Contracts.empty());
+	}
+
+	void ProcessorContract::CodeCache::Delete(Contract& x)
+	{
+		x.m_pImage->m_Contracts.erase(boost::intrusive::list<Contract::Ref>::s_iterator_to(x.m_Ref));
+		m_Contracts.erase(ContractSet::s_iterator_to(x.m_Key));
+		m_ContractMru.erase(ContractMru::s_iterator_to(x.m_Mru));
+		delete &x;
+	}
+
+	void ProcessorContract::CodeCache::Delete(Image& x)
+	{
+		while (!x.m_Contracts.empty())
+			Delete(x.m_Contracts.front().get_ParentObj());
+
+		m_Images.erase(ImageSet::s_iterator_to(x.m_Key));
+		m_ImageMru.erase(ImageMru::s_iterator_to(x.m_Mru));
+		delete &x;
+	}
+
+	void ProcessorContract::CodeCache::Invalidate(const ContractID& cid)
+	{
+		Contract::Key key;
+		key.m_Value = cid;
+
+		auto it = m_Contracts.find(key);
+		if (m_Contracts.end() != it)
+		{
+			Delete(it->get_ParentObj());
+			m_Stats.m_Invalidated++;
+		}
+	}
+
+	std::shared_ptr<Wasm::Processor::Decoded> ProcessorContract::CodeCache::Get(const ContractID& cid, const Blob& body)
+	{
+		if (!m_MaxImages || !m_MaxContracts)
+			return nullptr;
+
+		Contract::Key key;
+		key.m_Value = cid;
+
+		auto it = m_Contracts.find(key);
+		if (m_Contracts.end() != it)
+		{
+			Contract& c = it->get_ParentObj();
+			Image& img = *c.m_pImage;
+
+			if (Blob(img.m_Body) == body)
+			{
+				m_ContractMru.erase(ContractMru::s_iterator_to(c.m_Mru));
+				m_ContractMru.push_front(c.m_Mru);
+				m_ImageMru.erase(ImageMru::s_iterator_to(img.m_Mru));
+				m_ImageMru.push_front(img.m_Mru);
+
+				m_Stats.m_Hits++;
+				return img.m_pDecoded;
+			}
+
+			Delete(c);
+			m_Stats.m_Invalidated++;
+		}
+
+		Image::Key keyImg;
+		get_ShaderID(keyImg.m_Value, body);
+
+		Image* pImg = nullptr;
+
+		auto itImg = m_Images.find(keyImg);
+		if (m_Images.end() != itImg)
+		{
+			pImg = &itImg->get_ParentObj();
+			m_ImageMru.erase(ImageMru::s_iterator_to(pImg->m_Mru));
+			m_ImageMru.push_front(pImg->m_Mru);
+
+			m_Stats.m_HitsShader++;
+		}
+		else
+		{
+			while (m_ImageMru.size() >= m_MaxImages)
+				Delete(m_ImageMru.back().get_ParentObj());
+
+			pImg = new Image;
+			pImg->m_Key.m_Value = keyImg.m_Value;
+			body.Export(pImg->m_Body);
+			pImg->m_pDecoded = std::make_shared<Wasm::Processor::Decoded>();
+
+			m_Images.insert(pImg->m_Key);
+			m_ImageMru.push_front(pImg->m_Mru);
+
+			m_Stats.m_Misses++;
+		}
+
+		while (m_ContractMru.size() >= m_MaxContracts)
+			Delete(m_ContractMru.back().get_ParentObj());
+
+		auto* pC = new Contract;
+		pC->m_Key.m_Value = cid;
+		pC->m_pImage = pImg;
+
+		m_Contracts.insert(pC->m_Key);
+		m_ContractMru.push_front(pC->m_Mru);
+		pImg->m_Contracts.push_back(pC->m_Ref);
+
+		return pImg->m_pDecoded;
+	}
 	void Processor::Compile(ByteBuffer& res, const Blob& src, Kind kind)
 	{
 		Wasm::CheckpointTxt cp("Wasm/compile");
@@ -346,10 +346,16 @@ namespace bvm2 {
 			{
 				ContractID m_Cid;
 				ByteBuffer m_Body;
+				Wasm::Processor::Decoded m_Decoded;
+				std::shared_ptr<Wasm::Processor::Decoded> m_pCached; // if set - used instead of m_Decoded
 				Wasm::Word m_FarRetAddr;
 				Wasm::Word m_StackPosMin;
 				Wasm::Word m_StackBytesMax;
 				Wasm::Word m_StackBytesRet;
+
+				Wasm::Processor::Decoded& get_Decoded() {
+					return m_pCached ? *m_pCached : m_Decoded;
+				}
 			};
 
 			intrusive::list_autoclear<Frame> m_Stack;
@@ -417,6 +423,100 @@ namespace bvm2 {
 
 		uint32_t m_Charge = Limits::BlockCharge;
 
+		uint32_t RunCharged(); // runs a portion of the code, charging Cost::Cycle per instruction. Returns the num of instructions executed
+
+		struct CodeCache
+		{
+			// Pre-decoded shader images, reused across the calls (and blocks).
+			// Images are keyed by ShaderID, contracts with the same code share the same image.
+			// The contract -> image mapping is kept too, to avoid ShaderID calculation on each call.
+			struct Image;
+
+			struct Contract
+			{
+				struct Key
+					:public boost::intrusive::set_base_hook<>
+				{
+					typedef ContractID Type;
+					Type m_Value;
+					bool operator < (const Key& x) const { return m_Value < x.m_Value; }
+					IMPLEMENT_GET_PARENT_OBJ(Contract, m_Key)
+				} m_Key;
+
+				struct Mru
+					:public boost::intrusive::list_base_hook<>
+				{
+					IMPLEMENT_GET_PARENT_OBJ(Contract, m_Mru)
+				} m_Mru;
+
+				struct Ref
+					:public boost::intrusive::list_base_hook<>
+				{
+					IMPLEMENT_GET_PARENT_OBJ(Contract, m_Ref)
+				} m_Ref; // in the image
+
+				Image* m_pImage;
+			};
+
+			struct Image
+			{
+				struct Key
+					:public boost::intrusive::set_base_hook<>
+				{
+					typedef ShaderID Type;
+					Type m_Value;
+					bool operator < (const Key& x) const { return m_Value < x.m_Value; }
+					IMPLEMENT_GET_PARENT_OBJ(Image, m_Key)
+				} m_Key;
+
+				struct Mru
+					:public boost::intrusive::list_base_hook<>
+				{
+					IMPLEMENT_GET_PARENT_OBJ(Image, m_Mru)
+				} m_Mru;
+
+				boost::intrusive::list<Contract::Ref> m_Contracts;
+
+				ByteBuffer m_Body;
+				std::shared_ptr<Wasm::Processor::Decoded> m_pDecoded; // may outlive the image, if the contract is still running
+			};
+
+			typedef boost::intrusive::set<Contract::Key> ContractSet;
+			typedef boost::intrusive::list<Contract::Mru> ContractMru;
+			typedef boost::intrusive::set<Image::Key> ImageSet;
+			typedef boost::intrusive::list<Image::Mru> ImageMru;
+
+			ContractSet m_Contracts;
+			ContractMru m_ContractMru;
+			ImageSet m_Images;
+			ImageMru m_ImageMru;
+
+			uint32_t m_MaxImages = 64;
+			uint32_t m_MaxContracts = 1024;
+
+			struct Stats
+			{
+				uint64_t m_Hits = 0; // contract found
+				uint64_t m_HitsShader = 0; // contract not found, but its shader is
+				uint64_t m_Misses = 0; // decoded from scratch
+				uint64_t m_Invalidated = 0;
+			} m_Stats; // accumulated since creation
+
+			~CodeCache() {
+				Clear();
+			}
+
+			void Clear();
+			void Delete(Contract&);
+			void Delete(Image&);
+
+			void Invalidate(const ContractID&); // contract body is modified or deleted
+
+			std::shared_ptr<Wasm::Processor::Decoded> Get(const ContractID&, const Blob& body); // modifies MRU
+		};
+
+		CodeCache* m_pCodeCache = nullptr; // optional
+
 		virtual void CallFar(const ContractID&, uint32_t iMethod, Wasm::Word pArgs); // can override to invoke host code instead of interpretator (for debugging)
 	};
 
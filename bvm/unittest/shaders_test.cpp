@@ -420,6 +420,57 @@ namespace bvm2 {
 		}
 	}
 
+	void TestCodeCache()
+	{
+		ProcessorContract::CodeCache cc;
+		cc.m_MaxImages = 2;
+		cc.m_MaxContracts = 3;
+
+		ByteBuffer pBody[3];
+		for (uint32_t i = 0; i < _countof(pBody); i++)
+			pBody[i].assign(100 + i, static_cast<uint8_t>(i));
+
+		ContractID pCid[4];
+		for (uint32_t i = 0; i < _countof(pCid); i++)
+		{
+			pCid[i] = Zero;
+			pCid[i].m_pData[0] = static_cast<uint8_t>(i + 1);
+		}
+
+		auto p0 = cc.Get(pCid[0], pBody[0]);
+		verify_test(p0 && (1 == cc.m_Stats.m_Misses));
+		verify_test(cc.Get(pCid[0], pBody[0]) == p0);
+		verify_test(1 == cc.m_Stats.m_Hits);
+
+		// another contract, same shader
+		verify_test(cc.Get(pCid[1], pBody[0]) == p0);
+		verify_test(1 == cc.m_Stats.m_HitsShader);
+
+		auto p1 = cc.Get(pCid[2], pBody[1]);
+		verify_test(p1 != p0);
+
+		// modified body. The 1st image is evicted, but remains valid for its holder
+		auto p2 = cc.Get(pCid[2], pBody[2]);
+		verify_test((p2 != p1) && (p2 != p0));
+		verify_test(1 == cc.m_Stats.m_Invalidated);
+		verify_test(3 == cc.m_Stats.m_Misses);
+		verify_test(1 == p0.use_count());
+		verify_test(1 == cc.m_Contracts.size());
+
+		cc.Invalidate(pCid[2]);
+		verify_test(2 == cc.m_Stats.m_Invalidated);
+		verify_test(cc.m_Contracts.empty());
+
+		verify_test(cc.Get(pCid[3], pBody[1]) == p1);
+		verify_test(2 == cc.m_Stats.m_HitsShader);
+
+		for (uint32_t i = 0; i < _countof(pCid); i++)
+			verify_test(cc.Get(pCid[i], pBody[1]) == p1);
+
+		verify_test(3 == cc.m_Contracts.size());
+		verify_test(2 == cc.m_Images.size());
+	}
+
 	struct MyProcessor
 		:public ProcessorContract
 	{
@@ -500,6 +551,9 @@ namespace bvm2 {
 			auto* pE = m_Vars.Find(key);
 			auto nOldSize = pE ? static_cast<uint32_t>(pE->m_Data.size()) : 0;
 
+			if (ContractID::nBytes == key.n)
+				m_MyCodeCache.Invalidate(*reinterpret_cast<const ContractID*>(key.p)); // contract body
+
 			if (pAction)
 			{
 				key.Export(pAction->m_Key);
@@ -672,9 +726,27 @@ namespace bvm2 {
 			//m_Dbg.m_Stack = true;
 			//m_Dbg.m_Instructions = true;
 			//m_Dbg.m_ExtCall = true;
+
+			m_pCodeCache = &m_MyCodeCache;
 		}
 
 		uint32_t m_Cycles;
+		bool m_SingleStep = false; // run instructions one-by-one, w/o the pre-decoded form
+		bool m_Differential = true; // run each method in both modes, verify the results and charges are the same
+		bool m_Quiet = false;
+
+		CodeCache m_MyCodeCache;
+
+		// for the interpreter benchmark
+		uint64_t m_WasmTime_us = 0;
+		uint64_t m_HostTime_us = 0;
+
+		virtual void InvokeExt(uint32_t n) override
+		{
+			uint64_t t0_us = GetTime_us();
+			ProcessorContract::InvokeExt(n);
+			m_HostTime_us += GetTime_us() - t0_us;
+		}
 
 		void CallFarN(const ContractID& cid, uint32_t iMethod, void* pArgs, uint32_t nArgs, uint8_t bInheritContext)
 		{
@@ -695,12 +767,20 @@ namespace bvm2 {
 			}
 
 			bool bWasm = false;
-			for (; m_FarCalls.m_Stack.size() > nFrames; m_Cycles++)
+			uint64_t t0_us = GetTime_us();
+
+			while (m_FarCalls.m_Stack.size() > nFrames)
 			{
 				bWasm = true;
 
-				DischargeUnits(Limits::Cost::Cycle);
-				RunOnce();
+				if (m_SingleStep)
+				{
+					DischargeUnits(Limits::Cost::Cycle);
+					RunOnce();
+					m_Cycles++;
+				}
+				else
+					m_Cycles += RunCharged();
 
 				if (m_Dbg.m_pOut)
 				{
@@ -712,6 +792,8 @@ namespace bvm2 {
 				}
 			}
 
+			m_WasmTime_us += GetTime_us() - t0_us;
+
 			if (bWasm) {
 				verify_test(nSp == m_Stack.get_AlasSp()); // stack must be restored
 			}
@@ -745,10 +827,85 @@ namespace bvm2 {
 			CallFarN(cid, iMethod, Cast::NotConst(args.p), args.n, 0);
 
 			os << "Done in " << m_Cycles << " cycles, Discharge=" << (nUnitsMax - m_Charge) << std::endl << std::endl;
-			std::cout << os.str();
+			if (!m_Quiet)
+				std::cout << os.str();
+		}
+
+		typedef std::vector<ByteBuffer> State;
+
+		void get_State(State& res)
+		{
+			// vars and assets, for comparison
+			res.clear();
+
+			for (const auto& x : m_Vars)
+			{
+				res.emplace_back();
+				x.ToBlob().Export(res.back());
+				res.push_back(x.m_Data);
+			}
+
+			for (const auto& x : m_Assets)
+			{
+				res.emplace_back();
+				Blob(&x.first, sizeof(x.first)).Export(res.back());
+				res.emplace_back();
+				Blob(&x.second.m_Amount, sizeof(x.second.m_Amount)).Export(res.back());
+				res.emplace_back();
+				Blob(x.second.m_Pid).Export(res.back());
+			}
 		}
 
 		bool RunGuarded(const ContractID& cid, uint32_t iMethod, const Blob& args, const Blob* pCode)
+		{
+			if (!m_Differential || m_SingleStep)
+				return RunGuardedInternal(cid, iMethod, args, pCode);
+
+			// 1st run step-by-step, then undo and run via the pre-decoded form
+			ByteBuffer bufArgs, bufArgs1;
+			args.Export(bufArgs);
+			size_t nChanges = m_lstUndo.size();
+
+			m_SingleStep = true;
+			m_Quiet = true;
+			std::fill(m_vStack.begin(), m_vStack.end(), 0);
+			bool bRet1 = RunGuardedInternal(cid, iMethod, args, pCode);
+			m_SingleStep = false;
+			m_Quiet = false;
+
+			uint32_t nCycles1 = m_Cycles;
+			uint32_t nCharge1 = m_Charge;
+			args.Export(bufArgs1);
+
+			// the whole stack memory, including the leftovers above the operand stack top, which the contract can read as well
+			std::vector<Wasm::Word> vStack1 = m_vStack;
+
+			State s1, s2;
+			get_State(s1);
+
+			UndoChanges(nChanges);
+			if (args.n)
+				memcpy(Cast::NotConst(args.p), &bufArgs.front(), args.n);
+
+			std::fill(m_vStack.begin(), m_vStack.end(), 0);
+			bool bRet = RunGuardedInternal(cid, iMethod, args, pCode);
+
+			verify_test(bRet == bRet1);
+			verify_test(m_Charge == nCharge1);
+			if (bRet)
+			{
+				verify_test(m_Cycles == nCycles1); // not counted precisely on failure
+				verify_test(m_vStack == vStack1);
+			}
+			verify_test(Blob(args) == Blob(bufArgs1));
+
+			get_State(s2);
+			verify_test(s1 == s2);
+
+			return bRet;
+		}
+
+		bool RunGuardedInternal(const ContractID& cid, uint32_t iMethod, const Blob& args, const Blob* pCode)
 		{
 			bool ret = true;
 			size_t nChanges = m_lstUndo.size();
@@ -770,8 +927,11 @@ namespace bvm2 {
 
 			}
 			catch (const std::exception& e) {
-				std::cout << "*** Shader Execution failed. Undoing changes" << std::endl;
-				std::cout << e.what() << std::endl;
+				if (!m_Quiet)
+				{
+					std::cout << "*** Shader Execution failed. Undoing changes" << std::endl;
+					std::cout << e.what() << std::endl;
+				}
 
 				UndoChanges(nChanges);
 				m_FarCalls.m_Stack.Clear();
@@ -1562,10 +1722,46 @@ namespace bvm2 {
 
 			verify_test(RunGuarded_T(cid, args.s_iMethod, args));
 
-			m_Dbg = dbg;
-
 			verify_test(args.m_Hash == hv);
 
+			// interpreter benchmark. Must give the same result and charge in both modes
+			uint32_t pCycles[2], pCharge[2];
+			m_Differential = false;
+
+			for (uint32_t iMode = 0; iMode < 2; iMode++)
+			{
+				m_SingleStep = !iMode;
+
+				const uint32_t nRuns = 20;
+				uint64_t nInstructions = 0;
+				m_WasmTime_us = 0;
+				m_HostTime_us = 0;
+
+				for (uint32_t i = 0; i < nRuns; i++)
+				{
+					Shaders::Dummy::VerifyBeamHeader args2 = args;
+					args2.m_Hash = Zero;
+
+					verify_test(RunGuarded_T(cid, args2.s_iMethod, args2));
+					verify_test(args2.m_Hash == hv);
+
+					nInstructions += m_Cycles;
+					pCycles[iMode] = m_Cycles;
+					pCharge[iMode] = m_Charge;
+				}
+
+				// exclude the host calls
+				uint64_t dt_us = std::max<uint64_t>(m_WasmTime_us - std::min(m_HostTime_us, m_WasmTime_us), 1);
+				printf("\tWasm %s: %u instructions in %u us, %.1f mln instructions/sec\n", iMode ? "threaded" : "single-step", static_cast<uint32_t>(nInstructions), static_cast<uint32_t>(dt_us), double(nInstructions) / dt_us);
+			}
+
+			m_SingleStep = false;
+			m_Differential = true;
+			verify_test(pCycles[0] == pCycles[1]);
+			verify_test(pCharge[0] == pCharge[1]);
+
+			m_Dbg = dbg;
+
 			Difficulty::Raw diff;
 			s.m_PoW.m_Difficulty.Unpack(diff);
 			diff.Negate();
@@ -2737,6 +2933,7 @@ int main()
 		using namespace beam::bvm2;
 
 		TestMergeSort();
+		TestCodeCache();
 
 		MyProcessor proc;
 /*
@@ -1517,8 +1517,11 @@ namespace Wasm {
 
 		void OnLocal(bool bSet, bool bGet)
 		{
-			uint32_t nOffset = m_Instruction.Read<uint32_t>();
+			OnLocal(m_Instruction.Read<uint32_t>(), bSet, bGet);
+		}
 
+		void OnLocal(uint32_t nOffset, bool bSet, bool bGet)
+		{
 			uint8_t nType = Type::s_Base + static_cast<uint8_t>((sizeof(Word) - 1) & (nOffset - Type::s_Base));
 			uint8_t nWords = Type::Words(nType);
 
@@ -1564,8 +1567,12 @@ namespace Wasm {
 			Stack::TestAlignmentPower(nAlign);
 
 			auto nOffs = m_Instruction.Read<Word>();
-			nOffs += m_Stack.Pop<Word>();
+			return MemArgEx(nOffs, nSize, bW);
+		}
 
+		uint8_t* MemArgEx(Word nOffs, uint32_t nSize, bool bW)
+		{
+			nOffs += m_Stack.Pop<Word>();
 			return get_AddrEx(nOffs, nSize, bW);
 		}
 
@@ -1577,21 +1584,28 @@ namespace Wasm {
 			return MemArgEx(nSize, false);
 		}
 
+		struct RunCheckpoint :public Checkpoint {
+			Word m_Ip;
+			virtual void Dump(std::ostream& os) override {
+				os << "wasm/Run, Ip=" << uintBigFrom(m_Ip);
+			}
+		};
+
 		void RunOncePlus()
 		{
-			struct MyCheckpoint :public Checkpoint {
-				Word m_Ip;
-				virtual void Dump(std::ostream& os) override {
-					os << "wasm/Run, Ip=" << uintBigFrom(m_Ip);
-				}
-			} cp;
+			RunCheckpoint cp;
 			cp.m_Ip = get_Ip();
 
+			RunInstruction();
+		}
+
+		void RunInstruction()
+		{
 			typedef Instruction I;
 			I nInstruction = (I) m_Instruction.Read1();
 
 				if (m_Dbg.m_Instructions)
-					*m_Dbg.m_pOut << "ip=" << uintBigFrom(cp.m_Ip) << ", sp=" << uintBigFrom(m_Stack.m_Pos) << ' ';
+					*m_Dbg.m_pOut << "ip=" << uintBigFrom(get_Ip() - 1) << ", sp=" << uintBigFrom(m_Stack.m_Pos) << ' ';
 
 			switch (nInstruction)
 			{
@@ -1642,6 +1656,108 @@ namespace Wasm {
 			}
 
 		}
+
+		void OnDrop(uint8_t nType);
+		void OnSelect(uint8_t nType);
+		void OnProlog(uint32_t nWords);
+		Word OnRetEx(uint32_t nRets, uint32_t nLocals, uint32_t nArgs);
+
+		/////////////////////////////////////////////
+		// Threaded dispatch
+		typedef Decoded::Op Op;
+
+		static const uint32_t s_Stop = static_cast<uint32_t>(-1);
+		static const uint32_t s_Unfused = static_cast<uint32_t>(-2);
+
+		void SetIp(Word ip)
+		{
+			// unlike Jmp - no test, the ip may point to the end of the code
+			m_Instruction.m_p0 = reinterpret_cast<const uint8_t*>(m_Code.p) + ip;
+			m_Instruction.m_p1 = reinterpret_cast<const uint8_t*>(m_Code.p) + m_Code.n;
+		}
+
+		void RunManyPlus(uint32_t& nCycles);
+
+		uint32_t Resolve(Decoded&, Word ip);
+		uint32_t ResolveJmp(Decoded&, uint32_t iOp);
+		uint32_t DecodeTrace(Decoded&, Word ip);
+		bool DecodeOne(Decoded&, Reader&);
+		bool DecodeFused(Decoded&, Reader&, Word ip, Word nOffset);
+		void DecodeMemArg(Decoded&, Reader&, Op::Handler, Word ip);
+
+		static Op& AddOp(Decoded&, Op::Handler, Word ip);
+
+		static uint32_t H_Generic(Processor&, Decoded&, uint32_t iOp);
+		static uint32_t H_Link(Processor&, Decoded&, uint32_t iOp);
+		static uint32_t H_LocalGetConstAdd(Processor&, Decoded&, uint32_t iOp);
+		static uint32_t H_br(Processor&, Decoded&, uint32_t iOp);
+		static uint32_t H_br_if(Processor&, Decoded&, uint32_t iOp);
+		static uint32_t H_call(Processor&, Decoded&, uint32_t iOp);
+		static uint32_t H_ret(Processor&, Decoded&, uint32_t iOp);
+		static uint32_t H_drop(Processor&, Decoded&, uint32_t iOp);
+		static uint32_t H_select(Processor&, Decoded&, uint32_t iOp);
+		static uint32_t H_prolog(Processor&, Decoded&, uint32_t iOp);
+
+		template <void (ProcessorPlus::*pfn)()>
+		static uint32_t H_Plain(Processor& p, Decoded&, uint32_t iOp)
+		{
+			(Cast::Up<ProcessorPlus>(p).*pfn)();
+			return iOp + 1;
+		}
+
+		template <bool bSet, bool bGet>
+		static uint32_t H_Local(Processor& p, Decoded& d, uint32_t iOp)
+		{
+			Cast::Up<ProcessorPlus>(p).OnLocal(d.m_vOps[iOp].m_Arg0, bSet, bGet);
+			return iOp + 1;
+		}
+
+		template <bool bGet>
+		static uint32_t H_GlobalImp(Processor& p, Decoded& d, uint32_t iOp)
+		{
+			const Op& op = d.m_vOps[iOp];
+			Cast::Up<ProcessorPlus>(p).SetIp(op.m_IpNext);
+			p.OnGlobalVar(op.m_Arg0, bGet);
+			return iOp + 1;
+		}
+
+		static uint32_t H_i32_const(Processor& p, Decoded& d, uint32_t iOp)
+		{
+			p.m_Stack.Push<uint32_t>(d.m_vOps[iOp].m_Arg0);
+			return iOp + 1;
+		}
+
+		static uint32_t H_i64_const(Processor& p, Decoded& d, uint32_t iOp)
+		{
+			const Op& op = d.m_vOps[iOp];
+			p.m_Stack.Push<uint64_t>(op.m_Arg0 | (static_cast<uint64_t>(op.m_Arg1) << 32));
+			return iOp + 1;
+		}
+
+		template <typename T, typename TMem>
+		static uint32_t H_Load(Processor& p, Decoded& d, uint32_t iOp)
+		{
+			const Op& op = d.m_vOps[iOp];
+			Stack::TestAlignmentPower(op.m_Arg0);
+
+			TMem val1 = from_wasm<typename Type::ToFlexible<TMem, false>::T>(Cast::Up<ProcessorPlus>(p).MemArgEx(op.m_Arg1, sizeof(TMem), false));
+			auto valExt = Type::Extend<T, TMem>(val1);
+			p.m_Stack.Push(valExt);
+
+			return iOp + 1;
+		}
+
+		template <typename T, typename TMem>
+		static uint32_t H_Store(Processor& p, Decoded& d, uint32_t iOp)
+		{
+			const Op& op = d.m_vOps[iOp];
+			auto val = p.m_Stack.Pop<T>();
+			Stack::TestAlignmentPower(op.m_Arg0);
+
+			to_wasm(Cast::Up<ProcessorPlus>(p).MemArgEx(op.m_Arg1, sizeof(TMem), true), static_cast<TMem>(val));
+
+			return iOp + 1;
+		}
 	};
 
 	Word Processor::get_Ip() const
@@ -1713,6 +1829,12 @@ namespace Wasm {
 		p.RunOncePlus();
 	}
 
+	void Processor::RunMany(uint32_t& nCycles)
+	{
+		auto& p = Cast::Up<ProcessorPlus>(*this);
+		p.RunManyPlus(nCycles);
+	}
+
 	void Processor::InvokeExt(uint32_t)
 	{
 		Fail(); // unresolved binding
@@ -1784,14 +1906,24 @@ namespace Wasm {
 
 	void ProcessorPlus::On_drop()
 	{
-		uint32_t nWords = Type::Words(m_Instruction.Read1());
+		OnDrop(m_Instruction.Read1());
+	}
+
+	void ProcessorPlus::OnDrop(uint8_t nType)
+	{
+		uint32_t nWords = Type::Words(nType);
 		Test(m_Stack.m_Pos - m_Stack.m_PosMin >= nWords);
 		m_Stack.m_Pos -= nWords;
 	}
 
 	void ProcessorPlus::On_select()
 	{
-		uint32_t nWords = Type::Words(m_Instruction.Read1());
+		OnSelect(m_Instruction.Read1());
+	}
+
+	void ProcessorPlus::OnSelect(uint8_t nType)
+	{
+		uint32_t nWords = Type::Words(nType);
 		auto nSel = m_Stack.Pop<Word>();
 
 		Test(m_Stack.m_Pos - m_Stack.m_PosMin >= (nWords << 1)); // must be at least 2 such operands
@@ -1910,7 +2042,11 @@ namespace Wasm {
 
 	void ProcessorPlus::On_prolog()
 	{
-		auto nWords = m_Instruction.Read<uint32_t>();
+		OnProlog(m_Instruction.Read<uint32_t>());
+	}
+
+	void ProcessorPlus::OnProlog(uint32_t nWords)
+	{
 		while (nWords--)
 			m_Stack.Push1(0); // for more safety - zero-init locals. This way we don't need initial stack initialization 
 	}
@@ -1921,6 +2057,11 @@ namespace Wasm {
 		auto nLocals = m_Instruction.Read<uint32_t>();
 		auto nArgs = m_Instruction.Read<uint32_t>();
 
+		OnRetEx(nRets, nLocals, nArgs);
+	}
+
+	Word ProcessorPlus::OnRetEx(uint32_t nRets, uint32_t nLocals, uint32_t nArgs)
+	{
 		// stack layout
 		// ...
 		// args
@@ -1946,6 +2087,8 @@ namespace Wasm {
 
 		m_Stack.m_Pos = nPosRetDst + nRets;
 		OnRet(nRetAddr);
+
+		return nRetAddr;
 	}
 
 	void Processor::OnCall(Word nAddr)
@@ -1958,6 +2101,459 @@ namespace Wasm {
 		Jmp(nRetAddr);
 	}
 
+	/////////////////////////////////////////////
+	// Threaded dispatch
+	void Processor::Decoded::Reset()
+	{
+		m_vOps.clear();
+		m_vIdx.clear();
+	}
+
+	void ProcessorPlus::RunManyPlus(uint32_t& nCycles)
+	{
+		assert(nCycles);
+
+		if (!m_pDecoded || m_Dbg.m_Instructions || m_Dbg.m_Stack)
+		{
+			nCycles--;
+			RunOncePlus();
+			return;
+		}
+
+		Decoded& d = *m_pDecoded;
+		if (d.m_vIdx.size() != m_Code.n + 1)
+		{
+			d.Reset();
+			d.m_vIdx.resize(m_Code.n + 1, 0);
+		}
+
+		RunCheckpoint cp;
+		cp.m_Ip = get_Ip();
+
+		uint32_t iOp = Resolve(d, cp.m_Ip);
+
+		for (bool bFirst = true; nCycles; )
+		{
+			const Op& op = d.m_vOps[iOp];
+			uint32_t nInstructions = op.m_Instructions;
+
+			if (nInstructions > nCycles)
+			{
+				iOp++; // fused op, not enough cycles. Its unfused form follows
+				continue;
+			}
+
+			if ((Op::Flags::Ext & op.m_Flags) && !bFirst)
+				break;
+
+			cp.m_Ip = op.m_Ip;
+
+			// the 1st instruction is accounted before it's executed (if it fails - it's still accounted)
+			uint32_t nPre = std::min(nInstructions, 1U);
+			nCycles -= nPre;
+
+			uint32_t iNext = op.m_pfn(*this, d, iOp);
+			if (s_Unfused == iNext)
+			{
+				nCycles += nPre;
+				iOp++;
+				continue;
+			}
+
+			nCycles -= nInstructions - nPre;
+
+			if (s_Stop == iNext)
+				return;
+
+			iOp = iNext;
+			if (nInstructions)
+				bFirst = false;
+		}
+
+		SetIp(d.m_vOps[iOp].m_Ip);
+	}
+
+	uint32_t ProcessorPlus::Resolve(Decoded& d, Word ip)
+	{
+		assert(ip < d.m_vIdx.size());
+		uint32_t iOp = d.m_vIdx[ip];
+		return iOp ? (iOp - 1) : DecodeTrace(d, ip);
+	}
+
+	uint32_t ProcessorPlus::ResolveJmp(Decoded& d, uint32_t iOp)
+	{
+		const Op& op = d.m_vOps[iOp];
+		if (op.m_iTarget)
+			return op.m_iTarget - 1;
+
+		Word ip = op.m_Arg0;
+		Test(ip < m_Code.n); // same as in Jmp
+
+		uint32_t iRet = Resolve(d, ip);
+		d.m_vOps[iOp].m_iTarget = iRet + 1; // op may be invalidated by now
+		return iRet;
+	}
+
+	ProcessorPlus::Op& ProcessorPlus::AddOp(Decoded& d, Op::Handler pfn, Word ip)
+	{
+		auto& op = d.m_vOps.emplace_back();
+		ZeroObject(op);
+		op.m_pfn = pfn;
+		op.m_Ip = ip;
+		op.m_Instructions = 1;
+		return op;
+	}
+
+	uint32_t ProcessorPlus::DecodeTrace(Decoded& d, Word ip)
+	{
+		// Decode the straight-line code, until an unconditional jump or an already decoded instruction.
+		// The decoding never fails: malformed instructions are left for the interpreter, which fails on them exactly as without decoding
+		const auto* pCode = reinterpret_cast<const uint8_t*>(m_Code.p);
+
+		Reader inp;
+		inp.m_p0 = pCode + ip;
+		inp.m_p1 = pCode + m_Code.n;
+
+		uint32_t iRet = static_cast<uint32_t>(d.m_vOps.size());
+
+		for (bool bEnd = false; !bEnd; )
+		{
+			ip = static_cast<Word>(inp.m_p0 - pCode);
+			uint32_t iOp = static_cast<uint32_t>(d.m_vOps.size());
+
+			if (d.m_vIdx[ip])
+			{
+				assert(iOp > iRet);
+
+				auto& op = AddOp(d, H_Link, ip);
+				op.m_iTarget = d.m_vIdx[ip];
+				op.m_Instructions = 0;
+				break;
+			}
+
+			d.m_vIdx[ip] = iOp + 1;
+
+			try
+			{
+				bEnd = DecodeOne(d, inp);
+			}
+			catch (const Exc&)
+			{
+				d.m_vOps.resize(iOp);
+				AddOp(d, H_Generic, ip);
+				bEnd = true;
+			}
+		}
+
+		return iRet;
+	}
+
+	bool ProcessorPlus::DecodeOne(Decoded& d, Reader& inp)
+	{
+		const auto* pCode = reinterpret_cast<const uint8_t*>(m_Code.p);
+		Word ip = static_cast<Word>(inp.m_p0 - pCode);
+
+		typedef Instruction I;
+		I nInstruction = (I) inp.Read1();
+
+		switch (nInstruction)
+		{
+		case I::local_get:
+			{
+				Word nOffset = inp.Read<uint32_t>();
+				if (!DecodeFused(d, inp, ip, nOffset))
+					AddOp(d, &H_Local<false, true>, ip).m_Arg0 = nOffset;
+			}
+			break;
+
+		case I::local_set:
+		case I::local_tee:
+			{
+				Word nOffset = inp.Read<uint32_t>();
+				auto pfn = (I::local_set == nInstruction) ? &H_Local<true, false> : &H_Local<true, true>;
+				AddOp(d, pfn, ip).m_Arg0 = nOffset;
+			}
+			break;
+
+		case I::global_get_imp:
+		case I::global_set_imp:
+			{
+				Word iVar = inp.Read<uint32_t>();
+				auto pfn = (I::global_get_imp == nInstruction) ? &H_GlobalImp<true> : &H_GlobalImp<false>;
+
+				auto& op = AddOp(d, pfn, ip);
+				op.m_Arg0 = iVar;
+				op.m_IpNext = static_cast<Word>(inp.m_p0 - pCode);
+			}
+			break;
+
+		case I::i32_const:
+			{
+				uint32_t nVal = inp.Read<int32_t>();
+				AddOp(d, H_i32_const, ip).m_Arg0 = nVal;
+			}
+			break;
+
+		case I::i64_const:
+			{
+				uint64_t nVal = inp.Read<int64_t>();
+
+				auto& op = AddOp(d, H_i64_const, ip);
+				op.m_Arg0 = static_cast<Word>(nVal);
+				op.m_Arg1 = static_cast<Word>(nVal >> 32);
+			}
+			break;
+
+		case I::drop:
+		case I::select:
+			{
+				uint8_t nType = inp.Read1();
+				AddOp(d, (I::drop == nInstruction) ? H_drop : H_select, ip).m_Arg0 = nType;
+			}
+			break;
+
+		case I::prolog:
+			{
+				Word nWords = inp.Read<uint32_t>();
+				AddOp(d, H_prolog, ip).m_Arg0 = nWords;
+			}
+			break;
+
+		case I::i32_wrap_i64: AddOp(d, &H_Plain<&ProcessorPlus::On_i32_wrap_i64>, ip); break;
+		case I::i64_extend_i32_s: AddOp(d, &H_Plain<&ProcessorPlus::On_i64_extend_i32_s>, ip); break;
+		case I::i64_extend_i32_u: AddOp(d, &H_Plain<&ProcessorPlus::On_i64_extend_i32_u>, ip); break;
+
+		case I::br:
+		case I::br_if:
+		case I::call:
+			{
+				Word nAddr = from_wasm<Word>(inp.Consume(sizeof(Word)));
+
+				auto& op = AddOp(d, (I::br == nInstruction) ? H_br : (I::br_if == nInstruction) ? H_br_if : H_call, ip);
+				op.m_Arg0 = nAddr;
+				op.m_IpNext = static_cast<Word>(inp.m_p0 - pCode); // ret addr for call
+			}
+			return (I::br == nInstruction);
+
+		case I::call_indirect:
+			AddOp(d, H_Generic, ip);
+			break;
+
+		case I::call_ext:
+			inp.Read<uint32_t>();
+			AddOp(d, H_Generic, ip).m_Flags = Op::Flags::Ext | Op::Flags::Stop;
+			break;
+
+		case I::ret:
+			{
+				Word nRets = inp.Read<uint32_t>();
+				Word nLocals = inp.Read<uint32_t>();
+				Word nArgs = inp.Read<uint32_t>();
+
+				auto& op = AddOp(d, H_ret, ip);
+				op.m_Arg0 = nRets;
+				op.m_Arg1 = nLocals;
+				op.m_Arg2 = nArgs;
+				op.m_IpNext = static_cast<Word>(inp.m_p0 - pCode);
+			}
+			return true;
+
+#define THE_MACRO(name, id32, id64) \
+		case I::i32_##name: AddOp(d, &H_Plain<&ProcessorPlus::On_##name<uint32_t, uint32_t> >, ip); break; \
+		case I::i64_##name: AddOp(d, &H_Plain<&ProcessorPlus::On_##name<uint32_t, uint64_t> >, ip); break;
+
+		WasmInstructions_unop_Polymorphic_32(THE_MACRO)
+		WasmInstructions_binop_Polymorphic_32(THE_MACRO)
+#undef THE_MACRO
+
+#define THE_MACRO(name, id32, id64) \
+		case I::i32_##name: AddOp(d, &H_Plain<&ProcessorPlus::On_##name<uint32_t, uint32_t> >, ip); break; \
+		case I::i64_##name: AddOp(d, &H_Plain<&ProcessorPlus::On_##name<uint64_t, uint64_t> >, ip); break;
+
+		WasmInstructions_binop_Polymorphic_x(THE_MACRO)
+#undef THE_MACRO
+
+#define THE_MACRO(id, type, name, tmem) \
+		case I::type##_##name: DecodeMemArg(d, inp, &H_Load<Type::Code2Type<Type::type>::T, tmem>, ip); break;
+
+		WasmInstructions_Load(THE_MACRO)
+#undef THE_MACRO
+
+#define THE_MACRO(id, type, name, tmem) \
+		case I::type##_##name: DecodeMemArg(d, inp, &H_Store<Type::Code2Type<Type::type>::T, tmem>, ip); break;
+
+		WasmInstructions_Store(THE_MACRO)
+#undef THE_MACRO
+
+		default:
+			// br_table, and whatever is not supported (would fail)
+			AddOp(d, H_Generic, ip);
+			return true;
+		}
+
+		return false;
+	}
+
+	void ProcessorPlus::DecodeMemArg(Decoded& d, Reader& inp, Op::Handler pfn, Word ip)
+	{
+		Word nAlign = inp.Read<Word>();
+		Word nOffs = inp.Read<Word>();
+
+		auto& op = AddOp(d, pfn, ip);
+		op.m_Arg0 = nAlign;
+		op.m_Arg1 = nOffs;
+	}
+
+	bool ProcessorPlus::DecodeFused(Decoded& d, Reader& inp, Word ip, Word nOffset)
+	{
+		// local.get (32-bit), i32.const, i32.add. Typical address calculation
+		uint8_t nType = Type::s_Base + static_cast<uint8_t>((sizeof(Word) - 1) & (nOffset - Type::s_Base));
+		if (Type::Words(nType) != 1)
+			return false;
+
+		const auto* pCode = reinterpret_cast<const uint8_t*>(m_Code.p);
+
+		Reader inp2 = inp;
+		Word ip1, ip2;
+		uint32_t nVal;
+
+		try
+		{
+			ip1 = static_cast<Word>(inp2.m_p0 - pCode);
+			if (Instruction::i32_const != inp2.Read1())
+				return false;
+			nVal = inp2.Read<int32_t>();
+
+			ip2 = static_cast<Word>(inp2.m_p0 - pCode);
+			if (Instruction::i32_add != inp2.Read1())
+				return false;
+		}
+		catch (const Exc&)
+		{
+			return false;
+		}
+
+		// the fused op is followed by the original instructions, in case it can't be executed as a whole
+		uint32_t iOp = static_cast<uint32_t>(d.m_vOps.size());
+
+		auto& op = AddOp(d, H_LocalGetConstAdd, ip);
+		op.m_Arg0 = nOffset;
+		op.m_Arg1 = nVal;
+		op.m_Instructions = 3;
+
+		AddOp(d, &H_Local<false, true>, ip).m_Arg0 = nOffset;
+		AddOp(d, H_i32_const, ip1).m_Arg0 = nVal;
+		AddOp(d, &H_Plain<&ProcessorPlus::On_add<uint32_t, uint32_t> >, ip2);
+
+		if (!d.m_vIdx[ip1])
+			d.m_vIdx[ip1] = iOp + 3;
+		if (!d.m_vIdx[ip2])
+			d.m_vIdx[ip2] = iOp + 4;
+
+		inp = inp2;
+		return true;
+	}
+
+	uint32_t ProcessorPlus::H_Generic(Processor& p_, Decoded& d, uint32_t iOp)
+	{
+		auto& p = Cast::Up<ProcessorPlus>(p_);
+		const Op& op = d.m_vOps[iOp];
+		bool bStop = !!(Op::Flags::Stop & op.m_Flags);
+
+		p.SetIp(op.m_Ip);
+		p.RunInstruction();
+
+		if (bStop || (p.m_pDecoded != &d))
+			return s_Stop;
+
+		return p.Resolve(d, p.get_Ip());
+	}
+
+	uint32_t ProcessorPlus::H_Link(Processor&, Decoded& d, uint32_t iOp)
+	{
+		return d.m_vOps[iOp].m_iTarget - 1;
+	}
+
+	uint32_t ProcessorPlus::H_LocalGetConstAdd(Processor& p, Decoded& d, uint32_t iOp)
+	{
+		const Op& op = d.m_vOps[iOp];
+		auto& s = p.m_Stack;
+
+		// proceed only if none of the instructions would fail. Otherwise run them one-by-one, so that the failure is the same
+		Word nOffset = op.m_Arg0 / sizeof(Word);
+		if ((s.m_Pos < s.m_PosMin) || !nOffset || (nOffset > s.m_Pos - s.m_PosMin) || (s.m_Pos + 2 > s.m_BytesCurrent / sizeof(Word)))
+			return s_Unfused;
+
+		// the constant is left above the stack top, as by the unfused form. It's visible to the contract (via the alias stack)
+		s.m_pPtr[s.m_Pos] = s.m_pPtr[s.m_Pos - nOffset] + op.m_Arg1;
+		s.m_pPtr[s.m_Pos + 1] = op.m_Arg1;
+		s.m_Pos++;
+
+		return iOp + 4;
+	}
+
+	uint32_t ProcessorPlus::H_br(Processor& p, Decoded& d, uint32_t iOp)
+	{
+		return Cast::Up<ProcessorPlus>(p).ResolveJmp(d, iOp);
+	}
+
+	uint32_t ProcessorPlus::H_br_if(Processor& p, Decoded& d, uint32_t iOp)
+	{
+		if (p.m_Stack.Pop<Word>())
+			return Cast::Up<ProcessorPlus>(p).ResolveJmp(d, iOp);
+
+		return iOp + 1;
+	}
+
+	uint32_t ProcessorPlus::H_call(Processor& p_, Decoded& d, uint32_t iOp)
+	{
+		auto& p = Cast::Up<ProcessorPlus>(p_);
+		Word nAddr = d.m_vOps[iOp].m_Arg0;
+		Word nRetAddr = d.m_vOps[iOp].m_IpNext;
+
+		p.m_Stack.Push(nRetAddr);
+		p.SetIp(nRetAddr);
+		p.OnCall(nAddr);
+
+		if (p.m_pDecoded != &d)
+			return s_Stop;
+
+		Word ip = p.get_Ip();
+		return (ip == nAddr) ? p.ResolveJmp(d, iOp) : p.Resolve(d, ip);
+	}
+
+	uint32_t ProcessorPlus::H_ret(Processor& p_, Decoded& d, uint32_t iOp)
+	{
+		auto& p = Cast::Up<ProcessorPlus>(p_);
+		const Op& op = d.m_vOps[iOp];
+
+		p.SetIp(op.m_IpNext);
+		Word nRetAddr = p.OnRetEx(op.m_Arg0, op.m_Arg1, op.m_Arg2);
+
+		if (!nRetAddr || (p.m_pDecoded != &d))
+			return s_Stop;
+
+		return p.Resolve(d, p.get_Ip());
+	}
+
+	uint32_t ProcessorPlus::H_drop(Processor& p, Decoded& d, uint32_t iOp)
+	{
+		Cast::Up<ProcessorPlus>(p).OnDrop(static_cast<uint8_t>(d.m_vOps[iOp].m_Arg0));
+		return iOp + 1;
+	}
+
+	uint32_t ProcessorPlus::H_select(Processor& p, Decoded& d, uint32_t iOp)
+	{
+		Cast::Up<ProcessorPlus>(p).OnSelect(static_cast<uint8_t>(d.m_vOps[iOp].m_Arg0));
+		return iOp + 1;
+	}
+
+	uint32_t ProcessorPlus::H_prolog(Processor& p, Decoded& d, uint32_t iOp)
+	{
+		Cast::Up<ProcessorPlus>(p).OnProlog(d.m_vOps[iOp].m_Arg0);
+		return iOp + 1;
+	}
+
 
 
 
@@ -328,6 +328,38 @@ namespace Wasm {
 		} m_Dbg;
 
 
+		struct Decoded
+		{
+			// Pre-decoded (threaded) form of the compiled code: handler pointers with inline operands, pre-resolved branch targets, fused common sequences.
+			// Built lazily from the code being executed. The code itself (and the addresses visible to the program) is not affected.
+			struct Op
+			{
+				typedef uint32_t (*Handler)(Processor&, Decoded&, uint32_t iOp); // returns the next op
+
+				struct Flags {
+					static const uint8_t Ext = 1; // host call, executed only at the beginning of the run
+					static const uint8_t Stop = 2; // the run ends after it
+				};
+
+				Handler m_pfn;
+				Word m_Ip;
+				Word m_IpNext; // set only where needed
+				Word m_Arg0;
+				Word m_Arg1;
+				Word m_Arg2;
+				uint32_t m_iTarget; // resolved jump target, 1-based
+				uint8_t m_Instructions; // original instructions covered by this op
+				uint8_t m_Flags;
+			};
+
+			std::vector<Op> m_vOps;
+			std::vector<uint32_t> m_vIdx; // ip -> op index, 1-based. Zero if not decoded yet
+
+			void Reset();
+		};
+
+		Decoded* m_pDecoded = nullptr; // optional, must correspond to m_Code
+
 		Word get_Ip() const;
 		void Jmp(uint32_t ip);
 
@@ -336,6 +368,11 @@ namespace Wasm {
 
 		void RunOnce();
 
+		// Runs at least 1 instruction, up to nCycles (decremented for each instruction, before it's executed).
+		// Host calls (InvokeExt) are executed only as the 1st instruction of the run. The run ends after them, after return to address 0, and if the code is switched.
+		// Uses the pre-decoded form if available, otherwise equivalent to a single RunOnce.
+		void RunMany(uint32_t& nCycles);
+
 		uint8_t* get_AddrEx(uint32_t nOffset, uint32_t nSize, bool bW) const;
 		uint8_t* get_AddrExVar(uint32_t nOffset, uint32_t& nSizeOut, bool bW) const;
 
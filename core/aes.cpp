@@ -1,5 +1,16 @@
 #include <assert.h>
 #include "aes.h"
+#include "cpu_caps.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#	define BEAM_AES_X86
+#	include <immintrin.h>
+#	ifdef _MSC_VER
+#		define BEAM_AES_TARGET(x)
+#	else // _MSC_VER
+#		define BEAM_AES_TARGET(x) __attribute__((target(x)))
+#	endif // _MSC_VER
+#endif // x86
 
 /*
 *  FIPS-197 compliant AES implementation
@@ -433,6 +444,596 @@ uint32_t KT1[256];
 uint32_t KT2[256];
 uint32_t KT3[256];
 
+#ifdef BEAM_AES_X86
+
+namespace {
+
+	uint32_t DetectCaps()
+	{
+		const uint32_t nCpu = CpuCaps::get();
+
+		const uint32_t nAesNi = CpuCaps::AesNi | CpuCaps::Sse41 | CpuCaps::Ssse3;
+		if ((nCpu & nAesNi) != nAesNi)
+			return 0;
+
+		uint32_t nRet = AES::Caps::AesNi;
+
+		const uint32_t nVaes = CpuCaps::Vaes | CpuCaps::Avx2;
+		if ((nCpu & nVaes) == nVaes)
+			nRet |= AES::Caps::Vaes;
+
+		return nRet;
+	}
+
+	struct AesNi
+	{
+		static const uint32_t s_Batch = 8; // blocks encrypted in parallel, to hide the latency of aesenc
+
+#define BEAM_AES_NI BEAM_AES_TARGET("aes,sse4.1,ssse3")
+
+		struct Keys
+		{
+			__m128i m_p[AES::Nr + 1];
+
+			BEAM_AES_NI Keys(const AES::Encoder& enc)
+			{
+				// our round keys are big-endian words, convert them to the byte order
+				const __m128i msk = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+				for (int i = 0; i <= AES::Nr; i++)
+					m_p[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(enc.m_erk + i * 4)), msk);
+			}
+		};
+
+		BEAM_AES_NI static __m128i Encrypt(const Keys& k, __m128i x)
+		{
+			x = _mm_xor_si128(x, k.m_p[0]);
+			for (int i = 1; i < AES::Nr; i++)
+				x = _mm_aesenc_si128(x, k.m_p[i]);
+			return _mm_aesenclast_si128(x, k.m_p[AES::Nr]);
+		}
+
+		BEAM_AES_NI static void Proceed(const AES::Encoder& enc, uint8_t* pDst, const uint8_t* pSrc)
+		{
+			Keys k(enc);
+			__m128i x = Encrypt(k, _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc)));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst), x);
+		}
+
+		// CTR counter as a 128-bit big-endian number
+		struct Counter
+		{
+			uint64_t m_Hi;
+			uint64_t m_Lo;
+
+			Counter(const uint8_t* p)
+			{
+				m_Hi = m_Lo = 0;
+				for (int i = 0; i < 8; i++)
+				{
+					m_Hi = (m_Hi << 8) | p[i];
+					m_Lo = (m_Lo << 8) | p[i + 8];
+				}
+			}
+
+			void Export(uint8_t* p) const
+			{
+				for (int i = 0; i < 8; i++)
+				{
+					p[i] = static_cast<uint8_t>(m_Hi >> ((7 - i) << 3));
+					p[i + 8] = static_cast<uint8_t>(m_Lo >> ((7 - i) << 3));
+				}
+			}
+
+			BEAM_AES_NI __m128i Next()
+			{
+				const __m128i msk = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+				__m128i x = _mm_shuffle_epi8(_mm_set_epi64x(static_cast<int64_t>(m_Hi), static_cast<int64_t>(m_Lo)), msk);
+
+				if (!++m_Lo)
+					m_Hi++;
+
+				return x;
+			}
+		};
+
+		BEAM_AES_NI static void XCrypt(const AES::Encoder& enc, uint8_t* pCounter, uint8_t* pBuf, uint32_t nBlocks)
+		{
+			Keys k(enc);
+			Counter ctr(pCounter);
+
+			for (; nBlocks >= s_Batch; nBlocks -= s_Batch)
+			{
+				__m128i pX[s_Batch];
+				for (uint32_t i = 0; i < s_Batch; i++)
+					pX[i] = _mm_xor_si128(ctr.Next(), k.m_p[0]);
+
+				for (int iRound = 1; iRound < AES::Nr; iRound++)
+					for (uint32_t i = 0; i < s_Batch; i++)
+						pX[i] = _mm_aesenc_si128(pX[i], k.m_p[iRound]);
+
+				for (uint32_t i = 0; i < s_Batch; i++)
+				{
+					__m128i* p = reinterpret_cast<__m128i*>(pBuf) + i;
+					pX[i] = _mm_aesenclast_si128(pX[i], k.m_p[AES::Nr]);
+					_mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), pX[i]));
+				}
+
+				pBuf += s_Batch * AES::s_BlockSize;
+			}
+
+			for (; nBlocks; nBlocks--, pBuf += AES::s_BlockSize)
+			{
+				__m128i* p = reinterpret_cast<__m128i*>(pBuf);
+				_mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), Encrypt(k, ctr.Next())));
+			}
+
+			ctr.Export(pCounter);
+		}
+
+#undef BEAM_AES_NI
+	};
+
+	struct Vaes
+	{
+		// same as AesNi::XCrypt, 2 blocks per ymm register
+		static const uint32_t s_Batch = 8;
+
+#define BEAM_AES_VAES BEAM_AES_TARGET("vaes,avx2,aes,sse4.1,ssse3")
+
+		BEAM_AES_VAES static void XCrypt(const AES::Encoder& enc, uint8_t* pCounter, uint8_t* pBuf, uint32_t nBlocks)
+		{
+			const uint32_t nRegs = s_Batch / 2;
+
+			AesNi::Keys k(enc);
+			__m256i pK[AES::Nr + 1];
+			for (int i = 0; i <= AES::Nr; i++)
+				pK[i] = _mm256_broadcastsi128_si256(k.m_p[i]);
+
+			AesNi::Counter ctr(pCounter);
+
+			for (; nBlocks >= s_Batch; nBlocks -= s_Batch)
+			{
+				__m256i pX[nRegs];
+				for (uint32_t i = 0; i < nRegs; i++)
+				{
+					__m128i x0 = ctr.Next();
+					__m128i x1 = ctr.Next();
+					pX[i] = _mm256_xor_si256(_mm256_set_m128i(x1, x0), pK[0]);
+				}
+
+				for (int iRound = 1; iRound < AES::Nr; iRound++)
+					for (uint32_t i = 0; i < nRegs; i++)
+						pX[i] = _mm256_aesenc_epi128(pX[i], pK[iRound]);
+
+				for (uint32_t i = 0; i < nRegs; i++)
+				{
+					__m256i* p = reinterpret_cast<__m256i*>(pBuf) + i;
+					pX[i] = _mm256_aesenclast_epi128(pX[i], pK[AES::Nr]);
+					_mm256_storeu_si256(p, _mm256_xor_si256(_mm256_loadu_si256(p), pX[i]));
+				}
+
+				pBuf += s_Batch * AES::s_BlockSize;
+			}
+
+			ctr.Export(pCounter);
+
+			if (nBlocks)
+				AesNi::XCrypt(enc, pCounter, pBuf, nBlocks);
+		}
+
+#undef BEAM_AES_VAES
+	};
+
+} // namespace
+
+#else // BEAM_AES_X86
+
+namespace {
+
+	uint32_t DetectCaps()
+	{
+		return 0;
+	}
+
+} // namespace
+
+#endif // BEAM_AES_X86
+
+namespace {
+
+	uint32_t& get_CapsRef()
+	{
+		static uint32_t s_Caps = DetectCaps();
+		return s_Caps;
+	}
+
+} // namespace
+
+uint32_t AES::get_Caps()
+{
+	return get_CapsRef();
+}
+
+void AES::set_Caps(uint32_t nCaps)
+{
+	get_CapsRef() = nCaps & (DetectCaps() | Caps::Table);
+}
+
+namespace {
+
+	// Constant-time software AES (bitsliced). No secret-dependent memory accesses or branches.
+	// Up to s_Batch blocks are processed at once: the state is kept as 8 bit planes (word i holds bit i of every byte),
+	// each block occupies a 16-bit lane, the state byte k (row k%4, column k/4) is at bit k of the lane.
+	struct AesCt
+	{
+		typedef uint64_t Word;
+		static const uint32_t s_Batch = 4;
+
+		struct State
+		{
+			Word m_p[8];
+		};
+
+		// S-box circuit by J.Boyar and R.Peralta, "A new combinational logic minimization technique with applications to cryptology"
+		// https://eprint.iacr.org/2009/191.pdf. Inputs x0..x7 and outputs s0..s7 are numbered from the high bit.
+		static void SubBytes(State& st)
+		{
+			Word* q = st.m_p;
+
+			const Word x0 = q[7], x1 = q[6], x2 = q[5], x3 = q[4], x4 = q[3], x5 = q[2], x6 = q[1], x7 = q[0];
+
+			// top linear transformation
+			const Word y14 = x3 ^ x5;
+			const Word y13 = x0 ^ x6;
+			const Word y9 = x0 ^ x3;
+			const Word y8 = x0 ^ x5;
+			const Word t0 = x1 ^ x2;
+			const Word y1 = t0 ^ x7;
+			const Word y4 = y1 ^ x3;
+			const Word y12 = y13 ^ y14;
+			const Word y2 = y1 ^ x0;
+			const Word y5 = y1 ^ x6;
+			const Word y3 = y5 ^ y8;
+			const Word t1 = x4 ^ y12;
+			const Word y15 = t1 ^ x5;
+			const Word y20 = t1 ^ x1;
+			const Word y6 = y15 ^ x7;
+			const Word y10 = y15 ^ t0;
+			const Word y11 = y20 ^ y9;
+			const Word y7 = x7 ^ y11;
+			const Word y17 = y10 ^ y11;
+			const Word y19 = y10 ^ y8;
+			const Word y16 = t0 ^ y11;
+			const Word y21 = y13 ^ y16;
+			const Word y18 = x0 ^ y16;
+
+			// non-linear section
+			const Word t2 = y12 & y15;
+			const Word t3 = y3 & y6;
+			const Word t4 = t3 ^ t2;
+			const Word t5 = y4 & x7;
+			const Word t6 = t5 ^ t2;
+			const Word t7 = y13 & y16;
+			const Word t8 = y5 & y1;
+			const Word t9 = t8 ^ t7;
+			const Word t10 = y2 & y7;
+			const Word t11 = t10 ^ t7;
+			const Word t12 = y9 & y11;
+			const Word t13 = y14 & y17;
+			const Word t14 = t13 ^ t12;
+			const Word t15 = y8 & y10;
+			const Word t16 = t15 ^ t12;
+			const Word t17 = t4 ^ t14;
+			const Word t18 = t6 ^ t16;
+			const Word t19 = t9 ^ t14;
+			const Word t20 = t11 ^ t16;
+			const Word t21 = t17 ^ y20;
+			const Word t22 = t18 ^ y19;
+			const Word t23 = t19 ^ y21;
+			const Word t24 = t20 ^ y18;
+
+			const Word t25 = t21 ^ t22;
+			const Word t26 = t21 & t23;
+			const Word t27 = t24 ^ t26;
+			const Word t28 = t25 & t27;
+			const Word t29 = t28 ^ t22;
+			const Word t30 = t23 ^ t24;
+			const Word t31 = t22 ^ t26;
+			const Word t32 = t31 & t30;
+			const Word t33 = t32 ^ t24;
+			const Word t34 = t23 ^ t33;
+			const Word t35 = t27 ^ t33;
+			const Word t36 = t24 & t35;
+			const Word t37 = t36 ^ t34;
+			const Word t38 = t27 ^ t36;
+			const Word t39 = t29 & t38;
+			const Word t40 = t25 ^ t39;
+
+			const Word t41 = t40 ^ t37;
+			const Word t42 = t29 ^ t33;
+			const Word t43 = t29 ^ t40;
+			const Word t44 = t33 ^ t37;
+			const Word t45 = t42 ^ t41;
+			const Word z0 = t44 & y15;
+			const Word z1 = t37 & y6;
+			const Word z2 = t33 & x7;
+			const Word z3 = t43 & y16;
+			const Word z4 = t40 & y1;
+			const Word z5 = t29 & y7;
+			const Word z6 = t42 & y11;
+			const Word z7 = t45 & y17;
+			const Word z8 = t41 & y10;
+			const Word z9 = t44 & y12;
+			const Word z10 = t37 & y3;
+			const Word z11 = t33 & y4;
+			const Word z12 = t43 & y13;
+			const Word z13 = t40 & y5;
+			const Word z14 = t29 & y2;
+			const Word z15 = t42 & y9;
+			const Word z16 = t45 & y14;
+			const Word z17 = t41 & y8;
+
+			// bottom linear transformation
+			const Word t46 = z15 ^ z16;
+			const Word t47 = z10 ^ z11;
+			const Word t48 = z5 ^ z13;
+			const Word t49 = z9 ^ z10;
+			const Word t50 = z2 ^ z12;
+			const Word t51 = z2 ^ z5;
+			const Word t52 = z7 ^ z8;
+			const Word t53 = z0 ^ z3;
+			const Word t54 = z6 ^ z7;
+			const Word t55 = z16 ^ z17;
+			const Word t56 = z12 ^ t48;
+			const Word t57 = t50 ^ t53;
+			const Word t58 = z4 ^ t46;
+			const Word t59 = z3 ^ t54;
+			const Word t60 = t46 ^ t57;
+			const Word t61 = z14 ^ t57;
+			const Word t62 = t52 ^ t58;
+			const Word t63 = t49 ^ t58;
+			const Word t64 = z4 ^ t59;
+			const Word t65 = t61 ^ t62;
+			const Word t66 = z1 ^ t63;
+			const Word s0 = t59 ^ t63;
+			const Word s6 = t56 ^ ~t62;
+			const Word s7 = t48 ^ ~t60;
+			const Word t67 = t64 ^ t65;
+			const Word s3 = t53 ^ t66;
+			const Word s4 = t51 ^ t66;
+			const Word s5 = t47 ^ t65;
+			const Word s1 = t64 ^ ~s3;
+			const Word s2 = t55 ^ ~t67;
+
+			q[7] = s0;
+			q[6] = s1;
+			q[5] = s2;
+			q[4] = s3;
+			q[3] = s4;
+			q[2] = s5;
+			q[1] = s6;
+			q[0] = s7;
+		}
+
+		// row r is rotated left by r columns, i.e. each 16-bit lane by 4*r bits
+		static void ShiftRows(State& st)
+		{
+			for (int i = 0; i < 8; i++)
+			{
+				Word x = st.m_p[i];
+				st.m_p[i] =
+					(x & 0x1111111111111111ull) |
+					((x >> 4) & 0x0222022202220222ull) | ((x << 12) & 0x2000200020002000ull) |
+					((x >> 8) & 0x0044004400440044ull) | ((x << 8) & 0x4400440044004400ull) |
+					((x >> 12) & 0x0008000800080008ull) | ((x << 4) & 0x8880888088808880ull);
+			}
+		}
+
+		// rotate the rows within each column (4-bit group) by 1 or 2
+		static Word RotRow1(Word x)
+		{
+			return ((x >> 1) & 0x7777777777777777ull) | ((x << 3) & 0x8888888888888888ull);
+		}
+
+		static Word RotRow2(Word x)
+		{
+			return ((x >> 2) & 0x3333333333333333ull) | ((x << 2) & 0xccccccccccccccccull);
+		}
+
+		// b[r] = 2*(a[r] ^ a[r+1]) ^ a[r+1] ^ a[r+2] ^ a[r+3]
+		static void MixColumns(State& st)
+		{
+			Word* q = st.m_p;
+			Word pY[8], pZ[8];
+
+			for (int i = 0; i < 8; i++)
+			{
+				pY[i] = RotRow1(q[i]);
+				pZ[i] = q[i] ^ pY[i];
+				q[i] = pY[i] ^ RotRow2(pZ[i]);
+			}
+
+			// multiplication by x modulo x^8 + x^4 + x^3 + x + 1
+			q[0] ^= pZ[7];
+			q[1] ^= pZ[0] ^ pZ[7];
+			q[2] ^= pZ[1];
+			q[3] ^= pZ[2] ^ pZ[7];
+			q[4] ^= pZ[3] ^ pZ[7];
+			q[5] ^= pZ[4];
+			q[6] ^= pZ[5];
+			q[7] ^= pZ[6];
+		}
+
+		static void AddRoundKey(State& st, const State& k)
+		{
+			for (int i = 0; i < 8; i++)
+				st.m_p[i] ^= k.m_p[i];
+		}
+
+		// 8x8 bit matrix transpose: bit i of byte j <-> bit j of byte i
+		static Word Transpose8(Word x)
+		{
+			Word t;
+			t = (x ^ (x >> 7)) & 0x00aa00aa00aa00aaull; x ^= t ^ (t << 7);
+			t = (x ^ (x >> 14)) & 0x0000cccc0000ccccull; x ^= t ^ (t << 14);
+			t = (x ^ (x >> 28)) & 0x00000000f0f0f0f0ull; x ^= t ^ (t << 28);
+			return x;
+		}
+
+		static void Load(State& st, const uint8_t* p, uint32_t nBlocks)
+		{
+			assert(nBlocks <= s_Batch);
+			memset0(st.m_p, sizeof(st.m_p));
+
+			for (uint32_t iBlock = 0; iBlock < nBlocks; iBlock++, p += AES::s_BlockSize)
+			{
+				Word lo = 0, hi = 0;
+				for (int i = 0; i < 8; i++)
+				{
+					lo |= Word(p[i]) << (i << 3);
+					hi |= Word(p[i + 8]) << (i << 3);
+				}
+
+				lo = Transpose8(lo);
+				hi = Transpose8(hi);
+
+				for (int i = 0; i < 8; i++)
+					st.m_p[i] |= (((lo >> (i << 3)) & 0xff) | (((hi >> (i << 3)) & 0xff) << 8)) << (iBlock << 4);
+			}
+		}
+
+		static void Store(uint8_t* p, const State& st, uint32_t nBlocks)
+		{
+			assert(nBlocks <= s_Batch);
+
+			for (uint32_t iBlock = 0; iBlock < nBlocks; iBlock++, p += AES::s_BlockSize)
+			{
+				Word lo = 0, hi = 0;
+				for (int i = 0; i < 8; i++)
+				{
+					Word x = st.m_p[i] >> (iBlock << 4);
+					lo |= (x & 0xff) << (i << 3);
+					hi |= ((x >> 8) & 0xff) << (i << 3);
+				}
+
+				lo = Transpose8(lo);
+				hi = Transpose8(hi);
+
+				for (int i = 0; i < 8; i++)
+				{
+					p[i] = static_cast<uint8_t>(lo >> (i << 3));
+					p[i + 8] = static_cast<uint8_t>(hi >> (i << 3));
+				}
+			}
+		}
+
+		struct Keys
+		{
+			State m_p[AES::Nr + 1];
+
+			Keys(const AES::Encoder& enc)
+			{
+				for (int i = 0; i <= AES::Nr; i++)
+				{
+					uint8_t pBuf[AES::s_BlockSize];
+					for (int j = 0; j < 4; j++)
+						PutBE(pBuf + (j << 2), enc.m_erk[(i << 2) + j]);
+
+					State& st = m_p[i];
+					Load(st, pBuf, 1);
+
+					// same key for all the lanes
+					for (int j = 0; j < 8; j++)
+					{
+						st.m_p[j] |= st.m_p[j] << 16;
+						st.m_p[j] |= st.m_p[j] << 32;
+					}
+				}
+			}
+		};
+
+		static void Encrypt(State& st, const Keys& k)
+		{
+			AddRoundKey(st, k.m_p[0]);
+
+			for (int i = 1; i < AES::Nr; i++)
+			{
+				SubBytes(st);
+				ShiftRows(st);
+				MixColumns(st);
+				AddRoundKey(st, k.m_p[i]);
+			}
+
+			SubBytes(st);
+			ShiftRows(st);
+			AddRoundKey(st, k.m_p[AES::Nr]);
+		}
+
+		static void Proceed(const AES::Encoder& enc, uint8_t* pDst, const uint8_t* pSrc)
+		{
+			Keys k(enc);
+			State st;
+			Load(st, pSrc, 1);
+			Encrypt(st, k);
+			Store(pDst, st, 1);
+		}
+
+		static void XCrypt(const AES::Encoder& enc, beam::uintBig_t<AES::s_BlockSize>& ctr, uint8_t* pBuf, uint32_t nBlocks)
+		{
+			Keys k(enc);
+
+			while (nBlocks)
+			{
+				uint32_t n = std::min(nBlocks, s_Batch);
+
+				uint8_t pTmp[AES::s_BlockSize * s_Batch];
+				for (uint32_t i = 0; i < n; i++)
+				{
+					memcpy(pTmp + i * AES::s_BlockSize, ctr.m_pData, AES::s_BlockSize);
+					ctr.Inc();
+				}
+
+				State st;
+				Load(st, pTmp, n);
+				Encrypt(st, k);
+				Store(pTmp, st, n);
+
+				memxor(pBuf, pTmp, n * AES::s_BlockSize);
+
+				pBuf += n * AES::s_BlockSize;
+				nBlocks -= n;
+			}
+		}
+
+		// S-box applied to each byte of the word, for the key schedule
+		static uint32_t SubWord(uint32_t x)
+		{
+			State st;
+			for (int i = 0; i < 8; i++)
+			{
+				st.m_p[i] = 0;
+				for (int j = 0; j < 4; j++)
+					st.m_p[i] |= Word((x >> ((j << 3) + i)) & 1) << j;
+			}
+
+			SubBytes(st);
+
+			uint32_t ret = 0;
+			for (int i = 0; i < 8; i++)
+				for (int j = 0; j < 4; j++)
+					ret |= uint32_t((st.m_p[i] >> j) & 1) << ((j << 3) + i);
+
+			return ret;
+		}
+
+		static void PutBE(uint8_t* p, uint32_t x)
+		{
+			PUT_UINT32(x, p, 0);
+		}
+	};
+
+} // namespace
+
 /* AES key scheduling routine */
 
 
@@ -456,24 +1057,17 @@ void AES::Encoder::Init(const uint8_t* pKey)
 	}
 
 	/* setup encryption round keys */
+	// the S-box is evaluated by the bitsliced circuit, no key-dependent table lookups
 
 	for (i = 0; i < 7; i++, RK += 8)
 	{
-		RK[8] = RK[0] ^ RCON[i] ^
-			(FSb[(uint8_t)(RK[7] >> 16)] << 24) ^
-			(FSb[(uint8_t)(RK[7] >> 8)] << 16) ^
-			(FSb[(uint8_t)(RK[7])] << 8) ^
-			(FSb[(uint8_t)(RK[7] >> 24)]);
+		RK[8] = RK[0] ^ RCON[i] ^ AesCt::SubWord((RK[7] << 8) | (RK[7] >> 24));
 
 		RK[9] = RK[1] ^ RK[8];
 		RK[10] = RK[2] ^ RK[9];
 		RK[11] = RK[3] ^ RK[10];
 
-		RK[12] = RK[4] ^
-			(FSb[(uint8_t)(RK[11] >> 24)] << 24) ^
-			(FSb[(uint8_t)(RK[11] >> 16)] << 16) ^
-			(FSb[(uint8_t)(RK[11] >> 8)] << 8) ^
-			(FSb[(uint8_t)(RK[11])]);
+		RK[12] = RK[4] ^ AesCt::SubWord(RK[11]);
 
 		RK[13] = RK[5] ^ RK[12];
 		RK[14] = RK[6] ^ RK[13];
@@ -545,6 +1139,21 @@ void AES::Decoder::Init(const Encoder& enc)
 
 void AES::Encoder::Proceed(uint8_t* pDst, const uint8_t* pSrc) const
 {
+#ifdef BEAM_AES_X86
+	if (Caps::AesNi & get_Caps())
+	{
+		AesNi::Proceed(*this, pDst, pSrc);
+		return;
+	}
+#endif // BEAM_AES_X86
+
+	if (!(Caps::Table & get_Caps()))
+	{
+		AesCt::Proceed(*this, pDst, pSrc);
+		return;
+	}
+
+	// Table-based path, opt-in only (Caps::Table). Note: it's not constant-time, the table lookups depend on the key and the data
 	uint32_t X0, X1, X2, X3, Y0, Y1, Y2, Y3;
 
 	const uint32_t* RK = m_erk;
@@ -824,25 +1433,69 @@ void AES::StreamCipher::PerfXor(uint8_t* pBuf, uint32_t nSize)
 
 void AES::StreamCipher::XCrypt(const Encoder& enc, uint8_t* pBuf, uint32_t nSize)
 {
-	while (true)
+	if (m_nBuf)
 	{
-		if (!m_nBuf)
-		{
-			enc.Proceed(m_pBuf, m_Counter.m_pData);
-			m_nBuf = _countof(m_pBuf);
-			m_Counter.Inc();
-		}
-
-		if (m_nBuf >= nSize)
-		{
-			PerfXor(pBuf, nSize);
-			break;
-		}
-
-		uint8_t n = m_nBuf;
-		PerfXor(pBuf, m_nBuf);
+		// remaining part of the already generated cipherstream
+		uint8_t n = (m_nBuf >= nSize) ? static_cast<uint8_t>(nSize) : m_nBuf;
+		PerfXor(pBuf, n);
 
 		pBuf += n;
 		nSize -= n;
 	}
+
+	uint32_t nBlocks = nSize / s_BlockSize;
+	if (nBlocks)
+	{
+		XCryptBlocks(enc, pBuf, nBlocks);
+
+		pBuf += nBlocks * s_BlockSize;
+		nSize -= nBlocks * s_BlockSize;
+	}
+
+	if (nSize)
+	{
+		assert(!m_nBuf);
+
+		enc.Proceed(m_pBuf, m_Counter.m_pData);
+		m_nBuf = _countof(m_pBuf);
+		m_Counter.Inc();
+
+		PerfXor(pBuf, nSize);
+	}
+}
+
+void AES::StreamCipher::XCryptBlocks(const Encoder& enc, uint8_t* pBuf, uint32_t nBlocks)
+{
+	assert(!m_nBuf);
+
+	const uint32_t nCaps = get_Caps();
+
+#ifdef BEAM_AES_X86
+	if (Caps::Vaes & nCaps)
+	{
+		Vaes::XCrypt(enc, m_Counter.m_pData, pBuf, nBlocks);
+		return;
+	}
+
+	if (Caps::AesNi & nCaps)
+	{
+		AesNi::XCrypt(enc, m_Counter.m_pData, pBuf, nBlocks);
+		return;
+	}
+#endif // BEAM_AES_X86
+
+	if (!(Caps::Table & nCaps))
+	{
+		AesCt::XCrypt(enc, m_Counter, pBuf, nBlocks);
+		return;
+	}
+
+	for (; nBlocks--; pBuf += s_BlockSize)
+	{
+		uint8_t pTmp[s_BlockSize];
+		enc.Proceed(pTmp, m_Counter.m_pData);
+		m_Counter.Inc();
+
+		memxor(pBuf, pTmp, s_BlockSize);
+	}
 }
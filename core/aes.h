@@ -8,6 +8,16 @@ struct AES
 	static const int Nr = 14; // num-rounds
 	static const int s_BlockSize = 16;
 
+	struct Caps
+	{
+		static const uint32_t AesNi = 1; // x86 AES instructions
+		static const uint32_t Vaes = 2; // AVX2-wide AES instructions, used for CTR only
+		static const uint32_t Table = 4; // opt-in: table-based software path instead of the bitsliced one. Faster, but NOT constant-time
+	};
+
+	static uint32_t get_Caps();
+	static void set_Caps(uint32_t); // can only restrict the detected caps (Table is the only opt-in). For tests and benchmarks
+
 	struct Encoder
 	{
 		uint32_t m_erk[64]; // encryption round keys. Actually needed 60, but during init extra space is used
@@ -34,6 +44,9 @@ struct AES
 
 		void Reset();
 		void XCrypt(const Encoder&, uint8_t* pBuf, uint32_t nSize);
+
+	private:
+		void XCryptBlocks(const Encoder&, uint8_t* pBuf, uint32_t nBlocks);
 	};
 
 };
@@ -2817,6 +2817,12 @@ namespace beam
 		return ret ? ret : 1;
 	}
 
+	uint64_t GetTime_us()
+	{
+		using namespace std::chrono;
+		return (uint64_t) duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+	}
+
 	/////////////
 	// Asset
 	const PeerID Asset::s_InvalidOwnerID = Zero;
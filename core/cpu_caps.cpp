@@ -0,0 +1,106 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_caps.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#	define BEAM_CPU_X86
+#	ifdef _MSC_VER
+#		include <intrin.h>
+#		include <immintrin.h>
+#	else // _MSC_VER
+#		include <cpuid.h>
+#	endif // _MSC_VER
+#endif // x86
+
+namespace {
+
+#ifdef BEAM_CPU_X86
+
+	void CpuId(uint32_t* pRegs, uint32_t nLeaf, uint32_t nSubLeaf)
+	{
+#ifdef _MSC_VER
+		__cpuidex(reinterpret_cast<int*>(pRegs), nLeaf, nSubLeaf);
+#else // _MSC_VER
+		__cpuid_count(nLeaf, nSubLeaf, pRegs[0], pRegs[1], pRegs[2], pRegs[3]);
+#endif // _MSC_VER
+	}
+
+	uint64_t XGetBv()
+	{
+#ifdef _MSC_VER
+		return _xgetbv(0);
+#else // _MSC_VER
+		uint32_t a, d;
+		__asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+		return (uint64_t(d) << 32) | a;
+#endif // _MSC_VER
+	}
+
+	uint32_t DetectCaps()
+	{
+		uint32_t pRegs[4]; // eax, ebx, ecx, edx
+		CpuId(pRegs, 0, 0);
+		const uint32_t nMaxLeaf = pRegs[0];
+		if (nMaxLeaf < 1)
+			return 0;
+
+		uint32_t nRet = 0;
+
+		CpuId(pRegs, 1, 0);
+		if (pRegs[2] & (1U << 9))
+			nRet |= CpuCaps::Ssse3;
+		if (pRegs[2] & (1U << 19))
+			nRet |= CpuCaps::Sse41;
+		if (pRegs[2] & (1U << 25))
+			nRet |= CpuCaps::AesNi;
+
+		const bool bOsXSave = !!(pRegs[2] & (1U << 27));
+		const bool bAvx = !!(pRegs[2] & (1U << 28));
+
+		if (nMaxLeaf < 7)
+			return nRet;
+
+		CpuId(pRegs, 7, 0);
+		if (pRegs[1] & (1U << 29))
+			nRet |= CpuCaps::ShaNi;
+
+		// the ymm-wide extensions also need the OS to preserve the ymm registers
+		if (bOsXSave && bAvx && ((XGetBv() & 6) == 6))
+		{
+			if (pRegs[1] & (1U << 5))
+				nRet |= CpuCaps::Avx2;
+			if (pRegs[2] & (1U << 9))
+				nRet |= CpuCaps::Vaes;
+		}
+
+		return nRet;
+	}
+
+#else // BEAM_CPU_X86
+
+	uint32_t DetectCaps()
+	{
+		return 0;
+	}
+
+#endif // BEAM_CPU_X86
+
+} // namespace
+
+uint32_t CpuCaps::get()
+{
+	static const uint32_t s_Caps = DetectCaps();
+	return s_Caps;
+}
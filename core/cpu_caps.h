@@ -0,0 +1,31 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <stdint.h>
+
+struct CpuCaps
+{
+	// x86 instruction set extensions used by the crypto primitives. Detected once, at the first call.
+	// Always 0 on other architectures.
+
+	static const uint32_t Ssse3 = 1;
+	static const uint32_t Sse41 = 2;
+	static const uint32_t AesNi = 4;
+	static const uint32_t ShaNi = 8;
+	static const uint32_t Avx2 = 0x10; // only if the OS preserves the ymm registers
+	static const uint32_t Vaes = 0x20; // same
+
+	static uint32_t get();
+};
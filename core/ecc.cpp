@@ -14,6 +14,7 @@
 
 #include "common.h"
 #include "ecc_native.h"
+#include "sha256.h"
 
 #if defined(__clang__) || defined(__GNUC__) || defined(__GNUG__)
 #	pragma GCC diagnostic push
@@ -370,14 +371,68 @@ namespace ECC {
 	void Hash::Processor::Write(const void* p, uint32_t n)
 	{
 		assert(m_bInitialized);
-		secp256k1_sha256_write(this, (const uint8_t*) p, n);
+
+		// same as secp256k1_sha256_write, but whole blocks are processed directly from the source, by the fastest available Sha256 implementation
+		const uint8_t* pSrc = reinterpret_cast<const uint8_t*>(p);
+		uint8_t* pBuf = reinterpret_cast<uint8_t*>(buf);
+
+		uint32_t nBuf = static_cast<uint32_t>(bytes % Sha256::s_BlockSize);
+		bytes += n;
+
+		if (nBuf)
+		{
+			uint32_t nFill = Sha256::s_BlockSize - nBuf;
+			if (n < nFill)
+			{
+				memcpy(pBuf + nBuf, pSrc, n);
+				return;
+			}
+
+			memcpy(pBuf + nBuf, pSrc, nFill);
+			Sha256::Transform(s, pBuf, 1);
+
+			pSrc += nFill;
+			n -= nFill;
+		}
+
+		uint32_t nBlocks = n / Sha256::s_BlockSize;
+		if (nBlocks)
+		{
+			Sha256::Transform(s, pSrc, nBlocks);
+
+			pSrc += nBlocks * Sha256::s_BlockSize;
+			n -= nBlocks * Sha256::s_BlockSize;
+		}
+
+		if (n)
+			memcpy(pBuf, pSrc, n);
 	}
 
 	void Hash::Processor::Finalize(Value& v)
 	{
 		assert(m_bInitialized);
-		secp256k1_sha256_finalize(this, v.m_pData);
-		
+
+		uint64_t nBits = static_cast<uint64_t>(bytes) << 3;
+
+		static const uint8_t s_pPad[Sha256::s_BlockSize] = { 0x80 };
+		Write(s_pPad, 1 + ((119 - static_cast<uint32_t>(bytes % Sha256::s_BlockSize)) % Sha256::s_BlockSize));
+
+		uint8_t pSize[sizeof(nBits)];
+		for (uint32_t i = 0; i < sizeof(nBits); i++)
+			pSize[i] = static_cast<uint8_t>(nBits >> ((sizeof(nBits) - 1 - i) << 3));
+		Write(pSize, sizeof(pSize));
+
+		static_assert(sizeof(s) == Value::nBytes, "");
+		for (uint32_t i = 0; i < _countof(s); i++)
+		{
+			uint8_t* pDst = v.m_pData + (i << 2);
+			pDst[0] = static_cast<uint8_t>(s[i] >> 24);
+			pDst[1] = static_cast<uint8_t>(s[i] >> 16);
+			pDst[2] = static_cast<uint8_t>(s[i] >> 8);
+			pDst[3] = static_cast<uint8_t>(s[i]);
+		}
+
+		ZeroObject(s);
 		m_bInitialized = false;
 	}
 
@@ -1684,6 +1739,125 @@ namespace ECC {
 	}
 
 
+	/////////////////////
+	// MultiMac_Buckets
+	MultiMac_Buckets::MultiMac_Buckets()
+	{
+		m_Batch.m_Size = 0;
+	}
+
+	void MultiMac_Buckets::Reset(uint32_t nMax)
+	{
+		m_vPts.clear();
+		m_vPts.reserve(nMax);
+		m_Batch.m_Size = 0;
+	}
+
+	void MultiMac_Buckets::Add(const Point::Native& pt)
+	{
+		uint32_t iIdx = get_Count();
+		m_vPts.emplace_back();
+
+		if (pt == Zero)
+		{
+			// can't be normalized
+			ZeroObject(m_vPts.back());
+			m_vPts.back().infinity = 1;
+			return;
+		}
+
+		if (m_Batch.m_Size == s_Batch)
+			FlushBatch();
+
+		m_pBatchIdx[m_Batch.m_Size] = iIdx;
+		m_Batch.m_pPts[m_Batch.m_Size] = pt;
+		m_Batch.m_Size++;
+	}
+
+	void MultiMac_Buckets::FlushBatch()
+	{
+		m_Batch.Normalize();
+
+		for (uint32_t i = 0; i < m_Batch.m_Size; i++)
+			m_Batch.get_As(m_vPts[m_pBatchIdx[i]], m_Batch.m_pPts[i]);
+
+		m_Batch.m_Size = 0;
+	}
+
+	uint32_t MultiMac_Buckets::get_WndBits(uint32_t nCount)
+	{
+		// estimated cost in point additions: nWnds * (nCount + 2 * nBuckets). Doublings are the same for all window sizes
+		uint32_t nRes = 1;
+		uint64_t nCostMin = static_cast<uint64_t>(-1);
+
+		for (uint32_t nWndBits = 1; nWndBits <= s_MaxWndBits; nWndBits++)
+		{
+			uint32_t nWnds = (nBits + nWndBits - 1) / nWndBits;
+			uint64_t nCost = static_cast<uint64_t>(nWnds) * (static_cast<uint64_t>(nCount) + (2ULL << nWndBits));
+
+			if (nCost < nCostMin)
+			{
+				nCostMin = nCost;
+				nRes = nWndBits;
+			}
+		}
+
+		return nRes;
+	}
+
+	void MultiMac_Buckets::Calculate(Point::Native& res, const Scalar::Native* pK)
+	{
+		FlushBatch();
+
+		res = Zero;
+
+		const uint32_t nCount = get_Count();
+		if (!nCount)
+			return;
+
+		const uint32_t nWndBits = get_WndBits(nCount);
+		m_vBuckets.resize((1U << nWndBits) - 1); // digit 0 needs no bucket
+
+		Point::Native ptSum, ptWnd;
+
+		for (uint32_t iBit = ((nBits - 1) / nWndBits) * nWndBits; ; iBit -= nWndBits)
+		{
+			const uint32_t nBitsWnd = std::min(nWndBits, nBits - iBit); // the most significant window may be shorter
+			const uint32_t nBuckets = (1U << nBitsWnd) - 1;
+
+			for (uint32_t i = 0; i < nBuckets; i++)
+				m_vBuckets[i] = Zero;
+
+			for (uint32_t i = 0; i < nCount; i++)
+			{
+				uint32_t nDigit = secp256k1_scalar_get_bits_var(&pK[i].get(), iBit, nBitsWnd);
+				if (nDigit)
+				{
+					secp256k1_gej& gej = m_vBuckets[nDigit - 1].get_Raw();
+					secp256k1_gej_add_ge_var(&gej, &gej, &m_vPts[i], nullptr);
+				}
+			}
+
+			// sum(i * bucket[i]), via running sums from the top
+			ptSum = Zero;
+			ptWnd = Zero;
+
+			for (uint32_t i = nBuckets; i--; )
+			{
+				secp256k1_gej_add_var(&ptSum.get_Raw(), &ptSum.get_Raw(), &m_vBuckets[i].get_Raw(), nullptr);
+				secp256k1_gej_add_var(&ptWnd.get_Raw(), &ptWnd.get_Raw(), &ptSum.get_Raw(), nullptr);
+			}
+
+			secp256k1_gej_add_var(&res.get_Raw(), &res.get_Raw(), &ptWnd.get_Raw(), nullptr);
+
+			if (!iBit)
+				break;
+
+			for (uint32_t i = 0; i < nWndBits; i++)
+				secp256k1_gej_double_var(&res.get_Raw(), &res.get_Raw(), nullptr);
+		}
+	}
+
 	/////////////////////
 	// ScalarGenerator
 	void ScalarGenerator::Initialize(const Scalar::Native& x)
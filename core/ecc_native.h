@@ -456,6 +456,36 @@ namespace ECC
 		void Prepare(uint32_t nMaxCasual, uint32_t nMaxPrepared);
 	};
 
+	struct MultiMac_Buckets
+	{
+		// Bucket (Pippenger) multi-exponentiation of casual points.
+		// The cost per point is roughly (nBits / w) additions, w grows with the number of points, whereas MultiMac needs ~nBits/5 additions per point.
+		// Variable-time, should only be used for verification.
+		static const uint32_t s_MinCount = 512; // below this MultiMac is faster
+		static const uint32_t s_MaxWndBits = 16;
+
+		MultiMac_Buckets();
+
+		void Reset(uint32_t nMax);
+		void Add(const Point::Native&); // normalization is deferred
+		uint32_t get_Count() const { return static_cast<uint32_t>(m_vPts.size()); }
+
+		void Calculate(Point::Native& res, const Scalar::Native* pK);
+
+		static uint32_t get_WndBits(uint32_t nCount);
+
+	private:
+		static const uint32_t s_Batch = 0x100;
+
+		std::vector<secp256k1_ge> m_vPts; // affine
+		std::vector<Point::Native> m_vBuckets;
+
+		Point::Native::BatchNormalizer_Arr_T<s_Batch> m_Batch;
+		uint32_t m_pBatchIdx[s_Batch];
+
+		void FlushBatch();
+	};
+
 	struct ScalarGenerator
 	{
 		// needed to quickly calculate power of a predefined scalar.
@@ -102,17 +102,25 @@ struct CommitmentStd
 	}
 };
 
+bool CmList::get_AtNative(Point::Native& res, uint32_t iIdx)
+{
+	Point::Storage pt_s;
+	if (!get_At(pt_s, iIdx))
+		return false;
+
+	res.Import(pt_s, false);
+	return true;
+}
+
 void CmList::Import(MultiMac& mm, uint32_t iPos, uint32_t nCount)
 {
 	Point::Native comm;
 
 	for (mm.Reset(); static_cast<uint32_t>(mm.m_Casual) < nCount; mm.m_Casual++)
 	{
-		Point::Storage pt_s;
-		if (!get_At(pt_s, iPos + mm.m_Casual))
+		if (!get_AtNative(comm, iPos + mm.m_Casual))
 			break;
 
-		comm.Import(pt_s, false);
 		mm.m_pCasual[mm.m_Casual].Init(comm);
 	}
 }
@@ -121,6 +129,24 @@ void CmList::Calculate(Point::Native& res, uint32_t iPos, uint32_t nCount, const
 {
 	Mode::Scope scope(Mode::Fast);
 
+	if (nCount >= MultiMac_Buckets::s_MinCount)
+	{
+		MultiMac_Buckets mmb;
+		mmb.Reset(nCount);
+
+		Point::Native comm;
+		for (uint32_t i = 0; i < nCount; i++)
+		{
+			if (!get_AtNative(comm, iPos + i))
+				break;
+			mmb.Add(comm);
+		}
+
+		mmb.Calculate(comm, pKs + iPos);
+		res += comm;
+		return;
+	}
+
 	const uint32_t nSizeNaggle = 128;
 	MultiMac_WithBufs<nSizeNaggle, 1> mm;
 
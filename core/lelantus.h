@@ -21,6 +21,7 @@ namespace Sigma {
 	struct CmList
 	{
 		virtual bool get_At(ECC::Point::Storage&, uint32_t iIdx) = 0;
+		virtual bool get_AtNative(ECC::Point::Native&, uint32_t iIdx); // override if the points are available in native form
 
 		void Import(ECC::MultiMac&, uint32_t iPos, uint32_t nCount);
 		void Calculate(ECC::Point::Native&, uint32_t iPos, uint32_t nCount, const ECC::Scalar::Native* pKs);
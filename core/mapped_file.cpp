@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include "mapped_file.h"
+#include "sha256.h"
 
 #ifndef WIN32
 #	include <errno.h>
@@ -55,6 +56,9 @@ namespace beam
 
 	MappedFileRaw::MappedFileRaw()
 	{
+		m_bPrivate = false;
+		m_bReadOnly = false;
+		m_bWarmupStop = false;
 		ResetVarsFile();
 		ResetVarsMapping();
 	}
@@ -100,6 +104,7 @@ namespace beam
 
 	void MappedFileRaw::Close()
 	{
+		StopWarmup();
 		CloseMapping();
 
 #ifdef WIN32
@@ -111,6 +116,8 @@ namespace beam
 #endif // WIN32
 
 		ResetVarsFile();
+		m_bPrivate = false;
+		m_bReadOnly = false;
 	}
 
 	void MappedFileRaw::OpenMapping()
@@ -122,10 +129,11 @@ namespace beam
 		test_SysRet(!GetFileSizeEx(m_hFile, (LARGE_INTEGER*) &m_nMapping), "GetFileSizeEx");
 		if (m_nMapping)
 		{
-			m_hMapping = CreateFileMapping(m_hFile, NULL, PAGE_READWRITE, 0, 0, NULL);
+			m_hMapping = CreateFileMapping(m_hFile, NULL, m_bReadOnly ? PAGE_READONLY : PAGE_READWRITE, 0, 0, NULL);
 			test_SysRet(!m_hMapping, "CreateFileMapping");
 
-			m_pMapping = (uint8_t*) MapViewOfFile(m_hMapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, (size_t) m_nMapping);
+			DWORD dwAccess = m_bReadOnly ? FILE_MAP_READ : m_bPrivate ? FILE_MAP_COPY : (FILE_MAP_READ | FILE_MAP_WRITE);
+			m_pMapping = (uint8_t*) MapViewOfFile(m_hMapping, dwAccess, 0, 0, (size_t) m_nMapping);
 			test_SysRet(!m_pMapping, "MapViewOfFile");
 		}
 
@@ -137,17 +145,107 @@ namespace beam
 
 		if (m_nMapping)
 		{
-			uint8_t* pPtr = (uint8_t*) mmap(NULL, m_nMapping, PROT_READ | PROT_WRITE, MAP_SHARED, m_hFile, 0);
+			int nProt = m_bReadOnly ? PROT_READ : (PROT_READ | PROT_WRITE);
+			uint8_t* pPtr = (uint8_t*) mmap(NULL, m_nMapping, nProt, m_bPrivate ? MAP_PRIVATE : MAP_SHARED, m_hFile, 0);
 			test_SysRet(MAP_FAILED == pPtr, "mmap");
 
 			m_pMapping = pPtr;
 		}
 
 #endif // WIN32
+
+		ApplyAccess();
+	}
+
+	void MappedFileRaw::ApplyAccess()
+	{
+#ifndef WIN32
+		if (!m_pMapping)
+			return;
+
+		// hints only, errors are ignored
+		if (m_Access.m_Random)
+			madvise(m_pMapping, m_nMapping, MADV_RANDOM);
+
+#	ifdef MADV_HUGEPAGE
+		if (m_Access.m_HugePages)
+			madvise(m_pMapping, m_nMapping, MADV_HUGEPAGE);
+#	endif // MADV_HUGEPAGE
+#endif // WIN32
+	}
+
+	void MappedFileRaw::ReadAll()
+	{
+		std::vector<uint8_t> vBuf(0x100000);
+
+		for (Offset n = 0; !m_bWarmupStop; n += vBuf.size())
+		{
+#ifdef WIN32
+			OVERLAPPED ov;
+			ZeroObject(ov);
+			ov.Offset = (DWORD) n;
+			ov.OffsetHigh = (DWORD) (n >> 32);
+
+			DWORD dw = 0;
+			if (!ReadFile(m_hFile, &vBuf.front(), (DWORD) vBuf.size(), &dw, &ov) || (dw < vBuf.size()))
+				break;
+#else // WIN32
+			if (pread(m_hFile, &vBuf.front(), vBuf.size(), n) < (ssize_t) vBuf.size())
+				break;
+#endif // WIN32
+		}
+	}
+
+	void MappedFileRaw::Prefault()
+	{
+		StopWarmup();
+
+		switch (m_Access.m_Prefault)
+		{
+		case Access::Prefault::Sync:
+			{
+				// read the file sequentially first, page faults (especially with m_Random) are much slower
+				ReadAll();
+
+				if (!m_pMapping)
+					break;
+
+#ifdef MADV_POPULATE_READ
+				if (!madvise(m_pMapping, m_nMapping, MADV_POPULATE_READ))
+					break;
+#endif // MADV_POPULATE_READ
+
+				// read-only access, won't break copy-on-write
+				const volatile uint8_t* p = m_pMapping;
+				for (Offset n = 0; n < m_nMapping; n += s_PageSize)
+					p[n];
+			}
+			break;
+
+		case Access::Prefault::Async:
+			m_Warmup = std::thread(&MappedFileRaw::ReadAll, this);
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	void MappedFileRaw::StopWarmup()
+	{
+		if (m_Warmup.joinable())
+		{
+			m_bWarmupStop = true;
+			m_Warmup.join();
+		}
+
+		m_bWarmupStop = false;
 	}
 
 	void MappedFileRaw::Resize(Offset n)
 	{
+		assert(!m_bReadOnly);
+
 #ifdef WIN32
 		test_SysRet(!SetFilePointerEx(m_hFile, (const LARGE_INTEGER&) n, NULL, FILE_BEGIN), "SetFilePointerEx");
 		test_SysRet(!SetEndOfFile(m_hFile), "SetEndOfFile");
@@ -156,7 +254,134 @@ namespace beam
 #endif // WIN32
 	}
 
-	void MappedFileRaw::Open(const char* sz)
+	void MappedFileRaw::Grow(Offset n)
+	{
+		assert(n >= m_nMapping);
+
+#ifdef __linux__
+		if (m_bPrivate && m_pMapping)
+		{
+			Resize(n);
+
+			uint8_t* pPtr = (uint8_t*) mremap(m_pMapping, m_nMapping, n, MREMAP_MAYMOVE);
+			test_SysRet(MAP_FAILED == pPtr, "mremap");
+
+			m_pMapping = pPtr;
+			m_nMapping = n;
+
+			ApplyAccess();
+			return;
+		}
+#endif // __linux__
+
+		assert(!m_bPrivate || !m_pMapping); // remapping would lose the private pages
+
+		CloseMapping();
+		Resize(n);
+		OpenMapping();
+	}
+
+	bool MappedFileRaw::IsPrivateSupported()
+	{
+#ifdef __linux__
+		// modified pages are found via pagemap
+		return !access("/proc/self/pagemap", R_OK);
+#else // __linux__
+		return false;
+#endif // __linux__
+	}
+
+	void MappedFileRaw::get_PrivatePages(std::vector<Offset>& v) const
+	{
+		assert(m_bPrivate);
+		v.clear();
+
+#ifdef __linux__
+		int hPagemap = open("/proc/self/pagemap", O_RDONLY);
+		test_SysRet(-1 == hPagemap, "open pagemap");
+
+		Offset nPages = AlignUp(m_nMapping, s_PageSize) / s_PageSize;
+		Offset iPage0 = ((uintptr_t) m_pMapping) / s_PageSize;
+
+		uint64_t pEntry[0x200];
+		for (Offset iPage = 0; iPage < nPages; )
+		{
+			size_t nCount = (size_t) std::min<Offset>(nPages - iPage, _countof(pEntry));
+			size_t nSize = nCount * sizeof(pEntry[0]);
+
+			bool bOk = (pread(hPagemap, pEntry, nSize, (iPage0 + iPage) * sizeof(pEntry[0])) == (ssize_t) nSize);
+			if (!bOk)
+				close(hPagemap);
+			test_SysRet(!bOk, "pread pagemap");
+
+			for (size_t i = 0; i < nCount; i++, iPage++)
+			{
+				// bits: 63 - present, 62 - swapped, 61 - file page. The copied page is present and anonymous, or swapped out
+				uint64_t x = pEntry[i];
+				bool bCopied = (1 & (x >> 62)) || ((1 & (x >> 63)) && !(1 & (x >> 61)));
+				if (bCopied)
+					v.push_back(iPage * s_PageSize);
+			}
+		}
+
+		close(hPagemap);
+#endif // __linux__
+	}
+
+	void MappedFileRaw::DiscardPrivate(const Offset* pPages, size_t nPages)
+	{
+#ifdef __linux__
+		// the pages will be re-read from the file on the next access
+		for (size_t i = 0; i < nPages; )
+		{
+			size_t i0 = i;
+			for (i++; (i < nPages) && (pPages[i] == pPages[i - 1] + s_PageSize); i++)
+				;
+
+			BEAM_VERIFY(!madvise(m_pMapping + pPages[i0], (i - i0) * s_PageSize, MADV_DONTNEED));
+		}
+#endif // __linux__
+	}
+
+	void MappedFileRaw::Write(Offset n, const void* p, size_t nSize)
+	{
+		assert(!m_bReadOnly);
+
+#ifdef WIN32
+		OVERLAPPED ov;
+		ZeroObject(ov);
+		ov.Offset = (DWORD) n;
+		ov.OffsetHigh = (DWORD) (n >> 32);
+
+		DWORD dw;
+		test_SysRet(!::WriteFile(m_hFile, p, (DWORD) nSize, &dw, &ov) || (dw != nSize), "WriteFile");
+#else // WIN32
+		while (nSize)
+		{
+			ssize_t nRet = pwrite(m_hFile, p, nSize, n);
+			test_SysRet(nRet <= 0, "pwrite");
+
+			p = ((const uint8_t*) p) + nRet;
+			n += nRet;
+			nSize -= nRet;
+		}
+#endif // WIN32
+	}
+
+	void MappedFileRaw::Sync()
+	{
+#ifdef WIN32
+		if (m_pMapping && !m_bPrivate)
+			test_SysRet(!FlushViewOfFile(m_pMapping, 0), "FlushViewOfFile");
+		test_SysRet(!FlushFileBuffers(m_hFile), "FlushFileBuffers");
+#else // WIN32
+		if (m_pMapping && !m_bPrivate)
+			test_SysRet(msync(m_pMapping, m_nMapping, MS_SYNC) != 0, "msync");
+		test_SysRet(fsync(m_hFile) != 0, "fsync");
+#endif // WIN32
+	}
+
+	void MappedFileRaw::Open(const char* sz, bool bReadOnly)
 	{
 		Close();
 
@@ -172,13 +397,21 @@ namespace beam
 		}
 
 #ifdef WIN32
-		m_hFile = CreateFileW(Utf8toUtf16(sz).c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, 0, NULL);
+		if (bReadOnly)
+			m_hFile = CreateFileW(Utf8toUtf16(sz).c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+		else
+			m_hFile = CreateFileW(Utf8toUtf16(sz).c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, 0, NULL);
 		test_SysRet(INVALID_HANDLE_VALUE == m_hFile, "CreateFile");
 #else // WIN32
-		m_hFile = open(sz, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP);
+		if (bReadOnly)
+			m_hFile = open(sz, O_RDONLY);
+		else
+			m_hFile = open(sz, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP);
 		test_SysRet(-1 == m_hFile, "open");
 #endif // WIN32
 
+		m_bReadOnly = bReadOnly;
+
 		OpenMapping();
 	}
 
@@ -221,15 +454,67 @@ namespace beam
 	////////////////////////////////////////
 	// MappedFile
 
+	uint64_t MappedFile::s_JournalMax = 0x10000000;
+
+#pragma pack(push, 1)
+	struct MappedFile::JournalHdr
+	{
+		static const uint8_t s_pSig[8];
+
+		uint8_t m_pSig[8];
+		uint32_t m_nPageSize;
+		uint32_t m_nTag;
+		uint64_t m_nPages;
+		uint8_t m_pTag[64];
+		uint32_t m_pChecksum[8]; // sha256 state after the whole journal, with this field zeroed
+		uint64_t m_nSize; // file size. The growth may not have reached the disk (0 for journals of older versions)
+
+		// followed by the page offsets (padded), and the pages
+
+		uint64_t get_SizeIdx() const
+		{
+			return AlignUp(m_nPages * sizeof(Offset), Sha256::s_BlockSize);
+		}
+
+		bool IsValid(uint64_t nSize) const
+		{
+			if (memcmp(m_pSig, s_pSig, sizeof(s_pSig)) ||
+				(m_nPageSize != MappedFileRaw::s_PageSize) ||
+				(m_nTag > sizeof(m_pTag)) ||
+				(m_nPages > nSize / m_nPageSize) || // also prevents overflow
+				(nSize < sizeof(JournalHdr) + get_SizeIdx() + m_nPages * m_nPageSize))
+				return false;
+
+			JournalHdr hdr = *this;
+			ZeroObject(hdr.m_pChecksum);
+
+			uint32_t pState[8];
+			Sha256::Init(pState);
+			Sha256::Transform(pState, (const uint8_t*) &hdr, sizeof(hdr) / Sha256::s_BlockSize);
+			Sha256::Transform(pState, (const uint8_t*) (this + 1), (get_SizeIdx() + m_nPages * m_nPageSize) / Sha256::s_BlockSize);
+
+			return !memcmp(pState, m_pChecksum, sizeof(pState));
+		}
+	};
+#pragma pack(pop)
+
+	const uint8_t MappedFile::JournalHdr::s_pSig[] = { 'B', 'e', 'a', 'm', 'J', 'r', 'n', 'l' };
+
 	MappedFile::MappedFile()
 	{
 		m_nBanks = 0;
+		m_nSizeSig = 0;
+		m_bJournal = false;
+		m_bJournalSkipped = false;
 	}
 
 	void MappedFile::Close()
 	{
 		m_Raw.Close();
+		m_Journal.Close();
 		m_nBanks = 0;
+		m_bJournal = false;
+		m_vPages.clear();
 	}
 
 	uint32_t MappedFile::Defs::get_Bank0() const
@@ -247,14 +532,28 @@ namespace beam
 			AlignUp(m_nFixedHdr, sizeof(Offset));
 	}
 
-	void MappedFile::Open(const char* sz, const Defs& d, bool bReset /* = false */)
+	void MappedFile::Open(const char* sz, const Defs& d, bool bReset /* = false */, const Blob* pJournalTag /* = nullptr */)
 	{
 		Close();
+
+		m_Raw.m_Access = m_Access;
 		m_Raw.Open(sz);
 
+		m_bJournal = pJournalTag && MappedFileRaw::IsPrivateSupported();
+		if (m_bJournal)
+		{
+			std::string sPath = sz;
+			sPath += ".journal";
+
+			m_Journal.Open(sPath.c_str());
+			RecoverJournal(*pJournalTag);
+		}
+
 		uint32_t nSizeMin = d.get_SizeMin();
 		if (bReset || (m_Raw.m_nMapping < nSizeMin) || memcmp(d.m_pSig, m_Raw.m_pMapping, d.m_nSizeSig))
 		{
+			bReset = true;
+
 			bool bShouldZeroInit = (m_Raw.m_nMapping > d.m_nSizeSig);
 			m_Raw.CloseMapping();
 
@@ -269,6 +568,150 @@ namespace beam
 
 		m_nBank0 = d.get_Bank0();
 		m_nBanks = d.m_nBanks;
+		m_nSizeSig = d.m_nSizeSig;
+
+		if (m_bJournal && !bReset)
+		{
+			// after reset stay shared until the 1st commit, the file is inconsistent anyway
+			m_Raw.CloseMapping();
+			m_Raw.m_bPrivate = true;
+			m_Raw.OpenMapping();
+		}
+
+		m_Raw.Prefault();
+	}
+
+	void MappedFile::RecoverJournal(const Blob& tag)
+	{
+		if (m_Journal.m_nMapping >= sizeof(JournalHdr))
+		{
+			const JournalHdr& hdr = m_Journal.get_At<JournalHdr>(0);
+			if (hdr.IsValid(m_Journal.m_nMapping) && (hdr.m_nTag == tag.n) && !memcmp(hdr.m_pTag, tag.p, tag.n))
+			{
+				// the commit was confirmed, but possibly not fully applied
+				if (hdr.m_nSize > m_Raw.m_nMapping)
+					m_Raw.Grow(hdr.m_nSize); // the mapping is still shared
+
+				const Offset* pIdx = (const Offset*) (&hdr + 1);
+				const uint8_t* pPage = ((const uint8_t*) pIdx) + hdr.get_SizeIdx();
+
+				for (uint64_t i = 0; i < hdr.m_nPages; i++, pPage += hdr.m_nPageSize)
+				{
+					Offset x = pIdx[i];
+					if (x < m_Raw.m_nMapping)
+						m_Raw.Write(x, pPage, (size_t) std::min<Offset>(hdr.m_nPageSize, m_Raw.m_nMapping - x));
+				}
+
+				m_Raw.Sync();
+			}
+		}
+
+		m_Journal.CloseMapping();
+		m_Journal.Resize(0);
+		m_Journal.Sync();
+	}
+
+	void MappedFile::CommitPrepare(const Blob& tag)
+	{
+		if (!IsJournaled())
+		{
+			m_Raw.Sync();
+			return;
+		}
+
+		m_Raw.get_PrivatePages(m_vPages);
+
+		m_bJournalSkipped = (m_vPages.size() * m_Raw.s_PageSize > s_JournalMax);
+		if (m_bJournalSkipped)
+		{
+			// too large. Invalidate the file until all the pages are written
+			std::vector<uint8_t> vZero(m_nSizeSig, 0);
+			m_Raw.Write(0, &vZero.front(), vZero.size());
+			m_Raw.Sync();
+			return;
+		}
+
+		static_assert(!(sizeof(JournalHdr) % Sha256::s_BlockSize), "");
+
+		JournalHdr hdr;
+		ZeroObject(hdr);
+		memcpy(hdr.m_pSig, JournalHdr::s_pSig, sizeof(hdr.m_pSig));
+		hdr.m_nPageSize = m_Raw.s_PageSize;
+		hdr.m_nPages = m_vPages.size();
+		hdr.m_nSize = m_Raw.m_nMapping;
+
+		assert(tag.n <= sizeof(hdr.m_pTag));
+		hdr.m_nTag = std::min<uint32_t>(tag.n, sizeof(hdr.m_pTag));
+		memcpy(hdr.m_pTag, tag.p, hdr.m_nTag);
+
+		uint32_t pState[8];
+		Sha256::Init(pState);
+		Sha256::Transform(pState, (const uint8_t*) &hdr, sizeof(hdr) / Sha256::s_BlockSize);
+
+		std::vector<Offset> vIdx(hdr.get_SizeIdx() / sizeof(Offset), 0);
+		std::copy(m_vPages.begin(), m_vPages.end(), vIdx.begin());
+
+		Offset nPos = sizeof(hdr);
+		if (!vIdx.empty())
+		{
+			size_t nSize = vIdx.size() * sizeof(Offset);
+			m_Journal.Write(nPos, &vIdx.front(), nSize);
+			Sha256::Transform(pState, (const uint8_t*) &vIdx.front(), nSize / Sha256::s_BlockSize);
+			nPos += nSize;
+		}
+
+		for (Offset x : m_vPages)
+		{
+			const uint8_t* pPage = m_Raw.m_pMapping + x;
+			m_Journal.Write(nPos, pPage, hdr.m_nPageSize);
+			Sha256::Transform(pState, pPage, hdr.m_nPageSize / Sha256::s_BlockSize);
+			nPos += hdr.m_nPageSize;
+		}
+
+		memcpy(hdr.m_pChecksum, pState, sizeof(pState));
+
+		m_Journal.Write(0, &hdr, sizeof(hdr));
+		m_Journal.Sync();
+	}
+
+	void MappedFile::CommitApply()
+	{
+		if (!IsJournaled())
+		{
+			if (m_bJournal)
+			{
+				// the file is consistent now
+				m_Raw.CloseMapping();
+				m_Raw.m_bPrivate = true;
+				m_Raw.OpenMapping();
+			}
+			return;
+		}
+
+		// the 1st page is written last: if the journal was skipped - it restores the signature
+		size_t i0 = (!m_vPages.empty() && !m_vPages.front()) ? 1 : 0;
+		for (size_t i = i0; i < m_vPages.size(); i++)
+			WritePage(m_vPages[i]);
+
+		if (m_bJournalSkipped)
+			m_Raw.Sync();
+
+		if (i0 || m_bJournalSkipped)
+			WritePage(0);
+
+		m_Raw.Sync();
+
+		if (!m_bJournalSkipped)
+			m_Journal.Resize(0); // no need to sync. If the journal survives - it contains the same data
+
+		m_Raw.DiscardPrivate(m_vPages.data(), m_vPages.size());
+		m_vPages.clear();
+	}
+
+	void MappedFile::WritePage(Offset x)
+	{
+		assert(x < m_Raw.m_nMapping);
+		m_Raw.Write(x, m_Raw.m_pMapping + x, (size_t) std::min<Offset>(m_Raw.s_PageSize, m_Raw.m_nMapping - x));
 	}
 
 	void* MappedFile::get_FixedHdr() const
@@ -292,9 +735,7 @@ namespace beam
 
 			nSize = AlignUp(nSize, sizeof(Offset));
 
-			m_Raw.CloseMapping();
-			m_Raw.Resize(n1);
-			m_Raw.OpenMapping();
+			m_Raw.Grow(n1);
 
 			Bank& b = get_Bank(iBank);
 			Offset* p = &b.m_Tail;
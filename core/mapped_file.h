@@ -14,6 +14,8 @@
 
 #pragma once
 #include "common.h"
+#include <thread>
+#include <atomic>
 
 namespace beam
 {
@@ -33,16 +35,52 @@ namespace beam
 		Offset m_nMapping;
 		uint8_t* m_pMapping;
 
+		// Copy-on-write mapping: modifications don't reach the file implicitly, the modified pages can be enumerated
+		bool m_bPrivate;
+		bool m_bReadOnly; // opened for read only, see Open()
+		static bool IsPrivateSupported();
+
+		struct Access
+		{
+			struct Prefault {
+				enum Enum {
+					None,
+					Sync, // read the whole file and map all the pages on open
+					Async, // read the whole file into the page cache in the background
+				};
+			};
+
+			bool m_Random = false; // disable read-ahead on page faults (the access pattern is a tree walk). Less memory, but slower cold access
+			bool m_HugePages = false; // transparent huge pages, effective only if the kernel supports them for file mappings
+			Prefault::Enum m_Prefault = Prefault::None;
+		};
+
+		Access m_Access; // hints are applied on every mapping, prefault - on Open
+
+		std::thread m_Warmup;
+		std::atomic<bool> m_bWarmupStop;
+
+		void ApplyAccess();
+		void Prefault();
+		void StopWarmup();
+		void ReadAll(); // into the page cache
+
 		void ResetVarsFile();
 		void ResetVarsMapping();
 		void CloseMapping();
 		void OpenMapping();
 		void Resize(Offset);
+		void Grow(Offset); // preserves the private pages
+
+		void get_PrivatePages(std::vector<Offset>&) const; // sorted page offsets
+		void DiscardPrivate(const Offset* pPages, size_t nPages); // must be already written to the file
+		void Write(Offset, const void*, size_t); // to the file, bypassing the mapping
+		void Sync();
 
 		MappedFileRaw();
 		~MappedFileRaw();
 
-		void Open(const char* sz);
+		void Open(const char* sz, bool bReadOnly = false); // read-only: the file must exist, the mapping is not writable
 		void Close();
 
 		template <typename T> T& get_At(Offset n) const
@@ -73,13 +111,26 @@ namespace beam
 
 		uint32_t m_nBank0;
 		uint32_t m_nBanks;
+		uint32_t m_nSizeSig;
 
 		Bank& get_Bank(uint32_t iBank);
 
+		struct JournalHdr;
+
+		MappedFileRaw m_Journal;
+		bool m_bJournal;
+		bool m_bJournalSkipped;
+		std::vector<Offset> m_vPages;
+
+		void RecoverJournal(const Blob& tag);
+		void WritePage(Offset);
+
 	public:
 
 		MappedFile();
 
+		MappedFileRaw::Access m_Access; // set before Open
+
 		struct Defs
 		{
 			const uint8_t* m_pSig;
@@ -91,9 +142,24 @@ namespace beam
 			uint32_t get_SizeMin() const;
 		};
 
-		void Open(const char* sz, const Defs&, bool bReset = false);
+		void Open(const char* sz, const Defs&, bool bReset = false, const Blob* pJournalTag = nullptr);
 		void Close();
 
+		// Journaled mode (if pJournalTag is specified, and supported by the platform). The mapping is private, and the file
+		// is modified only on commit, which consists of 2 phases:
+		//	CommitPrepare - saves the modified pages and the caller-defined tag into the journal, synchronously
+		//	CommitApply - writes them into the file, and discards the journal
+		// If interrupted in-between - the journal is replayed on the next Open if the tag matches, or discarded otherwise.
+		// Modifications larger than s_JournalMax aren't journaled, instead the file signature is invalidated until CommitApply.
+		//
+		// In the non-journaled mode (as well as right after reset) the mapping is shared, and CommitPrepare just flushes it.
+		// Either way the tag should also be saved within the file, so that the caller can verify it after Open.
+		bool IsJournaled() const { return m_Raw.m_bPrivate; }
+		void CommitPrepare(const Blob& tag);
+		void CommitApply();
+
+		static uint64_t s_JournalMax;
+
 		void* get_FixedHdr() const;
 
 		template <typename T> T& get_At(Offset n) const
@@ -15,6 +15,7 @@
 #include "common.h"
 #include "merkle.h"
 #include "ecc_native.h"
+#include "sha256.h"
 
 namespace beam {
 namespace Merkle {
@@ -43,6 +44,12 @@ void Interpret(Hash& hash, const Proof& p)
 		Interpret(hash, *it);
 }
 
+void InterpretBatch(Hash* pOut, const Hash* pIn, size_t nPairs)
+{
+	static_assert(sizeof(Hash) == Sha256::s_HashSize, "");
+	Sha256::Hash64(pOut->m_pData, pIn->m_pData, nPairs);
+}
+
 
 /////////////////////////////
 // Mmr
@@ -479,9 +486,28 @@ struct FlyMmr::Inner
 		m_Count = m_This.m_Count;
 	}
 
+	static const uint8_t s_hBatch = 6;
+
 	void Calculate(Hash& hv, const Position& pos) const
 	{
-		if (pos.H)
+		if (pos.H && (pos.H <= s_hBatch))
+		{
+			// small subtree: load all the elements, then hash them level-by-level in batches
+			Hash pHv[1U << s_hBatch];
+			uint32_t n = 1U << pos.H;
+
+			uint64_t x0 = pos.X << pos.H;
+			assert(x0 + n <= m_Count);
+
+			for (uint32_t i = 0; i < n; i++)
+				m_This.LoadElement(pHv[i], x0 + i);
+
+			for (; n > 1; n >>= 1)
+				InterpretBatch(pHv, pHv, n >> 1);
+
+			hv = pHv[0];
+		}
+		else if (pos.H)
 		{
 			Position pos2;
 			pos2.X = pos.X << 1;
@@ -76,6 +76,7 @@ namespace Merkle {
 	void Interpret(Hash&, const Node&);
 	void Interpret(Hash&, const Hash& hLeft, const Hash& hRight);
 	void Interpret(Hash&, const Hash& hNew, bool bNewOnRight);
+	void InterpretBatch(Hash* pOut, const Hash* pIn, size_t nPairs); // pOut[i] = hash(pIn[2*i], pIn[2*i+1]). In-place (pOut == pIn) is allowed
 
 	struct Mmr
 	{
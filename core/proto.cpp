@@ -518,19 +518,30 @@ bool NodeConnection::IsLive() const
     return m_Connection && !m_pAsyncFail;
 }
 
+template <typename T>
+void NodeConnection::SendInternal(uint8_t nCode, const T& v)
+{
+    if (!IsLive())
+        return;
+    m_SerializeCache.clear();
+    MsgSerializer& ser = m_Protocol.serializeNoFinalize(m_SerializeCache, nCode, v);
+    m_Protocol.Encrypt(m_SerializeCache, ser);
+    io::Result res = m_Connection->write_msg(m_SerializeCache);
+    m_SerializeCache.clear();
+
+    TestIoResultAsync(res);
+    TestNotDrown();
+}
+
+void NodeConnection::SendBodyPack(const std::vector<BodyBuffersRef>& v)
+{
+    SendInternal(BodyPack::s_Code, v);
+}
+
 #define THE_MACRO(code, msg) \
 void NodeConnection::Send(const msg& v) \
 { \
-    if (!IsLive()) \
-        return; \
-    m_SerializeCache.clear(); \
-    MsgSerializer& ser = m_Protocol.serializeNoFinalize(m_SerializeCache, uint8_t(code), v); \
-    m_Protocol.Encrypt(m_SerializeCache, ser); \
-    io::Result res = m_Connection->write_msg(m_SerializeCache); \
-    m_SerializeCache.clear(); \
-\
-    TestIoResultAsync(res); \
-    TestNotDrown(); \
+    SendInternal(uint8_t(code), v); \
 } \
 \
 bool NodeConnection::OnMsgInternal(uint64_t, msg##_NoInit&& v) \
@@ -534,6 +534,31 @@ namespace proto {
 
 	};
 
+	// Serialized exactly as BodyBuffers, but refers to the data in-place. Output only
+	struct BodyBuffersRef
+	{
+		Blob m_Perishable;
+		Blob m_Eternal;
+
+		BodyBuffersRef() :m_Perishable(nullptr, 0), m_Eternal(nullptr, 0) {}
+
+		template <typename Archive>
+		void serialize(Archive& ar)
+		{
+			Save(ar, m_Perishable);
+			Save(ar, m_Eternal);
+		}
+
+	private:
+		template <typename Archive>
+		static void Save(Archive& ar, const Blob& x)
+		{
+			ar.write_seq_size(x.n);
+			if (x.n)
+				ar.write(reinterpret_cast<const uint8_t*>(x.p), x.n);
+		}
+	};
+
     enum Unused_ { Unused };
     enum Uninitialized_ { Uninitialized };
 
@@ -736,6 +761,9 @@ namespace proto {
 
         SerializedMsg m_SerializeCache;
 
+        template <typename T>
+        void SendInternal(uint8_t nCode, const T&);
+
         void TestIoResultAsync(const io::Result& res);
         void TestInputMsgContext(uint8_t);
 
@@ -854,6 +882,9 @@ namespace proto {
         BeamNodeMsgsAll(THE_MACRO)
 #undef THE_MACRO
 
+        // same as Send(BodyPack), but the bodies are serialized directly from where they're referenced
+        void SendBodyPack(const std::vector<BodyBuffersRef>&);
+
         struct Server
         {
             io::TcpServer::Ptr m_pServer; // just delete it to stop listening
@@ -14,6 +14,11 @@
 
 #include "radixtree.h"
 #include "ecc_native.h"
+#include "../utility/executor.h"
+
+#ifdef _MSC_VER
+#	include <xmmintrin.h>
+#endif // _MSC_VER
 
 namespace beam {
 
@@ -31,6 +36,7 @@ const uint8_t* RadixTree::get_NodeKey(const Node& n) const
 
 RadixTree::RadixTree()
 	:m_RootOffset(0)
+	,m_Stamp(0)
 {
 }
 
@@ -47,6 +53,7 @@ void RadixTree::Clear()
 
 		DeleteNode(get_Root());
 		m_RootOffset = 0;
+		m_Stamp++;
 	}
 }
 
@@ -145,68 +152,220 @@ void RadixTree::ReplaceTip(CursorBase& cu, Node* pNew)
 
 bool RadixTree::Goto(CursorBase& cu, const uint8_t* pKey, uint16_t nBits) const
 {
+	return GotoInternal(cu, nullptr, 0, pKey, nBits);
+}
+
+bool RadixTree::Goto(SeqCursorBase& cu, const uint8_t* pKey, uint16_t nBits) const
+{
+	intptr_t nBase = get_Base();
+	uint16_t nBitsPrev = (cu.m_Stamp == m_Stamp) ? cu.m_nBitsPrev : 0;
+
+	if (nBitsPrev && (cu.m_Base != nBase))
+	{
+		// the tree was remapped, all the nodes moved by the same offset
+		for (uint16_t i = 0; i < cu.m_nPtrs; i++)
+			cu.m_pp[i] = reinterpret_cast<Node*>(reinterpret_cast<intptr_t>(cu.m_pp[i]) + nBase - cu.m_Base);
+	}
+
+	bool bRet = GotoInternal(cu, cu.m_pKeyPrev, nBitsPrev, pKey, nBits);
+
+	memcpy(cu.m_pKeyPrev, pKey, (nBits + 7) >> 3);
+	cu.m_nBitsPrev = nBits;
+	cu.m_Base = nBase;
+	cu.m_Stamp = m_Stamp;
+
+	return bRet;
+}
+
+bool RadixTree::GotoInternal(CursorBase& cu, const uint8_t* pKeyPrev, uint16_t nBitsPrev, const uint8_t* pKey, uint16_t nBits) const
+{
+	// Descend by the branch bits only, then compare the whole key once against the key of the last node.
+	// All the keys within a subtree share its prefix, hence the first mismatch tells at which node the original path would stop.
+	// This way the keys of the intermediate nodes (which reside in random leaves) are not touched.
 	Node* p = get_Root();
 
-	if (p)
+	cu.m_nBits = 0;
+	cu.m_nPosInLastNode = 0;
+
+	if (!p)
+	{
+		cu.m_nPtrs = 0;
+		return !nBits;
+	}
+
+	uint16_t n0 = 0; // where the current node starts
+
+	if (nBitsPrev && cu.m_nPtrs && (cu.m_pp[0] == p))
+	{
+		// The cursor holds the path of the previous key. Its nodes are reused as long as the branch bits are common for both keys
+		uint16_t nCommon = FindMismatch(pKeyPrev, pKey, std::min(nBitsPrev, nBits));
+
+		uint16_t nPtrs = 1;
+		for (; nPtrs < cu.m_nPtrs; nPtrs++)
+		{
+			uint16_t nEnd = n0 + p->get_Bits();
+			if (nEnd >= nCommon)
+				break;
+
+			p = cu.m_pp[nPtrs];
+			n0 = nEnd + 1;
+		}
+
+		cu.m_nPtrs = nPtrs;
+	}
+	else
 	{
 		cu.m_pp[0] = p;
 		cu.m_nPtrs = 1;
-	} else
-		cu.m_nPtrs = 0;
+	}
 
-	cu.m_nBits = 0;
-	cu.m_nPosInLastNode = 0;
+	while (true)
+	{
+		uint16_t nEnd = n0 + p->get_Bits();
+		if (nEnd >= nBits)
+			break;
+
+		assert(!(Node::s_Leaf & p->m_Bits)); // leaves span to the end of the key
+
+		p = Cast::Up<Joint>(p)->m_ppC[1 & CursorBase::get_BitRawStat(pKey, nEnd)].get_Strict();
+		assert(p); // joints should have both children!
 
-	while (nBits > cu.m_nBits)
+		cu.m_pp[cu.m_nPtrs++] = p;
+		n0 = nEnd + 1;
+	}
+
+	uint16_t nDiff = FindMismatch(pKey, get_NodeKey(*p), nBits);
+	if (nDiff == nBits)
 	{
-		if (!p)
-			return false;
+		cu.m_nBits = nBits;
+		cu.m_nPosInLastNode = nBits - n0;
+		return true;
+	}
+
+	// locate the node that contains the mismatch. It can't be a branch bit, we followed the same path
+	n0 = 0;
+	for (cu.m_nPtrs = 0; ; )
+	{
+		p = cu.m_pp[cu.m_nPtrs++];
+		uint16_t nEnd = n0 + p->get_Bits();
+		if (nDiff < nEnd)
+			break;
+
+		assert(nDiff > nEnd);
+		n0 = nEnd + 1;
+	}
+
+	cu.m_nBits = nDiff;
+	cu.m_nPosInLastNode = nDiff - n0;
+	return false;
+}
+
+uint16_t RadixTree::FindMismatch(const uint8_t* pKey0, const uint8_t* pKey1, uint16_t nBits)
+{
+	// returns the first different bit, or nBits if equal
+	uint16_t nBytes = nBits >> 3;
+	uint16_t iByte = 0;
+
+	for (; iByte < nBytes; iByte++)
+		if (pKey0[iByte] != pKey1[iByte])
+			break;
+
+	for (uint16_t n = iByte << 3; n < nBits; n++)
+		if (1 & (CursorBase::get_BitRawStat(pKey0, n) ^ CursorBase::get_BitRawStat(pKey1, n)))
+			return n;
+
+	return nBits;
+}
 
-		const uint8_t* pKeyNode = get_NodeKey(*p);
+void RadixTree::Prefetch(const uint8_t* const* ppKeys, uint32_t nKeys, uint16_t nBits) const
+{
+	// Walks the paths of several keys simultaneously, one level per pass, and prefetches the next nodes.
+	// The cache misses of different keys overlap, instead of being paid one after another during the lookups.
+	Node* pRoot = get_Root();
+	if (!pRoot)
+		return;
+
+	const uint32_t nBatch = 16;
+
+	for (uint32_t i0 = 0; i0 < nKeys; i0 += nBatch)
+	{
+		uint32_t nCount = std::min(nBatch, nKeys - i0);
+
+		Node* pp[nBatch];
+		uint16_t pPos[nBatch];
 
-		uint16_t nThreshold = std::min<uint16_t>(cu.m_nBits + p->get_Bits(), nBits);
+		for (uint32_t i = 0; i < nCount; i++)
+		{
+			pp[i] = pRoot;
+			pPos[i] = 0;
+		}
 
-		while (cu.m_nBits < nThreshold)
+		for (bool bActive = true; bActive; )
 		{
-			if (!(7 & cu.m_nBits) && (cu.m_nBits + 7 < nThreshold))
+			bActive = false;
+
+			for (uint32_t i = 0; i < nCount; i++)
 			{
-				uint32_t nByte = cu.m_nBits >> 3;
-				if (pKey[nByte] == pKeyNode[nByte])
+				Node* p = pp[i];
+				if (!p)
+					continue;
+
+				uint16_t nEnd = pPos[i] + p->get_Bits();
+				if ((Node::s_Leaf & p->m_Bits) || (nEnd >= nBits))
 				{
-					cu.m_nBits += 8;
-					cu.m_nPosInLastNode += 8;
+					PrefetchMem(get_NodeKey(*p));
+					pp[i] = nullptr;
 					continue;
 				}
-			}
 
-			if (1 & (cu.get_BitRaw(pKey) ^ cu.get_BitRaw(pKeyNode)))
-				return false; // no match
+				// the key of the joint isn't prefetched, the lookup descends by the branch bits only and compares the key of the last node
+				const Joint& x = Cast::Up<Joint>(*p);
+				p = x.m_ppC[1 & CursorBase::get_BitRawStat(ppKeys[i0 + i], nEnd)].get_Strict();
+				PrefetchMem(p);
 
-			cu.m_nBits++;
-			cu.m_nPosInLastNode++;
+				pp[i] = p;
+				pPos[i] = nEnd + 1;
+				bActive = true;
+			}
 		}
+	}
+}
 
-		if (cu.m_nBits == nBits)
-			return true;
-
-		assert(cu.m_nPosInLastNode == p->get_Bits());
-
-		Joint* pN = Cast::Up<Joint>(p);
-		p = pN->m_ppC[cu.get_Bit(pKey)].get_Strict();
+void RadixTree::PrefetchMem(const void* p)
+{
+#ifdef _MSC_VER
+	_mm_prefetch(static_cast<const char*>(p), _MM_HINT_T0);
+#else // _MSC_VER
+	__builtin_prefetch(p);
+#endif // _MSC_VER
+}
 
-		assert(p); // joints should have both children!
+void RadixTree::GotoMin(CursorBase& cu) const
+{
+	assert(cu.m_nPtrs);
 
+	for (Node* p = cu.m_pp[cu.m_nPtrs - 1]; !(Node::s_Leaf & p->m_Bits); )
+	{
+		p = Cast::Up<Joint>(p)->m_ppC[0].get_Strict();
 		cu.m_pp[cu.m_nPtrs++] = p;
-		cu.m_nBits++;
-		cu.m_nPosInLastNode = 0;
 	}
-
-	return true;
 }
 
 RadixTree::Leaf* RadixTree::Find(CursorBase& cu, const uint8_t* pKey, uint16_t nBits, bool& bCreate)
 {
-	if (Goto(cu, pKey, nBits))
+	return FindInternal(cu, Goto(cu, pKey, nBits), pKey, nBits, bCreate);
+}
+
+RadixTree::Leaf* RadixTree::Find(SeqCursorBase& cu, const uint8_t* pKey, uint16_t nBits, bool& bCreate)
+{
+	Leaf* pRet = FindInternal(cu, Goto(cu, pKey, nBits), pKey, nBits, bCreate);
+	cu.m_Stamp = m_Stamp; // the path is still valid
+	return pRet;
+}
+
+RadixTree::Leaf* RadixTree::FindInternal(CursorBase& cu, bool bFound, const uint8_t* pKey, uint16_t nBits, bool& bCreate)
+{
+	if (bFound)
 	{
 		bCreate = false;
 		return &cu.get_Leaf();
@@ -218,6 +377,7 @@ RadixTree::Leaf* RadixTree::Find(CursorBase& cu, const uint8_t* pKey, uint16_t n
 		return nullptr;
 
 	OnDirty();
+	m_Stamp++;
 
 	Leaf* pN = CreateLeaf();
 
@@ -284,9 +444,16 @@ RadixTree::Leaf* RadixTree::Find(CursorBase& cu, const uint8_t* pKey, uint16_t n
 	return pN;
 }
 
+void RadixTree::Delete(SeqCursorBase& cu)
+{
+	Delete(Cast::Down<CursorBase>(cu));
+	cu.m_Stamp = m_Stamp; // the path is still valid
+}
+
 void RadixTree::Delete(CursorBase& cu)
 {
 	OnDirty();
+	m_Stamp++;
 
 	assert(cu.m_nPtrs);
 
@@ -327,6 +494,7 @@ void RadixTree::Delete(CursorBase& cu)
 
 				pN->m_Bits += pPrev->m_Bits + 1;
 				ReplaceTip(cu, pN);
+				cu.m_pp[cu.m_nPtrs - 1] = pN; // keep the path valid
 
 				DeleteJoint(pPrev);
 
@@ -488,39 +656,155 @@ void RadixHashTree::get_Hash(Merkle::Hash& hv)
 		hv = Zero;
 }
 
+bool RadixHashTree::IsHashClean() const
+{
+	const Node* p = get_Root();
+	return !p || (Node::s_Clean & p->m_Bits);
+}
+
 const Merkle::Hash& RadixHashTree::get_Hash(Node& n, Merkle::Hash& hv)
 {
-	if (Node::s_Leaf & n.m_Bits)
+	if (!(Node::s_Clean & n.m_Bits))
 	{
-		const Merkle::Hash& ret = get_LeafHash(n, hv);
+		OnDirty();
 
-		if (!(Node::s_Clean & n.m_Bits))
-		{
-			OnDirty();
+		if (Node::s_Leaf & n.m_Bits)
 			n.m_Bits |= Node::s_Clean;
-		}
+		else
+			HashDirtyMT(Cast::Up<MyJoint>(n));
+	}
+
+	if (Node::s_Leaf & n.m_Bits)
+		return get_LeafHash(n, hv);
+
+	return Cast::Up<MyJoint>(n).m_Hash;
+}
+
+void RadixHashTree::HashDirtyMT(MyJoint& x)
+{
+	Executor* pEx = Executor::s_pInstance;
+	if (pEx && (pEx->get_Threads() > 1) && (CountDirty(x, s_ParallelMinJoints) >= s_ParallelMinJoints))
+	{
+		struct MyTask
+			:public Executor::TaskSync
+		{
+			RadixHashTree* m_pThis;
+			std::vector<MyJoint*> m_vRoots;
+
+			virtual void Exec(Executor::Context& ctx) override
+			{
+				uint32_t i0, nCount;
+				ctx.get_Portion(i0, nCount, static_cast<uint32_t>(m_vRoots.size()));
+
+				for (uint32_t i = 0; i < nCount; i++)
+					m_pThis->HashDirty(*m_vRoots[i0 + i]);
+			}
+
+		} t;
+
+		t.m_pThis = this;
+		CollectDirtyRoots(x, t.m_vRoots, s_ParallelDepth);
 
-		return ret;
+		pEx->ForkJoin(t); // don't wait for the unrelated async tasks
 	}
 
-	MyJoint& x = Cast::Up<MyJoint>(n);
-	if (!(Node::s_Clean & x.m_Bits))
+	// the rest (or everything) on this thread. Subtrees hashed in parallel are already clean
+	HashDirty(x);
+}
+
+void RadixHashTree::HashDirty(MyJoint& x)
+{
+	// Dirty joints of the same height are independent, their hashes are calculated in batches, bottom-up
+	JointLevels vLevels;
+	CollectDirty(x, vLevels);
+
+	std::vector<Merkle::Hash> vBuf;
+
+	for (size_t iLevel = 0; iLevel < vLevels.size(); iLevel++)
 	{
-		ECC::Hash::Processor hp;
+		const std::vector<MyJoint*>& v = vLevels[iLevel];
+		vBuf.resize(v.size() * _countof(x.m_ppC));
 
-		for (size_t i = 0; i < _countof(x.m_ppC); i++)
+		for (size_t i = 0; i < v.size(); i++)
 		{
-			ECC::Hash::Value hvPlaceholder;
-			hp << get_Hash(*x.m_ppC[i].get_Strict(), hvPlaceholder);
+			for (size_t j = 0; j < _countof(x.m_ppC); j++)
+			{
+				Merkle::Hash& hvChild = vBuf[i * _countof(x.m_ppC) + j];
+				Node& n = *v[i]->m_ppC[j].get_Strict();
+
+				if (Node::s_Leaf & n.m_Bits)
+				{
+					hvChild = get_LeafHash(n, hvChild);
+					n.m_Bits |= Node::s_Clean;
+				}
+				else
+				{
+					assert(Node::s_Clean & n.m_Bits); // lower levels are already processed
+					hvChild = Cast::Up<MyJoint>(n).m_Hash;
+				}
+			}
 		}
 
-		OnDirty();
+		Merkle::InterpretBatch(&vBuf.front(), &vBuf.front(), v.size());
+
+		for (size_t i = 0; i < v.size(); i++)
+		{
+			MyJoint& y = *v[i];
+			y.m_Hash = vBuf[i];
+			y.m_Bits |= Node::s_Clean;
+		}
+	}
+}
+
+uint32_t RadixHashTree::CollectDirty(MyJoint& x, JointLevels& vLevels)
+{
+	// returns the height of the joint above its dirty descendant joints
+	uint32_t nLevel = 0;
+
+	for (size_t i = 0; i < _countof(x.m_ppC); i++)
+	{
+		Node& n = *x.m_ppC[i].get_Strict();
+		if (!((Node::s_Leaf | Node::s_Clean) & n.m_Bits))
+			nLevel = std::max(nLevel, CollectDirty(Cast::Up<MyJoint>(n), vLevels) + 1);
+	}
+
+	if (vLevels.size() <= nLevel)
+		vLevels.resize(nLevel + 1);
+
+	vLevels[nLevel].push_back(&x);
+	return nLevel;
+}
+
+uint32_t RadixHashTree::CountDirty(const MyJoint& x, uint32_t nMax)
+{
+	// counts the dirty joints (including this one), stops once nMax is reached
+	uint32_t nCount = 1;
 
-		hp >> x.m_Hash;
-		x.m_Bits |= Node::s_Clean;
+	for (size_t i = 0; (i < _countof(x.m_ppC)) && (nCount < nMax); i++)
+	{
+		const Node& n = *x.m_ppC[i].get_Strict();
+		if (!((Node::s_Leaf | Node::s_Clean) & n.m_Bits))
+			nCount += CountDirty(Cast::Up<MyJoint>(n), nMax - nCount);
 	}
 
-	return x.m_Hash;
+	return nCount;
+}
+
+void RadixHashTree::CollectDirtyRoots(MyJoint& x, std::vector<MyJoint*>& vRoots, uint32_t nDepth)
+{
+	// dirty joints at the specified depth below x. Dirty joints above it are left for the caller
+	for (size_t i = 0; i < _countof(x.m_ppC); i++)
+	{
+		Node& n = *x.m_ppC[i].get_Strict();
+		if ((Node::s_Leaf | Node::s_Clean) & n.m_Bits)
+			continue;
+
+		MyJoint& y = Cast::Up<MyJoint>(n);
+		if (nDepth > 1)
+			CollectDirtyRoots(y, vRoots, nDepth - 1);
+		else
+			vRoots.push_back(&y);
+	}
 }
 
 void RadixHashTree::get_Proof(Merkle::Proof& proof, const CursorBase& cu)
@@ -558,6 +842,22 @@ void UtxoTree::MyLeaf::get_Hash(Merkle::Hash& hv, const Key& key, Input::Count n
 		>> hv;
 }
 
+UtxoTree::MyLeaf* UtxoTree::FindMin(SeqCursorBase& cu, const ECC::Point& comm)
+{
+	Key::Data d;
+	d.m_Commitment = comm;
+	d.m_Maturity = 0;
+
+	Key key;
+	key = d;
+
+	if (!Goto(cu, key.V.m_pData, Key::s_BitsCommitment))
+		return nullptr;
+
+	GotoMin(cu);
+	return Cast::Up<MyLeaf>(&cu.get_Leaf());
+}
+
 void UtxoTree::MyLeaf::get_Hash(Merkle::Hash& hv) const
 {
 	get_Hash(hv, m_Key, get_Count());
@@ -136,11 +136,46 @@ public:
 		Cursor_T() :CursorBase(m_ppBuf) {}
 	};
 
+	// Cursor for a series of lookups of sorted keys (i.e. block inputs/outputs). It remembers the previous key,
+	// and the next lookup resumes from the part of the path shared by both keys, instead of starting from the root.
+	// Find/Delete via this cursor keep it valid. If the tree was modified by other means - the lookup starts from the root.
+	class SeqCursorBase :public CursorBase
+	{
+		uint8_t* const m_pKeyPrev;
+		uint16_t m_nBitsPrev;
+		intptr_t m_Base;
+		uint64_t m_Stamp;
+
+		friend class RadixTree;
+
+	public:
+		SeqCursorBase(Node** pp, uint8_t* pKey) :CursorBase(pp), m_pKeyPrev(pKey), m_nBitsPrev(0) {}
+	};
+
+	template <uint16_t nKeyBits>
+	class SeqCursor_T :public SeqCursorBase
+	{
+		Node* m_ppBuf[nKeyBits + 1];
+		uint8_t m_pKeyBuf[(nKeyBits + 7) >> 3];
+	public:
+		SeqCursor_T() :SeqCursorBase(m_ppBuf, m_pKeyBuf) {}
+	};
+
 	bool Goto(CursorBase& cu, const uint8_t* pKey, uint16_t nBits) const;
+	bool Goto(SeqCursorBase& cu, const uint8_t* pKey, uint16_t nBits) const;
+
+	// descends from the last node of the cursor to the leftmost (minimal) leaf
+	void GotoMin(CursorBase& cu) const;
+
+	// Brings the paths of the specified keys into the cache, to speed-up the subsequent lookups of those keys.
+	// nBits may be less than the key size, to prefetch only the path to the common subtree.
+	void Prefetch(const uint8_t* const* ppKeys, uint32_t nKeys, uint16_t nBits) const;
 
 	Leaf* Find(CursorBase& cu, const uint8_t* pKey, uint16_t nBits, bool& bCreate);
+	Leaf* Find(SeqCursorBase& cu, const uint8_t* pKey, uint16_t nBits, bool& bCreate);
 
 	void Delete(CursorBase& cu);
+	void Delete(SeqCursorBase& cu);
 
 	struct ITraveler
 	{
@@ -165,6 +200,7 @@ public:
 
 protected:
 	int64_t m_RootOffset;
+	uint64_t m_Stamp; // incremented on structural changes
 
 private:
 	void set_Root(Node*);
@@ -175,6 +211,11 @@ private:
 
 	static int Cmp(const uint8_t* pKey, const uint8_t* pThreshold, uint16_t n0, uint16_t dn);
 	static int Cmp1(uint8_t, const uint8_t* pThreshold, uint16_t n0);
+	static uint16_t FindMismatch(const uint8_t* pKey0, const uint8_t* pKey1, uint16_t nBits);
+
+	bool GotoInternal(CursorBase& cu, const uint8_t* pKeyPrev, uint16_t nBitsPrev, const uint8_t* pKey, uint16_t nBits) const;
+	Leaf* FindInternal(CursorBase& cu, bool bFound, const uint8_t* pKey, uint16_t nBits, bool& bCreate);
+	static void PrefetchMem(const void*);
 };
 
 class RadixHashTree
@@ -188,6 +229,12 @@ public:
 
 	void get_Hash(Merkle::Hash&);
 	void get_Proof(Merkle::Proof&, const CursorBase&);
+	bool IsHashClean() const;
+
+	// If the current Executor is multi-threaded and there are enough dirty joints - the tree is split at the fixed depth,
+	// and the dirty subtrees are rehashed on the executor threads.
+	static const uint32_t s_ParallelDepth = 6;
+	static const uint32_t s_ParallelMinJoints = 0x1000;
 
 protected:
 	// RadixTree
@@ -196,6 +243,14 @@ protected:
 
 	const Merkle::Hash& get_Hash(Node&, Merkle::Hash&);
 
+	typedef std::vector<std::vector<MyJoint*> > JointLevels;
+	static uint32_t CollectDirty(MyJoint&, JointLevels&);
+	static uint32_t CountDirty(const MyJoint&, uint32_t nMax);
+	static void CollectDirtyRoots(MyJoint&, std::vector<MyJoint*>&, uint32_t nDepth);
+
+	void HashDirty(MyJoint&); // doesn't call OnDirty, may run concurrently for disjoint subtrees
+	void HashDirtyMT(MyJoint&);
+
 	virtual const Merkle::Hash& get_LeafHash(Node&, Merkle::Hash&) = 0;
 };
 
@@ -284,12 +339,21 @@ public:
 	};
 
 	typedef RadixTree::Cursor_T<Key::s_Bits> Cursor;
+	typedef RadixTree::SeqCursor_T<Key::s_Bits> SeqCursor;
 
 	MyLeaf* Find(CursorBase& cu, const Key& key, bool& bCreate)
 	{
 		return Cast::Up<MyLeaf>(RadixTree::Find(cu, key.V.m_pData, key.s_Bits, bCreate));
 	}
 
+	MyLeaf* Find(SeqCursorBase& cu, const Key& key, bool& bCreate)
+	{
+		return Cast::Up<MyLeaf>(RadixTree::Find(cu, key.V.m_pData, key.s_Bits, bCreate));
+	}
+
+	// the element with the specified commitment and the minimal maturity
+	MyLeaf* FindMin(SeqCursorBase& cu, const ECC::Point& comm);
+
 	~UtxoTree() { Clear(); }
 
 	void PushID(TxoID, MyLeaf&);
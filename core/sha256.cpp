@@ -0,0 +1,391 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sha256.h"
+#include "cpu_caps.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#	define BEAM_SHA256_X86
+#	include <immintrin.h>
+#	ifdef _MSC_VER
+#		define BEAM_SHA256_TARGET(x)
+#	else // _MSC_VER
+#		define BEAM_SHA256_TARGET(x) __attribute__((target(x)))
+#	endif // _MSC_VER
+#endif // x86
+
+namespace {
+
+	const uint32_t s_pIV[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+
+	const uint32_t s_pK[64] = {
+		0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+		0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+		0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+		0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+		0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+		0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+		0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+		0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+	};
+
+	// 2nd block of a 64-byte message: 0x80, zeroes, and the length in bits (512)
+	const uint8_t s_pPad64[Sha256::s_BlockSize] = {
+		0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x02, 0
+	};
+
+	inline uint32_t Rotr(uint32_t x, int n)
+	{
+		return (x >> n) | (x << (32 - n));
+	}
+
+	inline uint32_t LoadBE(const uint8_t* p)
+	{
+		return
+			(uint32_t(p[0]) << 24) |
+			(uint32_t(p[1]) << 16) |
+			(uint32_t(p[2]) << 8) |
+			uint32_t(p[3]);
+	}
+
+	inline void StoreBE(uint8_t* p, uint32_t x)
+	{
+		p[0] = uint8_t(x >> 24);
+		p[1] = uint8_t(x >> 16);
+		p[2] = uint8_t(x >> 8);
+		p[3] = uint8_t(x);
+	}
+
+	void TransformGeneric(uint32_t* pS, const uint8_t* p, size_t nBlocks)
+	{
+		for (; nBlocks--; p += Sha256::s_BlockSize)
+		{
+			uint32_t pW[64];
+			for (int i = 0; i < 16; i++)
+				pW[i] = LoadBE(p + i * 4);
+
+			for (int i = 16; i < 64; i++)
+			{
+				uint32_t s0 = Rotr(pW[i - 15], 7) ^ Rotr(pW[i - 15], 18) ^ (pW[i - 15] >> 3);
+				uint32_t s1 = Rotr(pW[i - 2], 17) ^ Rotr(pW[i - 2], 19) ^ (pW[i - 2] >> 10);
+				pW[i] = pW[i - 16] + s0 + pW[i - 7] + s1;
+			}
+
+			uint32_t a = pS[0], b = pS[1], c = pS[2], d = pS[3], e = pS[4], f = pS[5], g = pS[6], h = pS[7];
+
+			for (int i = 0; i < 64; i++)
+			{
+				uint32_t t1 = h + (Rotr(e, 6) ^ Rotr(e, 11) ^ Rotr(e, 25)) + (g ^ (e & (f ^ g))) + s_pK[i] + pW[i];
+				uint32_t t2 = (Rotr(a, 2) ^ Rotr(a, 13) ^ Rotr(a, 22)) + ((a & b) | (c & (a | b)));
+
+				h = g;
+				g = f;
+				f = e;
+				e = d + t1;
+				d = c;
+				c = b;
+				b = a;
+				a = t1 + t2;
+			}
+
+			pS[0] += a;
+			pS[1] += b;
+			pS[2] += c;
+			pS[3] += d;
+			pS[4] += e;
+			pS[5] += f;
+			pS[6] += g;
+			pS[7] += h;
+		}
+	}
+
+#ifdef BEAM_SHA256_X86
+
+	uint32_t DetectCaps()
+	{
+		const uint32_t nCpu = CpuCaps::get();
+		uint32_t nRet = 0;
+
+		const uint32_t nShaNi = CpuCaps::ShaNi | CpuCaps::Sse41 | CpuCaps::Ssse3;
+		if ((nCpu & nShaNi) == nShaNi)
+			nRet |= Sha256::Caps::ShaNi;
+
+		if (CpuCaps::Avx2 & nCpu)
+			nRet |= Sha256::Caps::Avx2;
+
+		return nRet;
+	}
+
+	BEAM_SHA256_TARGET("sha,sse4.1,ssse3")
+	void TransformShaNi(uint32_t* pS, const uint8_t* p, size_t nBlocks)
+	{
+		const __m128i msk = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+		__m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pS)); // DCBA
+		__m128i s1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pS + 4)); // HGFE
+
+		tmp = _mm_shuffle_epi32(tmp, 0xB1); // CDAB
+		s1 = _mm_shuffle_epi32(s1, 0x1B); // EFGH
+		__m128i s0 = _mm_alignr_epi8(tmp, s1, 8); // ABEF
+		s1 = _mm_blend_epi16(s1, tmp, 0xF0); // CDGH
+
+		for (; nBlocks--; p += Sha256::s_BlockSize)
+		{
+			const __m128i s0Prev = s0;
+			const __m128i s1Prev = s1;
+
+			__m128i pMsg[4];
+
+			for (int i = 0; i < 16; i++)
+			{
+				__m128i& m = pMsg[i & 3];
+
+				if (i < 4)
+					m = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i * 16)), msk);
+				else
+				{
+					// w[i] = msg2(msg1(w[i-4], w[i-3]) + (w[i-2]:w[i-1] >> 1 word), w[i-1])
+					__m128i x = _mm_sha256msg1_epu32(m, pMsg[(i - 3) & 3]);
+					x = _mm_add_epi32(x, _mm_alignr_epi8(pMsg[(i - 1) & 3], pMsg[(i - 2) & 3], 4));
+					m = _mm_sha256msg2_epu32(x, pMsg[(i - 1) & 3]);
+				}
+
+				__m128i wk = _mm_add_epi32(m, _mm_loadu_si128(reinterpret_cast<const __m128i*>(s_pK + i * 4)));
+				s1 = _mm_sha256rnds2_epu32(s1, s0, wk);
+				s0 = _mm_sha256rnds2_epu32(s0, s1, _mm_shuffle_epi32(wk, 0x0E));
+			}
+
+			s0 = _mm_add_epi32(s0, s0Prev);
+			s1 = _mm_add_epi32(s1, s1Prev);
+		}
+
+		tmp = _mm_shuffle_epi32(s0, 0x1B); // FEBA
+		s1 = _mm_shuffle_epi32(s1, 0xB1); // DCHG
+		s0 = _mm_blend_epi16(tmp, s1, 0xF0); // DCBA
+		s1 = _mm_alignr_epi8(s1, tmp, 8); // HGFE
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pS), s0);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pS + 4), s1);
+	}
+
+	struct Avx2x8
+	{
+		// 8 independent messages, one per lane
+		static const uint32_t s_Lanes = 8;
+
+#define BEAM_SHA256_AVX2 BEAM_SHA256_TARGET("avx2")
+
+		BEAM_SHA256_AVX2 static __m256i Rotr(__m256i x, int n)
+		{
+			return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+		}
+
+		BEAM_SHA256_AVX2 static __m256i Xor3(__m256i a, __m256i b, __m256i c)
+		{
+			return _mm256_xor_si256(_mm256_xor_si256(a, b), c);
+		}
+
+		BEAM_SHA256_AVX2 static void Round(__m256i* pS, __m256i wk)
+		{
+			__m256i& a = pS[0]; __m256i& b = pS[1]; __m256i& c = pS[2]; __m256i& d = pS[3];
+			__m256i& e = pS[4]; __m256i& f = pS[5]; __m256i& g = pS[6]; __m256i& h = pS[7];
+
+			__m256i t1 = _mm256_add_epi32(h, Xor3(Rotr(e, 6), Rotr(e, 11), Rotr(e, 25)));
+			t1 = _mm256_add_epi32(t1, _mm256_xor_si256(g, _mm256_and_si256(e, _mm256_xor_si256(f, g)))); // Ch
+			t1 = _mm256_add_epi32(t1, wk);
+
+			__m256i t2 = Xor3(Rotr(a, 2), Rotr(a, 13), Rotr(a, 22));
+			t2 = _mm256_add_epi32(t2, _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)))); // Maj
+
+			h = g;
+			g = f;
+			f = e;
+			e = _mm256_add_epi32(d, t1);
+			d = c;
+			c = b;
+			b = a;
+			a = _mm256_add_epi32(t1, t2);
+		}
+
+		BEAM_SHA256_AVX2 static void Hash64(uint8_t* pOut, const uint8_t* pIn)
+		{
+			__m256i pW[16];
+			for (int i = 0; i < 16; i++)
+			{
+				const uint8_t* p = pIn + i * 4;
+				pW[i] = _mm256_set_epi32(
+					LoadBE(p + 7 * Sha256::s_BlockSize),
+					LoadBE(p + 6 * Sha256::s_BlockSize),
+					LoadBE(p + 5 * Sha256::s_BlockSize),
+					LoadBE(p + 4 * Sha256::s_BlockSize),
+					LoadBE(p + 3 * Sha256::s_BlockSize),
+					LoadBE(p + 2 * Sha256::s_BlockSize),
+					LoadBE(p + 1 * Sha256::s_BlockSize),
+					LoadBE(p));
+			}
+
+			__m256i pS[8], pS0[8];
+			for (int i = 0; i < 8; i++)
+				pS[i] = _mm256_set1_epi32(s_pIV[i]);
+
+			// 1st block: the message
+			for (int i = 0; i < 64; i++)
+			{
+				__m256i& w = pW[i & 15];
+				if (i >= 16)
+				{
+					const __m256i& w15 = pW[(i - 15) & 15];
+					const __m256i& w2 = pW[(i - 2) & 15];
+
+					__m256i s0 = Xor3(Rotr(w15, 7), Rotr(w15, 18), _mm256_srli_epi32(w15, 3));
+					__m256i s1 = Xor3(Rotr(w2, 17), Rotr(w2, 19), _mm256_srli_epi32(w2, 10));
+
+					w = _mm256_add_epi32(_mm256_add_epi32(w, s0), _mm256_add_epi32(pW[(i - 7) & 15], s1));
+				}
+
+				Round(pS, _mm256_add_epi32(w, _mm256_set1_epi32(s_pK[i])));
+			}
+
+			for (int i = 0; i < 8; i++)
+			{
+				pS[i] = _mm256_add_epi32(pS[i], _mm256_set1_epi32(s_pIV[i]));
+				pS0[i] = pS[i];
+			}
+
+			// 2nd block: the padding, same for all the lanes
+			const uint32_t* pWK = get_PadWK();
+			for (int i = 0; i < 64; i++)
+				Round(pS, _mm256_set1_epi32(pWK[i]));
+
+			uint32_t pRes[8][s_Lanes];
+			for (int i = 0; i < 8; i++)
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(pRes[i]), _mm256_add_epi32(pS[i], pS0[i]));
+
+			for (uint32_t iLane = 0; iLane < s_Lanes; iLane++)
+				for (int i = 0; i < 8; i++)
+					StoreBE(pOut + iLane * Sha256::s_HashSize + i * 4, pRes[i][iLane]);
+		}
+
+#undef BEAM_SHA256_AVX2
+
+		static const uint32_t* get_PadWK()
+		{
+			// message schedule of the padding block, with the round constants added
+			struct Data
+			{
+				uint32_t m_pWK[64];
+
+				Data()
+				{
+					uint32_t* pW = m_pWK;
+					for (int i = 0; i < 16; i++)
+						pW[i] = LoadBE(s_pPad64 + i * 4);
+
+					for (int i = 16; i < 64; i++)
+					{
+						uint32_t s0 = ::Rotr(pW[i - 15], 7) ^ ::Rotr(pW[i - 15], 18) ^ (pW[i - 15] >> 3);
+						uint32_t s1 = ::Rotr(pW[i - 2], 17) ^ ::Rotr(pW[i - 2], 19) ^ (pW[i - 2] >> 10);
+						pW[i] = pW[i - 16] + s0 + pW[i - 7] + s1;
+					}
+
+					for (int i = 0; i < 64; i++)
+						pW[i] += s_pK[i];
+				}
+			};
+
+			static const Data s_Data;
+			return s_Data.m_pWK;
+		}
+	};
+
+#endif // BEAM_SHA256_X86
+
+	uint32_t& get_CapsRef()
+	{
+#ifdef BEAM_SHA256_X86
+		static uint32_t s_Caps = DetectCaps();
+#else // BEAM_SHA256_X86
+		static uint32_t s_Caps = 0;
+#endif // BEAM_SHA256_X86
+		return s_Caps;
+	}
+
+} // namespace
+
+uint32_t Sha256::get_Caps()
+{
+	return get_CapsRef();
+}
+
+void Sha256::set_Caps(uint32_t nCaps)
+{
+	uint32_t& n = get_CapsRef();
+#ifdef BEAM_SHA256_X86
+	n = nCaps & DetectCaps();
+#else // BEAM_SHA256_X86
+	n = 0;
+	(void) nCaps;
+#endif // BEAM_SHA256_X86
+}
+
+void Sha256::Init(uint32_t* pState)
+{
+	memcpy(pState, s_pIV, sizeof(s_pIV));
+}
+
+void Sha256::Transform(uint32_t* pState, const uint8_t* pBlocks, size_t nBlocks)
+{
+#ifdef BEAM_SHA256_X86
+	if (Caps::ShaNi & get_Caps())
+	{
+		TransformShaNi(pState, pBlocks, nBlocks);
+		return;
+	}
+#endif // BEAM_SHA256_X86
+
+	TransformGeneric(pState, pBlocks, nBlocks);
+}
+
+void Sha256::Hash64(uint8_t* pOut, const uint8_t* pIn, size_t nCount)
+{
+#ifdef BEAM_SHA256_X86
+	// SHA-NI is faster than 8 lanes of AVX2, prefer it when both are available
+	if ((Caps::Avx2 & get_Caps()) && !(Caps::ShaNi & get_Caps()))
+	{
+		for (; nCount >= Avx2x8::s_Lanes; nCount -= Avx2x8::s_Lanes)
+		{
+			Avx2x8::Hash64(pOut, pIn);
+			pOut += s_HashSize * Avx2x8::s_Lanes;
+			pIn += s_BlockSize * Avx2x8::s_Lanes;
+		}
+	}
+#endif // BEAM_SHA256_X86
+
+	for (; nCount--; pOut += s_HashSize, pIn += s_BlockSize)
+	{
+		uint32_t pS[8];
+		Init(pS);
+		Transform(pS, pIn, 1);
+		Transform(pS, s_pPad64, 1);
+
+		for (int i = 0; i < 8; i++)
+			StoreBE(pOut + i * 4, pS[i]);
+	}
+}
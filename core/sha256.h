@@ -0,0 +1,43 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+struct Sha256
+{
+	// SHA-256 primitives. The implementation is selected at runtime according to the CPU capabilities.
+
+	static const uint32_t s_BlockSize = 64;
+	static const uint32_t s_HashSize = 32;
+
+	struct Caps
+	{
+		static const uint32_t ShaNi = 1; // x86 SHA extensions
+		static const uint32_t Avx2 = 2; // used for multi-buffer hashing only
+	};
+
+	static uint32_t get_Caps();
+	static void set_Caps(uint32_t); // can only restrict the detected caps. For tests and benchmarks
+
+	static void Init(uint32_t* pState);
+
+	// Processes whole blocks. The state is 8 native words
+	static void Transform(uint32_t* pState, const uint8_t* pBlocks, size_t nBlocks);
+
+	// Hashes nCount independent 64-byte messages (such as Merkle node pairs) into 32-byte results.
+	// Multi-buffer hashing is used where it's faster. In-place (pOut == pIn) is allowed.
+	static void Hash64(uint8_t* pOut, const uint8_t* pIn, size_t nCount);
+};
@@ -20,6 +20,7 @@
 #include "../../utility/serialize.h"
 #include "../serialization_adapters.h"
 #include "../aes.h"
+#include "../sha256.h"
 #include "../proto.h"
 #include "../lelantus.h"
 #include "../../utility/byteorder.h"
@@ -281,6 +282,77 @@ void TestHash()
 		// hash values must change, even if no explicit input was fed.
 		verify_test(!(hv == hv2));
 	}
+
+	// known answers
+	struct
+	{
+		const char* m_szMsg;
+		const char* m_szHash;
+	} const pVec[] = {
+		{ "", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+		{ "abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+		{ "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+	};
+
+	const uint32_t nCaps = Sha256::get_Caps();
+
+	for (uint32_t iCaps = 0; iCaps <= nCaps; iCaps++)
+	{
+		if ((iCaps & nCaps) != iCaps)
+			continue;
+
+		Sha256::set_Caps(iCaps);
+
+		for (size_t i = 0; i < _countof(pVec); i++)
+		{
+			Hash::Value hvRef;
+			hvRef.Scan(pVec[i].m_szHash);
+
+			Hash::Processor()
+				<< beam::Blob(pVec[i].m_szMsg, static_cast<uint32_t>(strlen(pVec[i].m_szMsg)))
+				>> hv;
+			verify_test(hv == hvRef);
+		}
+
+		// streaming with arbitrary chunks vs generic implementation
+		uint8_t pBuf[0x200];
+		GenRandom(pBuf, sizeof(pBuf));
+
+		for (uint32_t nSize = 0; nSize <= sizeof(pBuf); nSize += 7)
+		{
+			Hash::Value hvRef;
+			Sha256::set_Caps(0);
+			Hash::Processor() << beam::Blob(pBuf, nSize) >> hvRef;
+			Sha256::set_Caps(iCaps);
+
+			Hash::Processor hp;
+			for (uint32_t nDone = 0; nDone < nSize; )
+			{
+				uint32_t nPortion = std::min(nSize - nDone, (nDone % 67) + 1);
+				hp << beam::Blob(pBuf + nDone, nPortion);
+				nDone += nPortion;
+			}
+
+			hp >> hv;
+			verify_test(hv == hvRef);
+		}
+
+		// batch of 64-byte messages, in-place, odd count to include the tail
+		const uint32_t nBatch = 21;
+		Hash::Value pHv[nBatch * 2], pHvRef[nBatch];
+		for (uint32_t i = 0; i < _countof(pHv); i++)
+			GenRandom(pHv[i]);
+
+		for (uint32_t i = 0; i < nBatch; i++)
+			Hash::Processor() << pHv[i * 2] << pHv[i * 2 + 1] >> pHvRef[i];
+
+		Sha256::Hash64(pHv[0].m_pData, pHv[0].m_pData, nBatch);
+
+		for (uint32_t i = 0; i < nBatch; i++)
+			verify_test(pHv[i] == pHvRef[i]);
+	}
+
+	Sha256::set_Caps(nCaps);
 }
 
 void TestScalars()
@@ -568,6 +640,61 @@ void TestPoints()
 	p0 = -p0;
 	p0 += p1;
 	verify_test(p0 == Zero);
+
+	// bucket multi-exponentiation
+	const uint32_t nCount = 600;
+	std::vector<Point::Native> vPts(nCount);
+	std::vector<Scalar::Native> vKs(nCount);
+
+	MultiMac_Buckets mmb;
+	mmb.Reset(nCount);
+
+	p1 = Zero;
+	for (uint32_t i = 0; i < nCount; i++)
+	{
+		if (i % 100)
+		{
+			SetRandom(vPts[i]);
+			vPts[i] = vPts[i] * Two; // make sure it's not normalized
+		}
+		else
+			vPts[i] = Zero;
+
+		if (i % 7)
+			SetRandom(vKs[i]);
+		else
+		{
+			vKs[i] = Zero;
+			if (i % 2)
+				vKs[i] = -Scalar::Native(1U); // all bits set
+		}
+
+		mmb.Add(vPts[i]);
+		p1 += vPts[i] * vKs[i];
+	}
+
+	mmb.Calculate(p0, &vKs.front());
+
+	p0 = -p0;
+	p0 += p1;
+	verify_test(p0 == Zero);
+
+	// CmList switches to the buckets for large windows, and to MultiMac for small ones
+	static_assert(nCount >= MultiMac_Buckets::s_MinCount, "");
+
+	beam::Lelantus::CmListVec lst;
+	lst.m_vec.resize(nCount);
+	for (uint32_t i = 0; i < nCount; i++)
+		vPts[i].Export(lst.m_vec[i]);
+
+	p0 = Zero;
+	lst.Calculate(p0, 0, nCount, &vKs.front());
+
+	p0 = -p0;
+	for (uint32_t i0 = 0; i0 < nCount; i0 += 100)
+		lst.Calculate(p0, i0, 100, &vKs.front());
+
+	verify_test(p0 == Zero);
 }
 
 void TestSigning()
@@ -1482,6 +1609,55 @@ void TestAES()
 
 	sd.dec.Proceed(pBuf, pBuf); // inplace decode
 	verify_test(!memcmp(pBuf, pPlaintext, sizeof(pPlaintext)));
+
+	// all the implementations must produce the same results
+	const uint32_t nCaps = AES::get_Caps();
+	verify_test(!(AES::Caps::Table & nCaps)); // opt-in only
+	const uint32_t nCapsAll = nCaps | AES::Caps::Table;
+
+	std::vector<uint8_t> vRef(0x1000), vBuf(vRef.size());
+	for (size_t i = 0; i < vRef.size(); i++)
+		vRef[i] = static_cast<uint8_t>(i);
+
+	AES::StreamCipher asc;
+	asc.Reset();
+	memset(asc.m_Counter.m_pData + 8, 0xff, 8); // make sure carry propagation is the same
+	asc.m_Counter.m_pData[15] = 0x9c;
+	asc.XCrypt(se.enc, &vRef.front(), static_cast<uint32_t>(vRef.size()));
+
+	for (uint32_t iCaps = 0; iCaps <= nCapsAll; iCaps++)
+	{
+		if ((iCaps & nCapsAll) != iCaps)
+			continue;
+
+		AES::set_Caps(iCaps);
+		verify_test(AES::get_Caps() == iCaps);
+
+		se.enc.Init(pKey); // key schedule is the same regardless of the caps
+
+		memcpy(pBuf, pPlaintext, sizeof(pBuf));
+		se.enc.Proceed(pBuf, pBuf);
+		verify_test(!memcmp(pBuf, pCiphertext, sizeof(pBuf)));
+
+		for (size_t i = 0; i < vBuf.size(); i++)
+			vBuf[i] = static_cast<uint8_t>(i);
+
+		asc.Reset();
+		memset(asc.m_Counter.m_pData + 8, 0xff, 8);
+		asc.m_Counter.m_pData[15] = 0x9c;
+
+		// odd chunks, to test the partial blocks and the different batch remainders
+		for (uint32_t nPos = 0, nChunk = 1; nPos < vBuf.size(); nChunk += 7)
+		{
+			uint32_t n = std::min(nChunk, static_cast<uint32_t>(vBuf.size() - nPos));
+			asc.XCrypt(se.enc, &vBuf.front() + nPos, n);
+			nPos += n;
+		}
+
+		verify_test(vBuf == vRef);
+	}
+
+	AES::set_Caps(nCaps);
 }
 
 void TestKdfPair(Key::IKdf& skdf, Key::IPKdf& pkdf)
@@ -2323,6 +2499,74 @@ struct BenchmarkMeter
 	}
 };
 
+void RunBenchmarkMultiExp(uint32_t nCount)
+{
+	Mode::Scope scope(Mode::Fast);
+
+	std::vector<Point::Native> vPts(nCount);
+	std::vector<Scalar::Native> vKs(nCount);
+
+	for (uint32_t i = 0; i < nCount; i++)
+	{
+		SetRandom(vPts[i]);
+		SetRandom(vKs[i]);
+	}
+
+	Point::Native res, comm;
+	char szName[32];
+
+	{
+		const uint32_t nSizeNaggle = 128;
+		typedef MultiMac_WithBufs<nSizeNaggle, 1> MyMultiMac;
+		std::unique_ptr<MyMultiMac> pMm(new MyMultiMac);
+
+		snprintf(szName, sizeof(szName), "MultiMac.x%u", nCount);
+		BenchmarkMeter bm(szName);
+		bm.N = 1;
+		do
+		{
+			for (uint32_t i = 0; i < bm.N; i++)
+			{
+				res = Zero;
+
+				for (uint32_t i0 = 0; i0 < nCount; i0 += nSizeNaggle)
+				{
+					uint32_t n = std::min(nSizeNaggle, nCount - i0);
+
+					pMm->Reset();
+					for (; static_cast<uint32_t>(pMm->m_Casual) < n; pMm->m_Casual++)
+						pMm->m_pCasual[pMm->m_Casual].Init(vPts[i0 + pMm->m_Casual]);
+
+					pMm->m_pKCasual = &vKs[i0];
+					pMm->Calculate(comm);
+					res += comm;
+				}
+			}
+
+		} while (bm.ShouldContinue());
+	}
+
+	{
+		std::unique_ptr<MultiMac_Buckets> pMmb(new MultiMac_Buckets);
+
+		snprintf(szName, sizeof(szName), "MultiMac_Buckets.x%u", nCount);
+		BenchmarkMeter bm(szName);
+		bm.N = 1;
+		do
+		{
+			for (uint32_t i = 0; i < bm.N; i++)
+			{
+				pMmb->Reset(nCount);
+				for (uint32_t j = 0; j < nCount; j++)
+					pMmb->Add(vPts[j]);
+
+				pMmb->Calculate(res, &vKs.front());
+			}
+
+		} while (bm.ShouldContinue());
+	}
+}
+
 void RunBenchmark()
 {
 	Scalar::Native k1, k2;
@@ -2567,6 +2811,47 @@ void RunBenchmark()
 		} while (bm.ShouldContinue());
 	}
 
+	{
+		const uint32_t nCaps = Sha256::get_Caps();
+		const uint32_t nBatch = 0x400;
+		std::vector<Hash::Value> vHv(nBatch * 2);
+
+		for (uint32_t iCaps = 0; iCaps <= nCaps; iCaps++)
+		{
+			if ((iCaps & nCaps) != iCaps)
+				continue;
+
+			Sha256::set_Caps(iCaps);
+
+			char szName[32];
+			snprintf(szName, sizeof(szName), "Hash.64B.Caps-%u", iCaps);
+
+			{
+				BenchmarkMeter bm(szName);
+				do
+				{
+					for (uint32_t i = 0; i < bm.N; i++)
+						Hash::Processor() << vHv[0] << vHv[1] >> vHv[0];
+
+				} while (bm.ShouldContinue());
+			}
+
+			snprintf(szName, sizeof(szName), "Hash.64B.Batch.Caps-%u", iCaps);
+
+			{
+				BenchmarkMeter bm(szName);
+				do
+				{
+					for (uint32_t i = 0; i < bm.N; i += nBatch)
+						Sha256::Hash64(vHv.front().m_pData, vHv.front().m_pData, nBatch);
+
+				} while (bm.ShouldContinue());
+			}
+		}
+
+		Sha256::set_Caps(nCaps);
+	}
+
 	Hash::Processor() << "abcd" >> hv;
 
 	Signature sig;
@@ -2628,6 +2913,9 @@ void RunBenchmark()
 		} while (bm.ShouldContinue());
 	}
 
+	RunBenchmarkMultiExp(0x400);
+	RunBenchmarkMultiExp(0x4000);
+
 	RangeProof::Confidential bp;
 	RangeProof::CreatorParams cp;
 	SetRandom(cp.m_Seed.V);
@@ -2698,17 +2986,33 @@ void RunBenchmark()
 
 		uint8_t pBuf[0x400];
 
-		BenchmarkMeter bm("AES.XCrypt-1MB");
-		bm.N = 10;
-		do
+		const uint32_t nCaps = AES::get_Caps();
+		const uint32_t nCapsAll = nCaps | AES::Caps::Table;
+
+		for (uint32_t iCaps = 0; iCaps <= nCapsAll; iCaps++)
 		{
-			for (uint32_t i = 0; i < bm.N; i++)
+			if ((iCaps & nCapsAll) != iCaps)
+				continue;
+
+			AES::set_Caps(iCaps);
+
+			char szName[32];
+			snprintf(szName, sizeof(szName), "AES.XCrypt-1MB.Caps-%u", iCaps);
+
+			BenchmarkMeter bm(szName);
+			bm.N = 10;
+			do
 			{
-				for (size_t nSize = 0; nSize < 0x100000; nSize += sizeof(pBuf))
-					asc.XCrypt(enc, pBuf, sizeof(pBuf));
-			}
+				for (uint32_t i = 0; i < bm.N; i++)
+				{
+					for (size_t nSize = 0; nSize < 0x100000; nSize += sizeof(pBuf))
+						asc.XCrypt(enc, pBuf, sizeof(pBuf));
+				}
 
-		} while (bm.ShouldContinue());
+			} while (bm.ShouldContinue());
+		}
+
+		AES::set_Caps(nCaps);
 	}
 
 	{
@@ -295,6 +295,19 @@ namespace beam
 
 		t.get_Hash(hv1);
 
+		{
+			// prefetch is only a hint, must not affect anything
+			const uint8_t* pp[50];
+			for (uint32_t i = 0; i < _countof(pp); i++)
+				pp[i] = vKeys[rand() % vKeys.size()].V.m_pData;
+
+			t.Prefetch(pp, _countof(pp), UtxoTree::Key::s_BitsCommitment);
+			t.Prefetch(pp, _countof(pp), UtxoTree::Key::s_Bits);
+
+			t.get_Hash(hv2);
+			verify_test(hv2 == hv1);
+		}
+
 		for (uint32_t i = 0; i < vKeys.size(); i++)
 		{
 			if (i == vKeys.size()/2)
@@ -343,6 +356,76 @@ namespace beam
 
 		verify_test(vKeys.size() == t.Count());
 
+		{
+			// sequential cursor, sorted keys
+			std::vector<uint32_t> vIdx(vKeys.size());
+			for (uint32_t i = 0; i < vIdx.size(); i++)
+				vIdx[i] = i;
+
+			std::sort(vIdx.begin(), vIdx.end(), [&vKeys](uint32_t a, uint32_t b) { return vKeys[a].V < vKeys[b].V; });
+
+			UtxoTree t2;
+			UtxoTree::SeqCursor cu;
+
+			for (uint32_t i = 0; i < vIdx.size(); i++)
+			{
+				bool bCreate = true;
+				UtxoTree::MyLeaf* p = t2.Find(cu, vKeys[vIdx[i]], bCreate);
+				verify_test(p && bCreate);
+				SetLeafIDs(t2, *p, vIdx[i], false);
+			}
+
+			t2.get_Hash(hv2);
+			verify_test(hv2 == hv1);
+
+			for (uint32_t i = 0; i < vIdx.size(); i++)
+			{
+				const UtxoTree::Key& key = vKeys[vIdx[i]];
+				UtxoTree::Key::Data d;
+				d = key;
+
+				UtxoTree::MyLeaf* p = t2.FindMin(cu, d.m_Commitment);
+				verify_test(p && (p->m_Key.V == key.V));
+
+				bool bCreate = false;
+				verify_test(t2.Find(cu, key, bCreate) == p);
+			}
+
+			// delete in the reverse order, occasionally modify the tree by other means
+			for (uint32_t i = (uint32_t) vIdx.size(); i--; )
+			{
+				const UtxoTree::Key& key = vKeys[vIdx[i]];
+
+				if (!(i % 97) && i)
+				{
+					const UtxoTree::Key& key2 = vKeys[vIdx[i / 2]];
+
+					UtxoTree::Cursor cu2;
+					bool bCreate = false;
+					UtxoTree::MyLeaf* p = t2.Find(cu2, key2, bCreate);
+					verify_test(p);
+
+					SetLeafIDs(t2, *p, vIdx[i / 2], true);
+					t2.Delete(cu2);
+
+					bCreate = true;
+					p = t2.Find(cu2, key2, bCreate);
+					verify_test(p && bCreate);
+					SetLeafIDs(t2, *p, vIdx[i / 2], false);
+				}
+
+				bool bCreate = false;
+				UtxoTree::MyLeaf* p = t2.Find(cu, key, bCreate);
+				verify_test(p && !bCreate);
+				SetLeafIDs(t2, *p, vIdx[i], true);
+
+				t2.Delete(cu);
+			}
+
+			t2.get_Hash(hv2);
+			verify_test(hv2 == Zero);
+		}
+
 		// serialization
 		Serializer ser;
 		t.save(ser);
@@ -354,7 +437,53 @@ namespace beam
 
 		t.load(der);
 
-		t.get_Hash(hv2);
+		{
+			// rehash in parallel, the result must be the same
+			ExecutorMT_R ex;
+			ex.set_Threads(4);
+			Executor::Scope scope(ex);
+
+			t.get_Hash(hv2);
+			verify_test(hv2 == hv1);
+
+			// again, while a long async task is pending. Rehash must not wait for it
+			struct MyTask
+				:public Executor::TaskAsync
+			{
+				std::mutex* m_pMutex;
+				std::condition_variable* m_pCv;
+				bool* m_pRelease;
+
+				virtual void Exec(Executor::Context&) override
+				{
+					std::unique_lock<std::mutex> scope(*m_pMutex);
+					while (!*m_pRelease)
+						m_pCv->wait(scope);
+				}
+			};
+
+			std::mutex mx;
+			std::condition_variable cv;
+			bool bRelease = false;
+
+			auto pTask = std::make_unique<MyTask>();
+			pTask->m_pMutex = &mx;
+			pTask->m_pCv = &cv;
+			pTask->m_pRelease = &bRelease;
+			ex.Push(std::move(pTask));
+
+			der.reset(sb.first, sb.second);
+			t.load(der); // forget the cached hashes
+			t.get_Hash(hv2);
+
+			{
+				std::unique_lock<std::mutex> scope2(mx);
+				bRelease = true;
+			}
+			cv.notify_all();
+			ex.Flush(0);
+		}
+
 		verify_test(hv2 == hv1);
 
 		// narrow traverse
@@ -487,6 +616,217 @@ namespace beam
 		}
 	};
 
+	struct MappedJournalTest
+	{
+		static const uint32_t s_Items = 3000;
+
+		MappedFile m_File;
+		std::vector<MappedFile::Offset> m_vItems;
+		MappedFile::Defs m_Defs;
+		std::string m_sPath;
+
+		MappedJournalTest()
+		{
+			static const uint8_t s_pSig[] = { 0x5C, 0x21, 0x9E, 0x03, 0x7B, 0xD4, 0x46, 0x1A };
+
+			m_Defs.m_pSig = s_pSig;
+			m_Defs.m_nSizeSig = sizeof(s_pSig);
+			m_Defs.m_nBanks = 1;
+			m_Defs.m_nFixedHdr = sizeof(uint64_t);
+
+#ifdef WIN32
+			m_sPath = "mytest_j.bin";
+#else // WIN32
+			m_sPath = "/tmp/mytest_j.bin";
+#endif // WIN32
+		}
+
+		void Open(uint8_t nTag)
+		{
+			Blob tag(&nTag, sizeof(nTag));
+			m_File.Open(m_sPath.c_str(), m_Defs, false, &tag);
+		}
+
+		void Commit(uint8_t nTag, bool bApply)
+		{
+			Blob tag(&nTag, sizeof(nTag));
+			m_File.CommitPrepare(tag);
+			if (bApply)
+				m_File.CommitApply();
+		}
+
+		MappedFile::Offset get_FileSize() const
+		{
+			MappedFileRaw raw;
+			raw.Open(m_sPath.c_str());
+			return raw.m_nMapping;
+		}
+
+		void Truncate(MappedFile::Offset n) const
+		{
+			MappedFileRaw raw;
+			raw.Open(m_sPath.c_str());
+			raw.CloseMapping();
+			raw.Resize(n);
+		}
+
+		uint64_t& get_Gen() const
+		{
+			return *(uint64_t*) m_File.get_FixedHdr();
+		}
+
+		void Set(uint64_t nGen)
+		{
+			if (m_vItems.empty())
+			{
+				for (uint32_t i = 0; i < s_Items; i++)
+				{
+					void* p = m_File.Allocate(0, sizeof(uint64_t) * 8);
+					m_vItems.push_back(m_File.get_Offset(p));
+				}
+			}
+
+			get_Gen() = nGen;
+
+			// modify only a part of the items
+			for (uint32_t i = 0; i < s_Items; i += 3)
+				m_File.get_At<uint64_t>(m_vItems[i]) = nGen + i;
+		}
+
+		void Verify(uint64_t nGen) const
+		{
+			verify_test(get_Gen() == nGen);
+
+			for (uint32_t i = 0; i < s_Items; i += 3)
+				verify_test(m_File.get_At<uint64_t>(m_vItems[i]) == nGen + i);
+		}
+	};
+
+	void TestMappedJournal()
+	{
+		if (!MappedFileRaw::IsPrivateSupported())
+			return;
+
+		MappedJournalTest t;
+		DeleteFile(t.m_sPath.c_str());
+
+		t.Open(1);
+		verify_test(!t.m_File.IsJournaled()); // just created
+		t.Set(100);
+		t.Commit(1, true);
+		verify_test(t.m_File.IsJournaled());
+
+		// uncommitted modifications are lost
+		t.Set(200);
+		t.m_File.Close();
+		t.Open(1);
+		verify_test(t.m_File.IsJournaled());
+		t.Verify(100);
+
+		// interrupted commit, not confirmed
+		t.Set(300);
+		t.Commit(2, false);
+		t.m_File.Close();
+		t.Open(1);
+		t.Verify(100);
+
+		// interrupted commit, confirmed. The journal should be replayed
+		t.Set(400);
+		t.Commit(3, false);
+		t.m_File.Close();
+		t.Open(3);
+		t.Verify(400);
+
+		// complete commit, growing the file
+		t.m_vItems.clear();
+		t.Set(500);
+		t.Commit(4, true);
+		t.Set(600);
+		t.m_File.Close();
+		t.Open(4);
+		t.Verify(500);
+
+		// interrupted commit, confirmed, growing the file. The new file size didn't reach the disk, the replay must restore it
+		t.m_File.Close();
+		MappedFile::Offset nSize0 = t.get_FileSize();
+		t.Open(4);
+
+		t.m_vItems.clear();
+		t.Set(650);
+		t.Commit(5, false);
+		t.m_File.Close();
+		verify_test(t.get_FileSize() > nSize0);
+		t.Truncate(nSize0);
+		t.Open(5);
+		verify_test(t.m_File.IsJournaled());
+		t.Verify(650);
+
+		// too large to journal: interrupted commit invalidates the file
+		uint64_t nJournalMax = MappedFile::s_JournalMax;
+		MappedFile::s_JournalMax = 0;
+
+		t.Set(700);
+		t.Commit(6, false);
+		t.m_File.Close();
+		t.Open(6);
+		verify_test(!t.m_File.IsJournaled()); // reset
+		verify_test(!t.get_Gen());
+
+		t.m_vItems.clear();
+		t.Set(800);
+		t.Commit(7, true);
+		t.Set(900);
+		t.Commit(8, true);
+		t.m_File.Close();
+		t.Open(8);
+		t.Verify(900);
+
+		MappedFile::s_JournalMax = nJournalMax;
+		t.m_File.Close();
+	}
+
+	void TestMappedReadOnly()
+	{
+#ifdef WIN32
+		const char* sz = "mytest_ro.bin";
+#else // WIN32
+		const char* sz = "/tmp/mytest_ro.bin";
+#endif // WIN32
+
+		DeleteFile(sz);
+
+		// missing file: fails, and must not be created
+		for (int i = 0; i < 2; i++)
+		{
+			MappedFileRaw raw;
+			bool bThrown = false;
+			try {
+				raw.Open(sz, true);
+			}
+			catch (const std::exception&) {
+				bThrown = true;
+			}
+			verify_test(bThrown);
+		}
+
+		const uint64_t nVal = 0x0123456789abcdefULL;
+		{
+			MappedFileRaw raw;
+			raw.Open(sz);
+			raw.Write(0x1000, &nVal, sizeof(nVal));
+		}
+
+		MappedFileRaw raw;
+		raw.Open(sz, true);
+		verify_test(raw.m_bReadOnly);
+		verify_test(raw.m_nMapping == 0x1000 + sizeof(nVal));
+		verify_test(raw.get_At<uint64_t>(0x1000) == nVal);
+
+		raw.Close();
+		verify_test(!raw.m_bReadOnly);
+		DeleteFile(sz);
+	}
+
 	void TestMmr()
 	{
 		std::vector<Merkle::Hash> vHashes;
@@ -674,6 +1014,8 @@ namespace beam
 int main()
 {
 	beam::TestNavigator();
+	beam::TestMappedJournal();
+	beam::TestMappedReadOnly();
 	beam::TestUtxoTree();
 	beam::TestMmr();
 
@@ -126,6 +126,14 @@ namespace beam {
 #define TblCache_Data			"Data"
 #define TblCache_LastHit		"Hit"
 
+#define TblBodies				"Bodies"
+#define TblBodies_State			"State"
+#define TblBodies_Segment		"Segment"
+#define TblBodies_PosP			"PosP"
+#define TblBodies_SizeP			"SizeP"
+#define TblBodies_PosE			"PosE"
+#define TblBodies_SizeE			"SizeE"
+
 NodeDB::NodeDB()
 	:m_pDb(nullptr)
 {
@@ -176,12 +184,22 @@ void NodeDB::Close()
 {
 	if (m_pDb)
 	{
+		// Dirty entries exist only within a transaction (see ContractCacheModify). If it's still open here - it's not committed, and its changes are lost anyway.
+		if (m_ContractCache.m_Dirty)
+			LOG_WARNING() << "Contract data cache: " << m_ContractCache.m_Dirty << " uncommitted modifications discarded";
+		ContractCacheClear();
+
 		for (size_t i = 0; i < _countof(m_pPrep); i++)
 			m_pPrep[i].Close();
 
         BEAM_VERIFY(SQLITE_OK == sqlite3_close(m_pDb));
 		m_pDb = NULL;
 	}
+
+	m_sPath.clear();
+	m_Bodies.Close();
+	m_TxoArchive.Close();
+	m_KernelCache.Clear();
 }
 
 NodeDB::Recordset::Recordset()
@@ -345,15 +363,32 @@ const void* NodeDB::Recordset::get_BlobStrict(int col, uint32_t n)
 	return x.p;
 }
 
-void NodeDB::Open(const char* szPath)
+void NodeDB::Open(const char* szPath, const Tuning& tun)
 {
 	TestRet(sqlite3_open_v2(szPath, &m_pDb, SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX | SQLITE_OPEN_CREATE, NULL));
 	// Attempt to fix the "busy" error when PC goes to sleep and then awakes. Try the busy handler with non-zero timeout (maybe a single retry would be enough)
 	sqlite3_busy_timeout(m_pDb, 5000);
+	m_sPath = szPath;
 
 	ExecTextOut("PRAGMA locking_mode = EXCLUSIVE");
 	ExecTextOut("PRAGMA journal_size_limit=1048576"); // limit journal file, otherwise it may remain huge even after tx commit, until the app is closed
 
+	if (tun.m_PageSize)
+		ExecTextOut(("PRAGMA page_size=" + std::to_string(tun.m_PageSize)).c_str());
+	if (tun.m_CacheSize_MB)
+		ExecTextOut(("PRAGMA cache_size=-" + std::to_string(static_cast<uint64_t>(tun.m_CacheSize_MB) << 10)).c_str()); // negative is in KB
+	if (tun.m_MmapSize_MB)
+		ExecTextOut(("PRAGMA mmap_size=" + std::to_string(static_cast<uint64_t>(tun.m_MmapSize_MB) << 20)).c_str());
+
+	// the journal mode is persistent, switch back if WAL is no longer requested
+	std::string sJournal = ExecTextOut("PRAGMA journal_mode");
+	bool bWal = (sJournal == "wal");
+	if (tun.m_Wal != bWal)
+	{
+		sJournal = ExecTextOut(tun.m_Wal ? "PRAGMA journal_mode=WAL" : "PRAGMA journal_mode=DELETE");
+		LOG_INFO() << "DB journal mode: " << sJournal;
+	}
+
 	bool bCreate;
 	{
 		Recordset rs(*this, Query::Scheme, "SELECT name FROM sqlite_master WHERE type='table' AND name=?");
@@ -361,7 +396,7 @@ void NodeDB::Open(const char* szPath)
 		bCreate = !rs.Step();
 	}
 
-	const uint64_t nVersionTop = 29;
+	const uint64_t nVersionTop = 30;
 
 
 	Transaction t(*this);
@@ -427,6 +462,10 @@ void NodeDB::Open(const char* szPath)
 			CreateTables28();
 			// no break;
 
+		case 29: // block bodies moved out of the DB. Existing bodies are left in place, and erased as usual
+			CreateTables29();
+			// no break;
+
 			ParamIntSet(ParamID::DbVer, nVersionTop);
 
 		case nVersionTop:
@@ -441,6 +480,10 @@ void NodeDB::Open(const char* szPath)
 		}
 	}
 
+	BodyStoreOpen(szPath);
+	TxoArchiveOpen(szPath);
+	KeyFiltersOpen();
+
 	t.Commit();
 }
 
@@ -451,6 +494,47 @@ void NodeDB::CheckIntegrity()
 		ThrowError(("sqlite integrity: " + s).c_str());
 }
 
+void NodeDB::Backup(const char* szPath)
+{
+	ContractCacheFlush();
+
+	sqlite3* pDst = nullptr;
+	int ret = sqlite3_open_v2(szPath, &pDst, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
+	if (SQLITE_OK == ret)
+	{
+		sqlite3_backup* pBk = sqlite3_backup_init(pDst, "main", m_pDb, "main");
+		if (pBk)
+		{
+			sqlite3_backup_step(pBk, -1); // all the pages at once
+			ret = sqlite3_backup_finish(pBk);
+		}
+		else
+			ret = sqlite3_errcode(pDst);
+	}
+
+	sqlite3_close(pDst); // don't care about retval
+	TestRet(ret);
+}
+
+void NodeDB::get_SideFiles(std::vector<std::string>& v) const
+{
+	std::string sPath;
+	for (const auto& x : m_Bodies.m_Segments)
+	{
+		if (x.first && x.second.m_Size)
+		{
+			m_Bodies.get_Path(sPath, x.first);
+			v.push_back(sPath.substr(m_sPath.size()));
+		}
+	}
+
+	if (m_TxoArchive.m_State.m_Size)
+	{
+		m_TxoArchive.get_Path(sPath, m_TxoArchive.m_State.m_Gen);
+		v.push_back(sPath.substr(m_sPath.size()));
+	}
+}
+
 void NodeDB::Create()
 {
 	// create tables
@@ -551,6 +635,7 @@ void NodeDB::Create()
 	CreateTables23();
 	CreateTables27();
 	CreateTables28();
+	CreateTables29();
 }
 
 void NodeDB::CreateTables20()
@@ -621,6 +706,20 @@ void NodeDB::CreateTables28()
 	ExecQuick("CREATE INDEX [Idx" TblCache "_Hit" "] ON [" TblCache "] ([" TblCache_LastHit "]);");
 }
 
+void NodeDB::CreateTables29()
+{
+	ExecQuick("CREATE TABLE [" TblBodies "] ("
+		"[" TblBodies_State		"] INTEGER NOT NULL PRIMARY KEY,"
+		"[" TblBodies_Segment	"] INTEGER NOT NULL,"
+		"[" TblBodies_PosP		"] INTEGER,"
+		"[" TblBodies_SizeP		"] INTEGER,"
+		"[" TblBodies_PosE		"] INTEGER,"
+		"[" TblBodies_SizeE		"] INTEGER,"
+		"FOREIGN KEY (" TblBodies_State ") REFERENCES " TblStates "(OID))");
+
+	ExecQuick("CREATE INDEX [Idx" TblBodies "_Seg" "] ON [" TblBodies "] ([" TblBodies_Segment "]);");
+}
+
 void NodeDB::Vacuum()
 {
 	ExecQuick("VACUUM");
@@ -821,16 +920,30 @@ void NodeDB::Transaction::Start(NodeDB& db)
 void NodeDB::Transaction::Commit()
 {
 	assert(m_pDB);
+	m_pDB->ContractCacheFlush();
+	m_pDB->BodyStoreOnCommit(); // sync the bodies before the DB references them
+	m_pDB->TxoArchiveOnCommit();
 	m_pDB->ExecStep(Query::Commit, "COMMIT");
+
+	NodeDB* pDB = m_pDB;
 	m_pDB = NULL;
+	pDB->BodyStoreOnCommitted();
+	pDB->TxoArchiveOnCommitted();
+	pDB->KeyFiltersRebuild();
 }
 
 void NodeDB::Transaction::Rollback()
 {
 	if (m_pDB)
 	{
-		m_pDB->ExecStep(Query::Rollback, "ROLLBACK");
+		NodeDB* pDB = m_pDB;
 		m_pDB = nullptr;
+
+		pDB->ExecStep(Query::Rollback, "ROLLBACK");
+		pDB->BodyStoreOnRollback();
+		pDB->TxoArchiveOnRollback();
+		pDB->m_KernelCache.Clear();
+		pDB->ContractCacheClear();
 	}
 }
 
@@ -1033,6 +1146,8 @@ bool NodeDB::DeleteState(uint64_t rowid, uint64_t& rowPrev)
 	if (StateFlags::Reachable & nFlags)
 		TipReachableDel(rowid);
 
+	BodyDel(rowid);
+
 	rs.Reset(*this, Query::StateDel, "DELETE FROM " TblStates " WHERE rowid=?");
 	rs.put(0, rowid);
 
@@ -1477,13 +1592,37 @@ TxoID NodeDB::FindStateByTxoID(StateID& sid, TxoID id0)
 
 void NodeDB::SetStateBlock(uint64_t rowid, const Blob& bodyP, const Blob& bodyE, const PeerID& peer)
 {
-	Recordset rs(*this, Query::StateSetBlock, "UPDATE " TblStates " SET " TblStates_BodyP "=?," TblStates_BodyE "=?," TblStates_Peer "=? WHERE rowid=?");
-	if (bodyP.n)
-		rs.put(0, bodyP);
-	if (bodyE.n)
-		rs.put(1, bodyE);
-	rs.put(2, peer);
-	rs.put(3, rowid);
+	BodyDel(rowid); // in case it was already set
+
+	if (bodyP.n || bodyE.n)
+	{
+		uint32_t iSeg;
+		uint64_t posP, posE;
+		BodyReserve(static_cast<uint64_t>(bodyP.n) + bodyE.n);
+		BodyWrite(bodyP, iSeg, posP);
+		BodyWrite(bodyE, iSeg, posE);
+
+		Recordset rs(*this, Query::BodyIns, "INSERT INTO " TblBodies "(" TblBodies_State "," TblBodies_Segment "," TblBodies_PosP "," TblBodies_SizeP "," TblBodies_PosE "," TblBodies_SizeE ") VALUES(?,?,?,?,?,?)");
+		rs.put(0, rowid);
+		rs.put(1, iSeg);
+		if (bodyP.n)
+		{
+			rs.put(2, posP);
+			rs.put(3, bodyP.n);
+		}
+		if (bodyE.n)
+		{
+			rs.put(4, posE);
+			rs.put(5, bodyE.n);
+		}
+
+		rs.Step();
+		TestChanged1Row();
+	}
+
+	Recordset rs(*this, Query::StateSetBlock, "UPDATE " TblStates " SET " TblStates_BodyP "=NULL," TblStates_BodyE "=NULL," TblStates_Peer "=? WHERE rowid=?");
+	rs.put(0, peer);
+	rs.put(1, rowid);
 
 	rs.Step();
 	TestChanged1Row();
@@ -1491,20 +1630,51 @@ void NodeDB::SetStateBlock(uint64_t rowid, const Blob& bodyP, const Blob& bodyE,
 
 void NodeDB::GetStateBlock(uint64_t rowid, ByteBuffer* pP, ByteBuffer* pE, ByteBuffer* pRB)
 {
-	Recordset rs(*this, Query::StateGetBlock, "SELECT " TblStates_BodyP "," TblStates_BodyE "," TblStates_Rollback " FROM " TblStates " WHERE rowid=?");
+	Recordset rs(*this, Query::StateGetBlock, "SELECT "
+		TblStates "." TblStates_BodyP ","
+		TblStates "." TblStates_BodyE ","
+		TblStates "." TblStates_Rollback ","
+		TblBodies "." TblBodies_Segment ","
+		TblBodies "." TblBodies_PosP ","
+		TblBodies "." TblBodies_SizeP ","
+		TblBodies "." TblBodies_PosE ","
+		TblBodies "." TblBodies_SizeE
+		" FROM " TblStates " LEFT JOIN " TblBodies " ON " TblBodies "." TblBodies_State "=" TblStates ".rowid WHERE " TblStates ".rowid=?");
 	rs.put(0, rowid);
 	rs.StepStrict();
 
-	if (pP && !rs.IsNull(0))
-		rs.get(0, *pP);
-	if (pE && !rs.IsNull(1))
-		rs.get(1, *pE);
+	if (rs.IsNull(3))
+	{
+		// legacy, stored in the DB
+		if (pP && !rs.IsNull(0))
+			rs.get(0, *pP);
+		if (pE && !rs.IsNull(1))
+			rs.get(1, *pE);
+	}
+	else
+	{
+		uint32_t iSeg;
+		uint64_t pPos[2], pSize[2];
+		rs.get(3, iSeg);
+		rs.get(4, pPos[0]);
+		rs.get(5, pSize[0]);
+		rs.get(6, pPos[1]);
+		rs.get(7, pSize[1]);
+
+		if (pP && pSize[0])
+			BodyRead(*pP, iSeg, pPos[0], pSize[0]);
+		if (pE && pSize[1])
+			BodyRead(*pE, iSeg, pPos[1], pSize[1]);
+	}
+
 	if (pRB && !rs.IsNull(2))
 		rs.get(2, *pRB);
 }
 
 void NodeDB::DelStateBlockPP(uint64_t rowid)
 {
+	BodyDelP(rowid);
+
 	Recordset rs(*this, Query::StateDelBlockPP, "UPDATE " TblStates " SET " TblStates_BodyP "=NULL," TblStates_Peer "=NULL WHERE rowid=?");
 	rs.put(0, rowid);
 	rs.Step();
@@ -1513,6 +1683,8 @@ void NodeDB::DelStateBlockPP(uint64_t rowid)
 
 void NodeDB::DelStateBlockPPR(uint64_t rowid)
 {
+	BodyDelP(rowid);
+
 	Recordset rs(*this, Query::StateDelBlockPPR, "UPDATE " TblStates " SET " TblStates_BodyP "=NULL," TblStates_Rollback "=NULL," TblStates_Peer "=NULL WHERE rowid=?");
 	rs.put(0, rowid);
 	rs.Step();
@@ -1521,6 +1693,8 @@ void NodeDB::DelStateBlockPPR(uint64_t rowid)
 
 void NodeDB::DelStateBlockAll(uint64_t rowid)
 {
+	BodyDel(rowid);
+
 	Recordset rs(*this, Query::StateDelBlockAll, "UPDATE " TblStates
 		" SET " TblStates_BodyP "=NULL," TblStates_BodyE "=NULL," TblStates_Rollback "=NULL," TblStates_Peer "=NULL," TblStates_Extra "=NULL," TblStates_Txos "=NULL WHERE rowid=?");
 	rs.put(0, rowid);
@@ -2158,6 +2332,9 @@ void NodeDB::InsertKernel(const Blob& key, Height h)
 	rs.put(1, h);
 	rs.Step();
 	TestChanged1Row();
+
+	KernelCacheInvalidate(key);
+	KeyFilterAdd(m_KernelFilter, key);
 }
 
 void NodeDB::DeleteKernel(const Blob& key, Height h)
@@ -2169,6 +2346,8 @@ void NodeDB::DeleteKernel(const Blob& key, Height h)
 	rs.put(1, h);
 	rs.Step();
 
+	KernelCacheInvalidate(key);
+
 	uint32_t nRows = get_RowsChanged();
 	if (!nRows)
 		ThrowError("no krn");
@@ -2180,15 +2359,37 @@ void NodeDB::DeleteKernel(const Blob& key, Height h)
 
 Height NodeDB::FindKernel(const Blob& key)
 {
+	KeyLookupStats::Entry& st = m_KeyLookupStats.m_Kernels;
+	if (!m_KernelFilter.MayContain(KeyFilter::get_Hash(key)))
+	{
+		st.m_Filtered++;
+		return Rules::HeightGenesis - 1;
+	}
+
+	Height h;
+	bool bCacheable = (key.n == Merkle::Hash::nBytes);
+	if (bCacheable && m_KernelCache.Find(*reinterpret_cast<const Merkle::Hash*>(key.p), h))
+	{
+		st.m_Cached++;
+		return h;
+	}
+
+	st.m_Queried++;
+
 	Recordset rs(*this, Query::KernelFind, "SELECT " TblKernels_Height " FROM " TblKernels " WHERE " TblKernels_Key "=? ORDER BY " TblKernels_Height " DESC LIMIT 1");
 	rs.put(0, key);
 	if (!rs.Step())
+	{
+		st.m_Missed++;
 		return Rules::HeightGenesis - 1;
+	}
 
-	Height h;
 	rs.get(0, h);
-
 	assert(h >= Rules::HeightGenesis);
+
+	if (bCacheable)
+		m_KernelCache.Insert(*reinterpret_cast<const Merkle::Hash*>(key.p), h);
+
 	return h;
 }
 
@@ -2214,11 +2415,32 @@ void NodeDB::TxoAdd(TxoID id, const Blob& b)
 	rs.Step();
 }
 
+static std::string MakeBatchSql(const char* szPrefix, const char* szItem, const char* szSuffix, uint32_t nCount)
+{
+	std::string s = szPrefix;
+	for (uint32_t i = 0; i < nCount; i++)
+	{
+		if (i)
+			s += ',';
+		s += szItem;
+	}
+	s += szSuffix;
+	return s;
+}
+
 void NodeDB::TxoDel(TxoID id)
 {
 	Recordset rs(*this, Query::TxoDel, "DELETE FROM " TblTxo " WHERE " TblTxo_ID "=?");
 	rs.put(0, id);
 	rs.Step();
+
+	if (!get_RowsChanged() && TxoArchiveFind(id, nullptr, nullptr))
+	{
+		// archived. Becomes hidden once pruned
+		m_TxoArchive.m_State.m_Dead++;
+		return;
+	}
+
 	TestChanged1Row();
 }
 
@@ -2227,6 +2449,9 @@ void NodeDB::TxoDelFrom(TxoID id)
 	Recordset rs(*this, Query::TxoDelFrom, "DELETE FROM " TblTxo " WHERE " TblTxo_ID ">=?");
 	rs.put(0, id);
 	rs.Step();
+
+	if (id < m_TxoArchive.m_State.m_Watermark)
+		TxoArchiveRewrite(id); // should not happen normally, the archived range is below the rollback limit
 }
 
 void NodeDB::TxoSetSpent(TxoID id, Height h)
@@ -2244,12 +2469,46 @@ void NodeDB::EnumTxos(WalkerTxo& wlk, TxoID id0)
 {
 	wlk.m_Rs.Reset(*this, Query::TxoEnum, "SELECT " TblTxo_ID "," TblTxo_Value "," TblTxo_SpendHeight " FROM " TblTxo " WHERE " TblTxo_ID ">=? ORDER BY " TblTxo_ID);
 	wlk.m_Rs.put(0, id0);
+
+	wlk.m_pDB = this;
+	wlk.m_bRsPending = false;
+	wlk.m_bRsEnd = false;
+	TxoArchiveSeek(wlk.m_Arc, id0);
 }
 
 bool NodeDB::WalkerTxo::MoveNext()
 {
-	if (!m_Rs.Step())
+	if (!m_bRsPending && !m_bRsEnd)
+	{
+		if (m_Rs.Step())
+			m_bRsPending = true;
+		else
+			m_bRsEnd = true;
+	}
+
+	if (m_pDB && m_pDB->TxoArchiveNext(m_Arc))
+	{
+		TxoID id = m_Arc.m_vID[m_Arc.m_iPos];
+
+		TxoID idRs = 0;
+		if (m_bRsPending)
+			m_Rs.get(0, idRs);
+
+		if (!m_bRsPending || (id < idRs))
+		{
+			m_ID = id;
+			m_Value.p = m_Arc.m_pValues + TxoArchive::s_ValueSize * m_Arc.m_iPos;
+			m_Value.n = TxoArchive::s_ValueSize;
+			m_SpendHeight = m_Arc.m_vSpendHeight[m_Arc.m_iPos];
+
+			m_Arc.m_iPos++;
+			return true;
+		}
+	}
+
+	if (!m_bRsPending)
 		return false;
+	m_bRsPending = false;
 
 	m_Rs.get(0, m_ID);
 	m_Rs.get(1, m_Value);
@@ -2276,8 +2535,13 @@ void NodeDB::TxoGetValue(WalkerTxo& wlk, TxoID id0)
 	wlk.m_Rs.Reset(*this, Query::TxoGetValue, "SELECT " TblTxo_Value " FROM " TblTxo " WHERE " TblTxo_ID "=?");
 	wlk.m_Rs.put(0, id0);
 
-	wlk.m_Rs.StepStrict();
-	wlk.m_Rs.get(0, wlk.m_Value);
+	if (wlk.m_Rs.Step())
+		wlk.m_Rs.get(0, wlk.m_Value);
+	else
+	{
+		if (!TxoArchiveFind(id0, &wlk.m_Value, nullptr))
+			ThrowError("not found");
+	}
 }
 
 NodeDB::StreamMmr::StreamMmr(NodeDB& db, StreamType::Enum eType, bool bStoreH0)
@@ -2305,15 +2569,18 @@ void NodeDB::StreamMmr::ShrinkTo(uint64_t nCount)
 	ResizeTo(nCount);
 }
 
-void NodeDB::StreamMmr::ResizeTo(uint64_t nCount)
+void NodeDB::StreamMmr::ResizeTo(uint64_t nCount)
 {
 	m_DB.StreamResize(m_eType, get_TotalHashes(nCount, m_hStoreFrom) * sizeof(Merkle::Hash), get_TotalHashes(m_Count, m_hStoreFrom) * sizeof(Merkle::Hash));
 	m_Count = nCount;
+
+	if (m_FileCache.IsOpen())
+		m_FileCache.Resize(get_TotalHashes(nCount, 0));
 }
 
 void NodeDB::StreamMmr::LoadElement(Merkle::Hash& hv, const Merkle::Position& pos) const
 {
-	if (CacheFind(hv, pos))
+	if (FileCacheFind(hv, pos) || CacheFind(hv, pos))
 		return;
 
 	m_DB.StreamIO(m_eType, Pos2Idx(pos, m_hStoreFrom) * sizeof(Merkle::Hash), hv.m_pData, hv.nBytes, false);
@@ -2324,6 +2591,193 @@ void NodeDB::StreamMmr::SaveElement(const Merkle::Hash& hv, const Merkle::Positi
 {
 	m_DB.StreamIO(m_eType, Pos2Idx(pos, m_hStoreFrom) * sizeof(Merkle::Hash), Cast::NotConst(hv.m_pData), hv.nBytes, true);
 	CacheAdd(hv, pos);
+	FileCacheSave(hv, pos);
+}
+
+bool NodeDB::StreamMmr::FileCacheFind(Merkle::Hash& hv, const Merkle::Position& pos) const
+{
+	if (!m_FileCache.IsOpen())
+		return false;
+
+	const Merkle::Hash* p = m_FileCache.get_At(Pos2Idx(pos, 0));
+	if (!p)
+		return false;
+
+	hv = *p;
+	return true;
+}
+
+void NodeDB::StreamMmr::FileCacheSave(const Merkle::Hash& hv, const Merkle::Position& pos)
+{
+	if (!m_FileCache.IsOpen())
+		return;
+
+	Merkle::Hash* p = m_FileCache.get_At(Pos2Idx(pos, 0));
+	if (p)
+	{
+		m_FileCache.SetDirty();
+		*p = hv;
+	}
+}
+
+bool NodeDB::StreamMmr::FileCacheOpen(const char* sz, const Stamp& s)
+{
+	if (m_FileCache.Open(sz, s, get_TotalHashes(m_Count, 0)))
+		return true;
+
+	FileCacheRebuild();
+	return false;
+}
+
+void NodeDB::StreamMmr::FileCacheClose()
+{
+	m_FileCache.Close();
+}
+
+bool NodeDB::StreamMmr::IsFileCacheDirty() const
+{
+	return m_FileCache.IsOpen() && m_FileCache.get_Hdr().m_Dirty;
+}
+
+void NodeDB::StreamMmr::FileCacheFlush(const Stamp& s)
+{
+	if (m_FileCache.IsOpen())
+		m_FileCache.Flush(s);
+}
+
+void NodeDB::StreamMmr::FileCacheRebuild()
+{
+	m_FileCache.Resize(get_TotalHashes(m_Count, 0));
+
+	// The stream has the same (diagonal) order of the elements, just without the levels below m_hStoreFrom.
+	// Walk the elements in this order, and read the stream sequentially
+	std::vector<Merkle::Hash> v(0x8000);
+	uint64_t nTotal = get_TotalHashes(m_Count, m_hStoreFrom), nDone = 0;
+	size_t iBuf = 0, nBuf = 0;
+
+	Merkle::Position pos;
+	for (uint64_t n = 0; n < m_Count; n++)
+	{
+		for (pos.H = 0, pos.X = n; ; pos.H++, pos.X >>= 1)
+		{
+			if (pos.H >= m_hStoreFrom)
+			{
+				if (iBuf == nBuf)
+				{
+					assert(nDone < nTotal);
+					nBuf = static_cast<size_t>(std::min<uint64_t>(v.size(), nTotal - nDone));
+					m_DB.StreamIO(m_eType, nDone * sizeof(Merkle::Hash), v.front().m_pData, nBuf * sizeof(Merkle::Hash), false);
+					nDone += nBuf;
+					iBuf = 0;
+				}
+
+				*m_FileCache.get_At(Pos2Idx(pos, 0)) = v[iBuf++];
+			}
+
+			if (!(1 & pos.X))
+				break;
+		}
+	}
+}
+
+NodeDB::StreamMmr::FileCache::Hdr& NodeDB::StreamMmr::FileCache::get_Hdr() const
+{
+	return m_File.get_At<Hdr>(0);
+}
+
+Merkle::Hash* NodeDB::StreamMmr::FileCache::get_At(uint64_t idx) const
+{
+	if (!IsOpen() || (idx >= get_Hdr().m_Hashes))
+		return nullptr;
+
+	return &m_File.get_At<Merkle::Hash>(sizeof(Hdr) + sizeof(Merkle::Hash) * idx);
+}
+
+bool NodeDB::StreamMmr::FileCache::Open(const char* sz, const Stamp& s, uint64_t nHashes)
+{
+	// change this when format changes
+	static const uint8_t s_pSig[] = {
+		0xC4, 0x1B, 0x72, 0x5E,
+		0x09, 0xA8, 0x3D, 0xF6,
+		0x81, 0x57, 0xE2, 0x30,
+		0x9B, 0x6C, 0x14, 0xAD
+	};
+	static_assert(sizeof(s_pSig) == sizeof(Hdr::m_pSig));
+
+	m_File.Open(sz);
+
+	if (m_File.m_nMapping >= sizeof(Hdr))
+	{
+		const Hdr& h = get_Hdr();
+		if (!memcmp(h.m_pSig, s_pSig, sizeof(s_pSig)) &&
+			!h.m_Dirty &&
+			(h.m_Stamp == s) &&
+			(h.m_Hashes == nHashes) &&
+			(m_File.m_nMapping >= sizeof(Hdr) + sizeof(Merkle::Hash) * nHashes))
+			return true;
+	}
+
+	// reset
+	m_File.CloseMapping();
+	m_File.Resize(sizeof(Hdr));
+	m_File.OpenMapping();
+
+	Hdr& h = get_Hdr();
+	ZeroObject(h);
+	memcpy(h.m_pSig, s_pSig, sizeof(s_pSig));
+	SetDirty();
+
+	return false;
+}
+
+void NodeDB::StreamMmr::FileCache::Reserve(uint64_t nHashes)
+{
+	if (m_File.m_nMapping >= sizeof(Hdr) + sizeof(Merkle::Hash) * nHashes)
+		return;
+
+	const uint64_t nGranularity = 0x10000; // 2MB
+	nHashes = (nHashes + nGranularity - 1) / nGranularity * nGranularity;
+
+	m_File.CloseMapping();
+	m_File.Resize(sizeof(Hdr) + sizeof(Merkle::Hash) * nHashes);
+	m_File.OpenMapping();
+}
+
+void NodeDB::StreamMmr::FileCache::Resize(uint64_t nHashes)
+{
+	Reserve(nHashes);
+	SetDirty();
+
+	Hdr& h = get_Hdr(); // after reserve, mapping may have moved
+	uint64_t n0 = h.m_Hashes;
+	h.m_Hashes = nHashes;
+
+	if (nHashes > n0)
+		std::fill_n(get_At(n0), nHashes - n0, Zero); // the file is not truncated on shrink
+}
+
+void NodeDB::StreamMmr::FileCache::SetDirty()
+{
+	// The shared mapping is written back in arbitrary order. The dirty flag must reach the disk before any data modification,
+	// otherwise after a crash the modified data may be accepted with the old stamp.
+	Hdr& h = get_Hdr();
+	if (!h.m_Dirty)
+	{
+		h.m_Dirty = 1;
+		m_File.Sync();
+	}
+}
+
+void NodeDB::StreamMmr::FileCache::Flush(const Stamp& s)
+{
+	// Likewise the data must reach the disk before the header is marked clean. The header itself is not synced:
+	// if it's lost - the file remains dirty on disk, and is rebuilt on open.
+	Hdr& h = get_Hdr();
+	if (h.m_Dirty)
+		m_File.Sync();
+
+	h.m_Dirty = 0;
+	h.m_Stamp = s;
 }
 
 bool NodeDB::StreamMmr::CacheFind(Merkle::Hash& hv, const Merkle::Position& pos) const
@@ -2382,7 +2836,7 @@ void NodeDB::StatesMmr::LoadElement(Merkle::Hash& hv, const Merkle::Position& po
 		StreamMmr::LoadElement(hv, pos);
 	else
 	{
-		if (CacheFind(hv, pos))
+		if (FileCacheFind(hv, pos) || CacheFind(hv, pos))
 			return;
 
 		LoadStateHash(hv, pos.X + Rules::HeightGenesis);
@@ -2401,7 +2855,35 @@ void NodeDB::StatesMmr::SaveElement(const Merkle::Hash& hv, const Merkle::Positi
 	if (pos.H)
 		StreamMmr::SaveElement(hv, pos);
 	else
+	{
 		CacheAdd(hv, pos);
+		FileCacheSave(hv, pos);
+	}
+}
+
+void NodeDB::StatesMmr::FileCacheRebuild()
+{
+	StreamMmr::FileCacheRebuild();
+
+	// state hashes, not stored in the stream
+	Recordset rs(m_DB, Query::StateEnumActiveHashes, "SELECT " TblStates_Height "," TblStates_Hash " FROM " TblStates " WHERE " TblStates_Height ">=? AND " TblStates_Height "<? AND (" TblStates_Flags " & ?)");
+	rs.put(0, Rules::HeightGenesis);
+	rs.put(1, Rules::HeightGenesis + m_Count);
+	rs.put(2, StateFlags::Active);
+
+	uint64_t nCount = 0;
+	for (; rs.Step(); nCount++)
+	{
+		Merkle::Position pos;
+		pos.H = 0;
+		rs.get(0, pos.X);
+		pos.X -= Rules::HeightGenesis;
+
+		rs.get(1, *m_FileCache.get_At(Pos2Idx(pos, 0)));
+	}
+
+	if (nCount != m_Count)
+		ThrowInconsistent();
 }
 
 const uint32_t NodeDB::s_StreamBlob = 1024*1024; // arbitrary, but should not be changed after DB is created
@@ -2527,14 +3009,31 @@ bool NodeDB::UniqueInsertSafe(const Blob& key, const Blob* pVal)
 	if (pVal)
 		rs.put(1, *pVal);
 
-	return rs.StepModifySafe();
+	if (!rs.StepModifySafe())
+		return false;
+
+	KeyFilterAdd(m_UniqueFilter, key);
+	return true;
 }
 
 bool NodeDB::UniqueFind(const Blob& key, Recordset& rs)
 {
+	KeyLookupStats::Entry& st = m_KeyLookupStats.m_Unique;
+	if (!m_UniqueFilter.MayContain(KeyFilter::get_Hash(key)))
+	{
+		st.m_Filtered++;
+		return false;
+	}
+
+	st.m_Queried++;
+
 	rs.Reset(*this, Query::UniqueFind, "SELECT " TblUnique_Value " FROM " TblUnique " WHERE " TblUnique_Key "=?");
 	rs.put(0, key);
-	return rs.Step();
+	if (rs.Step())
+		return true;
+
+	st.m_Missed++;
+	return false;
 }
 
 void NodeDB::UniqueDeleteStrict(const Blob& key)
@@ -2954,17 +3453,34 @@ void NodeDB::AssetEvtsDeleteFrom(Height h)
 
 bool NodeDB::ContractDataFind(const Blob& key, Blob& data, Recordset& rs)
 {
-	rs.Reset(*this, Query::ContractDataFind, "SELECT " TblContracts_Value " FROM " TblContracts " WHERE " TblContracts_Key "=?");
-	rs.put(0, key);
-	if (!rs.Step())
+	ContractCache::Entry* pE = m_ContractCache.Find(key);
+	if (pE)
+		m_ContractCacheStats.m_Hits++;
+	else
+	{
+		m_ContractCacheStats.m_Misses++;
+
+		rs.Reset(*this, Query::ContractDataFind, "SELECT " TblContracts_Value " FROM " TblContracts " WHERE " TblContracts_Key "=?");
+		rs.put(0, key);
+
+		bool bFound = rs.Step();
+		if (bFound)
+			rs.get(0, data);
+
+		pE = &ContractCacheCreate(key, bFound ? &data : nullptr);
+	}
+
+	if (!pE->m_Exists)
 		return false;
 
-	rs.get(0, data);
+	data = pE->m_Data;
 	return true;
 }
 
 bool NodeDB::ContractDataFindNext(Blob& key, Recordset& rs)
 {
+	ContractCacheFlush();
+
 	rs.Reset(*this, Query::ContractDataFindNext, "SELECT " TblContracts_Key " FROM " TblContracts " WHERE " TblContracts_Key ">?");
 	rs.put(0, key);
 	if (!rs.Step())
@@ -2975,6 +3491,45 @@ bool NodeDB::ContractDataFindNext(Blob& key, Recordset& rs)
 }
 
 void NodeDB::ContractDataInsert(const Blob& key, const Blob& data)
+{
+	ContractCache::Entry* pE = m_ContractCache.Find(key);
+	if (!pE)
+		ContractDataInsertRaw(key, data);
+	else
+	{
+		if (pE->m_Exists)
+			ThrowError("1row change failed");
+		ContractCacheModify(*pE, &data);
+	}
+}
+
+void NodeDB::ContractDataUpdate(const Blob& key, const Blob& data)
+{
+	ContractCache::Entry* pE = m_ContractCache.Find(key);
+	if (!pE)
+		ContractDataUpdateRaw(key, data);
+	else
+	{
+		if (!pE->m_Exists)
+			ThrowError("1row change failed");
+		ContractCacheModify(*pE, &data);
+	}
+}
+
+void NodeDB::ContractDataDel(const Blob& key)
+{
+	ContractCache::Entry* pE = m_ContractCache.Find(key);
+	if (!pE)
+		ContractDataDelRaw(key);
+	else
+	{
+		if (!pE->m_Exists)
+			ThrowError("1row change failed");
+		ContractCacheModify(*pE, nullptr);
+	}
+}
+
+void NodeDB::ContractDataInsertRaw(const Blob& key, const Blob& data)
 {
 	Recordset rs(*this, Query::ContractDataInsert, "INSERT INTO " TblContracts " (" TblContracts_Key "," TblContracts_Value ") VALUES(?,?)");
 	rs.put(0, key);
@@ -2984,7 +3539,7 @@ void NodeDB::ContractDataInsert(const Blob& key, const Blob& data)
 	TestChanged1Row();
 }
 
-void NodeDB::ContractDataUpdate(const Blob& key, const Blob& data)
+void NodeDB::ContractDataUpdateRaw(const Blob& key, const Blob& data)
 {
 	Recordset rs(*this, Query::ContractDataUpdate, "UPDATE " TblContracts " SET " TblContracts_Value "=? WHERE " TblContracts_Key "=?");
 	rs.put(0, data);
@@ -2994,7 +3549,7 @@ void NodeDB::ContractDataUpdate(const Blob& key, const Blob& data)
 	TestChanged1Row();
 }
 
-void NodeDB::ContractDataDel(const Blob& key)
+void NodeDB::ContractDataDelRaw(const Blob& key)
 {
 	Recordset rs(*this, Query::ContractDataDel, "DELETE FROM " TblContracts " WHERE " TblContracts_Key "=?");
 	rs.put(0, key);
@@ -3005,12 +3560,16 @@ void NodeDB::ContractDataDel(const Blob& key)
 
 void NodeDB::ContractDataDelAll()
 {
+	ContractCacheClear();
+
 	Recordset rs(*this, Query::ContractDataDelAll, "DELETE FROM " TblContracts);
 	rs.Step();
 }
 
 void NodeDB::ContractDataEnum(WalkerContractData& wlk, const Blob& keyMin, const Blob& keyMax)
 {
+	ContractCacheFlush();
+
 	wlk.m_Rs.Reset(*this, Query::ContractDataEnum, "SELECT " TblContracts_Key "," TblContracts_Value " FROM " TblContracts " WHERE " TblContracts_Key ">=? AND " TblContracts_Key "<=? ORDER BY " TblContracts_Key);
 	wlk.m_Rs.put(0, keyMin);
 	wlk.m_Rs.put(1, keyMax);
@@ -3018,6 +3577,8 @@ void NodeDB::ContractDataEnum(WalkerContractData& wlk, const Blob& keyMin, const
 
 void NodeDB::ContractDataEnum(WalkerContractData& wlk)
 {
+	ContractCacheFlush();
+
 	wlk.m_Rs.Reset(*this, Query::ContractDataEnumAll, "SELECT " TblContracts_Key "," TblContracts_Value " FROM " TblContracts " ORDER BY " TblContracts_Key);
 }
 
@@ -3097,4 +3658,1275 @@ bool NodeDB::ContractLog::Walker::MoveNext()
 	return true;
 }
 
+/////////////////////////
+// BodyStore
+void NodeDB::BodyStore::get_Path(std::string& s, uint32_t iSeg) const
+{
+	char sz[0x20];
+	snprintf(sz, _countof(sz), ".blk%06u", iSeg);
+	s = m_sPath + sz;
+}
+
+uint64_t NodeDB::BodyStore::get_FileSize(uint32_t iSeg) const
+{
+	std::string sPath;
+	get_Path(sPath, iSeg);
+
+	std::FStream fs;
+	return fs.Open(sPath.c_str(), true) ? fs.get_Remaining() : 0;
+}
+
+void NodeDB::BodyStore::Close()
+{
+	m_Writer.Close();
+	m_Reader.Close();
+	m_iReader = 0;
+	m_iActive = 0;
+	m_sPath.clear();
+	m_Segments.clear();
+	m_setCompact.clear();
+	m_setUnsynced.clear();
+	m_vErase.clear();
+	m_Mapped.clear();
+}
+
+void NodeDB::BodyStoreOpen(const char* szPath)
+{
+	m_Bodies.Close();
+	m_Bodies.m_sPath = szPath;
+
+	BodyStoreLoad();
+
+	std::string sPath;
+	for (uint32_t iSeg = 1; iSeg < m_Bodies.m_iActive; iSeg++)
+	{
+		if (m_Bodies.m_Segments.end() == m_Bodies.m_Segments.find(iSeg))
+		{
+			// leftover of the compaction interrupted after the commit
+			m_Bodies.get_Path(sPath, iSeg);
+			DeleteFile(sPath.c_str());
+		}
+	}
+}
+
+void NodeDB::BodyStoreLoad()
+{
+	m_Bodies.m_Writer.Close();
+	m_Bodies.m_Segments.clear();
+	m_Bodies.m_iActive = static_cast<uint32_t>(ParamIntGetDef(ParamID::BodiesSegment));
+
+	Recordset rs(*this, Query::BodyStat, "SELECT " TblBodies_Segment ",SUM(IFNULL(" TblBodies_SizeP ",0)+IFNULL(" TblBodies_SizeE ",0)) FROM " TblBodies " GROUP BY " TblBodies_Segment);
+	while (rs.Step())
+	{
+		uint32_t iSeg;
+		rs.get(0, iSeg);
+		rs.get(1, m_Bodies.m_Segments[iSeg].m_Live);
+	}
+
+	if (m_Bodies.m_iActive)
+		m_Bodies.m_Segments[m_Bodies.m_iActive]; // create if missing
+
+	for (auto it = m_Bodies.m_Segments.begin(); m_Bodies.m_Segments.end() != it; it++)
+	{
+		BodyStore::Segment& seg = it->second;
+		seg.m_Size = m_Bodies.get_FileSize(it->first);
+
+		if (seg.m_Live > seg.m_Size)
+			ThrowError("block bodies segment truncated");
+
+		// pending compaction is not persisted, re-evaluate
+		if ((it->first != m_Bodies.m_iActive) && (seg.m_Live * 4 < seg.m_Size))
+			m_Bodies.m_setCompact.insert(it->first);
+	}
+}
+
+void NodeDB::BodyStoreSetSegmentMax(uint64_t n)
+{
+	m_Bodies.m_SegmentMax = n;
+}
+
+void NodeDB::BodyReserve(uint64_t nSize)
+{
+	if (m_Bodies.m_iActive)
+	{
+		const BodyStore::Segment& seg = m_Bodies.m_Segments[m_Bodies.m_iActive];
+		if (seg.m_Size && (seg.m_Size + nSize > m_Bodies.m_SegmentMax))
+		{
+			m_Bodies.m_Writer.Close();
+
+			if (!seg.m_Live)
+				m_Bodies.m_setCompact.insert(m_Bodies.m_iActive);
+
+			m_Bodies.m_iActive++;
+		}
+	}
+	else
+		m_Bodies.m_iActive = 1;
+
+	if (!m_Bodies.m_Writer.IsOpen())
+	{
+		ParamIntSet(ParamID::BodiesSegment, m_Bodies.m_iActive);
+
+		// the file may already exist, if a transaction that switched to it was rolled back. Just append to it
+		BodyStore::Segment& seg = m_Bodies.m_Segments[m_Bodies.m_iActive];
+		seg.m_Size = m_Bodies.get_FileSize(m_Bodies.m_iActive);
+
+		std::string sPath;
+		m_Bodies.get_Path(sPath, m_Bodies.m_iActive);
+		m_Bodies.m_Writer.Open(sPath.c_str(), false, true, true);
+	}
+}
+
+void NodeDB::BodyWrite(const Blob& x, uint32_t& iSeg, uint64_t& pos)
+{
+	assert(m_Bodies.m_Writer.IsOpen());
+
+	iSeg = m_Bodies.m_iActive;
+	BodyStore::Segment& seg = m_Bodies.m_Segments[iSeg];
+	pos = seg.m_Size;
+
+	if (x.n)
+	{
+		m_Bodies.m_Writer.write(x.p, x.n);
+		seg.m_Size += x.n;
+		seg.m_Live += x.n;
+
+		m_Bodies.m_setUnsynced.insert(iSeg);
+	}
+}
+
+void NodeDB::BodyRead(ByteBuffer& buf, uint32_t iSeg, uint64_t pos, uint64_t nSize)
+{
+	if ((iSeg == m_Bodies.m_iActive) && m_Bodies.m_Writer.IsOpen())
+		m_Bodies.m_Writer.Flush();
+
+	if (m_Bodies.m_iReader != iSeg)
+	{
+		m_Bodies.m_Reader.Close();
+		m_Bodies.m_iReader = 0;
+
+		std::string sPath;
+		m_Bodies.get_Path(sPath, iSeg);
+		if (!m_Bodies.m_Reader.Open(sPath.c_str(), true))
+			ThrowError("block bodies segment missing");
+
+		m_Bodies.m_iReader = iSeg;
+	}
+
+	buf.resize(static_cast<size_t>(nSize));
+
+	try {
+		m_Bodies.m_Reader.Seek(pos);
+		m_Bodies.m_Reader.read(&buf.front(), buf.size());
+	}
+	catch (const std::exception&) {
+		m_Bodies.m_Reader.Close(); // the stream state may be broken
+		m_Bodies.m_iReader = 0;
+		ThrowError("block bodies segment read");
+	}
+}
+
+const MappedFileRaw* NodeDB::BodyMap(uint32_t iSeg)
+{
+	if (sizeof(void*) < sizeof(uint64_t))
+		return nullptr; // don't exhaust the address space
+
+	auto itSeg = m_Bodies.m_Segments.find(iSeg);
+	if ((m_Bodies.m_Segments.end() == itSeg) || !itSeg->second.m_Size)
+		return nullptr;
+
+	std::unique_ptr<MappedFileRaw>& pMf = m_Bodies.m_Mapped[iSeg];
+	if (!pMf)
+	{
+		std::string sPath;
+		m_Bodies.get_Path(sPath, iSeg);
+
+		pMf = std::make_unique<MappedFileRaw>();
+		try {
+			pMf->Open(sPath.c_str(), true); // sealed, never modified in place. Fails if it's missing
+		}
+		catch (const std::exception&) {
+			m_Bodies.m_Mapped.erase(iSeg);
+			return nullptr;
+		}
+	}
+
+	return pMf.get();
+}
+
+bool NodeDB::GetStateBlockRef(uint64_t rowid, Blob* pP, Blob* pE)
+{
+	Recordset rs(*this, Query::BodyGetRef, "SELECT " TblBodies_Segment "," TblBodies_PosP "," TblBodies_SizeP "," TblBodies_PosE "," TblBodies_SizeE " FROM " TblBodies " WHERE " TblBodies_State "=?");
+	rs.put(0, rowid);
+	if (!rs.Step())
+		return false; // legacy, or none
+
+	uint32_t iSeg;
+	uint64_t pPos[2], pSize[2]; // NULL is read as 0
+	rs.get(0, iSeg);
+	rs.get(1, pPos[0]);
+	rs.get(2, pSize[0]);
+	rs.get(3, pPos[1]);
+	rs.get(4, pSize[1]);
+
+	if (iSeg == m_Bodies.m_iActive)
+		return false;
+
+	const MappedFileRaw* pMf = BodyMap(iSeg);
+	if (!pMf)
+		return false;
+
+	Blob* ppRes[] = { pP, pE };
+	for (uint32_t i = 0; i < _countof(ppRes); i++)
+	{
+		if (!ppRes[i])
+			continue;
+
+		if ((pSize[i] > pMf->m_nMapping) || (pPos[i] > pMf->m_nMapping - pSize[i]))
+			ThrowError("block bodies segment truncated");
+
+		ppRes[i]->p = pMf->m_pMapping + pPos[i];
+		ppRes[i]->n = static_cast<uint32_t>(pSize[i]);
+	}
+
+	return true;
+}
+
+void NodeDB::BodyFree(uint32_t iSeg, uint64_t nSize)
+{
+	if (!nSize)
+		return;
+
+	auto it = m_Bodies.m_Segments.find(iSeg);
+	if ((m_Bodies.m_Segments.end() == it) || (it->second.m_Live < nSize))
+		ThrowInconsistent();
+
+	BodyStore::Segment& seg = it->second;
+	seg.m_Live -= nSize;
+
+	// compact when most of the segment is dead
+	if ((iSeg != m_Bodies.m_iActive) && (seg.m_Live * 4 < seg.m_Size))
+		m_Bodies.m_setCompact.insert(iSeg);
+}
+
+void NodeDB::BodyDelP(uint64_t rowid)
+{
+	Recordset rs(*this, Query::BodyGet, "SELECT " TblBodies_Segment "," TblBodies_SizeP "," TblBodies_SizeE " FROM " TblBodies " WHERE " TblBodies_State "=?");
+	rs.put(0, rowid);
+	if (!rs.Step() || rs.IsNull(1))
+		return;
+
+	uint32_t iSeg;
+	uint64_t nSize;
+	rs.get(0, iSeg);
+	rs.get(1, nSize);
+
+	rs.Reset(*this, Query::BodyDelP, "UPDATE " TblBodies " SET " TblBodies_PosP "=NULL," TblBodies_SizeP "=NULL WHERE " TblBodies_State "=?");
+	rs.put(0, rowid);
+	rs.Step();
+	TestChanged1Row();
+
+	BodyFree(iSeg, nSize);
+}
+
+void NodeDB::BodyDel(uint64_t rowid)
+{
+	Recordset rs(*this, Query::BodyGet, "SELECT " TblBodies_Segment "," TblBodies_SizeP "," TblBodies_SizeE " FROM " TblBodies " WHERE " TblBodies_State "=?");
+	rs.put(0, rowid);
+	if (!rs.Step())
+		return;
+
+	uint32_t iSeg;
+	uint64_t nSizeP, nSizeE;
+	rs.get(0, iSeg);
+	rs.get(1, nSizeP); // NULL is read as 0
+	rs.get(2, nSizeE);
+
+	rs.Reset(*this, Query::BodyDel, "DELETE FROM " TblBodies " WHERE " TblBodies_State "=?");
+	rs.put(0, rowid);
+	rs.Step();
+	TestChanged1Row();
+
+	BodyFree(iSeg, nSizeP + nSizeE);
+}
+
+void NodeDB::BodyCompact(uint32_t iSeg)
+{
+	assert(iSeg != m_Bodies.m_iActive);
+
+	struct Entry {
+		uint64_t m_Row;
+		uint64_t m_pPos[2];
+		uint64_t m_pSize[2];
+	};
+
+	std::vector<Entry> vEntries;
+	{
+		Recordset rs(*this, Query::BodyEnumSegment, "SELECT " TblBodies_State "," TblBodies_PosP "," TblBodies_SizeP "," TblBodies_PosE "," TblBodies_SizeE " FROM " TblBodies " WHERE " TblBodies_Segment "=?");
+		rs.put(0, iSeg);
+
+		while (rs.Step())
+		{
+			Entry& e = vEntries.emplace_back();
+			rs.get(0, e.m_Row);
+			rs.get(1, e.m_pPos[0]);
+			rs.get(2, e.m_pSize[0]);
+			rs.get(3, e.m_pPos[1]);
+			rs.get(4, e.m_pSize[1]);
+		}
+	}
+
+	BodyStore::Segment& seg = m_Bodies.m_Segments[iSeg];
+
+	ByteBuffer buf;
+	for (size_t i = 0; i < vEntries.size(); i++)
+	{
+		const Entry& e = vEntries[i];
+		BodyReserve(e.m_pSize[0] + e.m_pSize[1]);
+
+		uint32_t iSegNew = 0;
+		uint64_t pPosNew[2];
+
+		for (uint32_t j = 0; j < 2; j++)
+		{
+			if (e.m_pSize[j])
+				BodyRead(buf, iSeg, e.m_pPos[j], e.m_pSize[j]);
+			else
+				buf.clear();
+
+			BodyWrite(buf, iSegNew, pPosNew[j]);
+		}
+
+		Recordset rs(*this, Query::BodyMove, "UPDATE " TblBodies " SET " TblBodies_Segment "=?," TblBodies_PosP "=?," TblBodies_PosE "=? WHERE " TblBodies_State "=?");
+		rs.put(0, iSegNew);
+		if (e.m_pSize[0])
+			rs.put(1, pPosNew[0]);
+		if (e.m_pSize[1])
+			rs.put(2, pPosNew[1]);
+		rs.put(3, e.m_Row);
+		rs.Step();
+		TestChanged1Row();
+
+		seg.m_Live -= e.m_pSize[0] + e.m_pSize[1];
+	}
+
+	if (seg.m_Live)
+		ThrowInconsistent();
+
+	m_Bodies.m_vErase.push_back(iSeg);
+}
+
+bool NodeDB::BodyStoreCompact()
+{
+	while (!m_Bodies.m_setCompact.empty())
+	{
+		uint32_t iSeg = *m_Bodies.m_setCompact.begin();
+		m_Bodies.m_setCompact.erase(m_Bodies.m_setCompact.begin());
+
+		if (iSeg != m_Bodies.m_iActive)
+		{
+			BodyCompact(iSeg);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void NodeDB::BodyStoreOnCommit()
+{
+	// bodies must be durable before the DB references to them are committed
+	if (m_Bodies.m_Writer.IsOpen())
+		m_Bodies.m_Writer.Flush();
+
+	std::string sPath;
+	for (uint32_t iSeg : m_Bodies.m_setUnsynced)
+	{
+		m_Bodies.get_Path(sPath, iSeg);
+		if (!SyncFile(sPath.c_str()))
+			ThrowError("block bodies segment sync");
+	}
+
+	m_Bodies.m_setUnsynced.clear();
+}
+
+void NodeDB::BodyStoreOnCommitted()
+{
+	std::string sPath;
+	for (size_t i = 0; i < m_Bodies.m_vErase.size(); i++)
+	{
+		uint32_t iSeg = m_Bodies.m_vErase[i];
+		if (m_Bodies.m_iReader == iSeg)
+		{
+			m_Bodies.m_Reader.Close();
+			m_Bodies.m_iReader = 0;
+		}
+
+		m_Bodies.m_Segments.erase(iSeg);
+		m_Bodies.m_Mapped.erase(iSeg);
+
+		m_Bodies.get_Path(sPath, iSeg);
+		DeleteFile(sPath.c_str());
+	}
+
+	m_Bodies.m_vErase.clear();
+}
+
+void NodeDB::BodyStoreOnRollback()
+{
+	// the written data is orphaned, it'll be reclaimed with the segment
+	std::set<uint32_t> setCompact;
+	setCompact.swap(m_Bodies.m_setCompact);
+	setCompact.insert(m_Bodies.m_vErase.begin(), m_Bodies.m_vErase.end());
+
+	m_Bodies.m_setUnsynced.clear();
+	m_Bodies.m_vErase.clear();
+	m_Bodies.m_Mapped.clear(); // the active segment may be reverted
+
+	if (!m_Bodies.m_sPath.empty())
+	{
+		BodyStoreLoad();
+
+		// segments emptied by the committed transactions are not referenced by the DB anymore, keep them pending
+		for (uint32_t iSeg : setCompact)
+			if ((iSeg != m_Bodies.m_iActive) && (m_Bodies.m_Segments.end() == m_Bodies.m_Segments.find(iSeg)))
+				m_Bodies.m_setCompact.insert(iSeg);
+	}
+}
+
+/////////////////////////
+// TxoArchive
+#pragma pack (push, 1)
+struct TxoArchiveChunkHdr
+{
+	uint64_t m_ID0;
+	uint64_t m_ID1;
+	uint32_t m_Count;
+	uint32_t m_SizeIDs;
+	uint32_t m_SizeHeights;
+
+	void Convert()
+	{
+		// to/from LE, symmetric
+		m_ID0 = ByteOrder::to_le(m_ID0);
+		m_ID1 = ByteOrder::to_le(m_ID1);
+		m_Count = ByteOrder::to_le(m_Count);
+		m_SizeIDs = ByteOrder::to_le(m_SizeIDs);
+		m_SizeHeights = ByteOrder::to_le(m_SizeHeights);
+	}
+};
+#pragma pack (pop)
+
+static void TxoArchiveVarWrite(ByteBuffer& buf, uint64_t x)
+{
+	for (; x >= 0x80; x >>= 7)
+		buf.push_back(static_cast<uint8_t>(x) | 0x80);
+	buf.push_back(static_cast<uint8_t>(x));
+}
+
+static const uint8_t* TxoArchiveVarRead(const uint8_t* p, const uint8_t* pEnd, uint64_t& x)
+{
+	x = 0;
+	for (uint32_t nShift = 0; (p != pEnd) && (nShift < 64); nShift += 7)
+	{
+		uint8_t c = *p++;
+		x |= static_cast<uint64_t>(c & 0x7f) << nShift;
+		if (!(c & 0x80))
+			return p;
+	}
+
+	return nullptr; // malformed
+}
+
+void NodeDB::TxoArchive::get_Path(std::string& s, uint64_t nGen) const
+{
+	char sz[0x20];
+	snprintf(sz, _countof(sz), ".txo%06u", static_cast<uint32_t>(nGen));
+	s = m_sPath + sz;
+}
+
+bool NodeDB::TxoArchive::IsAlive(TxoID id, Height hSpend) const
+{
+	return (hSpend > m_State.m_hPruned) || (id < m_State.m_idKeep);
+}
+
+void NodeDB::TxoArchive::Close()
+{
+	m_File.Close();
+	m_bOpen = false;
+	m_bWritten = false;
+	m_vChunks.clear();
+	m_Lookup.m_iChunk = static_cast<size_t>(-1);
+}
+
+void NodeDB::TxoArchiveOpen(const char* szPath)
+{
+	m_TxoArchive.Close();
+	m_TxoArchive.m_sPath = szPath;
+
+	TxoArchiveLoad();
+
+	// leftovers of the interrupted rewrite, either before or after the commit
+	std::string sPath;
+	m_TxoArchive.get_Path(sPath, m_TxoArchive.m_State.m_Gen + 1);
+	DeleteFile(sPath.c_str());
+
+	if (m_TxoArchive.m_State.m_Gen)
+	{
+		m_TxoArchive.get_Path(sPath, m_TxoArchive.m_State.m_Gen - 1);
+		DeleteFile(sPath.c_str());
+	}
+}
+
+void NodeDB::TxoArchiveLoad()
+{
+	TxoArchive& x = m_TxoArchive;
+	x.Close();
+	x.m_State = TxoArchive::State();
+
+	uint64_t pArr[7];
+	Blob blob(pArr, sizeof(pArr));
+	if (ParamGet(ParamID::TxoArchive, nullptr, &blob))
+	{
+		for (size_t i = 0; i < _countof(pArr); i++)
+			pArr[i] = ByteOrder::from_le(pArr[i]);
+
+		x.m_State.m_Gen = pArr[0];
+		x.m_State.m_Size = pArr[1];
+		x.m_State.m_Watermark = pArr[2];
+		x.m_State.m_Count = pArr[3];
+		x.m_State.m_Dead = pArr[4];
+		x.m_State.m_hPruned = pArr[5];
+		x.m_State.m_idKeep = pArr[6];
+	}
+
+	x.m_GenCommitted = x.m_State.m_Gen;
+
+	if (!x.m_State.m_Size)
+		return; // the file is created on the first write
+
+	std::string sPath;
+	x.get_Path(sPath, x.m_State.m_Gen);
+	x.m_File.Open(sPath.c_str());
+	x.m_bOpen = true;
+
+	if (x.m_File.m_nMapping < x.m_State.m_Size)
+		ThrowError("txo archive truncated");
+
+	if (x.m_File.m_nMapping > x.m_State.m_Size)
+	{
+		// uncommitted data
+		x.m_File.CloseMapping();
+		x.m_File.Resize(x.m_State.m_Size);
+		x.m_File.OpenMapping();
+	}
+
+	// index the chunks
+	for (uint64_t nPos = 0; nPos < x.m_State.m_Size; )
+	{
+		TxoArchiveChunkHdr hdr;
+		if (nPos + sizeof(hdr) > x.m_State.m_Size)
+			ThrowError("txo archive corrupted");
+
+		memcpy(&hdr, x.m_File.get_Base() + nPos, sizeof(hdr));
+		hdr.Convert();
+
+		TxoArchive::Chunk& c = x.m_vChunks.emplace_back();
+		c.m_ID0 = hdr.m_ID0;
+		c.m_ID1 = hdr.m_ID1;
+		c.m_Pos = nPos;
+
+		nPos += sizeof(hdr) + hdr.m_SizeIDs + static_cast<uint64_t>(hdr.m_Count) * TxoArchive::s_ValueSize + hdr.m_SizeHeights;
+		if (!hdr.m_Count || (hdr.m_ID1 < hdr.m_ID0) || (nPos > x.m_State.m_Size))
+			ThrowError("txo archive corrupted");
+	}
+}
+
+void NodeDB::TxoArchiveSaveState()
+{
+	const TxoArchive::State& st = m_TxoArchive.m_State;
+	uint64_t pArr[] = {
+		st.m_Gen,
+		st.m_Size,
+		st.m_Watermark,
+		st.m_Count,
+		st.m_Dead,
+		st.m_hPruned,
+		st.m_idKeep
+	};
+
+	for (size_t i = 0; i < _countof(pArr); i++)
+		pArr[i] = ByteOrder::to_le(pArr[i]);
+
+	Blob blob(pArr, sizeof(pArr));
+	ParamSet(ParamID::TxoArchive, nullptr, &blob);
+}
+
+void NodeDB::TxoArchiveDecode(TxoArchiveChunk& c, size_t iChunk)
+{
+	c.m_iPos = 0;
+	if (c.m_iChunk == iChunk)
+		return;
+
+	const TxoArchive& x = m_TxoArchive;
+	assert(iChunk < x.m_vChunks.size());
+
+	const uint8_t* p = x.m_File.get_Base() + x.m_vChunks[iChunk].m_Pos;
+
+	TxoArchiveChunkHdr hdr;
+	memcpy(&hdr, p, sizeof(hdr));
+	hdr.Convert();
+	p += sizeof(hdr);
+
+	c.m_iChunk = static_cast<size_t>(-1); // in case of failure
+	c.m_vID.resize(hdr.m_Count);
+	c.m_vSpendHeight.resize(hdr.m_Count);
+
+	const uint8_t* pEnd = p + hdr.m_SizeIDs;
+	TxoID id = hdr.m_ID0;
+	for (uint32_t i = 0; i < hdr.m_Count; i++)
+	{
+		if (i)
+		{
+			uint64_t dID;
+			p = TxoArchiveVarRead(p, pEnd, dID);
+			if (!p || !dID)
+				ThrowError("txo archive corrupted");
+			id += dID;
+		}
+		c.m_vID[i] = id;
+	}
+
+	c.m_pValues = pEnd;
+	p = pEnd + static_cast<size_t>(hdr.m_Count) * TxoArchive::s_ValueSize;
+	pEnd = p + hdr.m_SizeHeights;
+
+	for (uint32_t i = 0; i < hdr.m_Count; i++)
+	{
+		p = TxoArchiveVarRead(p, pEnd, c.m_vSpendHeight[i]);
+		if (!p)
+			ThrowError("txo archive corrupted");
+	}
+
+	c.m_iChunk = iChunk;
+}
+
+void NodeDB::TxoArchiveSeek(TxoArchiveChunk& c, TxoID id)
+{
+	const std::vector<TxoArchive::Chunk>& v = m_TxoArchive.m_vChunks;
+
+	// first chunk that ends at or after id
+	auto it = std::lower_bound(v.begin(), v.end(), id, [](const TxoArchive::Chunk& x, TxoID val) { return x.m_ID1 < val; });
+	size_t iChunk = it - v.begin();
+
+	if (v.size() == iChunk)
+	{
+		c.m_iChunk = iChunk;
+		c.m_iPos = 0;
+		return;
+	}
+
+	TxoArchiveDecode(c, iChunk);
+	c.m_iPos = static_cast<uint32_t>(std::lower_bound(c.m_vID.begin(), c.m_vID.end(), id) - c.m_vID.begin());
+}
+
+bool NodeDB::TxoArchiveNext(TxoArchiveChunk& c)
+{
+	const std::vector<TxoArchive::Chunk>& v = m_TxoArchive.m_vChunks;
+
+	while (c.m_iChunk < v.size())
+	{
+		if (c.m_iPos < c.m_vID.size())
+		{
+			if (m_TxoArchive.IsAlive(c.m_vID[c.m_iPos], c.m_vSpendHeight[c.m_iPos]))
+				return true;
+			c.m_iPos++;
+		}
+		else
+		{
+			if (c.m_iChunk + 1 == v.size())
+			{
+				c.m_iChunk = v.size();
+				break;
+			}
+
+			TxoArchiveDecode(c, c.m_iChunk + 1);
+		}
+	}
+
+	return false;
+}
+
+bool NodeDB::TxoArchiveFind(TxoID id, Blob* pVal, Height* pSpendHeight)
+{
+	if (id >= m_TxoArchive.m_State.m_Watermark)
+		return false;
+
+	TxoArchiveChunk& c = m_TxoArchive.m_Lookup;
+	const std::vector<TxoArchive::Chunk>& v = m_TxoArchive.m_vChunks;
+
+	if ((c.m_iChunk >= v.size()) || (id < v[c.m_iChunk].m_ID0) || (id > v[c.m_iChunk].m_ID1))
+	{
+		TxoArchiveSeek(c, id);
+		if (c.m_iChunk >= v.size())
+			return false;
+	}
+
+	auto it = std::lower_bound(c.m_vID.begin(), c.m_vID.end(), id);
+	if ((c.m_vID.end() == it) || (*it != id))
+		return false;
+
+	size_t i = it - c.m_vID.begin();
+	if (!m_TxoArchive.IsAlive(id, c.m_vSpendHeight[i]))
+		return false;
+
+	if (pVal)
+	{
+		pVal->p = c.m_pValues + TxoArchive::s_ValueSize * i;
+		pVal->n = TxoArchive::s_ValueSize;
+	}
+
+	if (pSpendHeight)
+		*pSpendHeight = c.m_vSpendHeight[i];
+
+	return true;
+}
+
+void NodeDB::TxoArchiveWrite(const TxoID* pID, const Height* pSpendHeight, const uint8_t* pValues, uint32_t nCount)
+{
+	TxoArchive& x = m_TxoArchive;
+	assert(nCount && (!x.m_vChunks.size() || (pID[0] > x.m_vChunks.back().m_ID1)));
+
+	if (!x.m_bOpen)
+	{
+		std::string sPath;
+		x.get_Path(sPath, x.m_State.m_Gen);
+		x.m_File.Open(sPath.c_str());
+		x.m_bOpen = true;
+
+		if (x.m_File.m_nMapping > x.m_State.m_Size)
+		{
+			// stale data
+			x.m_File.CloseMapping();
+			x.m_File.Resize(x.m_State.m_Size);
+		}
+	}
+
+	ByteBuffer buf;
+	std::vector<TxoArchive::Chunk> vNew;
+
+	while (nCount)
+	{
+		uint32_t n = std::min(nCount, TxoArchive::s_ChunkMax);
+
+		size_t nPosHdr = buf.size();
+		buf.resize(nPosHdr + sizeof(TxoArchiveChunkHdr));
+
+		for (uint32_t i = 1; i < n; i++)
+			TxoArchiveVarWrite(buf, pID[i] - pID[i - 1]);
+
+		TxoArchiveChunkHdr hdr;
+		hdr.m_ID0 = pID[0];
+		hdr.m_ID1 = pID[n - 1];
+		hdr.m_Count = n;
+		hdr.m_SizeIDs = static_cast<uint32_t>(buf.size() - nPosHdr - sizeof(hdr));
+
+		buf.insert(buf.end(), pValues, pValues + static_cast<size_t>(n) * TxoArchive::s_ValueSize);
+
+		size_t nPosHeights = buf.size();
+		for (uint32_t i = 0; i < n; i++)
+			TxoArchiveVarWrite(buf, pSpendHeight[i]);
+		hdr.m_SizeHeights = static_cast<uint32_t>(buf.size() - nPosHeights);
+
+		TxoArchive::Chunk& c = vNew.emplace_back();
+		c.m_ID0 = hdr.m_ID0;
+		c.m_ID1 = hdr.m_ID1;
+		c.m_Pos = x.m_State.m_Size + nPosHdr;
+
+		hdr.Convert();
+		memcpy(&buf[nPosHdr], &hdr, sizeof(hdr));
+
+		pID += n;
+		pSpendHeight += n;
+		pValues += static_cast<size_t>(n) * TxoArchive::s_ValueSize;
+		nCount -= n;
+		x.m_State.m_Count += n;
+	}
+
+	x.m_File.Write(x.m_State.m_Size, &buf.front(), buf.size());
+	x.m_State.m_Size += buf.size();
+	x.m_vChunks.insert(x.m_vChunks.end(), vNew.begin(), vNew.end());
+	x.m_bWritten = true;
+
+	// remap, the decoded chunks referencing the mapping are invalidated
+	x.m_File.CloseMapping();
+	x.m_File.OpenMapping();
+	x.m_Lookup.m_iChunk = static_cast<size_t>(-1);
+}
+
+uint64_t NodeDB::TxoArchiveMove(TxoID idEnd, Height hMaxSpent)
+{
+	TxoArchive& x = m_TxoArchive;
+	TxoID id0 = x.m_State.m_Watermark;
+
+	if ((idEnd <= id0) || (idEnd - id0 < TxoArchive::s_MoveMin))
+		return 0;
+	std::setmin(idEnd, id0 + TxoArchive::s_MoveMax);
+
+	std::vector<TxoID> vID;
+	std::vector<Height> vSpendHeight;
+	ByteBuffer bufValues;
+
+	{
+		Recordset rs(*this, Query::TxoArchiveEnum, "SELECT " TblTxo_ID "," TblTxo_Value "," TblTxo_SpendHeight " FROM " TblTxo " WHERE " TblTxo_ID ">=? AND " TblTxo_ID "<? AND " TblTxo_SpendHeight "<=? ORDER BY " TblTxo_ID);
+		rs.put(0, id0);
+		rs.put(1, idEnd);
+		rs.put(2, hMaxSpent);
+
+		while (rs.Step())
+		{
+			Blob val;
+			rs.get(1, val);
+
+			// only the plain commitment, without extra flags (such as incubation)
+			const uint8_t* p = reinterpret_cast<const uint8_t*>(val.p);
+			if ((TxoArchive::s_ValueSize != val.n) || (p[0] & ~3))
+				continue;
+
+			rs.get(0, vID.emplace_back());
+			rs.get(2, vSpendHeight.emplace_back());
+			bufValues.insert(bufValues.end(), p, p + val.n);
+		}
+	}
+
+	if (!vID.empty())
+	{
+		TxoArchiveWrite(&vID.front(), &vSpendHeight.front(), &bufValues.front(), static_cast<uint32_t>(vID.size()));
+
+		size_t i = 0;
+		for (; i + s_TxoBatch <= vID.size(); i += s_TxoBatch)
+		{
+			static const std::string s_Sql = MakeBatchSql("DELETE FROM " TblTxo " WHERE " TblTxo_ID " IN (", "?", ")", s_TxoBatch);
+
+			Recordset rs(*this, Query::TxoDelBatch, s_Sql.c_str());
+			for (uint32_t j = 0; j < s_TxoBatch; j++)
+				rs.put(j, vID[i + j]);
+
+			rs.Step();
+			if (get_RowsChanged() != static_cast<int>(s_TxoBatch))
+				ThrowError("txo not found");
+		}
+
+		for (; i < vID.size(); i++)
+			TxoDel(vID[i]);
+	}
+
+	x.m_State.m_Watermark = idEnd;
+	TxoArchiveSaveState();
+
+	return vID.size();
+}
+
+void NodeDB::TxoArchivePrune(Height h, TxoID idKeep)
+{
+	TxoArchive::State& st = m_TxoArchive.m_State;
+	st.m_hPruned = h;
+	st.m_idKeep = idKeep;
+
+	if ((st.m_Dead > TxoArchive::s_ChunkMax * 16) && (st.m_Dead * 2 > st.m_Count))
+		TxoArchiveRewrite(st.m_Watermark);
+	else
+		TxoArchiveSaveState();
+}
+
+void NodeDB::TxoArchiveRewrite(TxoID idEnd)
+{
+	TxoArchive& x = m_TxoArchive;
+
+	std::vector<TxoID> vID;
+	std::vector<Height> vSpendHeight;
+	ByteBuffer bufValues;
+
+	TxoArchiveChunk c;
+	for (TxoArchiveSeek(c, 0); TxoArchiveNext(c); c.m_iPos++)
+	{
+		TxoID id = c.m_vID[c.m_iPos];
+		if (id >= idEnd)
+			break;
+
+		vID.push_back(id);
+		vSpendHeight.push_back(c.m_vSpendHeight[c.m_iPos]);
+
+		const uint8_t* p = c.m_pValues + TxoArchive::s_ValueSize * c.m_iPos;
+		bufValues.insert(bufValues.end(), p, p + TxoArchive::s_ValueSize);
+	}
+
+	x.Close();
+
+	TxoArchive::State& st = x.m_State;
+	st.m_Gen++;
+	st.m_Size = 0;
+	st.m_Count = 0;
+	st.m_Dead = 0;
+	std::setmin(st.m_Watermark, idEnd);
+
+	std::string sPath;
+	x.get_Path(sPath, st.m_Gen);
+	DeleteFile(sPath.c_str());
+
+	if (!vID.empty())
+		TxoArchiveWrite(&vID.front(), &vSpendHeight.front(), &bufValues.front(), static_cast<uint32_t>(vID.size()));
+
+	TxoArchiveSaveState();
+}
+
+void NodeDB::TxoArchiveOnCommit()
+{
+	// the archived data must reach the file before the DB state referencing it is committed
+	if (m_TxoArchive.m_bWritten)
+	{
+		m_TxoArchive.m_File.Sync();
+		m_TxoArchive.m_bWritten = false;
+	}
+}
+
+void NodeDB::TxoArchiveOnCommitted()
+{
+	TxoArchive& x = m_TxoArchive;
+
+	std::string sPath;
+	for (; x.m_GenCommitted < x.m_State.m_Gen; x.m_GenCommitted++)
+	{
+		x.get_Path(sPath, x.m_GenCommitted);
+		DeleteFile(sPath.c_str());
+	}
+}
+
+void NodeDB::TxoArchiveOnRollback()
+{
+	TxoArchive& x = m_TxoArchive;
+	if (x.m_sPath.empty())
+		return;
+
+	uint64_t nGen = x.m_State.m_Gen;
+	TxoArchiveLoad();
+
+	std::string sPath;
+	for (; nGen > x.m_State.m_Gen; nGen--)
+	{
+		x.get_Path(sPath, nGen);
+		DeleteFile(sPath.c_str());
+	}
+}
+
+/////////////////////////////
+// Key filters
+uint64_t NodeDB::KeyFilter::get_Hash(const Blob& key)
+{
+	// FNV-1a, with the final mix. The keys are mostly hashes already, nothing stronger is needed
+	uint64_t h = 0xcbf29ce484222325ULL;
+	const uint8_t* p = reinterpret_cast<const uint8_t*>(key.p);
+	for (uint32_t i = 0; i < key.n; i++)
+		h = (h ^ p[i]) * 0x100000001b3ULL;
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return h;
+}
+
+void NodeDB::KeyFilter::Reset(uint64_t nKeys)
+{
+	m_Capacity = std::max(nKeys * 2, s_CapacityMin);
+	m_Count = 0;
+	m_bRebuild = false;
+
+	uint64_t nBits = 64;
+	while (nBits < m_Capacity * s_BitsPerKey)
+		nBits <<= 1;
+
+	m_vBits.assign(static_cast<size_t>(nBits >> 6), 0);
+}
+
+void NodeDB::KeyFilter::Add(uint64_t hash)
+{
+	if (m_vBits.empty())
+		return; // not built
+
+	uint64_t nMask = (static_cast<uint64_t>(m_vBits.size()) << 6) - 1;
+	uint64_t h2 = (hash >> 32) | (hash << 32) | 1;
+
+	for (uint32_t i = 0; i < s_Probes; i++, hash += h2)
+	{
+		uint64_t iBit = hash & nMask;
+		m_vBits[static_cast<size_t>(iBit >> 6)] |= 1ULL << (iBit & 63);
+	}
+
+	m_Count++;
+}
+
+bool NodeDB::KeyFilter::MayContain(uint64_t hash) const
+{
+	if (m_vBits.empty())
+		return true; // not built, the DB must be queried
+
+	uint64_t nMask = (static_cast<uint64_t>(m_vBits.size()) << 6) - 1;
+	uint64_t h2 = (hash >> 32) | (hash << 32) | 1;
+
+	for (uint32_t i = 0; i < s_Probes; i++, hash += h2)
+	{
+		uint64_t iBit = hash & nMask;
+		if (!(m_vBits[static_cast<size_t>(iBit >> 6)] & (1ULL << (iBit & 63))))
+			return false;
+	}
+
+	return true;
+}
+
+void NodeDB::KeyFilterBuild(KeyFilter& kf, Query::Enum iQuery, const char* sql)
+{
+	std::vector<uint64_t> vHashes;
+
+	Recordset rs(*this, iQuery, sql);
+	while (rs.Step())
+	{
+		Blob key;
+		rs.get(0, key);
+		vHashes.push_back(KeyFilter::get_Hash(key));
+	}
+
+	kf.Reset(vHashes.size());
+	for (size_t i = 0; i < vHashes.size(); i++)
+		kf.Add(vHashes[i]);
+}
+
+void NodeDB::KeyFilterAdd(KeyFilter& kf, const Blob& key)
+{
+	kf.Add(KeyFilter::get_Hash(key));
+	if (kf.IsFull())
+	{
+		kf.m_bRebuild = true;
+		if (sqlite3_get_autocommit(m_pDb))
+			KeyFiltersRebuild(); // no transaction, the DB is final
+	}
+}
+
+void NodeDB::KeyFiltersRebuild()
+{
+	if (m_KernelFilter.m_bRebuild)
+		KeyFilterBuild(m_KernelFilter, Query::KernelEnumKeys, "SELECT " TblKernels_Key " FROM " TblKernels);
+	if (m_UniqueFilter.m_bRebuild)
+		KeyFilterBuild(m_UniqueFilter, Query::UniqueEnumKeys, "SELECT " TblUnique_Key " FROM " TblUnique);
+}
+
+void NodeDB::KeyFiltersOpen()
+{
+	m_KernelFilter.m_bRebuild = true;
+	m_UniqueFilter.m_bRebuild = true;
+	KeyFiltersRebuild();
+
+	m_KernelCache.Clear();
+}
+
+void NodeDB::KernelCacheInvalidate(const Blob& key)
+{
+	if (key.n == Merkle::Hash::nBytes)
+		m_KernelCache.Invalidate(*reinterpret_cast<const Merkle::Hash*>(key.p));
+}
+
+bool NodeDB::KernelCache::Find(const Merkle::Hash& key, Height& h)
+{
+	auto it = m_Map.find(key);
+	if (m_Map.end() == it)
+		return false;
+
+	m_List.splice(m_List.begin(), m_List, it->second);
+	h = it->second->second;
+	return true;
+}
+
+void NodeDB::KernelCache::Insert(const Merkle::Hash& key, Height h)
+{
+	Invalidate(key);
+
+	if (m_List.size() >= s_Max)
+	{
+		m_Map.erase(m_List.back().first);
+		m_List.pop_back();
+	}
+
+	m_List.emplace_front(key, h);
+	m_Map[key] = m_List.begin();
+}
+
+void NodeDB::KernelCache::Invalidate(const Merkle::Hash& key)
+{
+	auto it = m_Map.find(key);
+	if (m_Map.end() != it)
+	{
+		m_List.erase(it->second);
+		m_Map.erase(it);
+	}
+}
+
+void NodeDB::KernelCache::Clear()
+{
+	m_List.clear();
+	m_Map.clear();
+}
+
+NodeDB::ContractCache::Entry* NodeDB::ContractCache::Find(const Blob& key)
+{
+	auto it = m_Map.find(key);
+	if (m_Map.end() == it)
+		return nullptr;
+
+	m_List.splice(m_List.begin(), m_List, it->second);
+	return &*it->second;
+}
+
+uint64_t NodeDB::ContractCache::get_Size(const Entry& x)
+{
+	return x.m_Key.size() + x.m_Data.size() + 0x60; // approx overhead of the list and map nodes
+}
+
+NodeDB::ContractCache::Entry& NodeDB::ContractCacheCreate(const Blob& key, const Blob* pData)
+{
+	ContractCache& cc = m_ContractCache;
+
+	cc.m_List.emplace_front();
+	ContractCache::Entry& x = cc.m_List.front();
+
+	key.Export(x.m_Key);
+	if (pData)
+		pData->Export(x.m_Data);
+	x.m_Exists = !!pData;
+	x.m_InDb = x.m_Exists;
+	x.m_Dirty = false;
+
+	cc.m_Map[x.m_Key] = cc.m_List.begin();
+
+	m_ContractCacheStats.m_Entries++;
+	m_ContractCacheStats.m_Size += ContractCache::get_Size(x);
+	ContractCacheShrink();
+
+	return x;
+}
+
+void NodeDB::ContractCacheModify(ContractCache::Entry& x, const Blob* pData)
+{
+	m_ContractCacheStats.m_Size -= ContractCache::get_Size(x);
+
+	if (pData)
+		pData->Export(x.m_Data);
+	else
+		x.m_Data.clear();
+	x.m_Exists = !!pData;
+
+	m_ContractCacheStats.m_Size += ContractCache::get_Size(x);
+	m_ContractCacheStats.m_Modified++;
+
+	if (!x.m_Dirty)
+	{
+		x.m_Dirty = true;
+		m_ContractCache.m_Dirty++;
+	}
+
+	if (sqlite3_get_autocommit(m_pDb))
+		ContractCacheWrite(x); // no transaction, the write-back is deferred only till its commit
+
+	ContractCacheShrink();
+}
+
+void NodeDB::ContractCacheWrite(ContractCache::Entry& x)
+{
+	if (!x.m_Dirty)
+		return;
+
+	if (x.m_Exists)
+	{
+		if (x.m_InDb)
+			ContractDataUpdateRaw(x.m_Key, x.m_Data);
+		else
+			ContractDataInsertRaw(x.m_Key, x.m_Data);
+		m_ContractCacheStats.m_Written++;
+	}
+	else
+	{
+		if (x.m_InDb)
+		{
+			ContractDataDelRaw(x.m_Key);
+			m_ContractCacheStats.m_Written++;
+		}
+	}
+
+	x.m_InDb = x.m_Exists;
+	x.m_Dirty = false;
+
+	assert(m_ContractCache.m_Dirty);
+	m_ContractCache.m_Dirty--;
+}
+
+void NodeDB::ContractCacheFlush()
+{
+	if (!m_ContractCache.m_Dirty)
+		return;
+
+	for (auto& x : m_ContractCache.m_List)
+		ContractCacheWrite(x);
+
+	assert(!m_ContractCache.m_Dirty);
+}
+
+void NodeDB::ContractCacheShrink()
+{
+	ContractCache& cc = m_ContractCache;
+
+	// the most recent entry is always kept
+	while ((m_ContractCacheStats.m_Size > cc.m_SizeMax) && (cc.m_List.size() > 1))
+	{
+		ContractCache::Entry& x = cc.m_List.back();
+		ContractCacheWrite(x);
+
+		m_ContractCacheStats.m_Entries--;
+		m_ContractCacheStats.m_Size -= ContractCache::get_Size(x);
+
+		cc.m_Map.erase(x.m_Key);
+		cc.m_List.pop_back();
+	}
+}
+
+void NodeDB::ContractCacheClear()
+{
+	m_ContractCache.m_Map.clear();
+	m_ContractCache.m_List.clear();
+	m_ContractCache.m_Dirty = 0;
+
+	m_ContractCacheStats.m_Entries = 0;
+	m_ContractCacheStats.m_Size = 0;
+}
+
+void NodeDB::ContractCacheSetMaxSize(uint64_t n)
+{
+	m_ContractCache.m_SizeMax = n;
+	ContractCacheShrink();
+}
+
+void NodeDB::ContractCacheStats::Log() const
+{
+	uint64_t nLookups = m_Hits + m_Misses;
+	uint32_t nHitPercent = nLookups ? static_cast<uint32_t>(m_Hits * 100 / nLookups) : 0;
+
+	LOG_INFO()
+		<< "Contract data cache. Entries=" << m_Entries << ", size=" << (m_Size >> 10) << " KB, hits=" << m_Hits << " (" << nHitPercent << "%), misses=" << m_Misses
+		<< ", modified=" << m_Modified << ", written=" << m_Written;
+}
+
+void NodeDB::KeyLookupStats::Log() const
+{
+	LOG_INFO()
+		<< "Key lookups. Kernels: filtered=" << m_Kernels.m_Filtered << ", cached=" << m_Kernels.m_Cached << ", queried=" << m_Kernels.m_Queried << ", missed=" << m_Kernels.m_Missed
+		<< ". Unique: filtered=" << m_Unique.m_Filtered << ", queried=" << m_Unique.m_Queried << ", missed=" << m_Unique.m_Missed;
+}
+
 } // namespace beam
@@ -16,7 +16,10 @@
 
 #include "core/common.h"
 #include "core/block_crypt.h"
+#include "core/mapped_file.h"
 #include "sqlite/sqlite3.h"
+#include <set>
+#include <list>
 
 namespace beam {
 
@@ -63,6 +66,10 @@ public:
 			ForbiddenState,
 			Flags1, // used for 2-stage migration, where the 2nd stage is performed by the Processor
 			CacheState,
+			BodiesSegment, // active segment of the block bodies store
+			ShieldedCacheStamp,
+			TxoArchive, // committed state of the TXO archive
+			MmrCacheStamp,
 		};
 	};
 
@@ -90,6 +97,7 @@ public:
 			StateFind,
 			StateFind2,
 			StateFindWithFlag,
+			StateEnumActiveHashes,
 			StateFindWorkGreater,
 			StateUpdPrevRow,
 			StateGetNextFCount,
@@ -126,6 +134,14 @@ public:
 			StateDelBlockPP,
 			StateDelBlockPPR,
 			StateDelBlockAll,
+			BodyGet,
+			BodyIns,
+			BodyDelP,
+			BodyDel,
+			BodyMove,
+			BodyEnumSegment,
+			BodyStat,
+			BodyGetRef,
 			EventIns,
 			EventDel,
 			EventEnum,
@@ -152,6 +168,7 @@ public:
 			KernelIns,
 			KernelFind,
 			KernelDel,
+			KernelEnumKeys,
 			TxoAdd,
 			TxoDel,
 			TxoDelFrom,
@@ -160,6 +177,8 @@ public:
 			TxoEnumBySpentMigrate,
 			TxoSetValue,
 			TxoGetValue,
+			TxoArchiveEnum,
+			TxoDelBatch,
 			BlockFind,
 			FindHeightBelow,
 			StreamIns,
@@ -169,6 +188,7 @@ public:
 			UniqueFind,
 			UniqueDel,
 			UniqueDelAll,
+			UniqueEnumKeys,
 			CacheIns,
 			CacheFind,
 			CacheEnumByHit,
@@ -235,8 +255,18 @@ public:
 	NodeDB();
 	virtual ~NodeDB();
 
+	// SQLite tuning. Zero values leave the SQLite defaults
+	struct Tuning
+	{
+		uint32_t m_PageSize = 0; // takes effect for a new DB, or on vacuum (unless in WAL mode)
+		uint32_t m_CacheSize_MB = 0;
+		uint32_t m_MmapSize_MB = 0;
+		bool m_Wal = false;
+	};
+
 	void Close();
-	void Open(const char* szPath);
+	void Open(const char* szPath, const Tuning&);
+	void Open(const char* szPath) { Open(szPath, Tuning()); }
 	bool IsOpen() const
 	{
 		return nullptr != m_pDb;
@@ -245,6 +275,12 @@ public:
 	void Vacuum();
 	void CheckIntegrity();
 
+	// Consistent copy of the DB file (the transaction must not be in progress), and the accompanying files
+	// (block bodies, TXO archive), as suffixes to the DB path. Used for snapshots
+	void Backup(const char* szPath);
+	void get_SideFiles(std::vector<std::string>&) const;
+	const std::string& get_Path() const { return m_sPath; }
+
 	virtual void OnModified() {}
 
 	class Recordset
@@ -349,10 +385,18 @@ public:
 
 	void SetStateBlock(uint64_t rowid, const Blob& bodyP, const Blob& bodyE, const PeerID&);
 	void GetStateBlock(uint64_t rowid, ByteBuffer* pP, ByteBuffer* pE, ByteBuffer* pRB);
+	// Refers to the body parts in the mapped segment, without copying. Valid until the segment is erased (not before the next commit).
+	// Returns false if the body is not available this way (legacy, or in the active segment that is still appended), then GetStateBlock should be used
+	bool GetStateBlockRef(uint64_t rowid, Blob* pP, Blob* pE);
 	void DelStateBlockPP(uint64_t rowid); // delete perishable, peer. Keep eternal, extra, txos, rollback
 	void DelStateBlockPPR(uint64_t rowid); // delete perishable, rollback, peer. Keep eternal, extra, txos
 	void DelStateBlockAll(uint64_t rowid); // delete perishable, peer, eternal, extra, txos, rollback
 
+	// Moves the live bodies of one mostly-dead segment to the active one, within the current transaction. Returns false if there's nothing to compact.
+	// The old segment file is erased once the transaction is committed.
+	bool BodyStoreCompact();
+	void BodyStoreSetSegmentMax(uint64_t);
+
 	struct StateID {
 		uint64_t m_Row;
 		Height m_Height;
@@ -529,6 +573,18 @@ public:
 	void TxoDelFrom(TxoID);
 	void TxoSetSpent(TxoID, Height);
 
+	static const uint32_t s_TxoBatch = 32; // rows per multi-row statement, when the archived TXOs are deleted
+
+	// Decoded chunk of the TXO archive (see TxoArchive)
+	struct TxoArchiveChunk
+	{
+		size_t m_iChunk = static_cast<size_t>(-1);
+		std::vector<TxoID> m_vID;
+		std::vector<Height> m_vSpendHeight;
+		const uint8_t* m_pValues = nullptr; // fixed width, within the mapping
+		uint32_t m_iPos = 0; // current record
+	};
+
 	struct WalkerTxo
 	{
 		Recordset m_Rs;
@@ -537,12 +593,27 @@ public:
 		Height m_SpendHeight;
 
 		bool MoveNext();
+
+		// archived TXOs are merged with the Txo table by ID. The value of an archived TXO points into the archive mapping,
+		// it's valid until the archive is modified.
+		NodeDB* m_pDB = nullptr;
+		TxoArchiveChunk m_Arc;
+		bool m_bRsPending = false;
+		bool m_bRsEnd = false;
 	};
 
 	void EnumTxos(WalkerTxo&, TxoID id0);
 	void TxoSetValue(TxoID, const Blob&);
 	void TxoGetValue(WalkerTxo&, TxoID);
 
+	// Moves the spent naked TXOs in [watermark, idEnd), spent at or below hMaxSpent, from the Txo table into the archive.
+	// TXOs that don't qualify (unspent, spent later, or with non-standard naked encoding) remain in the Txo table.
+	// The watermark is advanced only in big enough steps, so that the chunks are reasonably filled.
+	uint64_t TxoArchiveMove(TxoID idEnd, Height hMaxSpent);
+	// archived TXOs spent at or below h are deleted, unless their ID is below idKeep. Set after deleting them via TxoDel
+	void TxoArchivePrune(Height h, TxoID idKeep);
+	TxoID get_TxoArchiveWatermark() const { return m_TxoArchive.m_State.m_Watermark; }
+
 	void ShieldedResize(uint64_t n, uint64_t n0) {
 		StreamResize_T<ECC::Point::Storage>(StreamType::Shielded, n, n0);
 	}
@@ -597,7 +668,51 @@ public:
 		void ShrinkTo(uint64_t nCount);
 		void ResizeTo(uint64_t nCount);
 
+		// Optional memory-mapped copy of all the elements (including H0) in the flat form. Once open, it serves all the reads,
+		// the writes go to both. Valid only with the stamp of the DB commit it was flushed with, otherwise rebuilt from the DB.
+		typedef Merkle::Hash Stamp;
+
+		bool FileCacheOpen(const char* sz, const Stamp&); // returns false if rebuilt
+		void FileCacheClose();
+		bool IsFileCacheDirty() const;
+		void FileCacheFlush(const Stamp&);
+
 	protected:
+		class FileCache
+		{
+			MappedFileRaw m_File;
+
+			void Reserve(uint64_t nHashes);
+
+		public:
+
+#pragma pack(push, 1)
+			struct Hdr
+			{
+				uint8_t m_pSig[16];
+				uint64_t m_Dirty; // boolean, just aligned
+				Stamp m_Stamp;
+				uint64_t m_Hashes;
+			};
+#pragma pack(pop)
+
+			bool Open(const char* sz, const Stamp&, uint64_t nHashes);
+			bool IsOpen() const { return m_File.m_pMapping != nullptr; }
+			void Close() { m_File.Close(); }
+
+			Hdr& get_Hdr() const;
+			Merkle::Hash* get_At(uint64_t idx) const; // nullptr if beyond
+
+			void Resize(uint64_t nHashes); // new elements are zeroed
+			void SetDirty(); // durable, call before modifying the data
+			void Flush(const Stamp&); // syncs the data, then marks clean
+		} m_FileCache;
+
+		bool FileCacheFind(Merkle::Hash& hv, const Merkle::Position& pos) const;
+		void FileCacheSave(const Merkle::Hash& hv, const Merkle::Position& pos);
+
+		virtual void FileCacheRebuild();
+
 		// Mmr
 		virtual void LoadElement(Merkle::Hash& hv, const Merkle::Position& pos) const override;
 		virtual void SaveElement(const Merkle::Hash& hv, const Merkle::Position& pos) override;
@@ -636,8 +751,26 @@ public:
 		// Mmr
 		virtual void LoadElement(Merkle::Hash& hv, const Merkle::Position& pos) const override;
 		virtual void SaveElement(const Merkle::Hash& hv, const Merkle::Position& pos) override;
+
+		virtual void FileCacheRebuild() override;
 	};
 
+	// Kernel and unique key lookups go through in-memory filters first, the "not found" case normally doesn't hit the DB
+	struct KeyLookupStats
+	{
+		struct Entry {
+			uint64_t m_Filtered = 0; // absent according to the filter, no DB access
+			uint64_t m_Cached = 0; // found in the cache, no DB access
+			uint64_t m_Queried = 0; // DB queries
+			uint64_t m_Missed = 0; // DB queries that found nothing (filter false positives)
+		};
+
+		Entry m_Kernels;
+		Entry m_Unique;
+
+		void Log() const;
+	} m_KeyLookupStats; // accumulated since open
+
 	bool UniqueInsertSafe(const Blob& key, const Blob* pVal); // returns false if not unique (and doesn't update the value)
 	bool UniqueFind(const Blob& key, Recordset&);
 	void UniqueDeleteStrict(const Blob& key);
@@ -705,6 +838,24 @@ public:
 	void ContractDataEnum(WalkerContractData&, const Blob& keyMin, const Blob& keyMax);
 	void ContractDataEnum(WalkerContractData&);
 
+	// Contract data goes through a write-back cache, that spans multiple blocks.
+	// Modifications of the cached vars are written on commit (or eviction, or before the enumeration), consecutive
+	// modifications are coalesced. The cache is discarded on rollback.
+	struct ContractCacheStats
+	{
+		uint64_t m_Hits = 0;
+		uint64_t m_Misses = 0; // DB queries
+		uint64_t m_Modified = 0; // modifications of the cached vars
+		uint64_t m_Written = 0; // DB writes of the cached vars
+		uint64_t m_Entries = 0; // current
+		uint64_t m_Size = 0; // current, in bytes
+
+		void Log() const;
+	} m_ContractCacheStats; // accumulated since open
+
+	void ContractCacheSetMaxSize(uint64_t);
+	void ContractCacheFlush();
+
 	void StreamsDelAll(StreamType::Enum t0, StreamType::Enum t1);
 
 	struct ContractLog
@@ -745,6 +896,7 @@ public:
 private:
 
 	sqlite3* m_pDb;
+	std::string m_sPath;
 
 	struct Statement
 	{
@@ -771,6 +923,7 @@ private:
 	void CreateTables23();
 	void CreateTables27();
 	void CreateTables28();
+	void CreateTables29();
 	void ExecQuick(const char*);
 	std::string ExecTextOut(const char*);
 	bool ExecStep(sqlite3_stmt*);
@@ -817,6 +970,186 @@ private:
 	Asset::ID AssetFindMinFree(Asset::ID nMin);
 
 	void set_CacheState(CacheState&); // auto cleans the cache if necessary
+
+	// Block bodies are kept outside the DB, in append-only segment files. The DB only references them (segment, offset, size).
+	// The written segments are synced to disk before the DB transaction is committed.
+	// Freed space is reclaimed by compaction (see BodyStoreCompact).
+	struct BodyStore
+	{
+		static const uint64_t s_SegmentMax = 1024 * 1024 * 128;
+		uint64_t m_SegmentMax = s_SegmentMax;
+
+		struct Segment {
+			uint64_t m_Size = 0;
+			uint64_t m_Live = 0;
+		};
+
+		std::string m_sPath;
+		std::map<uint32_t, Segment> m_Segments;
+		std::set<uint32_t> m_setCompact;
+		std::set<uint32_t> m_setUnsynced; // written within the current transaction
+		std::vector<uint32_t> m_vErase;
+		std::map<uint32_t, std::unique_ptr<MappedFileRaw> > m_Mapped; // non-active segments, mapped on demand
+
+		uint32_t m_iActive = 0;
+		std::FStream m_Writer;
+		uint32_t m_iReader = 0;
+		std::FStream m_Reader;
+
+		void get_Path(std::string&, uint32_t iSeg) const;
+		uint64_t get_FileSize(uint32_t iSeg) const;
+		void Close();
+
+	} m_Bodies;
+
+	void BodyStoreOpen(const char* szPath);
+	void BodyStoreLoad();
+	void BodyReserve(uint64_t nSize); // makes sure the body of the specified size fits the active segment
+	void BodyWrite(const Blob&, uint32_t& iSeg, uint64_t& pos);
+	void BodyRead(ByteBuffer&, uint32_t iSeg, uint64_t pos, uint64_t nSize);
+	const MappedFileRaw* BodyMap(uint32_t iSeg);
+	void BodyFree(uint32_t iSeg, uint64_t nSize);
+	void BodyDelP(uint64_t rowid);
+	void BodyDel(uint64_t rowid);
+	void BodyCompact(uint32_t iSeg);
+	void BodyStoreOnCommit();
+	void BodyStoreOnCommitted();
+	void BodyStoreOnRollback();
+
+	// Bloom filter of the existing keys. It's only extended: the deleted (and rolled-back) keys leave their bits, so that
+	// it never gives false negatives. Rebuilt from the DB once the number of added keys exceeds the capacity it's sized for.
+	// Within a transaction the rebuild is postponed until it's committed: the keys deleted by the transaction would be lost
+	// from the filter if it's rolled back.
+	struct KeyFilter
+	{
+		static const uint32_t s_BitsPerKey = 16;
+		static const uint32_t s_Probes = 4;
+		static const uint64_t s_CapacityMin = 0x10000;
+
+		std::vector<uint64_t> m_vBits;
+		uint64_t m_Capacity = 0;
+		uint64_t m_Count = 0; // keys added since the last build
+		bool m_bRebuild = false; // full, pending the commit
+
+		static uint64_t get_Hash(const Blob&);
+		void Reset(uint64_t nKeys);
+		void Add(uint64_t hash);
+		bool MayContain(uint64_t hash) const;
+		bool IsFull() const { return m_Count > m_Capacity; }
+	};
+
+	KeyFilter m_KernelFilter;
+	KeyFilter m_UniqueFilter;
+
+	struct ContractCache
+	{
+		struct Entry
+		{
+			ByteBuffer m_Key;
+			ByteBuffer m_Data;
+			bool m_Exists;
+			bool m_InDb; // as written in the DB
+			bool m_Dirty;
+		};
+
+		typedef std::list<Entry> List;
+		List m_List; // the most recently used first
+		std::map<Blob, List::iterator> m_Map; // the key points to the entry
+		uint64_t m_Dirty = 0;
+		uint64_t m_SizeMax = 1024 * 1024 * 32;
+
+		static uint64_t get_Size(const Entry&);
+		Entry* Find(const Blob&); // modifies MRU
+	} m_ContractCache;
+
+	// MRU cache of the found kernels. Invalidated per key on insert/delete, and entirely on rollback
+	struct KernelCache
+	{
+		static const size_t s_Max = 0x4000;
+
+		typedef std::list<std::pair<Merkle::Hash, Height> > List;
+		List m_List; // the most recently used first
+		std::map<Merkle::Hash, List::iterator> m_Map;
+
+		bool Find(const Merkle::Hash&, Height&);
+		void Insert(const Merkle::Hash&, Height);
+		void Invalidate(const Merkle::Hash&);
+		void Clear();
+	} m_KernelCache;
+
+	// Compact append-only storage of the spent naked TXOs below the horizon, moved out of the Txo table.
+	// The file is a sequence of chunks, each is a columnar set of records sorted by TxoID:
+	//	ChunkHdr, ID deltas (varint), commitments (fixed width), spend heights (varint)
+	// The chunk boundaries (ID range and position) are indexed in memory on open.
+	// The committed state (file generation and size, etc.) is kept in the DB params, and whatever is written beyond is
+	// discarded on open or rollback. Deleted records are hidden by the pruned spend height, the file is rewritten
+	// (into the next generation) once most of the records are dead.
+	struct TxoArchive
+	{
+		static const uint32_t s_ChunkMax = 1024; // records
+		static const uint32_t s_ValueSize = sizeof(ECC::Point); // naked TXO, commitment only
+		static const TxoID s_MoveMin = s_ChunkMax * 8; // min watermark step
+		static const TxoID s_MoveMax = s_ChunkMax * 64; // max watermark step per call
+
+		struct State
+		{
+			uint64_t m_Gen = 0;
+			uint64_t m_Size = 0;
+			TxoID m_Watermark = 0; // all the archived TXOs are below. Non-qualified TXOs below it remain in the Txo table
+			uint64_t m_Count = 0;
+			uint64_t m_Dead = 0;
+			Height m_hPruned = 0;
+			TxoID m_idKeep = 0;
+		} m_State;
+
+		struct Chunk
+		{
+			TxoID m_ID0;
+			TxoID m_ID1; // inclusive
+			uint64_t m_Pos;
+		};
+
+		std::string m_sPath;
+		MappedFileRaw m_File;
+		std::vector<Chunk> m_vChunks;
+		uint64_t m_GenCommitted = 0; // generations below the current one are erased once it's committed
+		bool m_bOpen = false;
+		bool m_bWritten = false; // not synced yet
+
+		TxoArchiveChunk m_Lookup; // last decoded chunk for lookups
+
+		void get_Path(std::string&, uint64_t nGen) const;
+		bool IsAlive(TxoID, Height hSpend) const;
+		void Close();
+	} m_TxoArchive;
+
+	void TxoArchiveOpen(const char* szPath);
+	void TxoArchiveLoad();
+	void TxoArchiveSaveState();
+	void TxoArchiveDecode(TxoArchiveChunk&, size_t iChunk);
+	void TxoArchiveSeek(TxoArchiveChunk&, TxoID);
+	bool TxoArchiveNext(TxoArchiveChunk&); // skips the dead records. Returns false at the end
+	bool TxoArchiveFind(TxoID, Blob* pVal, Height* pSpendHeight);
+	void TxoArchiveWrite(const TxoID*, const Height*, const uint8_t* pValues, uint32_t nCount);
+	void TxoArchiveRewrite(TxoID idEnd); // live records below idEnd into the next generation
+	void TxoArchiveOnCommit();
+	void TxoArchiveOnCommitted();
+	void TxoArchiveOnRollback();
+
+	void KeyFilterBuild(KeyFilter&, Query::Enum, const char* sql);
+	void KeyFilterAdd(KeyFilter&, const Blob& key);
+	void KeyFiltersRebuild(); // those pending
+	void KeyFiltersOpen();
+	void KernelCacheInvalidate(const Blob&);
+
+	ContractCache::Entry& ContractCacheCreate(const Blob& key, const Blob* pData);
+	void ContractCacheModify(ContractCache::Entry&, const Blob* pData);
+	void ContractCacheWrite(ContractCache::Entry&);
+	void ContractCacheShrink();
+	void ContractCacheClear();
+	void ContractDataInsertRaw(const Blob& key, const Blob&);
+	void ContractDataUpdateRaw(const Blob& key, const Blob&);
+	void ContractDataDelRaw(const Blob& key);
 };
 
 
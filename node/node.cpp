@@ -30,6 +30,8 @@
 
 #include "pow/external_pow.h"
 
+#include <deque>
+
 namespace beam {
 
 bool Node::SyncStatus::operator == (const SyncStatus& x) const
@@ -915,8 +917,12 @@ void Node::Initialize(IExternalPOW* externalPOW)
         m_Cfg.m_VerificationThreads = m_Processor.m_ExecutorMT.get_Threads();
 
     m_Processor.m_ExecutorMT.set_Threads(std::max<uint32_t>(m_Cfg.m_VerificationThreads, 1U));
+    m_TxDeferred.m_Executor.set_Threads(m_Cfg.m_TxVerificationThreads ?
+        m_Cfg.m_TxVerificationThreads :
+        std::max<uint32_t>(m_Processor.m_ExecutorMT.get_Threads() / 2, 1U));
 
     m_Processor.m_Horizon = m_Cfg.m_Horizon;
+    m_Processor.m_VerificationWindow = m_Cfg.m_VerificationWindow;
     m_Processor.Initialize(m_Cfg.m_sPathLocal.c_str(), m_Cfg.m_ProcessorParams);
 
 	if (m_Cfg.m_ProcessorParams.m_EraseSelfID)
@@ -1143,6 +1149,7 @@ Node::~Node()
 
     assert(m_setTasks.empty());
 
+	m_TxDeferred.m_Executor.Stop();
 	m_Processor.Stop();
 
 	if (!std::uncaught_exceptions() && m_Processor.get_DB().IsOpen())
@@ -1884,9 +1891,12 @@ void Node::Peer::OnMsg(proto::GetBodyPack&& msg)
 
 				if (NodeDB::StateFlags::Active & p.get_DB().GetStateFlags(sid.m_Row))
 				{
-					// functionality only supported for active states
-					proto::BodyPack msgBody;
+					// functionality only supported for active states.
+					// The bodies stored as-is are serialized directly from the mapped segments, others are re-created
+					std::vector<proto::BodyBuffersRef> vBodies;
+					std::deque<proto::BodyBuffers> vCreated;
 					size_t nSize = 0;
+					size_t nSizeMax = get_BodyPackSizeMax();
 
 					sid.m_Height -= msg.m_CountExtra;
 					Height hMax = std::min(msg.m_Top.m_Height, sid.m_Height + m_This.m_Cfg.m_BandwidthCtl.m_MaxBodyPackCount);
@@ -1895,20 +1905,29 @@ void Node::Peer::OnMsg(proto::GetBodyPack&& msg)
 					{
 						sid.m_Row = p.FindActiveAtStrict(sid.m_Height);
 
-						proto::BodyBuffers bb;
-						if (!GetBlock(bb, sid, msg, true))
-							break;
+						proto::BodyBuffersRef& br = vBodies.emplace_back();
+						if (!GetBlockRef(br, sid, msg))
+						{
+							proto::BodyBuffers& bb = vCreated.emplace_back();
+							if (!GetBlock(bb, sid, msg, true))
+							{
+								vBodies.pop_back();
+								break;
+							}
+
+							br.m_Perishable = bb.m_Perishable;
+							br.m_Eternal = bb.m_Eternal;
+						}
 
-						nSize += bb.m_Eternal.size() + bb.m_Perishable.size();
-						msgBody.m_Bodies.push_back(std::move(bb));
+						nSize += br.m_Eternal.n + br.m_Perishable.n;
 
-						if (nSize >= m_This.m_Cfg.m_BandwidthCtl.m_MaxBodyPackSize)
+						if (nSize >= nSizeMax)
 							break;
 					}
 
-					if (msgBody.m_Bodies.size())
+					if (!vBodies.empty())
 					{
-						Send(msgBody);
+						SendBodyPack(vBodies);
 						return;
 					}
 				}
@@ -1941,6 +1960,47 @@ void Node::Peer::OnMsg(proto::GetBodyPack&& msg)
     Send(msgMiss);
 }
 
+size_t Node::Peer::get_BodyPackSizeMax()
+{
+	const Config::BandwidthCtl& bwc = m_This.m_Cfg.m_BandwidthCtl; // alias
+
+	size_t nUnsent = get_Unsent();
+	if (nUnsent >= bwc.m_MaxBodyPackUnsent)
+		return 0; // only 1 body
+
+	return std::min(bwc.m_MaxBodyPackSize, bwc.m_MaxBodyPackUnsent - nUnsent);
+}
+
+bool Node::Peer::GetBlockRef(proto::BodyBuffersRef& out, const NodeDB::StateID& sid, const proto::GetBodyPack& msg)
+{
+	Blob* pP = nullptr;
+	Blob* pE = nullptr;
+
+	switch (msg.m_FlagE)
+	{
+	case proto::BodyBuffers::Full:
+		pE = &out.m_Eternal;
+		break;
+	case proto::BodyBuffers::None:
+		break;
+	default:
+		return false; // handled by GetBlock
+	}
+
+	switch (msg.m_FlagP)
+	{
+	case proto::BodyBuffers::Full:
+		pP = &out.m_Perishable;
+		break;
+	case proto::BodyBuffers::None:
+		break;
+	default:
+		return false; // Recovery1 is re-created
+	}
+
+	return m_This.m_Processor.GetBlockRef(sid, pE, pP, msg.m_Height0, msg.m_HorizonLo1, msg.m_HorizonHi1);
+}
+
 bool Node::Peer::GetBlock(proto::BodyBuffers& out, const NodeDB::StateID& sid, const proto::GetBodyPack& msg, bool bActive)
 {
 	ByteBuffer* pP = nullptr;
@@ -2136,6 +2196,7 @@ void Node::OnTransactionDeferred(Transaction::Ptr&& pTx, const PeerID* pSender,
     TxDeferred::Element txd;
     txd.m_pTx = std::move(pTx);
     txd.m_Fluff = bFluff;
+    txd.m_Time_ms = GetTime_ms();
 
     if (pSender)
         txd.m_Sender = *pSender;
@@ -2159,34 +2220,294 @@ void Node::OnTransactionDeferred(Transaction::Ptr&& pTx, const PeerID* pSender,
     }
 
     m_TxDeferred.m_lst.push_back(std::move(txd));
+    m_TxAdmissionStats.m_Pending = static_cast<uint32_t>(m_TxDeferred.m_lst.size());
 }
 
-void Node::TxDeferred::OnSchedule()
+struct Node::TxDeferred::Pack
 {
-    if (!m_lst.empty())
-    {
-        TxDeferred::Element& x = m_lst.front();
-        get_ParentObj().OnTransaction(std::move(x.m_pTx), &x.m_Sender, x.m_Fluff, nullptr);
-        m_lst.pop_front();
-    }
+	struct Item
+		:public Element
+	{
+		Transaction::Context::Params m_Pars;
+		Transaction::Context m_Ctx;
 
-    if (m_lst.empty())
-        cancel();
+		Item() :m_Ctx(m_Pars) {}
 
+		bool Validate(Height h)
+		{
+			m_Ctx.Reset();
+			m_Ctx.m_Height.m_Min = h;
+			return m_Ctx.ValidateAndSummarize(*m_pTx, m_pTx->get_Reader());
+		}
+	};
+
+	std::list<Item> m_lst;
+	Height m_Height; // cursor at dispatch
+	uint32_t m_Invalid = 0;
+	uint32_t m_Reverified = 0; // during bisection
+	uint64_t m_Verify_us = 0;
+};
+
+struct Node::TxDeferred::Done
+{
+	std::mutex m_Mutex;
+	std::list<std::unique_ptr<Pack> > m_lst;
+	io::AsyncEvent::Trigger m_Trigger;
+};
+
+struct Node::TxDeferred::Task
+	:public Executor::TaskAsync
+{
+	// Bulletproofs, signatures and asset proofs of all the txs are accumulated in a single (large) multi-exponentiation.
+	// The tx executor threads have no batch of their own, each task brings one
+	typedef ECC::InnerProduct::BatchContextEx<16> MyBatch;
+
+	// Asset proofs: the multipliers of the generators are accumulated per list, and added to the batch before it's flushed
+	struct AssetBatch
+		:public Asset::Proof::BatchContext
+	{
+		std::map<Asset::ID, std::vector<ECC::Scalar::Native> > m_Lists;
+
+		virtual bool IsValid(ECC::Point::Native& hGen, const Asset::Proof& p) override
+		{
+			assert(ECC::InnerProduct::BatchContext::s_pInstance);
+
+			std::vector<ECC::Scalar::Native>& vKs = m_Lists[p.m_Begin];
+			if (vKs.empty())
+				vKs.resize(get_N());
+
+			return p.IsValid(hGen, *ECC::InnerProduct::BatchContext::s_pInstance, &vKs.front());
+		}
+
+		void Calculate(ECC::Point::Native& res)
+		{
+			uint32_t N = get_N();
+
+			for (auto& x : m_Lists)
+			{
+				Asset::Proof::CmList lst;
+				lst.m_Begin = x.first;
+				lst.Calculate(res, 0, N, &x.second.front());
+			}
+
+			m_Lists.clear();
+		}
+
+		static uint32_t get_N()
+		{
+			uint32_t N = Rules::get().CA.m_ProofCfg.get_N();
+			assert(N);
+			return N;
+		}
+	};
+
+	std::unique_ptr<Pack> m_pPack;
+	std::shared_ptr<Done> m_pDone;
+	std::unique_ptr<MyBatch> m_pBc;
+	AssetBatch m_Assets;
+	Height m_h;
+
+	static void SetInvalid(Transaction::Context& ctx)
+	{
+		// empty range, the merge on the reactor thread would fail
+		ctx.m_Height.m_Min = MaxHeight;
+		ctx.m_Height.m_Max = 0;
+	}
+
+	bool Flush()
+	{
+		m_Assets.Calculate(m_pBc->m_Sum);
+		return m_pBc->Flush();
+	}
+
+	bool IsValid(Pack::Item* const* pp, size_t n)
+	{
+		m_pBc->Reset();
+		m_Assets.m_Lists.clear();
+
+		for (size_t i = 0; i < n; i++)
+			if (!pp[i]->Validate(m_h))
+				return false;
+
+		return Flush();
+	}
+
+	void Bisect(Pack::Item* const* pp, size_t n)
+	{
+		// the combined batch of those txs failed. Find the culprit(s)
+		if (1 == n)
+		{
+			SetInvalid(pp[0]->m_Ctx);
+			m_pPack->m_Invalid++;
+			return;
+		}
+
+		size_t n0 = n / 2;
+		Verify(pp, n0);
+		Verify(pp + n0, n - n0);
+	}
+
+	void Verify(Pack::Item* const* pp, size_t n)
+	{
+		m_pPack->m_Reverified += static_cast<uint32_t>(n);
+		if (!IsValid(pp, n))
+			Bisect(pp, n);
+	}
+
+	virtual void Exec(Executor::Context&) override
+	{
+		Pack& p = *m_pPack;
+		uint64_t t0_us = GetTime_us();
+		m_h = p.m_Height + 1;
+
+		m_pBc.reset(new MyBatch);
+
+		{
+			MyBatch::Scope scope(*m_pBc);
+			Asset::Proof::BatchContext::Scope scopeAssets(m_Assets);
+
+			// 1st pass: txs that fail the non-batched checks are rejected immediately
+			std::vector<Pack::Item*> v;
+			v.reserve(p.m_lst.size());
+
+			bool bClean = true;
+			for (auto& x : p.m_lst)
+			{
+				if (x.Validate(m_h))
+					v.push_back(&x);
+				else
+				{
+					SetInvalid(x.m_Ctx);
+					p.m_Invalid++;
+					bClean = false; // its partial equations may remain in the batch
+				}
+			}
+
+			if (!v.empty())
+			{
+				if (!bClean)
+					Verify(&v.front(), v.size());
+				else
+					if (!Flush())
+						Bisect(&v.front(), v.size());
+			}
+		}
+
+		m_pBc.reset();
+
+		p.m_Verify_us = GetTime_us() - t0_us;
+
+		std::unique_lock<std::mutex> scope(m_pDone->m_Mutex);
+		m_pDone->m_lst.push_back(std::move(m_pPack));
+		m_pDone->m_Trigger();
+	}
+};
+
+void Node::TxDeferred::Dispatch()
+{
+	Node& n = get_ParentObj();
+	Executor& ex = m_Executor;
+	uint32_t nBatchSize = std::max<uint32_t>(n.m_Cfg.m_TxBatchSize, 1U);
+
+	while (!m_lst.empty() && (m_Batches < ex.get_Threads()))
+	{
+		if (!m_pDone)
+		{
+			m_pDone = std::make_shared<Done>();
+
+			io::AsyncEvent::Callback cb = [this]() { OnDone(); };
+			m_pEvtDone = io::AsyncEvent::create(io::Reactor::get_Current(), std::move(cb));
+			m_pDone->m_Trigger = m_pEvtDone;
+		}
+
+		std::unique_ptr<Task> pTask(new Task);
+		pTask->m_pDone = m_pDone;
+		pTask->m_pPack.reset(new Pack);
+
+		Pack& p = *pTask->m_pPack;
+		p.m_Height = n.m_Processor.m_Cursor.m_ID.m_Height;
+
+		for (uint32_t i = 0; (i < nBatchSize) && !m_lst.empty(); i++)
+		{
+			p.m_lst.emplace_back();
+			Cast::Down<Element>(p.m_lst.back()) = std::move(m_lst.front());
+			m_lst.pop_front();
+		}
+
+		n.m_TxAdmissionStats.m_InProgress += static_cast<uint32_t>(p.m_lst.size());
+		m_Batches++;
+
+		ex.Push(std::move(pTask));
+	}
+
+	n.m_TxAdmissionStats.m_Pending = static_cast<uint32_t>(m_lst.size());
+}
+
+void Node::TxDeferred::OnDone()
+{
+	std::list<std::unique_ptr<Pack> > lst;
+	{
+		std::unique_lock<std::mutex> scope(m_pDone->m_Mutex);
+		lst.swap(m_pDone->m_lst);
+	}
+
+	Node& n = get_ParentObj();
+	TxAdmissionStats& s = n.m_TxAdmissionStats;
+
+	for (auto& pPack : lst)
+	{
+		Pack& p = *pPack;
+		assert(m_Batches);
+		m_Batches--;
+
+		bool bTipMoved = (p.m_Height != n.m_Processor.m_Cursor.m_ID.m_Height);
+
+		LOG_VERBOSE() << "Tx batch: " << p.m_lst.size() << " txs, invalid=" << p.m_Invalid << ", reverified=" << p.m_Reverified << ", verify=" << p.m_Verify_us << " us" << (bTipMoved ? ", tip moved" : "");
+
+		uint32_t t_ms = GetTime_ms();
+
+		for (auto& x : p.m_lst)
+		{
+			s.m_InProgress--;
+			s.m_Done++;
+
+			uint32_t dt_ms = t_ms - x.m_Time_ms;
+			s.m_TotalLatency_ms += dt_ms;
+			std::setmax(s.m_MaxLatency_ms, dt_ms);
+
+			if (x.m_Ctx.m_Height.IsEmpty())
+				s.m_Invalid++;
+
+			// if the tip has moved meanwhile - the height-dependent part of the context-free validation is stale, redo it in full
+			n.OnTransaction(std::move(x.m_pTx), &x.m_Sender, x.m_Fluff, nullptr, bTipMoved ? nullptr : &x.m_Ctx);
+		}
+	}
+
+	Dispatch();
 }
 
-uint8_t Node::OnTransaction(Transaction::Ptr&& pTx, const PeerID* pSender, bool bFluff, std::ostream* pExtraInfo)
+void Node::TxDeferred::OnSchedule()
+{
+	cancel();
+	Dispatch(); // the rest will be dispatched once the executor frees up
+}
+
+uint8_t Node::OnTransaction(Transaction::Ptr&& pTx, const PeerID* pSender, bool bFluff, std::ostream* pExtraInfo, const Transaction::Context* pCtxFree)
 {
     return bFluff ?
-        OnTransactionFluff(std::move(pTx), pExtraInfo, pSender, nullptr) :
-        OnTransactionStem(std::move(pTx), pExtraInfo);
+        OnTransactionFluff(std::move(pTx), pExtraInfo, pSender, nullptr, pCtxFree) :
+        OnTransactionStem(std::move(pTx), pExtraInfo, pCtxFree);
 }
 
-uint8_t Node::ValidateTx(Transaction::Context& ctx, const Transaction& tx, uint32_t& nSizeCorrection, Amount& feeReserve, std::ostream* pExtraInfo)
+uint8_t Node::ValidateTx(Transaction::Context& ctx, const Transaction& tx, uint32_t& nSizeCorrection, Amount& feeReserve, std::ostream* pExtraInfo, const Transaction::Context* pCtxFree)
 {
     ctx.m_Height.m_Min = m_Processor.m_Cursor.m_ID.m_Height + 1;
 
-    if (!(m_Processor.ValidateAndSummarize(ctx, tx, tx.get_Reader()) && ctx.IsValidTransaction()))
+    bool bValid = pCtxFree ?
+        ctx.Merge(*pCtxFree) :
+        m_Processor.ValidateAndSummarize(ctx, tx, tx.get_Reader());
+
+    if (!(bValid && ctx.IsValidTransaction()))
     {
         if (pExtraInfo)
             *pExtraInfo << "Context-free validation failed";
@@ -2327,7 +2648,7 @@ uint32_t Node::RandomUInt32(uint32_t threshold)
     return threshold;
 }
 
-uint8_t Node::OnTransactionStem(Transaction::Ptr&& ptx, std::ostream* pExtraInfo)
+uint8_t Node::OnTransactionStem(Transaction::Ptr&& ptx, std::ostream* pExtraInfo, const Transaction::Context* pCtxFree)
 {
 	TxStats s;
 	ptx->get_Reader().AddStats(s);
@@ -2386,7 +2707,7 @@ uint8_t Node::OnTransactionStem(Transaction::Ptr&& ptx, std::ostream* pExtraInfo
 
 		if (!bTested)
 		{
-			uint8_t nCode = ValidateTx(ctx, *ptx, nSizeCorrection, feeReserve, pExtraInfo);
+			uint8_t nCode = ValidateTx(ctx, *ptx, nSizeCorrection, feeReserve, pExtraInfo, pCtxFree);
 			if (proto::TxStatus::Ok != nCode)
 				return nCode;
 
@@ -2401,7 +2722,7 @@ uint8_t Node::OnTransactionStem(Transaction::Ptr&& ptx, std::ostream* pExtraInfo
     {
 		if (!bTested)
 		{
-			uint8_t nCode = ValidateTx(ctx, *ptx, nSizeCorrection, feeReserve, pExtraInfo);
+			uint8_t nCode = ValidateTx(ctx, *ptx, nSizeCorrection, feeReserve, pExtraInfo, pCtxFree);
 			if (proto::TxStatus::Ok != nCode)
 				return nCode;
 		}
@@ -2691,7 +3012,7 @@ Height Node::SampleDummySpentHeight()
 	return h;
 }
 
-uint8_t Node::OnTransactionFluff(Transaction::Ptr&& ptxArg, std::ostream* pExtraInfo, const PeerID* pSender, TxPool::Stem::Element* pElem)
+uint8_t Node::OnTransactionFluff(Transaction::Ptr&& ptxArg, std::ostream* pExtraInfo, const PeerID* pSender, TxPool::Stem::Element* pElem, const Transaction::Context* pCtxFree)
 {
     Transaction::Ptr ptx;
     ptx.swap(ptxArg);
@@ -2722,7 +3043,7 @@ uint8_t Node::OnTransactionFluff(Transaction::Ptr&& ptxArg, std::ostream* pExtra
     // new transaction
     uint32_t nSizeCorrection = 0;
     Amount feeReserve = 0;
-    uint8_t nCode = pElem ? proto::TxStatus::Ok : ValidateTx(ctx, tx, nSizeCorrection, feeReserve, pExtraInfo);
+    uint8_t nCode = pElem ? proto::TxStatus::Ok : ValidateTx(ctx, tx, nSizeCorrection, feeReserve, pExtraInfo, pCtxFree);
     LogTx(tx, nCode, key.m_Key);
 
 	if (proto::TxStatus::Ok != nCode) {
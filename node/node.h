@@ -73,6 +73,7 @@ struct Node
 		uint32_t m_MaxConcurrentBlocksRequest = 18;
 		uint32_t m_MaxPoolTransactions = 100 * 1000;
 		uint32_t m_MaxDeferredTransactions = 100 * 1000;
+		uint32_t m_TxBatchSize = 64; // max deferred txs per context-free validation batch
 		uint32_t m_MiningThreads = 0; // by default disabled
 
 		bool m_LogEvents = false; // may be insecure. Off by default.
@@ -84,6 +85,14 @@ struct Node
 		// negative: number of cores minus number of mining threads.
 		int m_VerificationThreads = 0;
 
+		// Number of threads for the context-free validation of the incoming txs, separate from the above.
+		// 0: half of the verification threads (at least 1)
+		uint32_t m_TxVerificationThreads = 0;
+
+		// Max size of downloaded blocks that may be pending context-free verification during sync, including the blocks verified ahead of the cursor.
+		// Larger value lets more blocks be verified ahead, at the expense of memory.
+		size_t m_VerificationWindow = NodeProcessor::s_VerificationWindowDef;
+
 		struct RollbackLimit
 		{
 			Height m_Max = 60; // artificial restriction on how much the node will rollback automatically
@@ -121,6 +130,10 @@ struct Node
 			size_t m_MaxBodyPackSize = 1024 * 1024 * 5;
 			uint32_t m_MaxBodyPackCount = 3000;
 
+			// per-peer budget of unsent data while serving body packs. Packs are trimmed to fit it (but contain at least 1 body),
+			// so that a peer that requests faster than it reads doesn't inflate our send queue towards m_Drown
+			size_t m_MaxBodyPackUnsent = 1024 * 1024 * 10;
+
 		} m_BandwidthCtl;
 
 		struct TestMode {
@@ -212,7 +225,17 @@ struct Node
 	bool DecodeAndCheckHdrs(std::vector<Block::SystemState::Full>&, const proto::HdrPack&);
 	static bool DecodeAndCheckHdrsImpl(std::vector<Block::SystemState::Full>&, const proto::HdrPack&, ExecutorMT&);
 
-	uint8_t OnTransaction(Transaction::Ptr&&, const PeerID*, bool bFluff, std::ostream* pExtraInfo);
+	uint8_t OnTransaction(Transaction::Ptr&&, const PeerID*, bool bFluff, std::ostream* pExtraInfo, const Transaction::Context* pCtxFree = nullptr);
+
+	struct TxAdmissionStats
+	{
+		uint32_t m_Pending = 0; // deferred, not dispatched yet
+		uint32_t m_InProgress = 0; // context-free validation on the executor threads
+		uint64_t m_Done = 0;
+		uint64_t m_Invalid = 0; // rejected by the context-free validation
+		uint64_t m_TotalLatency_ms = 0; // from deferral till the admission decision
+		uint32_t m_MaxLatency_ms = 0;
+	} m_TxAdmissionStats;
 
         // for step-by-step tests
 	void GenerateFakeBlocks(uint32_t n);
@@ -378,18 +401,35 @@ private:
 			Transaction::Ptr m_pTx;
 			PeerID m_Sender;
 			bool m_Fluff;
+			uint32_t m_Time_ms;
 		};
 
 		std::list<Element> m_lst;
 
+		// Context-free validation of the deferred txs is done in batches on the executor threads.
+		// The rest (context validation, pool insertion) is done on the reactor thread once the batch is back.
+		struct Pack;
+		struct Done;
+		struct Task;
+
+		// Own threads, the batches don't queue up with the block verification tasks
+		ExecutorMT_R m_Executor;
+
+		std::shared_ptr<Done> m_pDone;
+		io::AsyncEvent::Ptr m_pEvtDone;
+		uint32_t m_Batches = 0; // in progress
+
+		void Dispatch();
+		void OnDone();
+
 		virtual void OnSchedule() override;
 
 		IMPLEMENT_GET_PARENT_OBJ(Node, m_TxDeferred)
 	} m_TxDeferred;
 
 	void OnTransactionDeferred(Transaction::Ptr&&, const PeerID*, bool bFluff);
-	uint8_t OnTransactionStem(Transaction::Ptr&&, std::ostream* pExtraInfo);
-	uint8_t OnTransactionFluff(Transaction::Ptr&&, std::ostream* pExtraInfo, const PeerID*, Dandelion::Element*);
+	uint8_t OnTransactionStem(Transaction::Ptr&&, std::ostream* pExtraInfo, const Transaction::Context* pCtxFree = nullptr);
+	uint8_t OnTransactionFluff(Transaction::Ptr&&, std::ostream* pExtraInfo, const PeerID*, Dandelion::Element*, const Transaction::Context* pCtxFree = nullptr);
 	void OnTransactionAggregated(Dandelion::Element&);
 	void PerformAggregation(Dandelion::Element&);
 	void AddDummyInputs(Transaction&);
@@ -398,7 +438,7 @@ private:
 	void AddDummyOutputs(Transaction&, Amount feeReserve);
 	Height SampleDummySpentHeight();
 
-	uint8_t ValidateTx(Transaction::Context&, const Transaction&, uint32_t& nSizeCorrection, Amount& feeReserve, std::ostream* pExtraInfo); // complete validation
+	uint8_t ValidateTx(Transaction::Context&, const Transaction&, uint32_t& nSizeCorrection, Amount& feeReserve, std::ostream* pExtraInfo, const Transaction::Context* pCtxFree); // complete validation. Context-free part is skipped if already done
 	static bool CalculateFeeReserve(const TxStats&, const HeightRange&, const AmountBig::Type&, uint32_t nBvmCharge, Amount& feeReserve);
 	void LogTx(const Transaction&, uint8_t nStatus, const Transaction::KeyType&);
 	void LogTxStem(const Transaction&, const char* szTxt);
@@ -548,6 +588,8 @@ private:
 		void OnChocking();
 		void SetTxCursor(TxPool::Fluff::Element*);
 		bool GetBlock(proto::BodyBuffers&, const NodeDB::StateID&, const proto::GetBodyPack&, bool bActive);
+		bool GetBlockRef(proto::BodyBuffersRef&, const NodeDB::StateID&, const proto::GetBodyPack&);
+		size_t get_BodyPackSizeMax();
 
 		bool IsChocking(size_t nExtra = 0);
 		bool ShouldAssignTasks();
@@ -23,6 +23,7 @@
 #include "../utility/blobmap.h"
 #include <condition_variable>
 #include <cctype>
+#include <deque>
 
 namespace beam {
 
@@ -88,7 +89,7 @@ void NodeProcessor::Initialize(const char* szPath)
 
 void NodeProcessor::Initialize(const char* szPath, const StartParams& sp)
 {
-	m_DB.Open(szPath);
+	m_DB.Open(szPath, sp.m_DbTuning);
 	m_DbTx.Start(m_DB);
 
 	if (sp.m_CheckIntegrity)
@@ -164,7 +165,10 @@ void NodeProcessor::Initialize(const char* szPath, const StartParams& sp)
 	m_Mmr.m_Shielded.m_Count = m_DB.ParamIntGetDef(NodeDB::ParamID::ShieldedInputs);
 	m_Mmr.m_Shielded.m_Count += m_Extra.m_ShieldedOutputs;
 
+	m_Mapped.set_Access(sp.m_MappingAccess);
 	InitializeMapped(szPath);
+	InitializeShieldedCache(szPath);
+	InitializeMmrCache(szPath);
 	m_Extra.m_Txos = get_TxosBefore(m_Cursor.m_ID.m_Height + 1);
 
 	uint64_t nFlags1 = m_DB.ParamIntGetDef(NodeDB::ParamID::Flags1);
@@ -270,11 +274,16 @@ bool NodeProcessor::ManualSelection::IsAllowed(const Merkle::Hash& hv) const
 
 void NodeProcessor::InitializeMapped(const char* sz)
 {
+	uint32_t t0_ms = GetTime_ms();
+
 	if (InitMapping(sz, false))
 	{
 		LOG_INFO() << "Mapping image found";
 		if (TestDefinition())
+		{
+			LOG_INFO() << "Mapping image ready in " << (GetTime_ms() - t0_ms) << " ms";
 			return; // ok
+		}
 
 		LOG_WARNING() << "Definition mismatch, discarding mapped image";
 		m_Mapped.Close();
@@ -291,6 +300,70 @@ void NodeProcessor::InitializeMapped(const char* sz)
 	TestDefinitionStrict();
 }
 
+void NodeProcessor::InitializeShieldedCache(const char* sz)
+{
+	std::string sPath;
+	get_ShieldedCachePath(sPath, sz);
+
+	ShieldedCache::Stamp us;
+	Blob blob(us);
+
+	if (!m_DB.ParamGet(NodeDB::ParamID::ShieldedCacheStamp, nullptr, &blob))
+	{
+		us = 1U;
+		us.Negate();
+	}
+
+	m_ShieldedCache.Open(sPath.c_str(), us);
+
+	uint64_t nCount = m_ShieldedCache.get_Hdr().m_Count;
+	if (nCount > m_Extra.m_ShieldedOutputs)
+	{
+		// should not happen
+		m_ShieldedCache.ShrinkTo(0);
+		nCount = 0;
+	}
+
+	if (nCount < m_Extra.m_ShieldedOutputs)
+	{
+		LOG_INFO() << "Rebuilding shielded cache...";
+
+		std::vector<ECC::Point::Storage> v(0x1000);
+		while (nCount < m_Extra.m_ShieldedOutputs)
+		{
+			uint64_t n = std::min<uint64_t>(v.size(), m_Extra.m_ShieldedOutputs - nCount);
+			m_DB.ShieldedRead(nCount, &v.front(), n);
+			m_ShieldedCache.Append(&v.front(), n);
+			nCount += n;
+		}
+	}
+}
+
+void NodeProcessor::InitializeMmrCache(const char* sz)
+{
+	NodeDB::StreamMmr::Stamp us;
+	Blob blob(us);
+
+	if (!m_DB.ParamGet(NodeDB::ParamID::MmrCacheStamp, nullptr, &blob))
+	{
+		us = 1U;
+		us.Negate();
+	}
+
+	std::string sPath;
+	bool bOk = true;
+
+	get_DerivedPath(sPath, sz, "-mmr-states.bin");
+	bOk &= m_Mmr.m_States.FileCacheOpen(sPath.c_str(), us);
+	get_DerivedPath(sPath, sz, "-mmr-shielded.bin");
+	bOk &= m_Mmr.m_Shielded.FileCacheOpen(sPath.c_str(), us);
+	get_DerivedPath(sPath, sz, "-mmr-assets.bin");
+	bOk &= m_Mmr.m_Assets.FileCacheOpen(sPath.c_str(), us);
+
+	if (!bOk)
+		LOG_INFO() << "MMR cache rebuilt";
+}
+
 void NodeProcessor::TestDefinitionStrict()
 {
 	if (!TestDefinition())
@@ -312,6 +385,46 @@ bool NodeProcessor::TestDefinition()
 	return m_Cursor.m_Full.m_Definition == hv;
 }
 
+bool NodeProcessor::TestHeaderChain()
+{
+	// Move an empty cursor up the chain, as if the blocks were interpreted. This way the difficulty and the timestamp median
+	// are evaluated by the same code, with the recent states cache.
+	Cursor cu;
+	ZeroObject(cu);
+	RecentStates rs;
+
+	TemporarySwap<Cursor> swpCursor(cu, m_Cursor);
+	TemporarySwap<RecentStates> swpRecent(rs, m_RecentStates);
+
+	for (Height h = Rules::HeightGenesis; h <= cu.m_Sid.m_Height; h++)
+	{
+		uint64_t row = (h == cu.m_Sid.m_Height) ? cu.m_Sid.m_Row : m_DB.FindActiveStateStrict(h);
+
+		Block::SystemState::Full s;
+		m_DB.get_State(row, s);
+
+		if (m_Cursor.m_Sid.m_Row ? !m_Cursor.m_Full.IsNext(s) : ((s.m_Height != h) || (s.m_Prev != Rules::get().Prehistoric)))
+			return false;
+
+		if (s.m_PoW.m_Difficulty.m_Packed != get_NextDifficulty().m_Packed)
+			return false;
+
+		Difficulty::Raw wrk = m_Cursor.m_Full.m_ChainWork + s.m_PoW.m_Difficulty;
+		if ((wrk != s.m_ChainWork) || (s.m_TimeStamp <= get_MovingMedian()))
+			return false;
+
+		if (!s.IsValid())
+			return false;
+
+		m_RecentStates.Push(row, s);
+		m_Cursor.m_Sid.m_Row = row;
+		m_Cursor.m_Sid.m_Height = h;
+		m_Cursor.m_Full = s;
+	}
+
+	return true;
+}
+
 
 // Ridiculous! Had to write this because strmpi isn't standard!
 int My_strcmpi(const char* sz1, const char* sz2)
@@ -333,7 +446,17 @@ int My_strcmpi(const char* sz1, const char* sz2)
 
 void NodeProcessor::get_MappingPath(std::string& sPath, const char* sz)
 {
-	// derive mapping path from db path
+	get_DerivedPath(sPath, sz, "-utxo-image.bin");
+}
+
+void NodeProcessor::get_ShieldedCachePath(std::string& sPath, const char* sz)
+{
+	get_DerivedPath(sPath, sz, "-shielded-cache.bin");
+}
+
+void NodeProcessor::get_DerivedPath(std::string& sPath, const char* sz, const char* szSufixNew)
+{
+	// derive path from db path
 	sPath = sz;
 
 	static const char szSufix[] = ".db";
@@ -342,7 +465,258 @@ void NodeProcessor::get_MappingPath(std::string& sPath, const char* sz)
 	if ((sPath.size() >= nSufix) && !My_strcmpi(sPath.c_str() + sPath.size() - nSufix, szSufix))
 		sPath.resize(sPath.size() - nSufix);
 
-	sPath += "-utxo-image.bin";
+	sPath += szSufixNew;
+}
+
+struct NodeProcessor::Snapshot
+{
+	// File layout: Hdr, {FileHdr, data} * m_Files, checksum of all the preceding
+	static const uint32_t s_Version = 1;
+
+#pragma pack (push, 1)
+	struct Hdr
+	{
+		char m_szSignature[8];
+		uintBigFor<uint32_t>::Type m_Version;
+		Merkle::Hash m_hvCfg;
+		uintBigFor<Height>::Type m_Height;
+		Merkle::Hash m_hvState;
+		uintBigFor<uint32_t>::Type m_Files;
+	};
+
+	struct FileHdr
+	{
+		uint8_t m_Derived; // the suffix is to the derived path (as the UTXO image), otherwise to the DB path
+		char m_szSuffix[0x20];
+		uintBigFor<uint64_t>::Type m_Size;
+	};
+#pragma pack (pop)
+
+	static const char s_szSignature[sizeof(Hdr::m_szSignature) + 1];
+
+	struct Entry
+	{
+		std::string m_sPath;
+		FileHdr m_Hdr;
+	};
+
+	static void Copy(std::FStream& fsDst, std::FStream& fsSrc, uint64_t nSize, ECC::Hash::Processor& hp)
+	{
+		ByteBuffer buf(std::min<uint64_t>(nSize, 1U << 20));
+		while (nSize)
+		{
+			uint32_t n = static_cast<uint32_t>(std::min<uint64_t>(nSize, buf.size()));
+			fsSrc.read(&buf.front(), n);
+			fsDst.write(&buf.front(), n);
+			hp << Blob(&buf.front(), n);
+			nSize -= n;
+		}
+	}
+
+	static void Fail(const char* sz)
+	{
+		throw std::runtime_error(std::string("Snapshot: ") + sz);
+	}
+};
+
+const char NodeProcessor::Snapshot::s_szSignature[] = "BeamSnap";
+
+void NodeProcessor::ExportSnapshot(const char* szSnapshot)
+{
+	if (m_Cursor.m_ID.m_Height < Rules::HeightGenesis)
+		Snapshot::Fail("no state");
+	if (IsFastSync())
+		Snapshot::Fail("sync is in progress");
+
+	bool bTx = m_DbTx.IsInProgress(); // restored on exit
+	if (bTx)
+		CommitMappingAndDB();
+
+	const std::string& sPath = m_DB.get_Path();
+	std::string sDbCopy = std::string(szSnapshot) + "-db.tmp";
+
+	try
+	{
+		std::vector<Snapshot::Entry> vEntries;
+
+		auto fnAdd = [&vEntries](const std::string& sBase, const std::string& sSuffix, bool bDerived)
+		{
+			std::FStream fs;
+			if (!fs.Open((sBase + sSuffix).c_str(), true))
+				return;
+
+			Snapshot::Entry& e = vEntries.emplace_back();
+			e.m_sPath = sBase + sSuffix;
+
+			ZeroObject(e.m_Hdr);
+			e.m_Hdr.m_Derived = bDerived;
+			if (sSuffix.size() >= sizeof(e.m_Hdr.m_szSuffix))
+				Snapshot::Fail("path suffix too long");
+			memcpy(e.m_Hdr.m_szSuffix, sSuffix.c_str(), sSuffix.size());
+			e.m_Hdr.m_Size = uintBigFrom(fs.get_Remaining());
+		};
+
+		m_DB.Backup(sDbCopy.c_str());
+		fnAdd(sDbCopy, "", false);
+		if (vEntries.empty())
+			Snapshot::Fail("DB backup missing");
+
+		std::vector<std::string> vSide;
+		m_DB.get_SideFiles(vSide);
+		for (const auto& sSuffix : vSide)
+			fnAdd(sPath, sSuffix, false);
+
+		std::string sBase, sDerived;
+		get_DerivedPath(sBase, sPath.c_str(), "");
+
+		get_MappingPath(sDerived, sPath.c_str());
+		fnAdd(sBase, sDerived.substr(sBase.size()), true);
+		get_ShieldedCachePath(sDerived, sPath.c_str());
+		fnAdd(sBase, sDerived.substr(sBase.size()), true);
+
+		Snapshot::Hdr hdr;
+		memcpy(hdr.m_szSignature, Snapshot::s_szSignature, sizeof(hdr.m_szSignature));
+		hdr.m_Version = uintBigFrom(Snapshot::s_Version);
+		hdr.m_hvCfg = Rules::get().get_LastFork().m_Hash;
+		hdr.m_Height = uintBigFrom(m_Cursor.m_ID.m_Height);
+		hdr.m_hvState = m_Cursor.m_ID.m_Hash;
+		hdr.m_Files = uintBigFrom(static_cast<uint32_t>(vEntries.size()));
+
+		std::FStream fs;
+		fs.Open(szSnapshot, false, true);
+
+		ECC::Hash::Processor hp;
+		fs.write(&hdr, sizeof(hdr));
+		hp << Blob(&hdr, sizeof(hdr));
+
+		for (const auto& e : vEntries)
+		{
+			std::FStream fsSrc;
+			fsSrc.Open(e.m_sPath.c_str(), true, true);
+
+			uint64_t nSize;
+			e.m_Hdr.m_Size.Export(nSize);
+			if (fsSrc.get_Remaining() != nSize)
+				Snapshot::Fail("file size changed");
+
+			fs.write(&e.m_Hdr, sizeof(e.m_Hdr));
+			hp << Blob(&e.m_Hdr, sizeof(e.m_Hdr));
+
+			Snapshot::Copy(fs, fsSrc, nSize, hp);
+		}
+
+		Merkle::Hash hv;
+		hp >> hv;
+		fs.write(hv.m_pData, hv.nBytes);
+		fs.Flush();
+	}
+	catch (...)
+	{
+		DeleteFile(sDbCopy.c_str());
+		DeleteFile(szSnapshot);
+		if (bTx)
+			m_DbTx.Start(m_DB);
+		throw;
+	}
+
+	DeleteFile(sDbCopy.c_str());
+	if (bTx)
+		m_DbTx.Start(m_DB);
+
+	LOG_INFO() << "Snapshot exported: " << m_Cursor.m_ID;
+}
+
+void NodeProcessor::ImportSnapshot(const char* szSnapshot, const char* szPath)
+{
+	std::FStream fs;
+	if (fs.Open(szPath, true))
+		Snapshot::Fail("DB already exists");
+
+	fs.Open(szSnapshot, true, true);
+
+	Snapshot::Hdr hdr;
+	fs.read(&hdr, sizeof(hdr));
+
+	uint32_t nVer, nFiles;
+	hdr.m_Version.Export(nVer);
+	hdr.m_Files.Export(nFiles);
+
+	if (memcmp(hdr.m_szSignature, Snapshot::s_szSignature, sizeof(hdr.m_szSignature)) || (Snapshot::s_Version != nVer))
+		Snapshot::Fail("unsupported format");
+	if (!Rules::get().FindFork(hdr.m_hvCfg))
+		Snapshot::Fail("incompatible configuration");
+
+	Block::SystemState::ID sid;
+	hdr.m_Height.Export(sid.m_Height);
+	sid.m_Hash = hdr.m_hvState;
+
+	LOG_INFO() << "Importing snapshot " << sid << "...";
+
+	ECC::Hash::Processor hp;
+	hp << Blob(&hdr, sizeof(hdr));
+
+	std::vector<std::string> vFiles; // erased on failure
+
+	try
+	{
+		std::string sBase;
+		get_DerivedPath(sBase, szPath, "");
+
+		for (uint32_t i = 0; i < nFiles; i++)
+		{
+			Snapshot::FileHdr fh;
+			fs.read(&fh, sizeof(fh));
+			hp << Blob(&fh, sizeof(fh));
+
+			// the suffix must not lead out of the target directory
+			const char* szSuffix = fh.m_szSuffix;
+			if (fh.m_szSuffix[_countof(fh.m_szSuffix) - 1] || strchr(szSuffix, '/') || strchr(szSuffix, '\\') || (fh.m_Derived > 1) || (!i != !*szSuffix))
+				Snapshot::Fail("malformed");
+
+			std::string sDst = fh.m_Derived ? sBase : std::string(szPath);
+			sDst += szSuffix;
+
+			uint64_t nSize;
+			fh.m_Size.Export(nSize);
+			if (nSize > fs.get_Remaining())
+				Snapshot::Fail("truncated");
+
+			std::FStream fsDst;
+			fsDst.Open(sDst.c_str(), false, true); // overwrite leftovers, they don't belong to any DB
+			vFiles.push_back(std::move(sDst));
+
+			Snapshot::Copy(fsDst, fs, nSize, hp);
+			fsDst.Flush();
+		}
+
+		Merkle::Hash hv, hvExpected;
+		hp >> hvExpected;
+		fs.read(hv.m_pData, hv.nBytes);
+		if (hv != hvExpected)
+			Snapshot::Fail("checksum mismatch");
+		fs.Close();
+
+		NodeProcessor np;
+		np.Initialize(szPath); // rebuilds the UTXO image if it doesn't match, fails if the DB doesn't match the cursor header
+
+		if (np.m_Cursor.m_ID != sid)
+			Snapshot::Fail("state mismatch");
+		if (np.IsFastSync() || !np.TestDefinition())
+			Snapshot::Fail("state verification failed");
+		if (!np.TestHeaderChain())
+			Snapshot::Fail("header chain verification failed");
+
+		np.m_DB.ParamDelSafe(NodeDB::ParamID::MyID); // the snapshot comes from another node
+		np.CommitDB();
+	}
+	catch (...)
+	{
+		for (const auto& s : vFiles)
+			DeleteFile(s.c_str());
+		throw;
+	}
+
+	LOG_INFO() << "Snapshot imported";
 }
 
 bool NodeProcessor::InitMapping(const char* sz, bool bForceReset)
@@ -391,6 +765,30 @@ NodeProcessor::Mmr::Mmr(NodeDB& db)
 {
 }
 
+bool NodeProcessor::Mmr::IsFileCacheDirty() const
+{
+	return m_States.IsFileCacheDirty() || m_Shielded.IsFileCacheDirty() || m_Assets.IsFileCacheDirty();
+}
+
+void NodeProcessor::Mmr::FileCacheFlush(const NodeDB::StreamMmr::Stamp& us)
+{
+	// the stamp is shared, so the clean ones are re-stamped as well
+	m_States.FileCacheFlush(us);
+	m_Shielded.FileCacheFlush(us);
+	m_Assets.FileCacheFlush(us);
+}
+
+struct NodeProcessor::BvmCodeCache
+	:public bvm2::ProcessorContract::CodeCache
+{
+	void Log() const
+	{
+		LOG_INFO()
+			<< "Bvm code cache. Hits=" << m_Stats.m_Hits << ", shader hits=" << m_Stats.m_HitsShader << ", misses=" << m_Stats.m_Misses << ", invalidated=" << m_Stats.m_Invalidated
+			<< ". Images=" << m_Images.size() << ", contracts=" << m_Contracts.size();
+	}
+};
+
 NodeProcessor::NodeProcessor()
 	:m_Mmr(m_DB)
 {
@@ -408,35 +806,53 @@ NodeProcessor::~NodeProcessor()
 	}
 }
 
+void NodeProcessor::UpdateStamp(Merkle::Hash& us, NodeDB::ParamID::Enum id)
+{
+	Blob blob(us);
+
+	if (m_DB.ParamGet(id, nullptr, &blob)) {
+		ECC::Hash::Processor() << us >> us;
+	} else {
+		ECC::GenRandom(us);
+	}
+
+	m_DB.ParamSet(id, nullptr, &blob);
+}
+
 void NodeProcessor::CommitMappingAndDB()
 {
 	Mapped::Stamp us;
+	ShieldedCache::Stamp usCache;
+	NodeDB::StreamMmr::Stamp usMmr;
 
 	bool bFlushMapping = (m_Mapped.IsOpen() && m_Mapped.get_Hdr().m_Dirty);
+	bool bFlushCache = (m_ShieldedCache.IsOpen() && m_ShieldedCache.get_Hdr().m_Dirty);
+	bool bFlushMmr = m_Mmr.IsFileCacheDirty();
 
 	if (bFlushMapping)
 	{
-		Blob blob(us);
-
-		if (m_DB.ParamGet(NodeDB::ParamID::MappingStamp, nullptr, &blob)) {
-			ECC::Hash::Processor() << us >> us;
-		} else {
-			ECC::GenRandom(us);
-		}
-
-		m_DB.ParamSet(NodeDB::ParamID::MappingStamp, nullptr, &blob);
+		UpdateStamp(us, NodeDB::ParamID::MappingStamp);
+		m_Mapped.FlushStrict(us); // must be durable before the DB commit
 	}
+	if (bFlushCache)
+		UpdateStamp(usCache, NodeDB::ParamID::ShieldedCacheStamp);
+	if (bFlushMmr)
+		UpdateStamp(usMmr, NodeDB::ParamID::MmrCacheStamp);
 
 	m_DbTx.Commit();
 
 	if (bFlushMapping)
-		m_Mapped.FlushStrict(us);
+		m_Mapped.FlushApply();
+	if (bFlushCache)
+		m_ShieldedCache.FlushStrict(usCache);
+	if (bFlushMmr)
+		m_Mmr.FileCacheFlush(usMmr);
 }
 
 void NodeProcessor::Vacuum()
 {
 	if (m_DbTx.IsInProgress())
-		m_DbTx.Commit();
+		CommitMappingAndDB();
 
 	LOG_INFO() << "DB compacting...";
 	m_DB.Vacuum();
@@ -837,9 +1253,39 @@ void NodeProcessor::UnreachableLog::Log(const Block::SystemState::ID& id)
 	LOG_WARNING() << id << " State unreachable"; // probably will pollute the log, but it's a critical situation anyway
 }
 
+struct NodeProcessor::ShieldedCache::List
+	:public Sigma::CmList
+{
+	const ShieldedCache* m_pThis = nullptr;
+	TxoID m_ID0 = 0;
+
+	virtual bool get_At(ECC::Point::Storage& res, uint32_t iIdx) override
+	{
+		ECC::Point::Native pt;
+		if (!get_AtNative(pt, iIdx))
+			return false;
+
+		pt.Export(res);
+		return true;
+	}
+
+	virtual bool get_AtNative(ECC::Point::Native& res, uint32_t iIdx) override
+	{
+		uint64_t pos = m_ID0 + iIdx;
+		if (pos >= m_pThis->get_Hdr().m_Count)
+			return false;
+
+		Convert(res, *m_pThis->get_At(pos));
+		return true;
+	}
+};
+
 struct NodeProcessor::MultiSigmaContext
 {
-	static const uint32_t s_Chunk = 0x400;
+	// Each chunk is split between the executor threads, the portions should be large enough for the bucket multi-exponentiation.
+	// The chunk only bounds the node range, the node stores just the covered window
+	static const uint32_t s_Chunk = 0x4000;
+	static_assert(s_Chunk / 16 >= ECC::MultiMac_Buckets::s_MinCount, "a full chunk on 16 threads should still use the buckets");
 
 	struct Node
 	{
@@ -852,7 +1298,7 @@ struct NodeProcessor::MultiSigmaContext
 			IMPLEMENT_GET_PARENT_OBJ(Node, m_ID)
 		} m_ID;
 
-		ECC::Scalar::Native m_pS[s_Chunk];
+		std::vector<ECC::Scalar::Native> m_vS; // [m_Min, m_Max), grown on demand
 		uint32_t m_Min, m_Max;
 
 		typedef boost::intrusive::multiset<ID> IDSet;
@@ -923,14 +1369,24 @@ void NodeProcessor::MultiSigmaContext::Add(TxoID id0, uint32_t nCount, const ECC
 		{
 			n.m_Min = nOffset;
 			n.m_Max = nOffset + nPortion;
+			n.m_vS.resize(nPortion);
 		}
 		else
 		{
-			std::setmin(n.m_Min, nOffset);
-			std::setmax(n.m_Max, nOffset + nPortion);
+			if (n.m_Min > nOffset)
+			{
+				n.m_vS.insert(n.m_vS.begin(), n.m_Min - nOffset, ECC::Scalar::Native());
+				n.m_Min = nOffset;
+			}
+
+			if (n.m_Max < nOffset + nPortion)
+			{
+				n.m_Max = nOffset + nPortion;
+				n.m_vS.resize(n.m_Max - n.m_Min);
+			}
 		}
 
-		ECC::Scalar::Native* pT = n.m_pS + nOffset;
+		ECC::Scalar::Native* pT = &n.m_vS.front() + (nOffset - n.m_Min);
 		for (uint32_t i = 0; i < nPortion; i++)
 			pT[i] += pS[i];
 
@@ -952,11 +1408,11 @@ struct NodeProcessor::MultiSigmaContext::MyTask
 		ECC::Point::Native& val = m_pThis->m_vRes[ctx.m_iThread];
 		val = Zero;
 
+		// the list is positioned at the window start
 		uint32_t i0, nCount;
 		ctx.get_Portion(i0, nCount, m_pNode->m_Max - m_pNode->m_Min);
-		i0 += m_pNode->m_Min;
 
-		m_pThis->get_List().Calculate(val, i0, nCount, m_pNode->m_pS);
+		m_pThis->get_List().Calculate(val, i0, nCount, &m_pNode->m_vS.front());
 	}
 };
 
@@ -970,6 +1426,7 @@ void NodeProcessor::MultiSigmaContext::Calculate(ECC::Point::Native& res, NodePr
 		Node& n = m_Set.begin()->get_ParentObj();
 		assert(n.m_Min < n.m_Max);
 		assert(n.m_Max <= s_Chunk);
+		assert(n.m_vS.size() == n.m_Max - n.m_Min);
 
 		m_vRes.resize(nThreads);
 		PrepareList(np, n);
@@ -999,23 +1456,38 @@ struct NodeProcessor::MultiShieldedContext
 	}
 
 	bool IsValid(const TxVectors::Eternal&, Height, ECC::InnerProduct::BatchContext&, uint32_t iVerifier, uint32_t nTotal, ValidatedCache&);
-	void Prepare(const TxVectors::Eternal&, NodeProcessor&, Height);
+	bool Prepare(const TxVectors::Eternal&, NodeProcessor&, Height); // false if some referenced shielded state isn't reached yet
 
 private:
 
 	Sigma::CmListVec m_Lst;
+	ShieldedCache::List m_LstCached;
+	Sigma::CmList* m_pList = &m_Lst;
 
 	bool IsValid(const TxKernelShieldedInput&, Height hScheme, std::vector<ECC::Scalar::Native>& vBuf, ECC::InnerProduct::BatchContext&);
 
 	virtual Sigma::CmList& get_List() override
 	{
-		return m_Lst;
+		return *m_pList;
 	}
 
 	virtual void PrepareList(NodeProcessor& np, const Node& n) override
 	{
-		m_Lst.m_vec.resize(s_Chunk); // will allocate if empty
-		np.get_DB().ShieldedRead(n.m_ID.m_Value + n.m_Min, &m_Lst.m_vec.front() + n.m_Min, n.m_Max - n.m_Min);
+		TxoID id0 = n.m_ID.m_Value + n.m_Min;
+
+		const ShieldedCache& sc = np.m_ShieldedCache;
+		if (sc.IsOpen() && (sc.get_Hdr().m_Count >= n.m_ID.m_Value + n.m_Max))
+		{
+			// stream directly from the cache, no DB reads and point decoding
+			m_LstCached.m_pThis = &sc;
+			m_LstCached.m_ID0 = id0;
+			m_pList = &m_LstCached;
+			return;
+		}
+
+		m_Lst.m_vec.resize(n.m_Max - n.m_Min);
+		np.get_DB().ShieldedRead(id0, &m_Lst.m_vec.front(), m_Lst.m_vec.size());
+		m_pList = &m_Lst;
 	}
 
 	struct Walker
@@ -1126,15 +1598,16 @@ bool NodeProcessor::MultiShieldedContext::IsValid(const TxVectors::Eternal& txve
 	return wlk.Process(txve.m_vKernels);
 }
 
-void NodeProcessor::MultiShieldedContext::Prepare(const TxVectors::Eternal& txve, NodeProcessor& np, Height h)
+bool NodeProcessor::MultiShieldedContext::Prepare(const TxVectors::Eternal& txve, NodeProcessor& np, Height h)
 {
 	if (h < Rules::get().pForks[3].m_Height)
-		return;
+		return true;
 
 	struct MyWalker
 		:public Walker
 	{
 		NodeProcessor* m_pProc;
+		bool m_bReached = true;
 
 		virtual bool OnKrn(const TxKernelShieldedInput& v) override
 		{
@@ -1145,7 +1618,10 @@ void NodeProcessor::MultiShieldedContext::Prepare(const TxVectors::Eternal& txve
 			if (nStatePos < m_pProc->m_Extra.m_ShieldedOutputs)
 				m_pProc->get_DB().ShieldedStateRead(nStatePos, &hv, 1);
 			else
+			{
 				hv = Zero;
+				m_bReached = false;
+			}
 
 			return true;
 		}
@@ -1155,6 +1631,7 @@ void NodeProcessor::MultiShieldedContext::Prepare(const TxVectors::Eternal& txve
 	wlk.m_pProc = &np;
 
 	wlk.Process(txve.m_vKernels);
+	return wlk.m_bReached;
 }
 
 struct NodeProcessor::MultiAssetContext
@@ -1185,7 +1662,7 @@ private:
 		static_assert(sizeof(n.m_ID.m_Value) >= sizeof(m_Lst.m_Begin));
 
 		// TODO: maybe cache it in DB
-		m_Lst.m_Begin = static_cast<Asset::ID>(n.m_ID.m_Value);
+		m_Lst.m_Begin = static_cast<Asset::ID>(n.m_ID.m_Value + n.m_Min);
 	}
 };
 
@@ -1218,9 +1695,30 @@ struct NodeProcessor::MultiblockContext
 	HeightRange m_InProgress;
 	PeerID  m_pidLast;
 
+	ImportStats m_Stats;
+
+	struct TimeScope
+	{
+		uint64_t& m_Res;
+		uint64_t m_t0_us;
+
+		TimeScope(uint64_t& res)
+			:m_Res(res)
+			,m_t0_us(GetTime_us())
+		{
+		}
+
+		~TimeScope()
+		{
+			m_Res += GetTime_us() - m_t0_us;
+		}
+	};
+
 	MultiblockContext(NodeProcessor& np)
 		:m_This(np)
 	{
+		m_Stats.m_Total_us = GetTime_us();
+
 		m_InProgress.m_Max = m_This.m_Cursor.m_ID.m_Height;
 		m_InProgress.m_Min = m_InProgress.m_Max + 1;
 		assert(m_InProgress.IsEmpty());
@@ -1233,7 +1731,10 @@ struct NodeProcessor::MultiblockContext
 
 	~MultiblockContext()
 	{
-		m_This.get_Executor().Flush();
+		{
+			TimeScope ts(m_Stats.m_Wait_us);
+			m_This.get_Executor().Flush();
+		}
 
 		if (m_bBatchDirty)
 		{
@@ -1250,6 +1751,24 @@ struct NodeProcessor::MultiblockContext
 			Task0 t;
 			m_This.get_Executor().ExecAll(t);
 		}
+
+		if (m_Stats.m_Blocks)
+		{
+			m_Stats.m_Total_us = GetTime_us() - m_Stats.m_Total_us;
+			m_This.m_ImportStats += m_Stats;
+
+			if (m_Stats.m_Blocks > 1)
+			{
+				m_Stats.Log(m_This.get_Executor().get_Threads());
+				m_This.m_DB.m_KeyLookupStats.Log();
+				m_This.m_DB.m_ContractCacheStats.Log();
+
+				if (m_This.m_pBvmCodeCache)
+					m_This.m_pBvmCodeCache->Log();
+				if (m_This.m_BvmParallel.m_Blocks)
+					m_This.m_BvmParallel.Log();
+			}
+		}
 	}
 
 	ECC::Scalar::Native m_Offset;
@@ -1311,6 +1830,45 @@ struct NodeProcessor::MultiblockContext
 		uint32_t m_iVerifier;
 	};
 
+	// The following blocks of the path, loaded ahead of the cursor. Normally they're already pushed for verification,
+	// which runs while the preceding blocks are interpreted.
+	struct Ahead
+	{
+		uint64_t m_Row;
+		MyTask::SharedBlock::Ptr m_pShared;
+		bool m_bPushed;
+	};
+
+	std::deque<Ahead> m_qAhead;
+
+	const uint64_t* m_pPath = nullptr; // rows of the path after the current block, the next one is the last
+	size_t m_nPath = 0;
+
+	bool Load(MyTask::SharedBlock& sb, uint64_t row, ByteBuffer& bbP, ByteBuffer& bbE)
+	{
+		TimeScope ts(m_Stats.m_Load_us);
+
+		m_This.m_DB.GetStateBlock(row, &bbP, &bbE, nullptr);
+
+		Block::Body& block = sb.m_Body;
+
+		try {
+			Deserializer der;
+			der.reset(bbP);
+			der & Cast::Down<Block::BodyBase>(block);
+			der & Cast::Down<TxVectors::Perishable>(block);
+
+			der.reset(bbE);
+			der & Cast::Down<TxVectors::Eternal>(block);
+		}
+		catch (const std::exception&) {
+			return false;
+		}
+
+		sb.m_Size = bbP.size() + bbE.size();
+		return true;
+	}
+
 	bool Flush()
 	{
 		FlushInternal();
@@ -1323,6 +1881,7 @@ struct NodeProcessor::MultiblockContext
 			return;
 
 		Executor& ex = m_This.get_Executor();
+		TimeScope ts(m_Stats.m_Wait_us);
 		ex.Flush();
 
 		if (m_bFail)
@@ -1435,14 +1994,12 @@ struct NodeProcessor::MultiblockContext
 
 		m_pidLast = pid;
 
-		const size_t nSizeMax = 1024 * 1024 * 10; // fair enough
-
 		Executor& ex = m_This.get_Executor();
 		for (uint32_t nTasks = static_cast<uint32_t>(-1); ; )
 		{
 			{
 				std::unique_lock<std::mutex> scope(m_Mutex);
-				if (m_SizePending <= nSizeMax)
+				if (m_SizePending <= m_This.m_VerificationWindow)
 				{
 					m_SizePending += pShared->m_Size;
 					break;
@@ -1450,9 +2007,20 @@ struct NodeProcessor::MultiblockContext
 			}
 
 			assert(nTasks);
+			TimeScope ts(m_Stats.m_Wait_us);
 			nTasks = ex.Flush(nTasks - 1);
 		}
 
+		m_Msc.Prepare(pShared->m_Body, m_This, pShared->m_Ctx.m_Height.m_Min);
+
+		PushBlock(pShared);
+	}
+
+	void PushBlock(const MyTask::SharedBlock::Ptr& pShared)
+	{
+		m_Stats.m_Blocks++;
+		m_Stats.m_Bytes += pShared->m_Size;
+
 		// The following won't hold if some blocks in the current range were already verified in the past, and omitted from the current verification
 		//		m_InProgress.m_Max++;
 		//		assert(m_InProgress.m_Max == pShared->m_Ctx.m_Height.m_Min);
@@ -1461,14 +2029,71 @@ struct NodeProcessor::MultiblockContext
 		bool bFull = (pShared->m_Ctx.m_Height.m_Min > m_This.m_SyncData.m_Target.m_Height);
 
 		pShared->m_Pars.m_bAllowUnsignedOutputs = !bFull;
-		pShared->m_Pars.m_pAbort = &m_bFail;
-		pShared->m_Pars.m_nVerifiers = ex.get_Threads();
-
-		m_Msc.Prepare(pShared->m_Body, m_This, pShared->m_Ctx.m_Height.m_Min);
 
 		PushTasks(pShared, pShared->m_Pars);
 	}
 
+	// Push the following blocks of the path for verification, while the current one (at height h) is interpreted.
+	// Stops where OnBlock would flush (peer change, TxoLo, fast-sync target), at the already validated blocks,
+	// and at a block that depends on the shielded state that isn't interpreted yet.
+	void PushAhead(Height h)
+	{
+		while ((m_qAhead.size() < m_This.m_VerificationAhead) && (m_qAhead.size() < m_nPath) && !m_bFail)
+		{
+			if (!m_qAhead.empty() && !m_qAhead.back().m_bPushed)
+				break; // waits for the cursor
+
+			Height hNext = h + 1 + m_qAhead.size();
+
+			if ((m_InProgress.m_Max + 1 != hNext) ||
+				(m_InProgress.m_Max == m_This.m_SyncData.m_TxoLo) ||
+				(m_InProgress.m_Max == m_This.m_SyncData.m_Target.m_Height) ||
+				(hNext == m_This.m_ManualSelection.m_Sid.m_Height))
+				break;
+
+			{
+				std::unique_lock<std::mutex> scope(m_Mutex);
+				if (m_SizePending > m_This.m_VerificationWindow)
+					break; // don't wait, the cursor will get there
+			}
+
+			uint64_t row = m_pPath[m_nPath - 1 - m_qAhead.size()];
+			if (m_This.m_DB.get_StateTxos(row) != MaxHeight)
+				break; // already validated
+
+			PeerID pid;
+			if (!m_This.m_DB.get_Peer(row, pid))
+				pid = Zero;
+			if (pid != m_pidLast)
+				break;
+
+			MyTask::SharedBlock::Ptr pShared = std::make_shared<MyTask::SharedBlock>(*this);
+
+			ByteBuffer bbP, bbE;
+			if (!Load(*pShared, row, bbP, bbE))
+				break; // will fail when the cursor gets there
+
+			pShared->m_Ctx.m_Height = hNext;
+
+			m_qAhead.emplace_back();
+			Ahead& x = m_qAhead.back();
+			x.m_Row = row;
+			x.m_pShared = pShared;
+			x.m_bPushed = m_Msc.Prepare(pShared->m_Body, m_This, hNext);
+
+			if (x.m_bPushed)
+			{
+				{
+					std::unique_lock<std::mutex> scope(m_Mutex);
+					m_SizePending += pShared->m_Size;
+				}
+
+				m_Stats.m_Ahead++;
+				PushBlock(pShared);
+			}
+		}
+	}
+
 	void PushTasks(const MyTask::Shared::Ptr& pShared, TxBase::Context::Params& pars)
 	{
 		Executor& ex = m_This.get_Executor();
@@ -1531,6 +2156,8 @@ void NodeProcessor::MultiblockContext::MyTask::Exec(Executor::Context&)
 
 void NodeProcessor::MultiblockContext::MyTask::SharedBlock::Exec(uint32_t iVerifier)
 {
+	uint64_t t0_us = GetTime_us();
+
 	TxBase::Context ctx(m_Ctx.m_Params);
 	ctx.m_Height = m_Ctx.m_Height;
 	ctx.m_iVerifier = iVerifier;
@@ -1546,7 +2173,10 @@ void NodeProcessor::MultiblockContext::MyTask::SharedBlock::Exec(uint32_t iVerif
 	if (bValid)
 		bValid = m_Mbc.m_Msc.IsValid(m_Body, m_Ctx.m_Height.m_Min, *ECC::InnerProduct::BatchContext::s_pInstance, iVerifier, m_Ctx.m_Params.m_nVerifiers, m_Mbc.m_This.m_ValCache);
 
+	uint64_t dt_us = GetTime_us() - t0_us;
+
 	std::unique_lock<std::mutex> scope(m_Mbc.m_Mutex);
+	m_Mbc.m_Stats.m_Verify_us += dt_us;
 
 	if (bValid)
 		bValid = m_Ctx.Merge(ctx);
@@ -1571,6 +2201,34 @@ void NodeProcessor::MultiblockContext::MyTask::SharedBlock::Exec(uint32_t iVerif
 		m_Mbc.m_bFail = true;
 }
 
+void NodeProcessor::ImportStats::operator += (const ImportStats& x)
+{
+	m_Blocks += x.m_Blocks;
+	m_Ahead += x.m_Ahead;
+	m_Bytes += x.m_Bytes;
+	m_Load_us += x.m_Load_us;
+	m_Verify_us += x.m_Verify_us;
+	m_Interpret_us += x.m_Interpret_us;
+	m_Commit_us += x.m_Commit_us;
+	m_Wait_us += x.m_Wait_us;
+	m_Total_us += x.m_Total_us;
+}
+
+void NodeProcessor::ImportStats::Log(uint32_t nThreads) const
+{
+	// Verification runs in parallel, its time is normalized by the number of threads.
+	// The stage with the largest time bounds the import speed.
+	uint64_t nBlocksPerSec = m_Total_us ? (m_Blocks * 1000000 / m_Total_us) : 0;
+
+	LOG_VERBOSE()
+		<< "Imported " << m_Blocks << " blocks (" << m_Ahead << " verified ahead), " << (m_Bytes >> 10) << " KB in " << (m_Total_us / 1000) << " ms (" << nBlocksPerSec << " blocks/sec)"
+		<< ", load=" << (m_Load_us / 1000)
+		<< ", verify=" << (m_Verify_us / 1000 / std::max<uint32_t>(nThreads, 1)) << "x" << nThreads
+		<< ", interpret=" << (m_Interpret_us / 1000)
+		<< ", commit=" << (m_Commit_us / 1000)
+		<< ", wait=" << (m_Wait_us / 1000);
+}
+
 void NodeProcessor::TryGoUp()
 {
 	if (!IsTreasuryHandled())
@@ -1646,6 +2304,9 @@ void NodeProcessor::TryGoTo(NodeDB::StateID& sidTrg)
 		sidFwd.m_Height = m_Cursor.m_Sid.m_Height + 1;
 		sidFwd.m_Row = vPath[--iPos];
 
+		mbc.m_pPath = &vPath.front();
+		mbc.m_nPath = iPos;
+
 		Block::SystemState::Full s;
 		m_DB.get_State(sidFwd.m_Row, s); // need it for logging anyway
 
@@ -1671,7 +2332,7 @@ void NodeProcessor::TryGoTo(NodeDB::StateID& sidTrg)
 		if (IsFastSync())
 			m_DB.DelStateBlockPP(sidFwd.m_Row); // save space
 
-		if (mbc.m_InProgress.m_Max == m_SyncData.m_Target.m_Height)
+		if ((mbc.m_InProgress.m_Max == m_SyncData.m_Target.m_Height) && (mbc.m_InProgress.m_Max == m_Cursor.m_ID.m_Height))
 		{
 			if (!mbc.Flush())
 				break;
@@ -1866,6 +2527,14 @@ Height NodeProcessor::PruneOld()
 	if (IsBigger2(m_Cursor.m_Sid.m_Height, m_Extra.m_TxoHi, m_Horizon.m_Local.Hi))
 		hRet += RaiseTxoHi(m_Cursor.m_Sid.m_Height - m_Horizon.m_Local.Hi);
 
+	// Archive the compacted TXOs that can't be affected by rollback. Lag behind the TxoHi, so that most of the TXOs
+	// created in the archived range are already spent (and compacted), the rest remain in the DB
+	Height hArchive = std::min(m_Extra.m_TxoHi - std::min(m_Extra.m_TxoHi, m_Horizon.m_Local.Hi), m_Extra.m_Fossil);
+	if (hArchive >= Rules::HeightGenesis)
+		hRet += m_DB.TxoArchiveMove(get_TxosBefore(hArchive + 1), m_Extra.m_TxoHi);
+
+	m_DB.BodyStoreCompact(); // at most one segment per call, to spread the copying
+
 	return hRet;
 }
 
@@ -1936,6 +2605,7 @@ Height NodeProcessor::RaiseTxoLo(Height hTrg)
 
 	m_Extra.m_TxoLo = hTrg;
 	m_DB.ParamIntSet(NodeDB::ParamID::HeightTxoLo, m_Extra.m_TxoLo);
+	m_DB.TxoArchivePrune(m_Extra.m_TxoLo, m_Extra.m_TxosTreasury);
 
 	return hRet;
 }
@@ -2073,10 +2743,29 @@ bool NodeProcessor::Evaluator::get_History(Merkle::Hash& hv)
 
 bool NodeProcessor::Evaluator::get_Utxos(Merkle::Hash& hv)
 {
-	m_Proc.m_Mapped.m_Utxo.get_Hash(hv);
+	get_TreeHash(m_Proc.m_Mapped.m_Utxo, hv, "Utxos");
 	return true;
 }
 
+void NodeProcessor::Evaluator::get_TreeHash(RadixHashTree& t, Merkle::Hash& hv, const char* szName)
+{
+	if (t.IsHashClean())
+	{
+		t.get_Hash(hv);
+		return;
+	}
+
+	uint64_t t0_us = GetTime_us();
+
+	Executor& ex = m_Proc.get_Executor();
+	{
+		Executor::Scope scope(ex);
+		t.get_Hash(hv);
+	}
+
+	LOG_VERBOSE() << szName << " rehash at " << m_Height << ": " << (GetTime_us() - t0_us) << " us, threads=" << ex.get_Threads();
+}
+
 bool NodeProcessor::Evaluator::get_Kernels(Merkle::Hash& hv)
 {
 	m_Proc.EnsureCursorKernels();
@@ -2114,7 +2803,7 @@ bool NodeProcessor::Evaluator::get_Assets(Merkle::Hash& hv)
 
 bool NodeProcessor::Evaluator::get_Contracts(Merkle::Hash& hv)
 {
-	m_Proc.m_Mapped.m_Contract.get_Hash(hv);
+	get_TreeHash(m_Proc.m_Mapped.m_Contract, hv, "Contracts");
 	return true;
 }
 
@@ -2364,6 +3053,8 @@ struct NodeProcessor::BlockInterpretCtx
 
 	BlobMap::Set m_Dups; // mirrors 'unique' DB table in temporary mode
 
+	UtxoTree::SeqCursor m_UtxoCu; // inputs and outputs are sorted, consecutive lookups share the upper part of the path
+
 	typedef std::multiset<Blob> BlobPtrSet; // like BlobMap, but buffers are not allocated/copied
 	BlobPtrSet m_KrnIDs; // mirrors kernel ID DB table in temporary mode
 
@@ -2404,8 +3095,10 @@ struct NodeProcessor::BlockInterpretCtx
 		static bool IsOwnedVar(const bvm2::ContractID&, const Blob& key);
 
 		bool Invoke(const bvm2::ContractID&, uint32_t iMethod, const TxKernelContractControl&);
+		static void InvokeRaw(bvm2::ProcessorContract&, const bvm2::ContractID&, uint32_t iMethod, const TxKernelContractControl&, bool bValidateSigs); // throws on failure
 
 		uint32_t SaveVar(const Blob& key, const Blob& data);
+		uint32_t OnLog(const Blob& key, const Blob& val);
 		void UndoVars();
 		void ToggleSidEntry(const bvm2::ShaderID&, const bvm2::ContractID&, bool bSet);
 
@@ -2445,6 +3138,11 @@ struct NodeProcessor::BlockInterpretCtx
 	BlobMap::Set m_ContractVars;
 	BlobMap::Entry& get_ContractVar(const Blob& key, NodeDB& db);
 
+	bool get_HdrAt(NodeProcessor&, Block::SystemState::Full&) const;
+
+	struct BvmSpeculative;
+	BvmSpeculative* m_pBvmSpeculative = nullptr; // contract invocations pre-executed in parallel, if any
+
 	BlockInterpretCtx(Height h, bool bFwd)
 		:m_Height(h)
 		,m_Fwd(bFwd)
@@ -2489,14 +3187,85 @@ struct NodeProcessor::BlockInterpretCtx
 			m_ShieldedOutps = p.m_Extra.m_ShieldedOutputs;
 		}
 
-		void Do(NodeProcessor& p, Height h)
-		{
-			if (p.m_Extra.m_ShieldedOutputs != m_ShieldedOutps)
-				p.m_DB.ShieldedOutpSet(h, p.m_Extra.m_ShieldedOutputs);
+		void Do(NodeProcessor& p, Height h)
+		{
+			if (p.m_Extra.m_ShieldedOutputs != m_ShieldedOutps)
+				p.m_DB.ShieldedOutpSet(h, p.m_Extra.m_ShieldedOutputs);
+
+			ChangesFlushGlobal::Do(p);
+		}
+	};
+};
+
+/////////////////////////////
+// BvmSpeculative
+//
+// Top-level contract invocations of the block are pre-executed in parallel, against the state before the block.
+// Each run records the values it has read, and its effects (var writes and logs) in order.
+// Then, during the block interpretation, the run is applied only if everything it has read is still the same,
+// which gives exactly the same effects (state, logs, recovery data, charge) as the direct execution. Otherwise the invocation is re-executed.
+//
+// The exception is the locked funds balance, which is modified by every funds-moving call to the contract, and otherwise would make
+// all of them conflicting. It's not visible to the contract, only tested for overflow. So its changes are re-applied as deltas.
+struct NodeProcessor::BlockInterpretCtx::BvmSpeculative
+{
+	struct Op
+	{
+		struct Type {
+			static const uint8_t Save = 0;
+			static const uint8_t Log = 1;
+			static const uint8_t LockedAmount = 2;
+		};
+
+		uint8_t m_Type;
+		ByteBuffer m_Key;
+		ByteBuffer m_Val;
+		ByteBuffer m_Val0; // LockedAmount only, the value before
+	};
+
+	struct Run
+	{
+		const TxKernelContractInvoke* m_pKrn;
+		uint32_t m_LogPos = 0; // assumed position of the 1st log
+		uint32_t m_Logs = 0;
+		uint32_t m_Charge = 0; // consumed
+		bool m_Ok = false;
+
+		BlobMap::Set m_Reads; // values before the run
+		std::vector<Op> m_vOps;
+	};
+
+	BlockInterpretCtx& m_Bic;
+	NodeProcessor& m_Proc;
+
+	std::deque<Run> m_vRuns; // in the block order
+	size_t m_iNext = 0;
+
+	BvmSpeculative(BlockInterpretCtx& bic, NodeProcessor& p)
+		:m_Bic(bic)
+		,m_Proc(p)
+	{
+	}
+
+	bool Init(const TxVectors::Full&);
+	void Execute();
+	bool Apply(BvmProcessor&, const TxKernelContractControl&);
+
+private:
 
-			ChangesFlushGlobal::Do(p);
-		}
-	};
+	struct Processor;
+	struct Task;
+
+	std::mutex m_Mutex; // bic and DB are accessed by the runs concurrently
+	std::vector<Run*> m_vPending;
+	std::atomic<size_t> m_iPending;
+
+	void ExecutePending(Executor&);
+	void ExecuteOnce(Run&, uint32_t iThread);
+
+	static bool IsLockedAmount(const Blob& key);
+	static void LoadAmount(AmountBig::Type&, const ByteBuffer&);
+	static bool ApplyDelta(ByteBuffer& val, const Op&);
 };
 
 bool NodeProcessor::ExtractTreasury(const Blob& blob, Treasury::Data& td)
@@ -2693,36 +3462,46 @@ bool NodeProcessor::HandleBlock(const NodeDB::StateID& sid, const Block::SystemS
 	}
 
 	ByteBuffer bbP, bbE;
-	m_DB.GetStateBlock(sid.m_Row, &bbP, &bbE, nullptr);
-
-	MultiblockContext::MyTask::SharedBlock::Ptr pShared = std::make_shared<MultiblockContext::MyTask::SharedBlock>(mbc);
-	Block::Body& block = pShared->m_Body;
+	MultiblockContext::MyTask::SharedBlock::Ptr pShared;
+	bool bPushed = false;
 
-	try {
-		Deserializer der;
-		der.reset(bbP);
-		der & Cast::Down<Block::BodyBase>(block);
-		der & Cast::Down<TxVectors::Perishable>(block);
+	if (mbc.m_qAhead.empty())
+	{
+		pShared = std::make_shared<MultiblockContext::MyTask::SharedBlock>(mbc);
 
-		der.reset(bbE);
-		der & Cast::Down<TxVectors::Eternal>(block);
+		if (!mbc.Load(*pShared, sid.m_Row, bbP, bbE))
+		{
+			LOG_WARNING() << LogSid(m_DB, sid) << " Block deserialization failed";
+			return false;
+		}
 	}
-	catch (const std::exception&) {
-		LOG_WARNING() << LogSid(m_DB, sid) << " Block deserialization failed";
-		return false;
+	else
+	{
+		MultiblockContext::Ahead& x = mbc.m_qAhead.front();
+		assert(x.m_Row == sid.m_Row);
+
+		pShared = std::move(x.m_pShared);
+		bPushed = x.m_bPushed;
+		mbc.m_qAhead.pop_front();
 	}
 
+	Block::Body& block = pShared->m_Body;
+
 	bool bFirstTime = (m_DB.get_StateTxos(sid.m_Row) == MaxHeight);
 	if (bFirstTime)
 	{
-		pShared->m_Size = bbP.size() + bbE.size();
-		pShared->m_Ctx.m_Height = sid.m_Height;
+		if (!bPushed)
+		{
+			pShared->m_Ctx.m_Height = sid.m_Height;
 
-		PeerID pid;
-		if (!m_DB.get_Peer(sid.m_Row, pid))
-			pid = Zero;
+			PeerID pid;
+			if (!m_DB.get_Peer(sid.m_Row, pid))
+				pid = Zero;
+
+			mbc.OnBlock(pid, pShared);
+		}
 
-		mbc.OnBlock(pid, pShared);
+		mbc.PushAhead(sid.m_Height);
 
 		Difficulty::Raw wrk = m_Cursor.m_Full.m_ChainWork + s.m_PoW.m_Difficulty;
 
@@ -2747,6 +3526,8 @@ bool NodeProcessor::HandleBlock(const NodeDB::StateID& sid, const Block::SystemS
 
 	TxoID id0 = m_Extra.m_Txos;
 
+	uint64_t t0_us = GetTime_us();
+
 	BlockInterpretCtx bic(sid.m_Height, true);
 	BlockInterpretCtx::ChangesFlush cf(*this);
 	bic.SetAssetHi(*this);
@@ -2836,6 +3617,9 @@ bool NodeProcessor::HandleBlock(const NodeDB::StateID& sid, const Block::SystemS
 		}
 	}
 
+	uint64_t t1_us = GetTime_us();
+	mbc.m_Stats.m_Interpret_us += t1_us - t0_us;
+
 	if (bOk)
 	{
 		m_Cursor.m_hvKernels = ev.m_hvKernels;
@@ -2904,6 +3688,8 @@ bool NodeProcessor::HandleBlock(const NodeDB::StateID& sid, const Block::SystemS
 		m_RecentStates.Push(sid.m_Row, s);
 
 		cf.Do(*this, sid.m_Height);
+
+		mbc.m_Stats.m_Commit_us += GetTime_us() - t1_us;
 	}
 	else
 	{
@@ -3846,6 +4632,12 @@ bool NodeProcessor::HandleKernelType(const TxKernelShieldedOutput& krn, BlockInt
 			m_DB.ShieldedResize(m_Extra.m_ShieldedOutputs + 1, m_Extra.m_ShieldedOutputs);
 			m_DB.ShieldedWrite(m_Extra.m_ShieldedOutputs, &pt_s, 1);
 
+			if (m_ShieldedCache.IsOpen())
+			{
+				assert(m_ShieldedCache.get_Hdr().m_Count == m_Extra.m_ShieldedOutputs);
+				m_ShieldedCache.Append(&pt_s, 1);
+			}
+
 			// Append state hash
 			ECC::Hash::Value hvState;
 			if (m_Extra.m_ShieldedOutputs)
@@ -3884,6 +4676,8 @@ bool NodeProcessor::HandleKernelType(const TxKernelShieldedOutput& krn, BlockInt
 		if (!bic.m_Temporary)
 		{
 			m_DB.ShieldedResize(m_Extra.m_ShieldedOutputs - 1, m_Extra.m_ShieldedOutputs);
+			if (m_ShieldedCache.IsOpen())
+				m_ShieldedCache.ShrinkTo(m_Extra.m_ShieldedOutputs - 1);
 			m_DB.ShieldedStateResize(m_Extra.m_ShieldedOutputs - 1, m_Extra.m_ShieldedOutputs);
 		}
 
@@ -3982,8 +4776,36 @@ void NodeProcessor::HandleElementVecBwd(const T& vec, BlockInterpretCtx& bic, si
 			OnCorrupted();
 }
 
+void NodeProcessor::PrefetchUtxos(const TxVectors::Full& txv)
+{
+	// inputs and outputs are looked-up by their commitments in random places of the tree. Walk all the paths at once
+	size_t nCount = txv.m_vInputs.size() + txv.m_vOutputs.size();
+	if (nCount < 2)
+		return;
+
+	std::vector<UtxoTree::Key> vKeys(nCount);
+	std::vector<const uint8_t*> vPtrs(nCount);
+
+	UtxoTree::Key::Data d;
+	d.m_Maturity = 0;
+
+	for (size_t i = 0; i < nCount; i++)
+	{
+		d.m_Commitment = (i < txv.m_vInputs.size()) ?
+			txv.m_vInputs[i]->m_Commitment :
+			txv.m_vOutputs[i - txv.m_vInputs.size()]->m_Commitment;
+
+		vKeys[i] = d;
+		vPtrs[i] = vKeys[i].V.m_pData;
+	}
+
+	m_Mapped.m_Utxo.Prefetch(&vPtrs.front(), static_cast<uint32_t>(nCount), UtxoTree::Key::s_BitsCommitment);
+}
+
 bool NodeProcessor::HandleValidatedTx(const TxVectors::Full& txv, BlockInterpretCtx& bic)
 {
+	PrefetchUtxos(txv);
+
 	size_t pN[3];
 
 	bool bOk = true;
@@ -4027,7 +4849,21 @@ bool NodeProcessor::HandleValidatedBlock(const Block::Body& block, BlockInterpre
 		m_Extra.m_Txos--;
 	}
 
-	if (!HandleValidatedTx(block, bic))
+	std::unique_ptr<BlockInterpretCtx::BvmSpeculative> pBvmSpec;
+	if (bic.m_Fwd && !bic.m_Temporary && !bic.m_pTxErrorInfo && m_BvmParallel.m_MinInvocations && (get_Executor().get_Threads() > 1))
+	{
+		pBvmSpec = std::make_unique<BlockInterpretCtx::BvmSpeculative>(bic, *this);
+		if (pBvmSpec->Init(block))
+		{
+			pBvmSpec->Execute();
+			bic.m_pBvmSpeculative = pBvmSpec.get();
+		}
+	}
+
+	bool bOk = HandleValidatedTx(block, bic);
+	bic.m_pBvmSpeculative = nullptr;
+
+	if (!bOk)
 		return false;
 
 	// currently there's no extra info in the block that's needed
@@ -4040,39 +4876,23 @@ bool NodeProcessor::HandleValidatedBlock(const Block::Body& block, BlockInterpre
 
 bool NodeProcessor::HandleBlockElement(const Input& v, BlockInterpretCtx& bic)
 {
-	UtxoTree::Cursor cu;
+	UtxoTree::SeqCursor& cu = bic.m_UtxoCu;
 	UtxoTree::MyLeaf* p;
 	UtxoTree::Key::Data d;
 	d.m_Commitment = v.m_Commitment;
 
 	if (bic.m_Fwd)
 	{
-		struct Traveler :public UtxoTree::ITraveler {
-			virtual bool OnLeaf(const RadixTree::Leaf& x) override {
-				return false; // stop iteration
-			}
-		} t;
-
-
-		UtxoTree::Key kMin, kMax;
-
-		d.m_Maturity = Rules::HeightGenesis - 1;
-		kMin = d;
-		d.m_Maturity = bic.m_Height - 1;
-		kMax = d;
-
-		t.m_pCu = &cu;
-		t.m_pBound[0] = kMin.V.m_pData;
-		t.m_pBound[1] = kMax.V.m_pData;
-
-		if (m_Mapped.m_Utxo.Traverse(t))
+		// the one with the lowest maturity, it must be reached already
+		p = m_Mapped.m_Utxo.FindMin(cu, v.m_Commitment);
+		if (!p)
 			return false;
 
-		p = &Cast::Up<UtxoTree::MyLeaf>(cu.get_Leaf());
-
 		d = p->m_Key;
 		assert(d.m_Commitment == v.m_Commitment);
-		assert(d.m_Maturity < bic.m_Height);
+
+		if (d.m_Maturity >= bic.m_Height)
+			return false;
 
 		TxoID nID = p->m_ID;
 
@@ -4124,7 +4944,7 @@ bool NodeProcessor::HandleBlockElement(const Output& v, BlockInterpretCtx& bic)
 
 	m_Mapped.m_Utxo.EnsureReserve();
 
-	UtxoTree::Cursor cu;
+	UtxoTree::SeqCursor& cu = bic.m_UtxoCu;
 	bool bCreate = true;
 	UtxoTree::MyLeaf* p = m_Mapped.m_Utxo.Find(cu, key, bCreate);
 
@@ -4423,86 +5243,463 @@ NodeProcessor::BlockInterpretCtx::BvmProcessor::BvmProcessor(BlockInterpretCtx&
 	:m_Bic(bic)
 	,m_Proc(proc)
 {
+	if (!proc.m_pBvmCodeCache)
+		proc.m_pBvmCodeCache = std::make_unique<BvmCodeCache>();
+	m_pCodeCache = proc.m_pBvmCodeCache.get();
+
 	if (bic.m_Fwd)
 	{
-		BlockInterpretCtx::Ser ser(bic);
+		BlockInterpretCtx::Ser ser(bic);
+
+		RecoveryTag::Type n = RecoveryTag::Terminator;
+		ser & n;
+	}
+}
+
+bool NodeProcessor::BlockInterpretCtx::BvmProcessor::Invoke(const bvm2::ContractID& cid, uint32_t iMethod, const TxKernelContractControl& krn)
+{
+	bool bRes = false;
+	try
+	{
+		m_Charge = m_Bic.m_ChargePerBlock;
+
+		if (!m_Bic.m_pBvmSpeculative || !m_Bic.m_pBvmSpeculative->Apply(*this, krn))
+		{
+			if (m_Bic.m_pTxErrorInfo)
+				m_DbgCallstack.m_Enable = true;
+
+			InvokeRaw(*this, cid, iMethod, krn, !m_Bic.m_AlreadyValidated);
+		}
+
+		bRes = true;
+
+		if (m_Bic.m_Temporary)
+		{
+			BlockInterpretCtx::Ser ser(m_Bic);
+			RecoveryTag::Type nTag = RecoveryTag::Recharge;
+			ser & nTag;
+			ser & m_Bic.m_ChargePerBlock;
+		}
+
+		m_Bic.m_ChargePerBlock = m_Charge;
+	}
+	catch (const Wasm::Exc& e)
+	{
+		uint32_t n = e.m_Type + proto::TxStatus::ContractFailFirst;
+		m_Bic.m_TxStatus = (n < proto::TxStatus::ContractFailLast) ? static_cast<uint8_t>(n) : proto::TxStatus::ContractFailFirst;
+
+		if (e.m_Type == bvm2::ErrorSubType::NoCharge)
+			m_Bic.m_LimitExceeded = true;
+
+		if (m_Bic.m_pTxErrorInfo)
+			*m_Bic.m_pTxErrorInfo << e.what();
+	}
+	catch (const std::exception& e)
+	{
+		m_Bic.m_TxStatus = proto::TxStatus::ContractFailFirst;
+
+		if (m_Bic.m_pTxErrorInfo)
+			*m_Bic.m_pTxErrorInfo << e.what();
+	}
+
+	if (!bRes)
+	{
+		if (m_Bic.m_pTxErrorInfo)
+			DumpCallstack(*m_Bic.m_pTxErrorInfo);
+
+		UndoVars();
+	}
+	return bRes;
+}
+
+void NodeProcessor::BlockInterpretCtx::BvmProcessor::InvokeRaw(bvm2::ProcessorContract& proc, const bvm2::ContractID& cid, uint32_t iMethod, const TxKernelContractControl& krn, bool bValidateSigs)
+{
+	proc.InitStackPlus(proc.m_Stack.AlignUp(static_cast<uint32_t>(krn.m_Args.size())));
+	proc.m_Stack.PushAlias(krn.m_Args);
+
+	proc.CallFar(cid, iMethod, proc.m_Stack.get_AlasSp());
+
+	ECC::Hash::Processor hp;
+
+	if (bValidateSigs)
+	{
+		hp << krn.m_Msg;
+		proc.m_pSigValidate = &hp;
+	}
+
+	while (!proc.IsDone())
+		proc.RunCharged();
+
+	if (bValidateSigs)
+		proc.CheckSigs(krn.m_Commitment, krn.m_Signature);
+}
+
+struct NodeProcessor::BlockInterpretCtx::BvmSpeculative::Processor
+	:public bvm2::ProcessorContract
+{
+	BvmSpeculative& m_This;
+	Run& m_Run;
+	BlobMap::Set m_Writes;
+
+	Processor(BvmSpeculative& x, Run& r)
+		:m_This(x)
+		,m_Run(r)
+	{
+	}
+
+	BlobMap::Entry& get_Var(const Blob& key)
+	{
+		auto* pE = m_Writes.Find(key);
+		if (!pE)
+		{
+			// no dependency on the locked amount
+			BlobMap::Set& s = IsLockedAmount(key) ? m_Writes : m_Run.m_Reads;
+
+			pE = s.Find(key);
+			if (!pE)
+			{
+				pE = s.Create(key);
+
+				std::unique_lock<std::mutex> scope(m_This.m_Mutex);
+				pE->m_Data = m_This.m_Bic.get_ContractVar(key, m_This.m_Proc.m_DB).m_Data;
+			}
+		}
+		return *pE;
+	}
+
+	void LoadVar(const VarKey& vk, uint8_t* pVal, uint32_t& nValInOut) override
+	{
+		auto& e = get_Var(Blob(vk.m_p, vk.m_Size));
+
+		if (!e.m_Data.empty())
+		{
+			auto n0 = static_cast<uint32_t>(e.m_Data.size());
+			memcpy(pVal, &e.m_Data.front(), std::min(n0, nValInOut));
+			nValInOut = n0;
+		}
+		else
+			nValInOut = 0;
+	}
+
+	void LoadVar(const VarKey& vk, ByteBuffer& res) override
+	{
+		res = get_Var(Blob(vk.m_p, vk.m_Size)).m_Data;
+	}
+
+	uint32_t SaveVar(const VarKey& vk, const uint8_t* pVal, uint32_t nVal) override
+	{
+		Blob key(vk.m_p, vk.m_Size);
+		Blob data(pVal, nVal);
+
+		auto& e = get_Var(key);
+		auto nOldSize = static_cast<uint32_t>(e.m_Data.size());
+
+		if (Blob(e.m_Data) != data)
+		{
+			if (bvm2::ContractID::nBytes == key.n)
+				m_pCodeCache->Invalidate(*reinterpret_cast<const bvm2::ContractID*>(key.p)); // contract body
+
+			auto& op = m_Run.m_vOps.emplace_back();
+			key.Export(op.m_Key);
+			data.Export(op.m_Val);
+
+			if (IsLockedAmount(key))
+			{
+				op.m_Type = Op::Type::LockedAmount;
+				op.m_Val0 = e.m_Data;
+			}
+			else
+				op.m_Type = Op::Type::Save;
+
+			auto* pW = m_Writes.Find(key);
+			if (!pW)
+				pW = m_Writes.Create(key);
+			data.Export(pW->m_Data);
+		}
+
+		return nOldSize;
+	}
+
+	uint32_t OnLog(const VarKey& vk, const Blob& val) override
+	{
+		auto& op = m_Run.m_vOps.emplace_back();
+		Blob(vk.m_p, vk.m_Size).Export(op.m_Key);
+		val.Export(op.m_Val);
+		op.m_Type = Op::Type::Log;
+
+		return m_Run.m_LogPos + m_Run.m_Logs++;
+	}
+
+	Height get_Height() override
+	{
+		return m_This.m_Bic.m_Height - 1;
+	}
+
+	bool get_HdrAt(Block::SystemState::Full& s) override
+	{
+		std::unique_lock<std::mutex> scope(m_This.m_Mutex);
+		return m_This.m_Bic.get_HdrAt(m_This.m_Proc, s);
+	}
+
+	// asset operations modify the bic directly. Such an invocation is re-executed
+	Asset::ID AssetCreate(const Asset::Metadata&, const PeerID&) override
+	{
+		Wasm::Fail("speculative AssetCreate");
+		return 0;
+	}
+
+	bool AssetEmit(Asset::ID, const PeerID&, AmountSigned) override
+	{
+		Wasm::Fail("speculative AssetEmit");
+		return false;
+	}
+
+	bool AssetDestroy(Asset::ID, const PeerID&) override
+	{
+		Wasm::Fail("speculative AssetDestroy");
+		return false;
+	}
+};
+
+struct NodeProcessor::BlockInterpretCtx::BvmSpeculative::Task
+	:public Executor::TaskSync
+{
+	BvmSpeculative* m_pThis;
+
+	virtual void Exec(Executor::Context& ctx) override
+	{
+		// signatures must be verified right away, not deferred to the thread batch
+		ECC::InnerProduct::BatchContext* pBc = nullptr;
+		TemporarySwap<ECC::InnerProduct::BatchContext*> swp(pBc, ECC::InnerProduct::BatchContext::s_pInstance);
+
+		while (true)
+		{
+			size_t i = m_pThis->m_iPending++;
+			if (i >= m_pThis->m_vPending.size())
+				break;
+
+			m_pThis->ExecuteOnce(*m_pThis->m_vPending[i], ctx.m_iThread);
+		}
+	}
+};
+
+bool NodeProcessor::BlockInterpretCtx::BvmSpeculative::Init(const TxVectors::Full& txv)
+{
+	for (size_t i = 0; i < txv.m_vKernels.size(); i++)
+	{
+		const TxKernel& krn = *txv.m_vKernels[i];
+		if (TxKernel::Subtype::ContractInvoke != krn.get_Subtype())
+			continue;
+
+		const auto& krnInv = Cast::Up<TxKernelContractInvoke>(krn);
+		if (krnInv.m_iMethod) // c'tor call attempt would fail anyway
+			m_vRuns.emplace_back().m_pKrn = &krnInv;
+	}
+
+	return m_vRuns.size() >= m_Proc.m_BvmParallel.m_MinInvocations;
+}
+
+void NodeProcessor::BlockInterpretCtx::BvmSpeculative::Execute()
+{
+	Executor& ex = m_Proc.get_Executor();
+
+	// per-slot caches, the decoded code is modified while running. Kept across blocks, Get() verifies the cached body anyway
+	uint32_t nThreads = ex.get_Threads();
+	if (m_Proc.m_nBvmCodeCacheMT != nThreads)
+	{
+		m_Proc.m_pBvmCodeCacheMT.reset(new BvmCodeCache[nThreads]);
+		m_Proc.m_nBvmCodeCacheMT = nThreads;
+	}
+
+	for (auto& r : m_vRuns)
+		m_vPending.push_back(&r);
+
+	ExecutePending(ex);
+
+	// Now the log positions are known (assuming the runs are applied). Re-run those that emitted logs at wrong positions,
+	// since the position is visible to the contract.
+	uint32_t nPos = m_Bic.m_ContractLogs;
+	for (auto& r : m_vRuns)
+	{
+		if (!r.m_Ok)
+			continue;
+
+		if (r.m_Logs && (r.m_LogPos != nPos))
+		{
+			r.m_LogPos = nPos;
+			m_vPending.push_back(&r);
+		}
+
+		nPos += r.m_Logs;
+	}
+
+	ExecutePending(ex);
+
+	m_Proc.m_BvmParallel.m_Blocks++;
+	m_Proc.m_BvmParallel.m_Speculated += m_vRuns.size();
+}
+
+void NodeProcessor::BlockInterpretCtx::BvmSpeculative::ExecutePending(Executor& ex)
+{
+	if (m_vPending.empty())
+		return;
+
+	m_iPending = 0;
+
+	Task t;
+	t.m_pThis = this;
+	ex.ForkJoin(t); // don't wait for the unrelated async tasks
+
+	m_vPending.clear();
+}
+
+void NodeProcessor::BlockInterpretCtx::BvmSpeculative::ExecuteOnce(Run& r, uint32_t iThread)
+{
+	r.m_Logs = 0;
+	r.m_Charge = 0;
+	r.m_Ok = false;
+	r.m_Reads.Clear();
+	r.m_vOps.clear();
+
+	Processor proc(*this, r);
+	proc.m_pCodeCache = &m_Proc.m_pBvmCodeCacheMT[iThread];
+	proc.m_Charge = m_Bic.m_ChargePerBlock;
+
+	try
+	{
+		const auto& krn = *r.m_pKrn;
+		BvmProcessor::InvokeRaw(proc, krn.m_Cid, krn.m_iMethod, krn, !m_Bic.m_AlreadyValidated);
 
-		RecoveryTag::Type n = RecoveryTag::Terminator;
-		ser & n;
+		r.m_Charge = m_Bic.m_ChargePerBlock - proc.m_Charge;
+		r.m_Ok = true;
+	}
+	catch (const std::exception&) {
+		// will be re-executed, and fail with the appropriate error info
 	}
 }
 
-bool NodeProcessor::BlockInterpretCtx::BvmProcessor::Invoke(const bvm2::ContractID& cid, uint32_t iMethod, const TxKernelContractControl& krn)
+bool NodeProcessor::BlockInterpretCtx::BvmSpeculative::Apply(BvmProcessor& proc, const TxKernelContractControl& krn)
 {
-	bool bRes = false;
-	try
-	{
-		m_Charge = m_Bic.m_ChargePerBlock;
+	if ((m_iNext == m_vRuns.size()) || (&krn != m_vRuns[m_iNext].m_pKrn))
+		return false; // not pre-executed (nested or c'tor kernel)
 
-		if (m_Bic.m_pTxErrorInfo)
-			m_DbgCallstack.m_Enable = true;
+	const Run& r = m_vRuns[m_iNext++];
 
-		InitStackPlus(m_Stack.AlignUp(static_cast<uint32_t>(krn.m_Args.size())));
-		m_Stack.PushAlias(krn.m_Args);
+	if (!r.m_Ok || (r.m_Charge > proc.m_Charge))
+		return false;
+	if (r.m_Logs && (r.m_LogPos != m_Bic.m_ContractLogs))
+		return false;
 
-		CallFar(cid, iMethod, m_Stack.get_AlasSp());
+	for (auto it = r.m_Reads.begin(); r.m_Reads.end() != it; it++)
+		if (Blob(m_Bic.get_ContractVar(it->ToBlob(), m_Proc.m_DB).m_Data) != Blob(it->m_Data))
+			return false; // modified by the preceding kernels
 
-		ECC::Hash::Processor hp;
+	// evaluate the locked amounts wrt the current values, before anything is modified
+	BlobMap::Set setLocked;
+	std::vector<ByteBuffer> vLocked;
 
-		if (!m_Bic.m_AlreadyValidated)
-		{
-			hp << krn.m_Msg;
-			m_pSigValidate = &hp;
-		}
+	for (size_t i = 0; i < r.m_vOps.size(); i++)
+	{
+		const Op& op = r.m_vOps[i];
+		if (Op::Type::LockedAmount != op.m_Type)
+			continue;
 
-		while (!IsDone())
+		auto* pE = setLocked.Find(op.m_Key);
+		if (!pE)
 		{
-			DischargeUnits(bvm2::Limits::Cost::Cycle);
-			RunOnce();
+			pE = setLocked.Create(op.m_Key);
+			pE->m_Data = m_Bic.get_ContractVar(op.m_Key, m_Proc.m_DB).m_Data;
 		}
 
-		if (!m_Bic.m_AlreadyValidated)
-			CheckSigs(krn.m_Commitment, krn.m_Signature);
+		if (!ApplyDelta(pE->m_Data, op))
+			return false; // would fail
 
-		bRes = true;
+		vLocked.push_back(pE->m_Data);
+	}
 
-		if (m_Bic.m_Temporary)
+	for (size_t i = 0, iLocked = 0; i < r.m_vOps.size(); i++)
+	{
+		const Op& op = r.m_vOps[i];
+		switch (op.m_Type)
 		{
-			BlockInterpretCtx::Ser ser(m_Bic);
-			RecoveryTag::Type nTag = RecoveryTag::Recharge;
-			ser & nTag;
-			ser & m_Bic.m_ChargePerBlock;
-		}
+		case Op::Type::Log:
+			proc.OnLog(op.m_Key, op.m_Val);
+			break;
 
-		m_Bic.m_ChargePerBlock = m_Charge;
+		case Op::Type::LockedAmount:
+			proc.SaveVar(op.m_Key, vLocked[iLocked++]);
+			break;
+
+		default:
+			proc.SaveVar(op.m_Key, op.m_Val);
+		}
 	}
-	catch (const Wasm::Exc& e)
-	{
-		uint32_t n = e.m_Type + proto::TxStatus::ContractFailFirst;
-		m_Bic.m_TxStatus = (n < proto::TxStatus::ContractFailLast) ? static_cast<uint8_t>(n) : proto::TxStatus::ContractFailFirst;
 
-		if (e.m_Type == bvm2::ErrorSubType::NoCharge)
-			m_Bic.m_LimitExceeded = true;
+	proc.m_Charge -= r.m_Charge;
+	m_Proc.m_BvmParallel.m_Applied++;
+	return true;
+}
 
-		if (m_Bic.m_pTxErrorInfo)
-			*m_Bic.m_pTxErrorInfo << e.what();
+bool NodeProcessor::BlockInterpretCtx::BvmSpeculative::IsLockedAmount(const Blob& key)
+{
+	return
+		(key.n > bvm2::ContractID::nBytes) &&
+		(Shaders::KeyTag::LockedAmount == reinterpret_cast<const uint8_t*>(key.p)[bvm2::ContractID::nBytes]);
+}
+
+void NodeProcessor::BlockInterpretCtx::BvmSpeculative::LoadAmount(AmountBig::Type& x, const ByteBuffer& buf)
+{
+	// same as ProcessorContract::LoadFixedOrZero
+	if (buf.size() == x.nBytes)
+		memcpy(x.m_pData, &buf.front(), x.nBytes);
+	else
+		x = Zero;
+}
+
+bool NodeProcessor::BlockInterpretCtx::BvmSpeculative::ApplyDelta(ByteBuffer& buf, const Op& op)
+{
+	// Repeats the ProcessorContract::HandleAmountInner logic, with the lock/unlock amount derived from the recorded modification.
+	AmountBig::Type val0, val1, val;
+	LoadAmount(val0, op.m_Val0);
+	LoadAmount(val1, op.m_Val);
+	LoadAmount(val, buf);
+
+	bool bLock = (val1 >= val0);
+	if (!bLock)
+		std::swap(val0, val1);
+
+	// delta = val1 - val0
+	val0.Negate();
+	val0 += val1;
+
+	if (bLock)
+	{
+		val += val0;
+		if (val < val0)
+			return false; // overflow
 	}
-	catch (const std::exception& e)
+	else
 	{
-		m_Bic.m_TxStatus = proto::TxStatus::ContractFailFirst;
+		if (val < val0)
+			return false; // overflow
 
-		if (m_Bic.m_pTxErrorInfo)
-			*m_Bic.m_pTxErrorInfo << e.what();
+		val.Negate();
+		val += val0;
+		val.Negate();
 	}
 
-	if (!bRes)
-	{
-		if (m_Bic.m_pTxErrorInfo)
-			DumpCallstack(*m_Bic.m_pTxErrorInfo);
+	// same as ProcessorContract::SaveNnz
+	if (val == Zero)
+		buf.clear();
+	else
+		Blob(val).Export(buf);
 
-		UndoVars();
-	}
-	return bRes;
+	return true;
+}
+
+void NodeProcessor::BvmParallel::Log() const
+{
+	LOG_INFO() << "Bvm parallel. Blocks=" << m_Blocks << ", invocations=" << m_Speculated << ", applied=" << m_Applied << ", re-executed=" << (m_Speculated - m_Applied);
 }
 
 BlobMap::Entry& NodeProcessor::BlockInterpretCtx::get_ContractVar(const Blob& key, NodeDB& db)
@@ -4551,6 +5748,9 @@ uint32_t NodeProcessor::BlockInterpretCtx::BvmProcessor::SaveVar(const Blob& key
 
 	if (Blob(e.m_Data) != data)
 	{
+		if (bvm2::ContractID::nBytes == key.n)
+			m_pCodeCache->Invalidate(*reinterpret_cast<const bvm2::ContractID*>(key.p)); // contract body
+
 		RecoveryTag::Type nTag = RecoveryTag::Insert;
 
 		if (data.n)
@@ -4655,6 +5855,11 @@ void NodeProcessor::BlockInterpretCtx::BvmProcessor::ContractDataToggleTree(cons
 }
 
 uint32_t NodeProcessor::BlockInterpretCtx::BvmProcessor::OnLog(const VarKey& vk, const Blob& val)
+{
+	return OnLog(Blob(vk.m_p, vk.m_Size), val);
+}
+
+uint32_t NodeProcessor::BlockInterpretCtx::BvmProcessor::OnLog(const Blob& key, const Blob& val)
 {
 	assert(m_Bic.m_Fwd);
 	if (!m_Bic.m_Temporary)
@@ -4663,7 +5868,7 @@ uint32_t NodeProcessor::BlockInterpretCtx::BvmProcessor::OnLog(const VarKey& vk,
 		NodeDB::ContractLog::Entry x;
 		x.m_Pos.m_Height = m_Bic.m_Height;
 		x.m_Pos.m_Pos = m_Bic.m_ContractLogs;
-		x.m_Key = Blob(vk.m_p, vk.m_Size);
+		x.m_Key = key;
 		x.m_Val = val;
 		m_Proc.m_DB.ContractLogInsert(x);
 	}
@@ -4675,7 +5880,6 @@ uint32_t NodeProcessor::BlockInterpretCtx::BvmProcessor::OnLog(const VarKey& vk,
 
 	if (!m_Bic.m_SkipDefinition)
 	{
-		Blob key(vk.m_p, vk.m_Size);
 		bool bMmr = IsContractVarStoredInMmr(key);
 		ser & bMmr;
 
@@ -4693,17 +5897,22 @@ Height NodeProcessor::BlockInterpretCtx::BvmProcessor::get_Height()
 
 bool NodeProcessor::BlockInterpretCtx::BvmProcessor::get_HdrAt(Block::SystemState::Full& s)
 {
-	if (s.m_Height > m_Bic.m_Height - 1)
+	return m_Bic.get_HdrAt(m_Proc, s);
+}
+
+bool NodeProcessor::BlockInterpretCtx::get_HdrAt(NodeProcessor& p, Block::SystemState::Full& s) const
+{
+	if (s.m_Height > m_Height - 1)
 		return false;
 
-	if (s.m_Height == m_Proc.m_Cursor.m_Full.m_Height)
-		s = m_Proc.m_Cursor.m_Full;
+	if (s.m_Height == p.m_Cursor.m_Full.m_Height)
+		s = p.m_Cursor.m_Full;
 	else
 	{
 		if (s.m_Height < Rules::HeightGenesis)
 			return false;
 
-		m_Proc.get_DB().get_State(m_Proc.FindActiveAtStrict(s.m_Height), s);
+		p.get_DB().get_State(p.FindActiveAtStrict(s.m_Height), s);
 	}
 
 	return true;
@@ -6183,9 +7392,43 @@ bool NodeProcessor::ITxoWalker_Unspent::OnTxo(const NodeDB::WalkerTxo& wlk, Heig
 
 void NodeProcessor::InitializeUtxos()
 {
+	// The unspent TXOs are read in batches. Each batch is decoded and sorted on the executor threads (partitioned by the key prefix),
+	// then inserted via the sequential cursor, which is cheap for the sorted keys.
 	struct Walker
-		:public ITxoWalker_UnspentNaked
+		:public ITxoWalker
 	{
+		struct Txo
+		{
+			TxoID m_ID;
+			Height m_hCreate;
+			uint32_t m_nNaked;
+			uint8_t m_pNaked[s_TxoNakedMax];
+		};
+
+		struct Utxo
+		{
+			UtxoTree::Key m_Key;
+			TxoID m_ID;
+
+			bool operator < (const Utxo& x) const
+			{
+				int n = m_Key.V.cmp(x.m_Key.V);
+				return n ? (n < 0) : (m_ID < x.m_ID); // keep the original order of duplicates
+			}
+		};
+
+		enum {
+			s_Batch = 0x40000,
+			s_Buckets = 0x100, // by the 1st key byte
+		};
+
+		std::vector<Txo> m_vTxos;
+		std::vector<Utxo> m_vUtxos;
+		std::vector<Utxo> m_vSorted;
+		uint32_t m_pBucket[s_Buckets + 1];
+
+		UtxoTree::SeqCursor m_Cu;
+
 		TxoID m_TxosTotal;
 		NodeProcessor& m_This;
 		Walker(NodeProcessor& x) :m_This(x) {}
@@ -6193,23 +7436,152 @@ void NodeProcessor::InitializeUtxos()
 		virtual bool OnTxo(const NodeDB::WalkerTxo& wlk, Height hCreate) override
 		{
 			m_This.InitializeUtxosProgress(wlk.m_ID, m_TxosTotal);
-			return ITxoWalker_UnspentNaked::OnTxo(wlk, hCreate);
+
+			if (wlk.m_SpendHeight != MaxHeight)
+				return true;
+
+			m_vTxos.emplace_back();
+			Txo& x = m_vTxos.back();
+			x.m_ID = wlk.m_ID;
+			x.m_hCreate = hCreate;
+
+			Blob blob = wlk.m_Value;
+			TxoToNaked(x.m_pNaked, blob);
+			x.m_nNaked = blob.n;
+
+			if (m_vTxos.size() >= s_Batch)
+				Flush();
+
+			return true;
 		}
 
-		virtual bool OnTxo(const NodeDB::WalkerTxo& wlk, Height hCreate, Output& outp) override
+		struct TaskDecode
+			:public Executor::TaskSync
+		{
+			Walker* m_pThis;
+			std::atomic<bool> m_Err;
+
+			virtual void Exec(Executor::Context& ctx) override
+			{
+				uint32_t i0, nCount;
+				ctx.get_Portion(i0, nCount, static_cast<uint32_t>(m_pThis->m_vTxos.size()));
+
+				try
+				{
+					for (uint32_t i = 0; i < nCount; i++)
+					{
+						const Txo& x = m_pThis->m_vTxos[i0 + i];
+						Utxo& u = m_pThis->m_vUtxos[i0 + i];
+
+						Deserializer der;
+						der.reset(x.m_pNaked, x.m_nNaked);
+
+						Output outp;
+						der & outp;
+
+						UtxoTree::Key::Data d;
+						d.m_Commitment = outp.m_Commitment;
+						d.m_Maturity = outp.get_MinMaturity(x.m_hCreate);
+
+						u.m_Key = d;
+						u.m_ID = x.m_ID;
+					}
+				}
+				catch (const std::exception&)
+				{
+					m_Err = true;
+				}
+			}
+		};
+
+		struct TaskSort
+			:public Executor::TaskSync
+		{
+			Walker* m_pThis;
+
+			virtual void Exec(Executor::Context& ctx) override
+			{
+				uint32_t i0, nCount;
+				ctx.get_Portion(i0, nCount, s_Buckets);
+
+				for (uint32_t i = 0; i < nCount; i++)
+				{
+					auto it = m_pThis->m_vSorted.begin();
+					std::sort(it + m_pThis->m_pBucket[i0 + i], it + m_pThis->m_pBucket[i0 + i + 1]);
+				}
+			}
+		};
+
+		void Flush()
 		{
-			m_This.m_Extra.m_Txos = wlk.m_ID;
-			BlockInterpretCtx bic(hCreate, true);
-			if (!m_This.HandleBlockElement(outp, bic))
+			if (m_vTxos.empty())
+				return;
+
+			Executor& ex = m_This.get_Executor();
+			m_vUtxos.resize(m_vTxos.size());
+
+			TaskDecode td;
+			td.m_pThis = this;
+			td.m_Err = false;
+			ex.ExecAll(td);
+
+			if (td.m_Err)
 				OnCorrupted();
 
-			return true;
+			// partition
+			memset0(m_pBucket, sizeof(m_pBucket));
+			for (const auto& u : m_vUtxos)
+				m_pBucket[u.m_Key.V.m_pData[0] + 1]++;
+
+			for (uint32_t i = 0; i < s_Buckets; i++)
+				m_pBucket[i + 1] += m_pBucket[i];
+
+			m_vSorted.resize(m_vUtxos.size());
+			{
+				uint32_t pPos[s_Buckets];
+				memcpy(pPos, m_pBucket, sizeof(pPos));
+
+				for (const auto& u : m_vUtxos)
+					m_vSorted[pPos[u.m_Key.V.m_pData[0]]++] = u;
+			}
+
+			TaskSort ts;
+			ts.m_pThis = this;
+			ex.ExecAll(ts);
+
+			UtxoTree& t = m_This.m_Mapped.m_Utxo;
+
+			for (const auto& u : m_vSorted)
+			{
+				m_This.m_Mapped.m_Utxo.EnsureReserve();
+
+				bool bCreate = true;
+				UtxoTree::MyLeaf* p = t.Find(m_Cu, u.m_Key, bCreate);
+
+				m_Cu.InvalidateElement();
+
+				if (bCreate)
+					p->m_ID = u.m_ID;
+				else
+				{
+					if (!(p->get_Count() + 1))
+						OnCorrupted();
+
+					t.PushID(u.m_ID, *p);
+				}
+			}
+
+			t.OnDirty();
+			m_vTxos.clear();
 		}
 	};
 
 	Walker wlk(*this);
 	wlk.m_TxosTotal = get_TxosBefore(m_Cursor.m_ID.m_Height + 1);
+	wlk.m_vTxos.reserve(Walker::s_Batch);
+
 	EnumTxos(wlk);
+	wlk.Flush();
 }
 
 bool NodeProcessor::GetBlock(const NodeDB::StateID& sid, ByteBuffer* pEthernal, ByteBuffer* pPerishable, Height h0, Height hLo1, Height hHi1, bool bActive)
@@ -6217,7 +7589,22 @@ bool NodeProcessor::GetBlock(const NodeDB::StateID& sid, ByteBuffer* pEthernal,
 	return GetBlockInternal(sid, pEthernal, pPerishable, h0, hLo1, hHi1, bActive, nullptr);
 }
 
-bool NodeProcessor::GetBlockInternal(const NodeDB::StateID& sid, ByteBuffer* pEthernal, ByteBuffer* pPerishable, Height h0, Height hLo1, Height hHi1, bool bActive, Block::Body* pBody)
+bool NodeProcessor::GetBlockRef(const NodeDB::StateID& sid, Blob* pEthernal, Blob* pPerishable, Height h0, Height hLo1, Height hHi1)
+{
+	if (!GetBlockPrepare(sid, h0, hLo1, hHi1))
+		return false;
+
+	bool bFullBlock = (sid.m_Height >= hHi1) && (sid.m_Height > hLo1);
+	if (pPerishable && !bFullBlock)
+		return false; // must be re-created
+
+	if (!m_DB.GetStateBlockRef(sid.m_Row, pPerishable, pEthernal))
+		return false;
+
+	return !(pPerishable && !pPerishable->n); // otherwise must be re-created
+}
+
+bool NodeProcessor::GetBlockPrepare(const NodeDB::StateID& sid, Height h0, Height& hLo1, Height& hHi1)
 {
 	// h0 - current peer Height
 	// hLo1 - HorizonLo that peer needs after the sync
@@ -6251,6 +7638,14 @@ bool NodeProcessor::GetBlockInternal(const NodeDB::StateID& sid, ByteBuffer* pEt
 	if (IsFastSync() && (sid.m_Height > m_Cursor.m_ID.m_Height))
 		return false;
 
+	return true;
+}
+
+bool NodeProcessor::GetBlockInternal(const NodeDB::StateID& sid, ByteBuffer* pEthernal, ByteBuffer* pPerishable, Height h0, Height hLo1, Height hHi1, bool bActive, Block::Body* pBody)
+{
+	if (!GetBlockPrepare(sid, h0, hLo1, hHi1))
+		return false;
+
 	bool bFullBlock = (sid.m_Height >= hHi1) && (sid.m_Height > hLo1) && !pBody;
 	m_DB.GetStateBlock(sid.m_Row, bFullBlock ? pPerishable : nullptr, pEthernal, nullptr);
 
@@ -6469,6 +7864,7 @@ void NodeProcessor::RebuildNonStd()
 	m_Mmr.m_Assets.ResizeTo(0);
 	m_Mmr.m_Shielded.ResizeTo(0);
 	m_Extra.m_ShieldedOutputs = 0;
+	m_ShieldedCache.ShrinkTo(0);
 
 	static_assert(NodeDB::StreamType::StatesMmr == 0);
 	m_DB.StreamsDelAll(static_cast<NodeDB::StreamType::Enum>(1), NodeDB::StreamType::count);
@@ -6678,7 +8074,8 @@ bool NodeProcessor::Mapped::Open(const char* sz, const Stamp& s)
 	d.m_nBanks = Type::count;
 	d.m_nFixedHdr = sizeof(Hdr);
 
-	m_Mapping.Open(sz, d);
+	Blob tag(s);
+	m_Mapping.Open(sz, d, false, &tag);
 
 	Hdr& h = get_Hdr();
 	if (!h.m_Dirty && (h.m_Stamp == s))
@@ -6688,7 +8085,7 @@ bool NodeProcessor::Mapped::Open(const char* sz, const Stamp& s)
 		return true;
 	}
 
-	m_Mapping.Open(sz, d, true); // reset
+	m_Mapping.Open(sz, d, true, &tag); // reset
 	return false;
 }
 
@@ -6712,9 +8109,35 @@ void NodeProcessor::Mapped::FlushStrict(const Stamp& s)
 	h.m_Dirty = 0;
 	h.m_RootUtxo = m_Utxo.m_RootOffset;
 	h.m_RootContract = m_Contract.m_RootOffset;
-	// TODO: flush
-
 	h.m_Stamp = s;
+
+	try
+	{
+		// the stamp becomes valid only once the DB is committed, hence the modifications are either journaled, or (in the non-journaled mode) just flushed
+		m_Mapping.CommitPrepare(Blob(s));
+	}
+	catch (const std::exception& e)
+	{
+		// promote it
+		CorruptionException exc;
+		exc.m_sErr = e.what();
+		throw exc;
+	}
+}
+
+void NodeProcessor::Mapped::FlushApply()
+{
+	try
+	{
+		m_Mapping.CommitApply();
+	}
+	catch (const std::exception& e)
+	{
+		// promote it
+		CorruptionException exc;
+		exc.m_sErr = e.what();
+		throw exc;
+	}
 }
 
 void NodeProcessor::Mapped::Utxo::EnsureReserve()
@@ -6740,6 +8163,123 @@ void NodeProcessor::Mapped::OnDirty()
 	get_Hdr().m_Dirty = 1;
 }
 
+/////////////////////////////
+// ShieldedCache
+bool NodeProcessor::ShieldedCache::Open(const char* sz, const Stamp& s)
+{
+	// change this when format changes
+	static const uint8_t s_pSig[] = {
+		0x3A, 0x91, 0x0E, 0xC7,
+		0x5D, 0x22, 0x48, 0xB6,
+		0x9F, 0x04, 0x7B, 0xE1,
+		0x66, 0xD3, 0x2C, 0x58
+	};
+	static_assert(sizeof(s_pSig) == sizeof(Hdr::m_pSig));
+
+	m_File.Open(sz);
+
+	if (m_File.m_nMapping >= sizeof(Hdr))
+	{
+		const Hdr& h = get_Hdr();
+		if (!memcmp(h.m_pSig, s_pSig, sizeof(s_pSig)) &&
+			!h.m_Dirty &&
+			(h.m_Stamp == s) &&
+			(m_File.m_nMapping >= sizeof(Hdr) + sizeof(ECC::Point::Compact) * h.m_Count))
+			return true;
+	}
+
+	// reset
+	m_File.CloseMapping();
+	m_File.Resize(sizeof(Hdr));
+	m_File.OpenMapping();
+
+	Hdr& h = get_Hdr();
+	ZeroObject(h);
+	memcpy(h.m_pSig, s_pSig, sizeof(s_pSig));
+	h.m_Dirty = 1;
+
+	return false;
+}
+
+void NodeProcessor::ShieldedCache::Close()
+{
+	m_File.Close();
+}
+
+NodeProcessor::ShieldedCache::Hdr& NodeProcessor::ShieldedCache::get_Hdr() const
+{
+	return m_File.get_At<Hdr>(0);
+}
+
+const ECC::Point::Compact* NodeProcessor::ShieldedCache::get_At(uint64_t pos) const
+{
+	assert(pos < get_Hdr().m_Count);
+	return &m_File.get_At<ECC::Point::Compact>(sizeof(Hdr) + sizeof(ECC::Point::Compact) * pos);
+}
+
+void NodeProcessor::ShieldedCache::Reserve(uint64_t nCount)
+{
+	if (m_File.m_nMapping >= sizeof(Hdr) + sizeof(ECC::Point::Compact) * nCount)
+		return;
+
+	const uint64_t nGranularity = 0x10000; // 4MB
+	nCount = (nCount + nGranularity - 1) / nGranularity * nGranularity;
+
+	m_File.CloseMapping();
+	m_File.Resize(sizeof(Hdr) + sizeof(ECC::Point::Compact) * nCount);
+	m_File.OpenMapping();
+}
+
+void NodeProcessor::ShieldedCache::Append(const ECC::Point::Storage* p, uint64_t nCount)
+{
+	uint64_t n0 = get_Hdr().m_Count;
+	Reserve(n0 + nCount);
+
+	Hdr& h = get_Hdr(); // after reserve, mapping may have moved
+	h.m_Dirty = 1;
+	h.m_Count = n0 + nCount;
+
+	for (uint64_t i = 0; i < nCount; i++)
+		Convert(Cast::NotConst(*get_At(n0 + i)), p[i]);
+}
+
+void NodeProcessor::ShieldedCache::ShrinkTo(uint64_t nCount)
+{
+	Hdr& h = get_Hdr();
+	assert(nCount <= h.m_Count);
+
+	h.m_Dirty = 1;
+	h.m_Count = nCount; // the file is not truncated, will be reused
+}
+
+void NodeProcessor::ShieldedCache::FlushStrict(const Stamp& s)
+{
+	Hdr& h = get_Hdr();
+	assert(h.m_Dirty);
+
+	h.m_Dirty = 0;
+	h.m_Stamp = s;
+}
+
+void NodeProcessor::ShieldedCache::Convert(ECC::Point::Compact& res, const ECC::Point::Storage& src)
+{
+	ECC::Point::Native pt;
+	pt.Import(src, false); // already affine, no normalization needed
+
+	if (pt == Zero)
+		ZeroObject(res);
+	else
+		ECC::Point::Native::BatchNormalizer::get_As(res, pt);
+}
+
+void NodeProcessor::ShieldedCache::Convert(ECC::Point::Native& res, const ECC::Point::Compact& src)
+{
+	if (memis0(&src, sizeof(src)))
+		res = Zero; // can't be a valid point
+	else
+		src.Assign(res, true);
+}
+
 intptr_t NodeProcessor::Mapped::Utxo::get_Base() const
 {
 	return reinterpret_cast<intptr_t>(get_ParentObj().m_Mapping.get_Base());
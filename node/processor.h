@@ -109,9 +109,11 @@ class NodeProcessor
 
 		bool Open(const char* sz, const Stamp&);
 		bool IsOpen() const { return m_Mapping.get_Base() != nullptr; }
+		void set_Access(const MappedFileRaw::Access& x) { m_Mapping.m_Access = x; }
 
 		void Close();
 		void FlushStrict(const Stamp&);
+		void FlushApply();
 
 #pragma pack(push, 1)
 		struct Hdr
@@ -129,6 +131,46 @@ class NodeProcessor
 
 	Mapped m_Mapped;
 
+	// Shielded pool commitments in native affine form, mirrors the Shielded stream of the DB.
+	// Append-only (except rollbacks), memory-mapped.
+	class ShieldedCache
+	{
+		MappedFileRaw m_File;
+
+		void Reserve(uint64_t nCount);
+
+	public:
+
+		typedef Merkle::Hash Stamp;
+
+#pragma pack(push, 1)
+		struct Hdr
+		{
+			uint8_t m_pSig[16];
+			uint64_t m_Dirty; // boolean, just aligned
+			Stamp m_Stamp;
+			uint64_t m_Count;
+		};
+#pragma pack(pop)
+
+		struct List;
+
+		bool Open(const char* sz, const Stamp&);
+		bool IsOpen() const { return m_File.m_pMapping != nullptr; }
+		void Close();
+
+		Hdr& get_Hdr() const;
+		const ECC::Point::Compact* get_At(uint64_t pos) const;
+
+		void Append(const ECC::Point::Storage*, uint64_t nCount);
+		void ShrinkTo(uint64_t nCount);
+		void FlushStrict(const Stamp&);
+
+		static void Convert(ECC::Point::Compact&, const ECC::Point::Storage&);
+		static void Convert(ECC::Point::Native&, const ECC::Point::Compact&);
+
+	} m_ShieldedCache;
+
 	size_t m_nSizeUtxoComission;
 
 	struct MultiblockContext;
@@ -147,12 +189,18 @@ class NodeProcessor
 	bool TestDefinition();
 	void TestDefinitionStrict();
 	void CommitMappingAndDB();
+	void UpdateStamp(Merkle::Hash&, NodeDB::ParamID::Enum);
 	void RequestDataInternal(const Block::SystemState::ID&, uint64_t row, bool bBlock, const NodeDB::StateID& sidTrg);
 
 	bool HandleTreasury(const Blob&);
 
 	struct BlockInterpretCtx;
 
+	struct BvmCodeCache; // pre-decoded code of the recently called contracts
+	std::unique_ptr<BvmCodeCache> m_pBvmCodeCache;
+	std::unique_ptr<BvmCodeCache[]> m_pBvmCodeCacheMT; // per executor slot, for the speculative runs. Kept across blocks
+	uint32_t m_nBvmCodeCacheMT = 0;
+
 	template <typename T>
 	bool HandleElementVecFwd(const T& vec, BlockInterpretCtx&, size_t& n);
 	template <typename T>
@@ -160,6 +208,7 @@ class NodeProcessor
 
 	bool HandleBlock(const NodeDB::StateID&, const Block::SystemState::Full&, MultiblockContext&);
 	bool HandleValidatedTx(const TxVectors::Full&, BlockInterpretCtx&);
+	void PrefetchUtxos(const TxVectors::Full&);
 	bool HandleValidatedBlock(const Block::Body&, BlockInterpretCtx&);
 	bool HandleBlockElement(const Input&, BlockInterpretCtx&);
 	bool HandleBlockElement(const Output&, BlockInterpretCtx&);
@@ -202,6 +251,11 @@ class NodeProcessor
 	void InitCursor(bool bMovingUp);
 	bool InitMapping(const char*, bool bForceReset);
 	void InitializeMapped(const char*);
+	void InitializeShieldedCache(const char*);
+	void InitializeMmrCache(const char*);
+	static void get_DerivedPath(std::string&, const char*, const char* szSufix);
+
+	struct Snapshot;
 
 	typedef std::pair<int64_t, std::pair<int64_t, Difficulty::Raw> > THW; // Time-Height-Work. Time and Height are signed
 	Difficulty get_NextDifficulty();
@@ -265,6 +319,8 @@ public:
 		bool m_Vacuum = false;
 		bool m_ResetSelfID = false;
 		bool m_EraseSelfID = false;
+		MappedFileRaw::Access m_MappingAccess;
+		NodeDB::Tuning m_DbTuning;
 	};
 
 	void Initialize(const char* szPath);
@@ -272,6 +328,15 @@ public:
 
     static bool ExtractTreasury(const Blob&, Treasury::Data&);
 	static void get_MappingPath(std::string&, const char*);
+	static void get_ShieldedCachePath(std::string&, const char*);
+
+	// Snapshot of the whole node data as of the cursor: the DB, UTXO image, shielded cache, block bodies and TXO archive.
+	// Imported into a new DB path. Before use the header chain is replayed, and the state is verified against the cursor header definition
+	void ExportSnapshot(const char* szSnapshot);
+	static void ImportSnapshot(const char* szSnapshot, const char* szPath);
+
+	// Replays the active header chain up to the cursor: linkage, PoW, difficulty, timestamp and chainwork of each header
+	bool TestHeaderChain();
 
 	NodeProcessor();
 	virtual ~NodeProcessor();
@@ -386,6 +451,45 @@ public:
 
 	} m_UnreachableLog;
 
+	struct ImportStats
+	{
+		// multi-block import pipeline. Times are in microseconds
+		uint64_t m_Blocks = 0;
+		uint64_t m_Ahead = 0; // of them pushed for verification ahead of the cursor
+		uint64_t m_Bytes = 0;
+		uint64_t m_Load_us = 0; // read from DB + deserialize
+		uint64_t m_Verify_us = 0; // context-free verification, summed over all the verifier threads
+		uint64_t m_Interpret_us = 0; // UTXO/kernel/contract interpretation
+		uint64_t m_Commit_us = 0; // DB writes + recognition
+		uint64_t m_Wait_us = 0; // stalled on pending verification (window full or flush)
+		uint64_t m_Total_us = 0;
+
+		void operator += (const ImportStats&);
+		void Log(uint32_t nThreads) const;
+
+	} m_ImportStats; // accumulated since startup
+
+	static const size_t s_VerificationWindowDef = 1024 * 1024 * 10;
+
+	// max size of blocks pending context-free verification
+	size_t m_VerificationWindow = s_VerificationWindowDef;
+	// max number of the following blocks verified ahead of the cursor (within the above window), while the current one is interpreted. 0 to disable
+	uint32_t m_VerificationAhead = 32;
+
+	struct BvmParallel
+	{
+		// Contract invocations of a block are pre-executed in parallel on the executor threads, and then applied in the block order.
+		// An invocation whose inputs were modified by the preceding ones is re-executed.
+		uint32_t m_MinInvocations = 4; // per block, below that it's not worth it. 0 to disable
+
+		uint64_t m_Blocks = 0;
+		uint64_t m_Speculated = 0;
+		uint64_t m_Applied = 0;
+
+		void Log() const;
+
+	} m_BvmParallel; // stats accumulated since startup
+
 	bool IsFastSync() const { return m_SyncData.m_Target.m_Row != 0; }
 
 	void SaveSyncData();
@@ -430,6 +534,9 @@ public:
 		virtual bool get_Shielded(Merkle::Hash&) override;
 		virtual bool get_Assets(Merkle::Hash&) override;
 		virtual bool get_Contracts(Merkle::Hash&) override;
+
+		// rehash of the dirty part is done on the executor threads, its time is logged
+		void get_TreeHash(RadixHashTree&, Merkle::Hash&, const char* szName);
 	};
 
 	struct EvaluatorEx
@@ -583,6 +690,8 @@ public:
 	bool GenerateNewBlock(BlockContext&);
 
 	bool GetBlock(const NodeDB::StateID&, ByteBuffer* pEthernal, ByteBuffer* pPerishable, Height h0, Height hLo1, Height hHi1, bool bActive);
+	// Same, but refers to the stored body in-place (see NodeDB::GetStateBlockRef). Returns false if it's not stored as needed, then GetBlock should be used
+	bool GetBlockRef(const NodeDB::StateID&, Blob* pEthernal, Blob* pPerishable, Height h0, Height hLo1, Height hHi1);
 
 	struct ITxoWalker
 	{
@@ -764,6 +873,9 @@ public:
 		NodeDB::StreamMmr m_Shielded;
 		NodeDB::StreamMmr m_Assets;
 
+		bool IsFileCacheDirty() const;
+		void FileCacheFlush(const NodeDB::StreamMmr::Stamp&);
+
 	} m_Mmr;
 
 	TxoID get_ShieldedInputs() const {
@@ -833,6 +945,7 @@ private:
 	void GenerateNewHdr(BlockContext&, BlockInterpretCtx&);
 	DataStatus::Enum OnStateInternal(const Block::SystemState::Full&, Block::SystemState::ID&, bool bAlreadyChecked);
 	bool GetBlockInternal(const NodeDB::StateID&, ByteBuffer* pEthernal, ByteBuffer* pPerishable, Height h0, Height hLo1, Height hHi1, bool bActive, Block::Body*);
+	bool GetBlockPrepare(const NodeDB::StateID&, Height h0, Height& hLo1, Height& hHi1);
 };
 
 struct LogSid
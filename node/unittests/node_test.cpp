@@ -28,6 +28,10 @@
 #include "../../bvm/bvm2.h"
 #include "../../bvm/ManagerStd.h"
 
+namespace Shaders {
+#include "../../bvm/Shaders/vault/contract.h"
+}
+
 #ifndef LOG_VERBOSE_ENABLED
     #define LOG_VERBOSE_ENABLED 0
 #endif
@@ -314,12 +318,20 @@ namespace beam
 
 		ByteBuffer bbBodyP, bbBodyE;
 		db.GetStateBlock(pRows[0], &bbBodyP, &bbBodyE, nullptr);
+		verify_test(Blob(bbBodyP) == bBodyP);
+		verify_test(Blob(bbBodyE) == bBodyE);
 
-		//db.DelStateBlockPP(pRows[0]);
-		//db.GetStateBlock(pRows[0], &bbBodyP, &bbBodyE);
+		db.DelStateBlockPP(pRows[0]);
+		bbBodyP.clear();
+		bbBodyE.clear();
+		db.GetStateBlock(pRows[0], &bbBodyP, &bbBodyE, nullptr);
+		verify_test(bbBodyP.empty());
+		verify_test(Blob(bbBodyE) == bBodyE);
 
 		db.DelStateBlockAll(pRows[0]);
+		bbBodyE.clear();
 		db.GetStateBlock(pRows[0], &bbBodyP, &bbBodyE, nullptr);
+		verify_test(bbBodyP.empty() && bbBodyE.empty());
 
 		tr.Commit();
 		tr.Start(db);
@@ -564,6 +576,124 @@ namespace beam
 		db.DeleteKernel(bBodyP, 5);
 		verify_test(db.FindKernel(bBodyP) == 0);
 
+		// Kernel lookups via the filter and the cache, invalidated on rollback
+		{
+			tr.Commit();
+			tr.Start(db);
+
+			Merkle::Hash hvKrn1 = 12U, hvKrn2 = 13U;
+			NodeDB::KeyLookupStats::Entry st0 = db.m_KeyLookupStats.m_Kernels;
+
+			db.InsertKernel(hvKrn1, 9);
+			verify_test(db.FindKernel(hvKrn1) == 9);
+			verify_test(db.FindKernel(hvKrn1) == 9);
+			verify_test(db.FindKernel(hvKrn2) == 0);
+
+			const NodeDB::KeyLookupStats::Entry& st1 = db.m_KeyLookupStats.m_Kernels;
+			verify_test(st1.m_Cached == st0.m_Cached + 1);
+			verify_test(st1.m_Queried + st1.m_Filtered == st0.m_Queried + st0.m_Filtered + 2);
+
+			tr.Rollback();
+			tr.Start(db);
+
+			verify_test(db.FindKernel(hvKrn1) == 0);
+
+			db.InsertKernel(hvKrn1, 10);
+			verify_test(db.FindKernel(hvKrn1) == 10);
+			db.DeleteKernel(hvKrn1, 10);
+			verify_test(db.FindKernel(hvKrn1) == 0);
+
+			// a transaction deletes a kernel, then overflows the filter, and is rolled back. The kernel must be found
+			db.InsertKernel(hvKrn1, 11);
+			tr.Commit();
+			tr.Start(db);
+
+			db.DeleteKernel(hvKrn1, 11);
+			for (uint32_t i = 0; i < 0x10010; i++)
+			{
+				Merkle::Hash hv = i + 100;
+				db.InsertKernel(hv, 12);
+			}
+
+			tr.Rollback();
+			tr.Start(db);
+
+			verify_test(db.FindKernel(hvKrn1) == 11);
+			db.DeleteKernel(hvKrn1, 11);
+		}
+
+		// Contract data, via the write-back cache
+		{
+			tr.Commit();
+			tr.Start(db);
+
+			uint8_t pKey[] = { 1, 2, 3 };
+			uint8_t pVal[] = { 4, 5 };
+			Blob key(pKey, sizeof(pKey)), val;
+			NodeDB::Recordset rs;
+
+			NodeDB::ContractCacheStats st0 = db.m_ContractCacheStats;
+
+			verify_test(!db.ContractDataFind(key, val, rs));
+			db.ContractDataInsert(key, Blob(pVal, sizeof(pVal)));
+
+			for (uint8_t i = 0; i < 10; i++)
+			{
+				pVal[0] = i;
+				db.ContractDataUpdate(key, Blob(pVal, sizeof(pVal)));
+			}
+
+			verify_test(db.ContractDataFind(key, val, rs));
+			verify_test(Blob(pVal, sizeof(pVal)) == val);
+
+			const NodeDB::ContractCacheStats& st1 = db.m_ContractCacheStats;
+			verify_test(st1.m_Misses == st0.m_Misses + 1);
+			verify_test(st1.m_Hits == st0.m_Hits + 1);
+			verify_test(st1.m_Modified == st0.m_Modified + 11);
+			verify_test(st1.m_Written == st0.m_Written); // not written yet
+
+			// enumeration sees the pending modifications
+			NodeDB::WalkerContractData wlk;
+			db.ContractDataEnum(wlk, key, key);
+			verify_test(wlk.MoveNext());
+			verify_test(Blob(pVal, sizeof(pVal)) == wlk.m_Val);
+			verify_test(st1.m_Written == st0.m_Written + 1); // coalesced
+
+			db.ContractDataDel(key);
+			verify_test(!db.ContractDataFind(key, val, rs));
+
+			tr.Rollback();
+			tr.Start(db);
+
+			verify_test(!db.m_ContractCacheStats.m_Entries);
+			verify_test(!db.ContractDataFind(key, val, rs)); // the insert was rolled back
+
+			db.ContractDataInsert(key, Blob(pVal, sizeof(pVal)));
+			tr.Commit();
+			tr.Start(db);
+
+			// evicted entries are written too
+			db.ContractCacheSetMaxSize(0);
+			verify_test(db.ContractDataFind(key, val, rs));
+			pVal[1] = 77;
+			db.ContractDataUpdate(key, Blob(pVal, sizeof(pVal)));
+
+			uint8_t pKey2[] = { 1, 2, 4 };
+			verify_test(!db.ContractDataFind(Blob(pKey2, sizeof(pKey2)), val, rs));
+			verify_test(1 == db.m_ContractCacheStats.m_Entries);
+
+			db.ContractCacheSetMaxSize(1024 * 1024);
+			verify_test(db.ContractDataFind(key, val, rs));
+			verify_test(Blob(pVal, sizeof(pVal)) == val);
+
+			db.ContractDataDel(key);
+			tr.Commit();
+			tr.Start(db);
+
+			db.ContractCacheSetMaxSize(0);
+			verify_test(!db.ContractDataFind(key, val, rs));
+		}
+
 		// Shielded
 		TxoID nShielded = 16 * 1024 * 3 + 5;
 		db.ShieldedResize(nShielded, 0);
@@ -802,6 +932,340 @@ namespace beam
 		const char* g_sz3 = "/tmp/recovery_info";
 #endif // WIN32
 
+	struct TxoArchiveTest
+	{
+		static const TxoID s_Txos = 20000;
+		static const Height s_hCompacted = 50;
+
+		// spent below s_hCompacted and compacted - archived. The rest remain in the DB
+		static Height get_SpendHeight(TxoID id)
+		{
+			switch (id % 3)
+			{
+			case 0: return MaxHeight;
+			case 1: return 10 + (id % 5);
+			default: return 100;
+			}
+		}
+
+		static void get_Value(ByteBuffer& buf, TxoID id)
+		{
+			Height h = get_SpendHeight(id);
+			bool bNaked = (h != MaxHeight);
+			bool bIncubation = bNaked && !(id % 7);
+
+			buf.resize(bNaked ? (bIncubation ? 37 : 33) : 100);
+			for (size_t i = 0; i < buf.size(); i++)
+				buf[i] = static_cast<uint8_t>(id + i * 13);
+
+			buf[0] = bNaked ? (bIncubation ? 0x10 : (id & 3)) : 0x4;
+		}
+
+		Height m_hPruned = 0;
+		TxoID m_idKeep = 0;
+		TxoID m_idEnd = s_Txos;
+
+		bool IsVisible(TxoID id) const
+		{
+			return (id < m_idEnd) && ((get_SpendHeight(id) > m_hPruned) || (id < m_idKeep));
+		}
+
+		void Verify(NodeDB& db, TxoID id0) const
+		{
+			ByteBuffer buf;
+			TxoID id = id0;
+
+			NodeDB::WalkerTxo wlk;
+			for (db.EnumTxos(wlk, id0); wlk.MoveNext(); id++)
+			{
+				while (!IsVisible(id))
+					id++;
+
+				verify_test(wlk.m_ID == id);
+				verify_test(wlk.m_SpendHeight == get_SpendHeight(id));
+
+				get_Value(buf, id);
+				verify_test(Blob(buf) == wlk.m_Value);
+			}
+
+			while ((id < m_idEnd) && !IsVisible(id))
+				id++;
+			verify_test(id == m_idEnd);
+
+			for (TxoID idVal = id0 + 1; idVal < m_idEnd; idVal += 997)
+			{
+				if (!IsVisible(idVal))
+					continue;
+
+				db.TxoGetValue(wlk, idVal);
+				get_Value(buf, idVal);
+				verify_test(Blob(buf) == wlk.m_Value);
+			}
+		}
+
+		void Run()
+		{
+			DeleteFile(g_sz);
+
+			NodeDB db;
+			db.Open(g_sz);
+			NodeDB::Transaction tr(db);
+
+			std::vector<ByteBuffer> vBufs(s_Txos);
+			for (TxoID id = 0; id < s_Txos; id++)
+			{
+				get_Value(vBufs[id], id);
+				db.TxoAdd(id, vBufs[id]);
+
+				Height h = get_SpendHeight(id);
+				if (MaxHeight != h)
+					db.TxoSetSpent(id, h);
+			}
+
+			tr.Commit();
+			tr.Start(db);
+
+			verify_test(!db.TxoArchiveMove(1000, s_hCompacted)); // too small step
+			verify_test(db.TxoArchiveMove(s_Txos, s_hCompacted));
+			verify_test(db.get_TxoArchiveWatermark() == s_Txos);
+			Verify(db, 0);
+			Verify(db, 12345);
+
+			// rollback discards the archive changes
+			tr.Rollback();
+			tr.Start(db);
+			verify_test(!db.get_TxoArchiveWatermark());
+			Verify(db, 0);
+
+			verify_test(db.TxoArchiveMove(s_Txos, s_hCompacted));
+			tr.Commit();
+
+			db.Close();
+			db.Open(g_sz);
+			tr.Start(db);
+
+			verify_test(db.get_TxoArchiveWatermark() == s_Txos);
+			Verify(db, 0);
+
+			// delete the archived TXOs spent at height 10, except the first ones
+			m_hPruned = 10;
+			m_idKeep = 100;
+
+			for (TxoID id = m_idKeep; id < s_Txos; id++)
+				if (get_SpendHeight(id) <= m_hPruned)
+					db.TxoDel(id);
+
+			db.TxoArchivePrune(m_hPruned, m_idKeep);
+			Verify(db, 0);
+
+			// rollback into the archived range
+			m_idEnd = s_Txos / 2 + 3;
+			db.TxoDelFrom(m_idEnd);
+			verify_test(db.get_TxoArchiveWatermark() == m_idEnd);
+			Verify(db, 0);
+
+			tr.Commit();
+
+			db.Close();
+			db.Open(g_sz);
+
+			Verify(db, 0);
+			Verify(db, 777);
+
+			db.Close();
+			for (uint32_t iGen = 0; iGen < 2; iGen++)
+				DeleteFile((std::string(g_sz) + ".txo00000" + std::to_string(iGen)).c_str());
+		}
+	};
+
+	struct BodyStoreTest
+	{
+		static const uint32_t s_Blocks = 40;
+		static const uint32_t s_BodySize = 1000;
+		static const uint32_t s_PerSegment = 4; // blocks
+
+		uint64_t m_pRows[s_Blocks];
+		bool m_pLive[s_Blocks][2]; // perishable, eternal
+
+		static void get_Body(ByteBuffer& buf, uint32_t iBlock, uint32_t iPart)
+		{
+			buf.resize(s_BodySize);
+			for (size_t i = 0; i < buf.size(); i++)
+				buf[i] = static_cast<uint8_t>(iBlock * 7 + iPart * 3 + i);
+		}
+
+		static bool SegmentExists(uint32_t iSeg)
+		{
+			char sz[0x20];
+			snprintf(sz, _countof(sz), ".blk%06u", iSeg);
+
+			std::FStream fs;
+			return fs.Open((std::string(g_sz) + sz).c_str(), true);
+		}
+
+		static void DeleteSegments()
+		{
+			char sz[0x20];
+			for (uint32_t iSeg = 1; iSeg <= s_Blocks; iSeg++)
+			{
+				snprintf(sz, _countof(sz), ".blk%06u", iSeg);
+				DeleteFile((std::string(g_sz) + sz).c_str());
+			}
+		}
+
+		static void Open(NodeDB& db)
+		{
+			db.Open(g_sz);
+			db.BodyStoreSetSegmentMax(s_BodySize * 2 * s_PerSegment);
+		}
+
+		void Verify(NodeDB& db) const
+		{
+			ByteBuffer pBuf[2], bufRef;
+			proto::BodyPack msg;
+			std::vector<proto::BodyBuffersRef> vRefs;
+
+			for (uint32_t i = 0; i < s_Blocks; i++)
+			{
+				pBuf[0].clear();
+				pBuf[1].clear();
+				db.GetStateBlock(m_pRows[i], pBuf, pBuf + 1, nullptr);
+
+				for (uint32_t iPart = 0; iPart < 2; iPart++)
+				{
+					if (m_pLive[i][iPart])
+					{
+						get_Body(bufRef, i, iPart);
+						verify_test(pBuf[iPart] == bufRef);
+					}
+					else
+						verify_test(pBuf[iPart].empty());
+				}
+
+				// in-place, except the active segment
+				proto::BodyBuffersRef br;
+				if (db.GetStateBlockRef(m_pRows[i], &br.m_Perishable, &br.m_Eternal))
+				{
+					verify_test(br.m_Perishable == Blob(pBuf[0]));
+					verify_test(br.m_Eternal == Blob(pBuf[1]));
+
+					vRefs.push_back(br);
+
+					auto& bb = msg.m_Bodies.emplace_back();
+					bb.m_Perishable = pBuf[0];
+					bb.m_Eternal = pBuf[1];
+				}
+			}
+
+			verify_test(!vRefs.empty());
+
+			// same serialization
+			Serializer ser1, ser2;
+			ser1 & msg;
+			ser2 & vRefs;
+			verify_test(ser1.buffer().first && (ser1.buffer().second == ser2.buffer().second));
+			verify_test(!memcmp(ser1.buffer().first, ser2.buffer().first, ser1.buffer().second));
+		}
+
+		void Del(NodeDB& db, uint32_t iBlock, bool bAll)
+		{
+			if (bAll)
+			{
+				db.DelStateBlockAll(m_pRows[iBlock]);
+				m_pLive[iBlock][1] = false;
+			}
+			else
+				db.DelStateBlockPP(m_pRows[iBlock]);
+
+			m_pLive[iBlock][0] = false;
+		}
+
+		void Run()
+		{
+			DeleteFile(g_sz);
+			DeleteSegments();
+
+			NodeDB db;
+			Open(db);
+
+			PeerID peer = Zero;
+			Block::SystemState::Full s;
+			ZeroObject(s);
+
+			NodeDB::Transaction tr(db);
+
+			ByteBuffer pBuf[2];
+			for (uint32_t i = 0; i < s_Blocks; i++)
+			{
+				if (i)
+					s.get_Hash(s.m_Prev);
+				s.m_Height = i + Rules::HeightGenesis;
+				s.m_ChainWork = i;
+
+				m_pRows[i] = db.InsertState(s, peer);
+
+				get_Body(pBuf[0], i, 0);
+				get_Body(pBuf[1], i, 1);
+				db.SetStateBlock(m_pRows[i], pBuf[0], pBuf[1], peer);
+
+				m_pLive[i][0] = m_pLive[i][1] = true;
+			}
+
+			tr.Commit();
+			Verify(db);
+
+			// segment rollover
+			for (uint32_t iSeg = 1; iSeg <= s_Blocks / s_PerSegment; iSeg++)
+				verify_test(SegmentExists(iSeg));
+			verify_test(!SegmentExists(s_Blocks / s_PerSegment + 1));
+
+			// 1st segment: all dead. 2nd: only 1 eternal body is alive. 3rd: half alive
+			tr.Start(db);
+			for (uint32_t i = 0; i < s_PerSegment; i++)
+			{
+				Del(db, i, true);
+				Del(db, s_PerSegment + i, !!i);
+				Del(db, s_PerSegment * 2 + i, false);
+			}
+			tr.Commit();
+			Verify(db);
+
+			// rollback of the compaction
+			tr.Start(db);
+			verify_test(db.BodyStoreCompact());
+			verify_test(db.BodyStoreCompact());
+			verify_test(!db.BodyStoreCompact());
+			Verify(db);
+			tr.Rollback();
+
+			Verify(db);
+			verify_test(SegmentExists(1) && SegmentExists(2));
+
+			// compaction
+			tr.Start(db);
+			while (db.BodyStoreCompact())
+				;
+			tr.Commit();
+
+			Verify(db);
+			verify_test(!SegmentExists(1) && !SegmentExists(2)); // the live body is moved
+			verify_test(SegmentExists(3));
+
+			// reopen
+			db.Close();
+			Open(db);
+			Verify(db);
+
+			tr.Start(db);
+			verify_test(!db.BodyStoreCompact());
+			tr.Commit();
+
+			db.Close();
+			DeleteFile(g_sz);
+			DeleteSegments();
+		}
+	};
+
 	void TestNodeDB()
 	{
 		TestNodeDB(g_sz); // will create
@@ -810,6 +1274,218 @@ namespace beam
 			NodeDB db;
 			db.Open(g_sz); // test to open already-existing DB
 		}
+
+		TxoArchiveTest().Run();
+		BodyStoreTest().Run();
+	}
+
+	// Simulates the TXO writes of the sync: each block adds new outputs and spends the older ones.
+	// Measures the blocks/sec with the default and the tuned SQLite settings.
+	void TestNodeDBSyncBenchmark(const NodeDB::Tuning& tun, const char* szName)
+	{
+		const uint32_t nBlocks = 300;
+		const uint32_t nOuts = 100;
+		const uint32_t nCommitBlocks = 100;
+
+		DeleteFile(g_sz);
+
+		NodeDB db;
+		db.Open(g_sz, tun);
+		NodeDB::Transaction tr(db);
+
+		ByteBuffer bufVal(700); // roughly the serialized output with the bulletproof
+		std::vector<Blob> vVals(nOuts, Blob(bufVal));
+		std::vector<TxoID> vSpent;
+
+		uint64_t t0_us = GetTime_us();
+
+		TxoID id0 = 0;
+		for (uint32_t iBlock = 0; iBlock < nBlocks; iBlock++)
+		{
+			Height h = Rules::HeightGenesis + iBlock;
+
+			// spend half of the outputs of the previous block, and some older ones
+			vSpent.clear();
+			if (iBlock)
+			{
+				for (uint32_t i = 0; i < nOuts / 2; i++)
+					vSpent.push_back(id0 - nOuts + i * 2);
+				for (uint32_t i = 0; i < nOuts / 4; i++)
+					vSpent.push_back((id0 - nOuts) * i / nOuts + 1);
+
+				std::sort(vSpent.begin(), vSpent.end());
+				vSpent.erase(std::unique(vSpent.begin(), vSpent.end()), vSpent.end());
+				std::reverse(vSpent.begin(), vSpent.end()); // not in order, as in the block
+			}
+
+			for (size_t i = 0; i < vSpent.size(); i++)
+				db.TxoSetSpent(vSpent[i], h);
+			for (uint32_t i = 0; i < nOuts; i++)
+				db.TxoAdd(id0++, vVals[i]);
+
+			if (!((iBlock + 1) % nCommitBlocks))
+			{
+				tr.Commit();
+				tr.Start(db);
+			}
+		}
+
+		tr.Commit();
+
+		uint64_t dt_us = GetTime_us() - t0_us;
+		printf("\t%s: %u blocks in %u ms, %u blocks/sec\n", szName, nBlocks, static_cast<uint32_t>(dt_us / 1000), static_cast<uint32_t>(nBlocks * 1000000ULL / std::max<uint64_t>(dt_us, 1)));
+
+		// verify
+		NodeDB::WalkerTxo wlk;
+		TxoID nCount = 0, nSpent = 0;
+		for (db.EnumTxos(wlk, 0); wlk.MoveNext(); nCount++)
+		{
+			verify_test(wlk.m_ID == nCount);
+			if (MaxHeight != wlk.m_SpendHeight)
+				nSpent++;
+		}
+
+		verify_test(nCount == id0);
+		verify_test(nSpent > nBlocks * nOuts / 2);
+
+		tr.Start(db);
+		for (size_t i = 0; i < vSpent.size(); i++)
+			db.TxoSetSpent(vSpent[i], MaxHeight); // last block undo
+		tr.Commit();
+	}
+
+	void TestNodeDBSyncBenchmark()
+	{
+		NodeDB::Tuning tun;
+		TestNodeDBSyncBenchmark(tun, "Default");
+
+		tun.m_CacheSize_MB = 64;
+		TestNodeDBSyncBenchmark(tun, "64MB cache");
+
+		tun.m_Wal = true;
+		TestNodeDBSyncBenchmark(tun, "WAL, 64MB cache");
+
+		{
+			NodeDB db;
+			db.Open(g_sz); // should switch back from WAL
+		}
+
+		DeleteFile(g_sz);
+	}
+
+	// MMR in the DB stream, and with the memory-mapped file cache. Verifies it's consistent (rebuild, stamps),
+	// and measures the proof generation latency, as for the light client requests
+	void TestNodeDBMmrCache()
+	{
+		const uint64_t nCount = 50000;
+		const uint64_t nExtra = 1000;
+		const uint32_t nProofs = 2000;
+
+		std::string sPath = std::string(g_sz) + ".mmr";
+
+		DeleteFile(g_sz);
+		DeleteFile(sPath.c_str());
+
+		NodeDB db;
+		db.Open(g_sz);
+		NodeDB::Transaction tr(db);
+
+		Merkle::FixedMmr mmrRef(nCount + nExtra);
+		NodeDB::StreamMmr mmr(db, NodeDB::StreamType::ShieldedMmr, true);
+
+		auto fnAppend = [&](uint64_t n, uint64_t nSeed)
+		{
+			for (uint64_t i = 0; i < n; i++)
+			{
+				Merkle::Hash hv;
+				ECC::Hash::Processor() << nSeed << i >> hv;
+				mmrRef.Append(hv);
+				mmr.Append(hv);
+			}
+		};
+
+		auto fnVerify = [&](const NodeDB::StreamMmr& x)
+		{
+			Merkle::Hash hv, hvRef;
+			x.get_Hash(hv);
+			mmrRef.get_Hash(hvRef);
+			verify_test(hv == hvRef);
+
+			for (uint64_t i = 0; i < mmrRef.m_Count; i += 997)
+			{
+				Merkle::Proof p, pRef;
+				x.get_Proof(p, i);
+				mmrRef.get_Proof(pRef, i);
+				verify_test(p == pRef);
+			}
+		};
+
+		auto fnBench = [&](const char* szName)
+		{
+			uint64_t t0_us = GetTime_us();
+
+			for (uint32_t i = 0; i < nProofs; i++)
+			{
+				Merkle::Proof p;
+				mmr.get_Proof(p, (i * 7919ULL) % mmr.m_Count); // scattered, defeats the sequential cache
+			}
+
+			uint64_t dt_us = GetTime_us() - t0_us;
+			printf("\t%s: %u proofs in %u ms, %.2f us/proof\n", szName, nProofs, static_cast<uint32_t>(dt_us / 1000), double(dt_us) / nProofs);
+		};
+
+		fnAppend(nCount, 0);
+		fnVerify(mmr);
+		fnBench("DB stream");
+
+		NodeDB::StreamMmr::Stamp us1, us2;
+		us1 = 1U;
+		us2 = 2U;
+
+		verify_test(!mmr.FileCacheOpen(sPath.c_str(), us1)); // rebuilt
+		fnVerify(mmr);
+		fnBench("File cache");
+
+		// modify with the cache open
+		mmr.ShrinkTo(nCount - 3);
+		mmrRef.m_Count = nCount - 3;
+		fnAppend(nExtra + 3, 1);
+		fnVerify(mmr);
+
+		verify_test(mmr.IsFileCacheDirty());
+		mmr.FileCacheFlush(us1);
+		verify_test(!mmr.IsFileCacheDirty());
+		tr.Commit();
+		mmr.FileCacheClose();
+
+		{
+			NodeDB::StreamMmr mmr2(db, NodeDB::StreamType::ShieldedMmr, true);
+			mmr2.m_Count = mmr.m_Count;
+			verify_test(mmr2.FileCacheOpen(sPath.c_str(), us1)); // valid
+			fnVerify(mmr2);
+
+			// modify without flush
+			tr.Start(db);
+			mmr2.ShrinkTo(mmr2.m_Count - 1);
+			tr.Commit();
+		}
+
+		{
+			NodeDB::StreamMmr mmr2(db, NodeDB::StreamType::ShieldedMmr, true);
+			mmr2.m_Count = mmr.m_Count - 1;
+			verify_test(!mmr2.FileCacheOpen(sPath.c_str(), us1)); // dirty
+
+			mmr2.FileCacheFlush(us2);
+			mmr2.FileCacheClose();
+			verify_test(!mmr2.FileCacheOpen(sPath.c_str(), us1)); // stamp mismatch
+
+			mmrRef.m_Count--;
+			fnVerify(mmr2);
+		}
+
+		db.Close();
+		DeleteFile(g_sz);
+		DeleteFile(sPath.c_str());
 	}
 
 	struct MiniWallet
@@ -1215,6 +1891,141 @@ namespace beam
 			np.Initialize(g_sz, sp);
 		}
 
+		{
+			// force the mapped image rebuild. It's verified against the current state definition
+			std::string sPath;
+			NodeProcessor::get_MappingPath(sPath, g_sz);
+			DeleteFile(sPath.c_str());
+
+			NodeProcessor np;
+			np.m_Horizon = horz;
+			np.Initialize(g_sz);
+		}
+
+		{
+			// snapshot export and import
+			std::string sSnap = std::string(g_sz3) + ".snap";
+			Block::SystemState::ID id;
+
+			{
+				NodeProcessor np;
+				np.m_Horizon = horz;
+				np.Initialize(g_sz);
+				id = np.m_Cursor.m_ID;
+				np.ExportSnapshot(sSnap.c_str());
+			}
+
+			NodeProcessor::ImportSnapshot(sSnap.c_str(), g_sz2);
+
+			bool bThrown = false;
+			try {
+				NodeProcessor::ImportSnapshot(sSnap.c_str(), g_sz2); // already exists
+			} catch (const std::exception&) {
+				bThrown = true;
+			}
+			verify_test(bThrown);
+
+			std::vector<std::string> vSide;
+			{
+				NodeProcessor np;
+				np.m_Horizon = horz;
+				np.Initialize(g_sz2);
+				verify_test(np.m_Cursor.m_ID == id);
+				verify_test(np.TestHeaderChain());
+				verify_test(np.m_Cursor.m_ID == id); // restored
+
+				// headers that don't follow the difficulty rules are rejected
+				Rules& r = Rules::get();
+				Difficulty d0 = r.DA.Difficulty0;
+				r.DA.Difficulty0.m_Packed++;
+				verify_test(!np.TestHeaderChain());
+				r.DA.Difficulty0 = d0;
+
+				np.get_DB().get_SideFiles(vSide);
+			}
+
+			for (const auto& s : vSide)
+				DeleteFile((g_sz2 + s).c_str());
+			DeleteFile(g_sz2);
+
+			// corrupted snapshot is rejected, nothing is left
+			{
+				std::FStream fs;
+				verify_test(fs.Open(sSnap.c_str(), true));
+				uint64_t nSize = fs.get_Remaining();
+				ByteBuffer buf(static_cast<size_t>(nSize));
+				fs.read(&buf.front(), buf.size());
+				fs.Close();
+
+				buf[buf.size() / 2] ^= 1;
+
+				verify_test(fs.Open(sSnap.c_str(), false));
+				fs.write(&buf.front(), buf.size());
+			}
+
+			bThrown = false;
+			try {
+				NodeProcessor::ImportSnapshot(sSnap.c_str(), g_sz2);
+			} catch (const std::exception&) {
+				bThrown = true;
+			}
+			verify_test(bThrown);
+
+			std::FStream fs;
+			verify_test(!fs.Open(g_sz2, true));
+
+			DeleteFile(sSnap.c_str());
+		}
+
+		// multi-block import, with and without verification ahead of the cursor. The last round has a broken block in the middle
+		for (uint32_t iRound = 0; iRound < 3; iRound++)
+		{
+			const size_t iBad = (iRound == 2) ? nMid : blockChain.size();
+			std::vector<std::string> vSide;
+
+			{
+				NodeProcessor np;
+				np.m_VerificationAhead = iRound ? 4 : 0;
+				np.Initialize(g_sz2);
+				np.OnTreasury(g_Treasury);
+
+				PeerID peer;
+				ZeroObject(peer);
+
+				for (size_t i = 0; i < blockChain.size(); i++)
+				{
+					const BlockPlus& b = *blockChain[i];
+					np.OnState(b.m_Hdr, peer);
+
+					Block::SystemState::ID id;
+					b.m_Hdr.get_ID(id);
+
+					ByteBuffer bbP = b.m_BodyP;
+					if (i == iBad)
+						bbP.back() ^= 1;
+
+					np.OnBlock(id, bbP, b.m_BodyE, peer);
+				}
+
+				np.TryGoUp();
+
+				if (iBad < blockChain.size())
+					verify_test(np.m_Cursor.m_ID.m_Height < blockChain[iBad]->m_Hdr.m_Height);
+				else
+				{
+					verify_test(np.m_Cursor.m_ID.m_Height == blockChain.back()->m_Hdr.m_Height);
+					verify_test(np.m_Cursor.m_Full.m_Definition == blockChain.back()->m_Hdr.m_Definition);
+				}
+
+				verify_test(!np.m_ImportStats.m_Ahead == !np.m_VerificationAhead);
+
+				np.get_DB().get_SideFiles(vSide);
+			}
+
+			for (const auto& s : vSide)
+				DeleteFile((g_sz2 + s).c_str());
+			DeleteFile(g_sz2);
+		}
 	}
 
 	void TestNodeProcessor3(std::vector<BlockPlus::Ptr>& blockChain)
@@ -1696,6 +2507,252 @@ namespace beam
 		DeleteFile(g_sz3);
 	}
 
+	struct TxBatchTest
+	{
+		// Txs received from a peer node are validated context-free in batches. Only the invalid ones must be rejected, the rest admitted.
+		MiniWallet m_Wallet;
+
+		std::vector<Transaction::Ptr> m_vTxs;
+		std::set<Transaction::KeyType> m_setValid;
+		uint32_t m_Invalid = 0;
+
+		Transaction::Ptr CreateTx()
+		{
+			// no inputs, a single 0-valued confidential output. Valid below Fork1 (no fees)
+			Transaction::Ptr pTx = std::make_shared<Transaction>();
+			pTx->m_Offset = Zero;
+
+			m_Wallet.MakeTxKernel(*pTx, 0, 0);
+
+			CoinID cid(Zero);
+			cid.m_Idx = ++m_Wallet.m_nRunningIndex;
+			cid.m_Type = Key::Type::Regular;
+
+			ECC::Scalar::Native k;
+			Output::Ptr pOut(new Output);
+			pOut->Create(1, k, *m_Wallet.m_pKdf, cid, *m_Wallet.m_pKdf);
+
+			pTx->m_vOutputs.push_back(std::move(pOut));
+			MiniWallet::UpdateOffset(*pTx, k, true);
+
+			pTx->Normalize();
+			return pTx;
+		}
+
+		void AddValid()
+		{
+			Transaction::Ptr pTx = CreateTx();
+
+			Transaction::KeyType key;
+			pTx->get_Key(key);
+			m_setValid.insert(key);
+
+			m_vTxs.push_back(std::move(pTx));
+		}
+
+		void AddInvalid(Transaction::Ptr&& pTx)
+		{
+			m_vTxs.push_back(std::move(pTx));
+			m_Invalid++;
+		}
+
+		void AddBadCommitment()
+		{
+			// fails the non-batched checks
+			Transaction::Ptr pTx = CreateTx();
+			pTx->m_vOutputs.front()->m_Commitment.m_X = Zero;
+			pTx->m_vOutputs.front()->m_Commitment.m_X.Inv(); // above the field prime
+			AddInvalid(std::move(pTx));
+		}
+
+		void AddBadSignature()
+		{
+			// passes the non-batched checks, fails only the combined batch
+			Transaction::Ptr pTx = CreateTx();
+			Cast::Up<TxKernelStd>(*pTx->m_vKernels.front()).m_Signature.m_k.m_Value.Inc();
+			AddInvalid(std::move(pTx));
+		}
+
+		struct MyClient
+			:public proto::NodeConnection
+		{
+			TxBatchTest* m_pThis;
+			bool m_bSender = false;
+			std::set<Transaction::KeyType> m_setAdmitted;
+			std::function<void()> m_fnOnAddr;
+
+			virtual void OnConnectedSecure() override
+			{
+				if (m_bSender)
+				{
+					// identify as a node, its txs are deferred and validated in batches
+					ECC::Scalar::Native sk;
+					ECC::SetRandom(sk);
+					ProveID(sk, proto::IDType::Node);
+				}
+
+				SendLogin();
+
+				if (m_bSender)
+				{
+					for (const auto& pTx : m_pThis->m_vTxs)
+					{
+						proto::NewTransaction msg;
+						msg.m_Transaction = pTx;
+						msg.m_Fluff = true;
+						Send(msg);
+					}
+				}
+				else
+					Send(proto::GetExternalAddr(Zero));
+			}
+
+			virtual void SetupLogin(proto::Login& msg) override
+			{
+				if (!m_bSender)
+					msg.m_Flags |= proto::LoginFlags::SpreadingTransactions;
+			}
+
+			virtual void OnMsg(proto::HaveTransaction&& msg) override
+			{
+				verify_test(!m_bSender);
+				m_setAdmitted.insert(msg.m_ID);
+			}
+
+			virtual void OnMsg(proto::ExternalAddr&&) override
+			{
+				// all the previous msgs from the node have been received
+				m_fnOnAddr();
+			}
+
+			virtual void OnDisconnect(const DisconnectReason&) override
+			{
+				fail_test("OnDisconnect");
+				io::Reactor::get_Current().stop();
+			}
+		};
+
+		void Run()
+		{
+			io::Reactor::Ptr pReactor(io::Reactor::create());
+			io::Reactor::Scope scope(*pReactor);
+
+			Node node;
+			node.m_Cfg.m_sPathLocal = g_sz;
+			node.m_Cfg.m_Listen.port(g_Port);
+			node.m_Cfg.m_Listen.ip(INADDR_ANY);
+			node.m_Cfg.m_Treasury = g_Treasury;
+			node.m_Cfg.m_TxVerificationThreads = 2;
+
+			ECC::SetRandom(node);
+			node.Initialize();
+
+			io::Address addr;
+			addr.resolve("127.0.0.1");
+			addr.port(g_Port);
+
+			MyClient clSender, clListener;
+			clSender.m_pThis = this;
+			clSender.m_bSender = true;
+			clListener.m_pThis = this;
+
+			bool bDone = false;
+
+			clListener.m_fnOnAddr = [&]()
+			{
+				if (node.m_TxAdmissionStats.m_Done)
+				{
+					bDone = true;
+					io::Reactor::get_Current().stop();
+				}
+				else
+					clSender.Connect(addr); // the listener is logged-in
+			};
+
+			io::Timer::Ptr pTimer = io::Timer::create(*pReactor);
+			uint32_t nCycles = 0;
+
+			pTimer->start(100, true, [&]()
+			{
+				const Node::TxAdmissionStats& s = node.m_TxAdmissionStats;
+				if (s.m_Done == m_vTxs.size())
+				{
+					pTimer->cancel();
+					clListener.Send(proto::GetExternalAddr(Zero));
+				}
+				else
+					if (++nCycles > 600)
+					{
+						fail_test("tx batch not done");
+						io::Reactor::get_Current().stop();
+					}
+			});
+
+			clListener.Connect(addr);
+			pReactor->run();
+
+			verify_test(bDone);
+			verify_test(node.m_TxAdmissionStats.m_Invalid == m_Invalid);
+			verify_test(clListener.m_setAdmitted == m_setValid);
+		}
+	};
+
+	void TestNodeTxBatch()
+	{
+		{
+			// valid txs mixed with those that fail the non-batched checks
+			TxBatchTest t;
+			ECC::SetRandom(t.m_Wallet.m_pKdf);
+
+			for (uint32_t i = 0; i < 10; i++)
+			{
+				t.AddValid();
+				if (!(i % 3))
+					t.AddBadCommitment();
+			}
+
+			t.Run();
+		}
+
+		DeleteFile(g_sz);
+
+		for (uint32_t iBad = 0; iBad < 16; iBad += 7)
+		{
+			// a single culprit among the valid txs, must be isolated by bisection
+			TxBatchTest t;
+			ECC::SetRandom(t.m_Wallet.m_pKdf);
+
+			for (uint32_t i = 0; i < 16; i++)
+			{
+				if (i == iBad)
+					t.AddBadSignature();
+				t.AddValid();
+			}
+
+			t.Run();
+			DeleteFile(g_sz);
+		}
+
+		{
+			// several culprits, of both kinds
+			TxBatchTest t;
+			ECC::SetRandom(t.m_Wallet.m_pKdf);
+
+			for (uint32_t i = 0; i < 20; i++)
+			{
+				t.AddValid();
+				if (!(i % 5))
+					t.AddBadSignature();
+				if (7 == i)
+					t.AddBadCommitment();
+			}
+
+			t.Run();
+		}
+
+		DeleteFile(g_sz);
+	}
+
 	namespace bvm2
 	{
 		void Compile(ByteBuffer& res, const char* sz, Processor::Kind kind)
@@ -1712,6 +2769,184 @@ namespace beam
 
 	}
 
+	void HashContractState(NodeProcessor& np, Merkle::Hash& hv, uint32_t& nLogs)
+	{
+		ECC::Hash::Processor hp;
+
+		NodeDB::WalkerContractData wlkData;
+		for (np.get_DB().ContractDataEnum(wlkData); wlkData.MoveNext(); )
+			hp << wlkData.m_Key << wlkData.m_Val;
+
+		nLogs = 0;
+		NodeDB::ContractLog::Walker wlkLog;
+		for (np.get_DB().ContractLogEnum(wlkLog, HeightPos(0), HeightPos(MaxHeight)); wlkLog.MoveNext(); nLogs++)
+			hp
+				<< wlkLog.m_Entry.m_Pos.m_Height
+				<< wlkLog.m_Entry.m_Pos.m_Pos
+				<< wlkLog.m_Entry.m_Key
+				<< wlkLog.m_Entry.m_Val;
+
+		hp >> hv;
+	}
+
+	void TestNodeProcessorContracts()
+	{
+		// Blocks with many invocations of the vault contract, partially conflicting (the same accounts).
+		// The processor that pre-executes them in parallel must reach exactly the same state and logs as the sequential one.
+		// Both must also match the block definitions, which are generated by the sequential interpretation.
+
+		struct MyExecutorMT
+			:public ExecutorMT_R
+		{
+			void RunThread(uint32_t iThread) override
+			{
+				NodeProcessor::MyExecutor::MyContext ctx;
+				ctx.m_iThread = iThread;
+				ECC::InnerProduct::BatchContext::Scope scope(ctx.m_BatchCtx);
+
+				RunThreadCtx(ctx);
+			}
+
+			~MyExecutorMT() { Stop(); }
+		};
+
+		struct MyNodeProcessor
+			:public MyNodeProcessor1
+		{
+			MyExecutorMT m_Exec;
+			Executor& get_Executor() override { return m_Exec; }
+		};
+
+		MyNodeProcessor np;
+		np.m_Exec.set_Threads(4);
+		np.m_Horizon.m_Branching = 35;
+		np.Initialize(g_sz);
+		np.OnTreasury(g_Treasury);
+
+		NodeProcessor np2; // sequential
+		np2.m_Horizon.m_Branching = 35;
+		np2.Initialize(g_sz2);
+		np2.OnTreasury(g_Treasury);
+
+		ByteBuffer bufContract;
+		bvm2::Compile(bufContract, "vault/contract.wasm", bvm2::Processor::Kind::Contract);
+
+		bvm2::ContractID cid;
+		bvm2::get_Cid(cid, bufContract, Blob(nullptr, 0));
+
+		const uint32_t nInvokes = 40;
+		const uint32_t nAccounts = 32;
+		uint32_t nDeposits = 0;
+		bool bCreated = false;
+
+		for (Height h = Rules::HeightGenesis; h < 36 + Rules::HeightGenesis; h++)
+		{
+			Height h0 = np.m_Cursor.m_ID.m_Height;
+			Transaction::Ptr pTx;
+			Amount val = 0;
+
+			if (h0 + 1 >= Rules::get().pForks[3].m_Height)
+				val = np.m_Wallet.MakeTxInput(pTx, h0);
+
+			if (val)
+			{
+				HeightRange hr(h0 + 1, MaxHeight);
+
+				bvm2::ContractInvokeEntry cie;
+				cie.m_Charge = 0;
+
+				if (!bCreated)
+				{
+					cie.m_iMethod = 0;
+					cie.m_Data = bufContract;
+
+					Amount fee = cie.get_FeeMin(hr.m_Min);
+					verify_test(val > fee);
+					val -= fee;
+
+					cie.Generate(*pTx, *np.m_Wallet.m_pKdf, hr, fee);
+					bCreated = true;
+				}
+				else
+				{
+					cie.m_Cid = cid;
+					cie.m_iMethod = Shaders::Vault::Deposit::s_iMethod;
+
+					for (uint32_t i = 0; i < nInvokes; i++)
+					{
+						Amount valDeposit = 100 + i;
+
+						Shaders::Vault::Deposit arg;
+						ZeroObject(arg);
+						arg.m_Account.m_X = static_cast<uint32_t>((h * 7 + i * i) % nAccounts);
+						arg.m_Amount = ByteOrder::to_le(valDeposit);
+
+						cie.m_Args.resize(sizeof(arg));
+						memcpy(&cie.m_Args.front(), &arg, sizeof(arg));
+
+						cie.m_Spend.clear();
+						cie.m_Spend.AddSpend(0, valDeposit);
+
+						Amount fee = cie.get_FeeMin(hr.m_Min);
+						verify_test(val > fee + valDeposit);
+						val -= fee + valDeposit;
+
+						cie.Generate(*pTx, *np.m_Wallet.m_pKdf, hr, fee);
+					}
+
+					nDeposits += nInvokes;
+				}
+
+				np.m_Wallet.MakeTxOutput(*pTx, h0, 0, val);
+
+				uint32_t nBvmCharge = 0;
+				verify_test(proto::TxStatus::Ok == np.ValidateTxContextEx(*pTx, hr, false, nBvmCharge, nullptr));
+
+				Transaction::Context::Params pars;
+				Transaction::Context ctx(pars);
+				ctx.m_Height = h0 + 1;
+				verify_test(pTx->IsValid(ctx));
+
+				Transaction::KeyType key;
+				pTx->get_Key(key);
+
+				np.m_TxPool.AddValidTx(std::move(pTx), ctx, key, 0);
+			}
+
+			NodeProcessor::BlockContext bc(np.m_TxPool, 0, *np.m_Wallet.m_pKdf, *np.m_Wallet.m_pKdf);
+			verify_test(np.GenerateNewBlock(bc));
+
+			Block::SystemState::ID id;
+			bc.m_Hdr.get_ID(id);
+
+			np.OnState(bc.m_Hdr, PeerID());
+			np.OnBlock(id, bc.m_BodyP, bc.m_BodyE, PeerID());
+			np.TryGoUp();
+			verify_test(np.m_Cursor.m_ID == id);
+
+			np2.OnState(bc.m_Hdr, PeerID());
+			np2.OnBlock(id, bc.m_BodyP, bc.m_BodyE, PeerID());
+			np2.TryGoUp();
+			verify_test(np2.m_Cursor.m_ID == id);
+
+			np.m_Wallet.AddMyUtxo(CoinID(Rules::get_Emission(h), h, Key::Type::Coinbase)); // fees are too small to pay for the invocations
+		}
+
+		verify_test(nDeposits);
+		verify_test(np.m_BvmParallel.m_Speculated == nDeposits);
+		verify_test(np.m_BvmParallel.m_Applied > np.m_BvmParallel.m_Blocks); // not just the 1st one in each block
+		verify_test(np.m_BvmParallel.m_Applied < np.m_BvmParallel.m_Speculated); // conflicts must be re-executed
+		verify_test(!np2.m_BvmParallel.m_Blocks);
+
+		Merkle::Hash hv, hv2;
+		uint32_t nLogs, nLogs2;
+		HashContractState(np, hv, nLogs);
+		HashContractState(np2, hv2, nLogs2);
+
+		verify_test(hv == hv2);
+		verify_test((nLogs == nDeposits) && (nLogs2 == nDeposits));
+	}
+
 
 
 	void TestNodeClientProto()
@@ -2967,6 +4202,7 @@ namespace beam
 
 		node.m_Cfg.m_Treasury = g_Treasury;
 		node.Initialize();
+		node.get_Processor().get_DB().BodyStoreSetSegmentMax(1024 * 16); // sealed segments, the full bodies are served to the node2 from their mappings
 
 		cl.Connect(addr);
 
@@ -3460,6 +4696,19 @@ void TestAll()
 		beam::TestNodeDB();
 		beam::DeleteFile(beam::g_sz);
 
+		if (getenv("BEAM_NODE_TEST_BENCHMARK")) // timing only, opt-in
+		{
+			printf("NodeDB sync benchmark...\n");
+			fflush(stdout);
+
+			beam::TestNodeDBSyncBenchmark();
+		}
+
+		printf("NodeDB MMR cache...\n");
+		fflush(stdout);
+
+		beam::TestNodeDBMmrCache();
+
 		{
 			printf("NodeProcessor test1...\n");
 			fflush(stdout);
@@ -3490,6 +4739,11 @@ void TestAll()
 		beam::TestNodeConversation();
 		beam::DeleteFile(beam::g_sz);
 		beam::DeleteFile(beam::g_sz2);
+
+		printf("Node tx batch test...\n");
+		fflush(stdout);
+
+		beam::TestNodeTxBatch();
 	}
 
 	beam::Rules::get().MaxRollback = 100;
@@ -3501,6 +4755,13 @@ void TestAll()
 	beam::Rules::get().Shielded.m_ProofMin = { 4, 5 }; // 1K
 	beam::Rules::get().UpdateChecksum();
 
+	printf("NodeProcessor contracts test...\n");
+	fflush(stdout);
+
+	beam::TestNodeProcessorContracts();
+	beam::DeleteFile(beam::g_sz);
+	beam::DeleteFile(beam::g_sz2);
+
 	printf("Node <---> Client test (with proofs)...\n");
 	fflush(stdout);
 
@@ -3516,13 +4777,15 @@ void TestAll()
 			db.ParamIntSet(beam::NodeDB::ParamID::Flags1, beam::NodeDB::Flags1::PendingRebuildNonStd);
 		}
 
-		// test mapping image rebuilding with shielded in/outs and contracts
+		// test mapping image and shielded cache rebuilding with shielded in/outs and contracts
 		beam::io::Reactor::Ptr pReactor(beam::io::Reactor::create());
 		beam::io::Reactor::Scope scope(*pReactor);
 
 		std::string sPath;
 		beam::NodeProcessor::get_MappingPath(sPath, beam::g_sz);
 		beam::DeleteFile(sPath.c_str());
+		beam::NodeProcessor::get_ShieldedCachePath(sPath, beam::g_sz);
+		beam::DeleteFile(sPath.c_str());
 
 		beam::Node node;
 		node.m_Cfg.m_sPathLocal = beam::g_sz;
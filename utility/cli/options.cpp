@@ -139,6 +139,7 @@ namespace beam
         const char* MINING_THREADS = "mining_threads";
         const char* POW_SOLVE_TIME = "pow_solve_time";
         const char* VERIFICATION_THREADS = "verification_threads";
+        const char* VERIFICATION_WINDOW = "verification_window";
         const char* NONCEPREFIX_DIGITS = "nonceprefix_digits";
         const char* NODE_PEER = "peer";
         const char* NODE_PEERS_PERSISTENT = "peers_persistent";
@@ -174,6 +175,15 @@ namespace beam
         const char* MANUAL_SELECT = "manual_select";
         const char* CHECKDB = "check_db";
         const char* VACUUM = "vacuum";
+        const char* MAPPING_PREFAULT = "mapping_prefault";
+        const char* MAPPING_RANDOM = "mapping_random";
+        const char* MAPPING_HUGEPAGES = "mapping_hugepages";
+        const char* DB_PAGE_SIZE = "db_page_size";
+        const char* DB_CACHE_SIZE = "db_cache_size";
+        const char* DB_MMAP_SIZE = "db_mmap_size";
+        const char* DB_WAL = "db_wal";
+        const char* SNAPSHOT_EXPORT = "snapshot_export";
+        const char* SNAPSHOT_IMPORT = "snapshot_import";
         const char* CRASH = "crash";
         const char* INIT = "init";
         const char* RESTORE = "restore";
@@ -386,6 +396,7 @@ namespace beam
             (cli::POW_SOLVE_TIME, po::value<uint32_t>()->default_value(15 * 1000), "pow solve time. It works if FakePoW is enabled")
 
             (cli::VERIFICATION_THREADS, po::value<int>()->default_value(-1), "number of threads for cryptographic verifications (0 = single thread, -1 = auto)")
+            (cli::VERIFICATION_WINDOW, po::value<uint32_t>()->default_value(10), "max size (in MB) of downloaded blocks verified ahead of the interpreted ones during sync")
             (cli::NONCEPREFIX_DIGITS, po::value<unsigned>()->default_value(0), "number of hex digits for nonce prefix for stratum client (0..6)")
             (cli::NODE_PEER, po::value<vector<string>>()->multitoken(), "nodes to connect to")
             (cli::NODE_PEERS_PERSISTENT, po::value<bool>()->default_value(false), "Keep persistent connection to the specified peers, regardless to ratings")
@@ -401,6 +412,13 @@ namespace beam
             (cli::MANUAL_SELECT, po::value<std::string>(), "Explicit correct block selection at the specified height. Auto-rollback below this height if current branch is different")
             (cli::CHECKDB, po::value<bool>()->default_value(false), "DB integrity check")
             (cli::VACUUM, po::value<bool>()->default_value(false), "DB vacuum (compact)")
+            (cli::MAPPING_PREFAULT, po::value<string>()->default_value("async"), "UTXO image prefault on start: none, sync (before processing), async (background)")
+            (cli::MAPPING_RANDOM, po::value<bool>()->default_value(false), "Disable read-ahead for the UTXO image (saves memory, but slows down the cold start)")
+            (cli::MAPPING_HUGEPAGES, po::value<bool>()->default_value(false), "Request transparent huge pages for the UTXO image")
+            (cli::DB_PAGE_SIZE, po::value<uint32_t>()->default_value(0), "DB page size (in bytes), 0 - default. Applied to a new DB, or on vacuum")
+            (cli::DB_CACHE_SIZE, po::value<uint32_t>()->default_value(0), "DB page cache size (in MB), 0 - default")
+            (cli::DB_MMAP_SIZE, po::value<uint32_t>()->default_value(0), "max size (in MB) of the DB file accessed via memory mapping, 0 - disabled")
+            (cli::DB_WAL, po::value<bool>()->default_value(false), "DB write-ahead log journal mode")
             (cli::BBS_ENABLE, po::value<bool>()->default_value(true), "Enable SBBS messaging")
             (cli::CRASH, po::value<int>()->default_value(0), "Induce crash (test proper handling)")
             (cli::OWNER_KEY, po::value<string>(), "Owner viewer key")
@@ -411,6 +429,8 @@ namespace beam
             (cli::LOG_UTXOS, po::value<bool>()->default_value(false), "Log recovered UTXOs (make sure the log file is not exposed)")
             (cli::FAST_SYNC, po::value<bool>(), "Fast sync on/off (override horizons)")
             (cli::GENERATE_RECOVERY_PATH, po::value<string>(), "Recovery file to generate immediately after start")
+            (cli::SNAPSHOT_EXPORT, po::value<string>(), "Node data snapshot file to generate immediately after start")
+            (cli::SNAPSHOT_IMPORT, po::value<string>(), "Node data snapshot file to bootstrap from, if there's no DB yet")
             (cli::RECOVERY_AUTO_PATH, po::value<string>(), "path and file prefix for recovery auto-generation")
             (cli::RECOVERY_AUTO_PERIOD, po::value<uint32_t>()->default_value(30), "period (in blocks) for recovery auto-generation")
             ;
@@ -37,6 +37,7 @@ namespace beam
         extern const char* MINING_THREADS;
         extern const char* POW_SOLVE_TIME;
         extern const char* VERIFICATION_THREADS;
+        extern const char* VERIFICATION_WINDOW;
         extern const char* NONCEPREFIX_DIGITS;
         extern const char* NODE_PEER;
         extern const char* NODE_PEERS_PERSISTENT;
@@ -74,6 +75,15 @@ namespace beam
         extern const char* MANUAL_SELECT;
         extern const char* CHECKDB;
         extern const char* VACUUM;
+        extern const char* MAPPING_PREFAULT;
+        extern const char* MAPPING_RANDOM;
+        extern const char* MAPPING_HUGEPAGES;
+        extern const char* DB_PAGE_SIZE;
+        extern const char* DB_CACHE_SIZE;
+        extern const char* DB_MMAP_SIZE;
+        extern const char* DB_WAL;
+        extern const char* SNAPSHOT_EXPORT;
+        extern const char* SNAPSHOT_IMPORT;
         extern const char* CRASH;
         extern const char* INIT;
         extern const char* RESTORE;
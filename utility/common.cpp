@@ -20,6 +20,7 @@
 #ifndef WIN32
 #	include <unistd.h>
 #	include <errno.h>
+#	include <fcntl.h>
 #else
 #	include <dbghelp.h>
 #	pragma comment (lib, "dbghelp")
@@ -69,6 +70,17 @@ namespace beam
 		return ::DeleteFileW(Utf8toUtf16(sz).c_str()) != FALSE;
 	}
 
+	bool SyncFile(const char* sz)
+	{
+		HANDLE h = ::CreateFileW(Utf8toUtf16(sz).c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+		if (INVALID_HANDLE_VALUE == h)
+			return false;
+
+		bool bRet = (::FlushFileBuffers(h) != FALSE);
+		::CloseHandle(h);
+		return bRet;
+	}
+
 #else // WIN32
 
 	bool DeleteFile(const char* sz)
@@ -76,6 +88,17 @@ namespace beam
 		return !unlink(sz);
 	}
 
+	bool SyncFile(const char* sz)
+	{
+		int h = open(sz, O_RDONLY);
+		if (h < 0)
+			return false;
+
+		bool bRet = !fsync(h);
+		close(h);
+		return bRet;
+	}
+
 
 #endif // WIN32
 
@@ -160,6 +183,7 @@ namespace beam
 
 		m_Run = true;
 		m_pCtl = nullptr;
+		m_pFj = nullptr;
 		m_InProgress = 0;
 		m_FlushTarget = static_cast<uint32_t>(-1);
 
@@ -220,6 +244,46 @@ namespace beam
 		assert(!m_pCtl);
 	}
 
+	void ExecutorMT::ForkJoin(TaskSync& t)
+	{
+		InitSafe();
+
+		ForkJoinCtl fj;
+		fj.m_pTask = &t;
+		fj.m_iNext = 0;
+		fj.m_Done = 0;
+		fj.m_Total = get_Threads();
+
+		Context ctx;
+		ctx.m_pThis = this;
+
+		std::unique_lock<std::mutex> scope(m_Mutex);
+
+		while (m_pFj)
+			m_FjDone.wait(scope); // another fork/join is in progress
+
+		m_pFj = &fj;
+		m_NewTask.notify_all();
+
+		while (fj.m_iNext < fj.m_Total)
+		{
+			ctx.m_iThread = fj.m_iNext++;
+
+			scope.unlock();
+			t.Exec(ctx);
+			scope.lock();
+
+			fj.m_Done++;
+		}
+
+		// all the slots are taken, wait for those run by the executor threads
+		while (fj.m_Done < fj.m_Total)
+			m_FjDone.wait(scope);
+
+		m_pFj = nullptr;
+		m_FjDone.notify_all();
+	}
+
 	void ExecutorMT::Stop()
 	{
 		if (m_vThreads.empty())
@@ -260,6 +324,25 @@ namespace beam
 					if (!m_Run)
 						return;
 
+					if (m_pFj && (m_pFj->m_iNext < m_pFj->m_Total))
+					{
+						// fork/join slots go first, the caller is blocked
+						ForkJoinCtl& fj = *m_pFj;
+						uint32_t iThread = ctx.m_iThread;
+						ctx.m_iThread = fj.m_iNext++;
+
+						scope.unlock();
+						fj.m_pTask->Exec(ctx);
+						scope.lock();
+
+						ctx.m_iThread = iThread;
+
+						if (++fj.m_Done == fj.m_Total)
+							m_FjDone.notify_all();
+
+						continue;
+					}
+
 					if (!m_queTasks.empty())
 					{
 						pGuard.reset(&m_queTasks.front());
@@ -164,6 +164,7 @@ namespace beam
 #endif // WIN32
 
 	bool DeleteFile(const char*);
+	bool SyncFile(const char*); // flushes the file data to the disk
 
 	struct CorruptionException
 	{
@@ -66,6 +66,11 @@ namespace beam
 		virtual void Push(TaskAsync::Ptr&&) = 0;
 		virtual uint32_t Flush(uint32_t nMaxTasks = 0) = 0;
 		virtual void ExecAll(TaskSync&) = 0;
+
+		// Same as ExecAll (the task is invoked get_Threads() times, with distinct m_iThread), but doesn't wait for the pending async tasks.
+		// The calling thread takes part, the executor threads join as they free up. Hence m_iThread is a slot, not necessarily the executing thread.
+		virtual void ForkJoin(TaskSync& t) { ExecAll(t); }
+
 		virtual ~Executor() = default;
 	};
 
@@ -77,6 +82,7 @@ namespace beam
 		virtual void Push(TaskAsync::Ptr&&) override;
 		virtual uint32_t Flush(uint32_t nMaxTasks) override;
 		virtual void ExecAll(TaskSync&) override;
+		virtual void ForkJoin(TaskSync&) override;
 
 		ExecutorMT();
 		~ExecutorMT() { Stop(); }
@@ -104,6 +110,17 @@ namespace beam
 		std::condition_variable m_NewTask;
 		std::condition_variable m_Flushed;
 
+		struct ForkJoinCtl
+		{
+			TaskSync* m_pTask;
+			uint32_t m_iNext; // next slot to take
+			uint32_t m_Done;
+			uint32_t m_Total;
+		};
+
+		ForkJoinCtl* m_pFj;
+		std::condition_variable m_FjDone;
+
 		std::vector<std::thread> m_vThreads;
 
 		void InitSafe();